@@ -101,11 +101,12 @@ typedef struct
  * This callback sits between the enumerator and the enduser callback,
  *  filtering out files that don't match the wildcard pattern.
  */
-static void wildcardCallback(void *_d, const char *origdir, const char *fname)
+static void wildcardCallback(void *_d, const char *origdir, const char *fname,
+                             PHYSFS_Stat *stat)
 {
     const WildcardCallbackData *data = (const WildcardCallbackData *) _d;
     if (matchesPattern(fname, data->wildcard, data->caseSensitive))
-        data->callback(data->origData, origdir, fname);
+        data->callback(data->origData, origdir, fname, stat);
 } /* wildcardCallback */
 
 
@@ -121,7 +122,15 @@ void PHYSFSEXT_enumerateFilesCallbackWildcard(const char *dir,
     data.caseSensitive = caseSensitive;
     data.callback = c;
     data.origData = d;
-    PHYSFS_enumerateFilesCallback(dir, wildcardCallback, &data);
+
+    /*
+     * PhysicsFS does case-insensitive matching itself, and far faster
+     *  than we can, so only filter again if we need case sensitivity.
+     */
+    if (caseSensitive)
+        PHYSFS_enumerateFilesPatternCallback(dir, wildcard, wildcardCallback, &data);
+    else
+        PHYSFS_enumerateFilesPatternCallback(dir, wildcard, c, d);
 } /* PHYSFSEXT_enumerateFilesCallbackWildcard */
 
 
@@ -142,12 +151,15 @@ char **PHYSFSEXT_enumerateFilesWildcard(const char *dir, const char *wildcard,
                                         int caseSensitive)
 {
     const PHYSFS_Allocator *allocator = PHYSFS_getAllocator();
-    char **list = PHYSFS_enumerateFiles(dir);
+    char **list = PHYSFS_enumerateFilesPattern(dir, wildcard);
     char **retval = NULL;
     int totalmatches = 0;
     int matches = 0;
     char **i;
 
+    if (list == NULL)
+        return NULL;
+
     for (i = list; *i != NULL; i++)
     {
         #if 0
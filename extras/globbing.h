@@ -118,7 +118,8 @@ PHYSFS_DECL void PHYSFSEXT_freeEnumeration(char **list);
  *
  * \code
  *
- * static void printDir(void *data, const char *origdir, const char *fname)
+ * static void printDir(void *data, const char *origdir, const char *fname,
+ *                      PHYSFS_Stat *stat)
  * {
  *     printf(" * We've got [%s] in [%s].\n", fname, origdir);
  * }
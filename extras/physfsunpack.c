@@ -97,8 +97,10 @@ static void dumpFile(const char *fname)
 } /* dumpFile */
 
 
-static void unpackCallback(void *_depth, const char *origdir, const char *str)
+static void unpackCallback(void *_depth, const char *origdir, const char *str,
+                           PHYSFS_Stat *stat)
 {
+    PHYSFS_Stat statbuf;
     int depth = *((int *) _depth);
     const int len = strlen(origdir) + strlen(str) + 2;
     char *fname = (char *) malloc(len);
@@ -112,7 +114,16 @@ static void unpackCallback(void *_depth, const char *origdir, const char *str)
         snprintf(fname, len, "%s/%s", origdir, str);
 
         printf("%s ", fname);
-        if (PHYSFS_isDirectory(fname))
+
+        /* the enumerator usually hands us this already; stat if not. */
+        if (stat == NULL)
+        {
+            stat = &statbuf;
+            if (!PHYSFS_stat(fname, stat))
+                stat->filetype = PHYSFS_FILETYPE_OTHER;
+        } /* if */
+
+        if (stat->filetype == PHYSFS_FILETYPE_DIRECTORY)
         {
             depth++;
             printf("(directory)\n");
@@ -122,7 +133,7 @@ static void unpackCallback(void *_depth, const char *origdir, const char *str)
                 PHYSFS_enumerateFilesCallback(fname, unpackCallback, &depth);
         } /* if */
 
-        else if (PHYSFS_isSymbolicLink(fname))
+        else if (stat->filetype == PHYSFS_FILETYPE_SYMLINK)
         {
             printf("(symlink)\n");
             /* !!! FIXME: ?  if (!symlink(fname, */
@@ -9,8 +9,52 @@
 #define __PHYSICSFS_INTERNAL__
 #include "physfs_internal.h"
 
+#include <time.h>
+
 /* There's no PHYSFS_Io interface here. Use __PHYSFS_createNativeIo(). */
 
+/*
+ * Case-insensitive mounts (PHYSFS_MOUNT_IGNORE_CASE) find the real name of
+ *  each path element through an index of the directory it lives in: its
+ *  names, hashed by their case-folded form. Indexes are built the first
+ *  time we need one, and rebuilt when the directory's modtime changes.
+ *  Modtimes only have one-second resolution, so an index built in the same
+ *  second its directory last changed is "racy": if a name isn't in there,
+ *  we rebuild it once before believing that.
+ */
+#define DIR_CASE_INDEX_MAX 64  /* directories we keep indexes for. */
+
+typedef struct DirCaseName
+{
+    PHYSFS_uint32 hash;  /* __PHYSFS_hashString() of the name. */
+    PHYSFS_uint32 offset;  /* into DirCaseIndex::names, plus one. 0 == empty. */
+} DirCaseName;
+
+typedef struct DirCaseIndex
+{
+    char *path;  /* platform-dependent, with a trailing separator. */
+    PHYSFS_uint32 pathhash;
+    PHYSFS_sint64 modtime;
+    int racy;
+    int failed;  /* ran out of memory while building. */
+    char *names;  /* every name in the directory, back to back. */
+    size_t nameslen;
+    size_t namesalloc;
+    PHYSFS_uint32 namecount;
+    DirCaseName *buckets;
+    PHYSFS_uint32 bucketcount;  /* zero or a power of two. */
+    struct DirCaseIndex *next;
+} DirCaseIndex;
+
+typedef struct
+{
+    char *base;  /* platform-dependent, with a trailing separator. */
+    size_t baselen;
+    void *dirhandle;  /* (base), opened at mount time. Might be NULL. */
+    int ignorecase;
+    DirCaseIndex *indexes;  /* most recently used first. */
+    PHYSFS_uint32 indexcount;
+} DIRinfo;
 
 
 static char *cvtToDependent(const char *prepend, const char *path, char *buf)
@@ -29,18 +73,376 @@ static char *cvtToDependent(const char *prepend, const char *path, char *buf)
 } /* cvtToDependent */
 
 
-#define CVT_TO_DEPENDENT(buf, pre, dir) { \
-    const size_t len = ((pre) ? strlen((char *) pre) : 0) + strlen(dir) + 1; \
-    buf = cvtToDependent((char*)pre,dir,(char*)__PHYSFS_smallAlloc(len)); \
-}
+/*
+ * Everything goes through these instead of the platform functions, so it
+ *  can use paths relative to (info->dirhandle) when we have one. (path) is
+ *  relative to (info->dirhandle) if there is one, and otherwise a full
+ *  platform-dependent path that starts with (info->base). dirRelative()
+ *  turns the latter into the former.
+ */
+static const char *dirRelative(DIRinfo *info, const char *path)
+{
+    if ((path != NULL) && (info->dirhandle != NULL))
+        return path + info->baselen;
+    return path;
+} /* dirRelative */
+
 
+static int dirStat(DIRinfo *info, const char *path, PHYSFS_Stat *st)
+{
+#if PHYSFS_HAVE_DIRHANDLES
+    if (info->dirhandle != NULL)
+        return __PHYSFS_platformStatAt(info->dirhandle, path, st);
+#endif
+    return __PHYSFS_platformStat(path, st);
+} /* dirStat */
 
 
-static void *DIR_openArchive(PHYSFS_Io *io, const char *name, int forWriting)
+static void dirEnumerate(DIRinfo *info, const char *path,
+                         PHYSFS_EnumFilesCallback cb, int withStats,
+                         const char *origdir, void *callbackdata)
+{
+#if PHYSFS_HAVE_DIRHANDLES
+    if (info->dirhandle != NULL)
+    {
+        __PHYSFS_platformEnumerateFilesAt(info->dirhandle, path, cb,
+                                          withStats, origdir, callbackdata);
+        return;
+    } /* if */
+#endif
+    __PHYSFS_platformEnumerateFiles(path, cb, withStats, origdir, callbackdata);
+} /* dirEnumerate */
+
+
+static PHYSFS_Io *dirCreateIo(DIRinfo *info, const char *path, const int mode)
+{
+#if PHYSFS_HAVE_DIRHANDLES
+    if (info->dirhandle != NULL)
+        return __PHYSFS_createNativeIoAt(info->dirhandle, path, mode);
+#endif
+    return __PHYSFS_createNativeIo(path, mode);
+} /* dirCreateIo */
+
+
+static int dirMkDir(DIRinfo *info, const char *path)
+{
+#if PHYSFS_HAVE_DIRHANDLES
+    if (info->dirhandle != NULL)
+        return __PHYSFS_platformMkDirAt(info->dirhandle, path);
+#endif
+    return __PHYSFS_platformMkDir(path);
+} /* dirMkDir */
+
+
+static int dirDelete(DIRinfo *info, const char *path)
+{
+#if PHYSFS_HAVE_DIRHANDLES
+    if (info->dirhandle != NULL)
+        return __PHYSFS_platformDeleteAt(info->dirhandle, path);
+#endif
+    return __PHYSFS_platformDelete(path);
+} /* dirDelete */
+
+
+static void freeCaseIndex(DirCaseIndex *idx)
+{
+    allocator.Free(idx->path);
+    allocator.Free(idx->names);
+    allocator.Free(idx->buckets);
+    allocator.Free(idx);
+} /* freeCaseIndex */
+
+
+static void caseIndexCallback(void *data, const char *origdir,
+                              const char *fname, PHYSFS_Stat *stat)
+{
+    DirCaseIndex *idx = (DirCaseIndex *) data;
+    const size_t len = strlen(fname) + 1;
+
+    if (idx->failed)
+        return;
+
+    if ((idx->namesalloc - idx->nameslen) < len)
+    {
+        size_t newalloc = idx->namesalloc ? idx->namesalloc * 2 : 1024;
+        void *ptr;
+        while ((newalloc - idx->nameslen) < len)
+            newalloc *= 2;
+        ptr = allocator.Realloc(idx->names, newalloc);
+        if (ptr == NULL)
+        {
+            idx->failed = 1;
+            return;
+        } /* if */
+        idx->names = (char *) ptr;
+        idx->namesalloc = newalloc;
+    } /* if */
+
+    memcpy(idx->names + idx->nameslen, fname, len);
+    idx->nameslen += len;
+    idx->namecount++;
+} /* caseIndexCallback */
+
+
+static int buildCaseIndex(DIRinfo *info, DirCaseIndex *idx,
+                          const PHYSFS_sint64 modtime)
+{
+    PHYSFS_uint32 bucketcount = 64;
+    PHYSFS_uint32 mask;
+    size_t len;
+    size_t pos;
+
+    idx->nameslen = 0;
+    idx->namecount = 0;
+    idx->failed = 0;
+    dirEnumerate(info, dirRelative(info, idx->path), caseIndexCallback, 0, NULL, idx);  /* names only. */
+    BAIL_IF_MACRO(idx->failed, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    BAIL_IF_MACRO(idx->nameslen >= 0xFFFFFFFF, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    while (bucketcount < (idx->namecount * 2))  /* at most half full. */
+        bucketcount *= 2;
+
+    if (bucketcount != idx->bucketcount)
+    {
+        allocator.Free(idx->buckets);
+        idx->bucketcount = 0;
+        idx->buckets = (DirCaseName *) allocator.Malloc(bucketcount * sizeof (DirCaseName));
+        BAIL_IF_MACRO(!idx->buckets, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        idx->bucketcount = bucketcount;
+    } /* if */
+
+    memset(idx->buckets, '\0', bucketcount * sizeof (DirCaseName));
+    mask = bucketcount - 1;
+    for (pos = 0; pos < idx->nameslen; pos += len + 1)
+    {
+        const char *name = idx->names + pos;
+        const PHYSFS_uint32 hash = __PHYSFS_hashString(name, len = strlen(name));
+        PHYSFS_uint32 bucket = hash & mask;
+        while (idx->buckets[bucket].offset != 0)
+            bucket = (bucket + 1) & mask;
+        idx->buckets[bucket].hash = hash;
+        idx->buckets[bucket].offset = (PHYSFS_uint32) (pos + 1);
+    } /* for */
+
+    idx->modtime = modtime;
+    idx->racy = ((modtime + 1) >= ((PHYSFS_sint64) time(NULL)));
+    return 1;
+} /* buildCaseIndex */
+
+
+/* (path) is a platform-dependent directory, with a trailing separator. */
+static DirCaseIndex *getCaseIndex(DIRinfo *info, const char *path)
+{
+    const PHYSFS_uint32 hash = __PHYSFS_hashString(path, strlen(path));
+    DirCaseIndex *prev = NULL;
+    DirCaseIndex *idx;
+    PHYSFS_Stat statbuf;
+
+    if (!dirStat(info, dirRelative(info, path), &statbuf))
+        return NULL;
+    else if (statbuf.filetype != PHYSFS_FILETYPE_DIRECTORY)
+        return NULL;
+
+    for (idx = info->indexes; idx != NULL; prev = idx, idx = idx->next)
+    {
+        if ((idx->pathhash == hash) && (strcmp(idx->path, path) == 0))
+            break;
+    } /* for */
+
+    if (idx != NULL)
+    {
+        if (prev != NULL)  /* move it to the front of the list. */
+        {
+            prev->next = idx->next;
+            idx->next = info->indexes;
+            info->indexes = idx;
+        } /* if */
+    } /* if */
+
+    else
+    {
+        if (info->indexcount >= DIR_CASE_INDEX_MAX)  /* toss the oldest. */
+        {
+            DirCaseIndex **last = &info->indexes;
+            while ((*last)->next != NULL)
+                last = &(*last)->next;
+            freeCaseIndex(*last);
+            *last = NULL;
+            info->indexcount--;
+        } /* if */
+
+        idx = (DirCaseIndex *) allocator.Malloc(sizeof (DirCaseIndex));
+        BAIL_IF_MACRO(!idx, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        memset(idx, '\0', sizeof (DirCaseIndex));
+        idx->path = __PHYSFS_strdup(path);
+        if (idx->path == NULL)
+        {
+            allocator.Free(idx);
+            BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        } /* if */
+        idx->pathhash = hash;
+        idx->next = info->indexes;
+        info->indexes = idx;
+        info->indexcount++;
+        if (!buildCaseIndex(info, idx, statbuf.modtime))
+            return NULL;
+    } /* else */
+
+    if ((idx->modtime != statbuf.modtime) || (idx->buckets == NULL))
+    {
+        if (!buildCaseIndex(info, idx, statbuf.modtime))
+            return NULL;
+    } /* if */
+
+    return idx;
+} /* getCaseIndex */
+
+
+static const char *findCaseName(DIRinfo *info, DirCaseIndex *idx,
+                                const char *name)
+{
+    const PHYSFS_uint32 hash = __PHYSFS_hashString(name, strlen(name));
+    PHYSFS_uint32 mask;
+    PHYSFS_uint32 bucket;
+
+    while (1)
+    {
+        mask = idx->bucketcount - 1;
+        for (bucket = hash & mask; idx->buckets[bucket].offset != 0;
+             bucket = (bucket + 1) & mask)
+        {
+            const DirCaseName *dcn = &idx->buckets[bucket];
+            const char *str = idx->names + (dcn->offset - 1);
+            if ((dcn->hash == hash) && (__PHYSFS_utf8stricmp(str, name) == 0))
+                return str;
+        } /* for */
+
+        if (!idx->racy)
+            return NULL;  /* the index is current, so it really isn't there. */
+        else if (!buildCaseIndex(info, idx, idx->modtime))
+            return NULL;
+    } /* while */
+
+    return NULL;  /* shouldn't hit this. */
+} /* findCaseName */
+
+
+/* we changed something, so stop trusting what isn't in the indexes. */
+static void caseIndexesChanged(DIRinfo *info)
+{
+    DirCaseIndex *idx;
+    for (idx = info->indexes; idx != NULL; idx = idx->next)
+        idx->racy = 1;
+} /* caseIndexesChanged */
+
+
+/*
+ * Build the platform-dependent path for (path), using the names that are
+ *  actually on disk for each element. Elements that don't exist are used
+ *  as-is, so this works for files we're about to create, too. The return
+ *  value is always heap memory, but free it with __PHYSFS_smallFree().
+ */
+static char *resolveCase(DIRinfo *info, const char *path)
+{
+    const char dirsep = __PHYSFS_platformDirSeparator;
+    const size_t baselen = info->baselen;
+    size_t alloc = baselen + strlen(path) + 1;
+    char *retval = (char *) __PHYSFS_initSmallAlloc(NULL, alloc);
+    PHYSFS_Stat statbuf;
+    char *elements;
+    char *ptr;
+    size_t pos;
+
+    BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    cvtToDependent(info->base, path, retval);
+    if ((*path == '\0') || (dirStat(info, dirRelative(info, retval), &statbuf)))
+        return retval;  /* exact match; nothing to resolve. */
+
+    elements = __PHYSFS_strdup(path);
+    if (elements == NULL)
+    {
+        __PHYSFS_smallFree(retval);
+        BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    /* rebuild it one element at a time from the real names on disk. */
+    pos = baselen;
+    for (ptr = elements; ptr != NULL; )
+    {
+        char *end = strchr(ptr, '/');
+        const char *real = NULL;
+        DirCaseIndex *idx;
+        size_t reallen;
+
+        if (end != NULL)
+            *end = '\0';
+
+        retval[pos] = '\0';
+        idx = getCaseIndex(info, retval);
+        if (idx != NULL)
+            real = findCaseName(info, idx, ptr);
+        if (real == NULL)
+            real = ptr;  /* not there; use it as it was given to us. */
+
+        reallen = strlen(real);
+        if ((pos + reallen + 2) > alloc)
+        {
+            const size_t newalloc = (pos + reallen + 2) * 2;
+            char *newpath = (char *) __PHYSFS_initSmallAlloc(NULL, newalloc);
+            if (newpath == NULL)
+            {
+                allocator.Free(elements);
+                __PHYSFS_smallFree(retval);
+                BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+            } /* if */
+            memcpy(newpath, retval, pos);
+            __PHYSFS_smallFree(retval);
+            retval = newpath;
+            alloc = newalloc;
+        } /* if */
+
+        memcpy(retval + pos, real, reallen);
+        pos += reallen;
+        if (end != NULL)
+            retval[pos++] = dirsep;
+        retval[pos] = '\0';
+
+        ptr = (end != NULL) ? end + 1 : NULL;
+    } /* for */
+
+    allocator.Free(elements);
+    return retval;
+} /* resolveCase */
+
+
+/*
+ * Sets (path) to what the dir*() functions want for (dir), or NULL on
+ *  failure. If that needed a new string, it's in (buf); __PHYSFS_smallFree()
+ *  it when done. With a dirhandle on a platform that uses '/', the
+ *  platform-independent path is already the relative one, so there's
+ *  nothing to build.
+ */
+#define CVT_TO_DEPENDENT(buf, path, info, dir) { \
+    buf = NULL; \
+    if ((info)->ignorecase) \
+        path = dirRelative(info, buf = resolveCase(info, dir)); \
+    else if (((info)->dirhandle != NULL) && (__PHYSFS_platformDirSeparator == '/')) \
+        path = dir; \
+    else { \
+        const size_t len = (info)->baselen + strlen(dir) + 1; \
+        buf = cvtToDependent((info)->base,dir,(char*)__PHYSFS_smallAlloc(len)); \
+        path = dirRelative(info, buf); \
+    } \
+}
+
+
+static void *DIR_openArchiveWithFlags(PHYSFS_Io *io, const char *name,
+                                      int forWriting, PHYSFS_uint32 flags)
 {
     PHYSFS_Stat st;
     const char dirsep = __PHYSFS_platformDirSeparator;
-    char *retval = NULL;
+    DIRinfo *info = NULL;
+    char *base = NULL;
     const size_t namelen = strlen(name);
     const size_t seplen = 1;
 
@@ -49,53 +451,92 @@ static void *DIR_openArchive(PHYSFS_Io *io, const char *name, int forWriting)
     if (st.filetype != PHYSFS_FILETYPE_DIRECTORY)
         BAIL_MACRO(PHYSFS_ERR_UNSUPPORTED, NULL);
 
-    retval = allocator.Malloc(namelen + seplen + 1);
-    BAIL_IF_MACRO(retval == NULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    info = (DIRinfo *) allocator.Malloc(sizeof (DIRinfo));
+    BAIL_IF_MACRO(info == NULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(info, '\0', sizeof (DIRinfo));
 
-    strcpy(retval, name);
+    base = allocator.Malloc(namelen + seplen + 1);
+    if (base == NULL)
+    {
+        allocator.Free(info);
+        BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    strcpy(base, name);
 
     /* make sure there's a dir separator at the end of the string */
-    if (retval[namelen - 1] != dirsep)
+    if (base[namelen - 1] != dirsep)
     {
-        retval[namelen] = dirsep;
-        retval[namelen + 1] = '\0';
+        base[namelen] = dirsep;
+        base[namelen + 1] = '\0';
     } /* if */
 
-    return retval;
+    info->base = base;
+    info->baselen = strlen(base);
+    info->ignorecase = ((flags & PHYSFS_MOUNT_IGNORE_CASE) != 0);
+
+#if PHYSFS_HAVE_DIRHANDLES
+    info->dirhandle = __PHYSFS_platformOpenDirHandle(base);
+    if (info->dirhandle == NULL)
+        PHYSFS_getLastErrorCode();  /* not fatal; we'll use full paths. */
+#endif
+
+    return info;
+} /* DIR_openArchiveWithFlags */
+
+
+static void *DIR_openArchive(PHYSFS_Io *io, const char *name, int forWriting)
+{
+    return DIR_openArchiveWithFlags(io, name, forWriting, 0);
 } /* DIR_openArchive */
 
 
+static void DIR_enumerateFilesWithStats(void *opaque, const char *dname,
+                                        PHYSFS_EnumFilesCallback cb,
+                                        int withStats, const char *origdir,
+                                        void *callbackdata)
+{
+    DIRinfo *info = (DIRinfo *) opaque;
+    const char *path;
+    char *d;
+
+    CVT_TO_DEPENDENT(d, path, info, dname);
+    if (path != NULL)
+        dirEnumerate(info, path, cb, withStats, origdir, callbackdata);
+    __PHYSFS_smallFree(d);
+} /* DIR_enumerateFilesWithStats */
+
+
 static void DIR_enumerateFiles(void *opaque, const char *dname,
                                PHYSFS_EnumFilesCallback cb,
                                const char *origdir, void *callbackdata)
 {
-    char *d;
-
-    CVT_TO_DEPENDENT(d, opaque, dname);
-    if (d != NULL)
-    {
-        __PHYSFS_platformEnumerateFiles(d, cb, origdir, callbackdata);
-        __PHYSFS_smallFree(d);
-    } /* if */
+    DIR_enumerateFilesWithStats(opaque, dname, cb, 1, origdir, callbackdata);
 } /* DIR_enumerateFiles */
 
 
 static PHYSFS_Io *doOpen(void *opaque, const char *name, const int mode)
 {
+    DIRinfo *info = (DIRinfo *) opaque;
     PHYSFS_Io *io = NULL;
+    const char *path;
     char *f = NULL;
 
-    CVT_TO_DEPENDENT(f, opaque, name);
-    BAIL_IF_MACRO(!f, ERRPASS, NULL);
+    CVT_TO_DEPENDENT(f, path, info, name);
+    BAIL_IF_MACRO(!path, ERRPASS, NULL);
 
-    io = __PHYSFS_createNativeIo(f, mode);
+    io = dirCreateIo(info, path, mode);
     if (io == NULL)
     {
         const PHYSFS_ErrorCode err = PHYSFS_getLastErrorCode();
         PHYSFS_Stat statbuf;
-        __PHYSFS_platformStat(f, &statbuf);
+        dirStat(info, path, &statbuf);
         PHYSFS_setErrorCode(err);
     } /* if */
+    else if (mode != 'r')
+    {
+        caseIndexesChanged(info);  /* might be a new file. */
+    } /* else if */
 
     __PHYSFS_smallFree(f);
 
@@ -123,12 +564,15 @@ static PHYSFS_Io *DIR_openAppend(void *opaque, const char *filename)
 
 static int DIR_remove(void *opaque, const char *name)
 {
+    DIRinfo *info = (DIRinfo *) opaque;
+    const char *path;
     int retval;
     char *f;
 
-    CVT_TO_DEPENDENT(f, opaque, name);
-    BAIL_IF_MACRO(!f, ERRPASS, 0);
-    retval = __PHYSFS_platformDelete(f);
+    CVT_TO_DEPENDENT(f, path, info, name);
+    BAIL_IF_MACRO(!path, ERRPASS, 0);
+    retval = dirDelete(info, path);
+    caseIndexesChanged(info);
     __PHYSFS_smallFree(f);
     return retval;
 } /* DIR_remove */
@@ -136,12 +580,15 @@ static int DIR_remove(void *opaque, const char *name)
 
 static int DIR_mkdir(void *opaque, const char *name)
 {
+    DIRinfo *info = (DIRinfo *) opaque;
+    const char *path;
     int retval;
     char *f;
 
-    CVT_TO_DEPENDENT(f, opaque, name);
-    BAIL_IF_MACRO(!f, ERRPASS, 0);
-    retval = __PHYSFS_platformMkDir(f);
+    CVT_TO_DEPENDENT(f, path, info, name);
+    BAIL_IF_MACRO(!path, ERRPASS, 0);
+    retval = dirMkDir(info, path);
+    caseIndexesChanged(info);
     __PHYSFS_smallFree(f);
     return retval;
 } /* DIR_mkdir */
@@ -149,18 +596,33 @@ static int DIR_mkdir(void *opaque, const char *name)
 
 static void DIR_closeArchive(void *opaque)
 {
-    allocator.Free(opaque);
+    DIRinfo *info = (DIRinfo *) opaque;
+    DirCaseIndex *idx = info->indexes;
+    while (idx != NULL)
+    {
+        DirCaseIndex *next = idx->next;
+        freeCaseIndex(idx);
+        idx = next;
+    } /* while */
+#if PHYSFS_HAVE_DIRHANDLES
+    if (info->dirhandle != NULL)
+        __PHYSFS_platformCloseDirHandle(info->dirhandle);
+#endif
+    allocator.Free(info->base);
+    allocator.Free(info);
 } /* DIR_closeArchive */
 
 
 static int DIR_stat(void *opaque, const char *name, PHYSFS_Stat *stat)
 {
+    DIRinfo *info = (DIRinfo *) opaque;
+    const char *path;
     int retval = 0;
     char *d;
 
-    CVT_TO_DEPENDENT(d, opaque, name);
-    BAIL_IF_MACRO(!d, ERRPASS, 0);
-    retval = __PHYSFS_platformStat(d, stat);
+    CVT_TO_DEPENDENT(d, path, info, name);
+    BAIL_IF_MACRO(!path, ERRPASS, 0);
+    retval = dirStat(info, path, stat);
     __PHYSFS_smallFree(d);
     return retval;
 } /* DIR_stat */
@@ -184,7 +646,12 @@ const PHYSFS_Archiver __PHYSFS_Archiver_DIR =
     DIR_remove,
     DIR_mkdir,
     DIR_stat,
-    DIR_closeArchive
+    DIR_closeArchive,
+    NULL,  /* walk */
+    NULL,  /* enumerateFilesPrefix */
+    NULL,  /* locate */
+    DIR_enumerateFilesWithStats,
+    DIR_openArchiveWithFlags
 };
 
 /* end of archiver_dir.c ... */
@@ -377,7 +377,8 @@ static PHYSFS_sint64 iso_readfiledescriptor(ISO9660Handle *handle,
     rc = iso_readimage(handle, where + 1, &descriptor->extattributelen,
             descriptor->recordlen - sizeof(descriptor->recordlen));
     BAIL_IF_MACRO(rc == -1, ERRPASS, -1);
-    BAIL_IF_MACRO(rc != 1, PHYSFS_ERR_CORRUPT, -1);
+    BAIL_IF_MACRO(rc != descriptor->recordlen - sizeof (descriptor->recordlen),
+                  PHYSFS_ERR_CORRUPT, -1);
 
     return 0;
 } /* iso_readfiledescriptor */
@@ -454,15 +455,13 @@ static int iso_find_dir_entry(ISO9660Handle *handle,const char *path,
             } /* if */
             else
             {
-                /* !!! FIXME: set PHYSFS_ERR_NOT_FOUND? */
                 /* we're at a file but have a remaining subpath -> no match */
-                return 0;
+                BAIL_MACRO(PHYSFS_ERR_NOT_FOUND, -1);
             } /* else */
         } /* if */
     } /* while */
 
-    /* !!! FIXME: set PHYSFS_ERR_NOT_FOUND? */
-    return 0;
+    BAIL_MACRO(PHYSFS_ERR_NOT_FOUND, -1);
 } /* iso_find_dir_entry */
 
 
@@ -554,7 +553,7 @@ static void *ISO9660_openArchive(PHYSFS_Io *io, const char *filename, int forWri
     /* Skip system area to magic number in Volume descriptor */
     BAIL_IF_MACRO(!io->seek(io, 32769), ERRPASS, NULL);
     BAIL_IF_MACRO(io->read(io, magicnumber, 5) != 5, ERRPASS, NULL);
-    if (memcmp(magicnumber, "CD001", 6) != 0)
+    if (memcmp(magicnumber, "CD001", 5) != 0)
         BAIL_MACRO(PHYSFS_ERR_UNSUPPORTED, NULL);
 
     handle = allocator.Malloc(sizeof(ISO9660Handle));
@@ -672,10 +671,10 @@ static PHYSFS_uint32 iso_file_read_mem(ISO9660FileHandle *filehandle,
 static int iso_file_seek_mem(ISO9660FileHandle *fhandle, PHYSFS_sint64 offset)
 {
     BAIL_IF_MACRO(offset < 0, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(offset >= fhandle->filesize, PHYSFS_ERR_PAST_EOF, 0);
+    BAIL_IF_MACRO(offset > fhandle->filesize, PHYSFS_ERR_PAST_EOF, 0);
 
     fhandle->currpos = offset;
-    return 0;
+    return 1;
 } /* iso_file_seek_mem */
 
 
@@ -707,13 +706,13 @@ static int iso_file_seek_foreign(ISO9660FileHandle *fhandle,
                                  PHYSFS_sint64 offset)
 {
     BAIL_IF_MACRO(offset < 0, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(offset >= fhandle->filesize, PHYSFS_ERR_PAST_EOF, 0);
+    BAIL_IF_MACRO(offset > fhandle->filesize, PHYSFS_ERR_PAST_EOF, 0);
 
     PHYSFS_sint64 pos = fhandle->startblock * 2048 + offset;
-    BAIL_IF_MACRO(!fhandle->io->seek(fhandle->io, pos), ERRPASS, -1);
+    BAIL_IF_MACRO(!fhandle->io->seek(fhandle->io, pos), ERRPASS, 0);
 
     fhandle->currpos = offset;
-    return 0;
+    return 1;
 } /* iso_file_seek_foreign */
 
 
@@ -726,7 +725,10 @@ static void iso_file_close_foreign(ISO9660FileHandle *fhandle)
 
 static int iso_file_open_mem(ISO9660Handle *handle, ISO9660FileHandle *fhandle)
 {
+    __PHYSFS_MemCharge charge;
+    __PHYSFS_memCharge(__PHYSFS_memCurrentAccount(), PHYSFS_MEMORY_CACHE, &charge);
     fhandle->cacheddata = allocator.Malloc(fhandle->filesize);
+    __PHYSFS_memRestore(&charge);
     BAIL_IF_MACRO(!fhandle->cacheddata, PHYSFS_ERR_OUT_OF_MEMORY, -1);
     int rc = iso_readimage(handle, fhandle->startblock * 2048,
                            fhandle->cacheddata, fhandle->filesize);
@@ -764,6 +766,25 @@ closefile:
 } /* iso_file_open_foreign */
 
 
+int __PHYSFS_ISO9660_dataRange(PHYSFS_Io *io, PHYSFS_DataRange *range)
+{
+    const ISO9660FileHandle *fhandle;
+    int foreign;
+
+    if (io->read != ISO9660_read)
+        return 0;
+
+    /* cached files are in memory already; there's nothing to read. */
+    fhandle = (const ISO9660FileHandle *) io->opaque;
+    foreign = (fhandle->read == iso_file_read_foreign);
+    range->io = foreign ? fhandle->io : NULL;
+    range->offset = fhandle->startblock * 2048;
+    range->len = (PHYSFS_uint64) fhandle->filesize;
+    range->raw = foreign;
+    return 1;
+} /* __PHYSFS_ISO9660_dataRange */
+
+
 static PHYSFS_Io *ISO9660_openRead(void *opaque, const char *filename)
 {
     PHYSFS_Io *retval = NULL;
@@ -790,7 +811,9 @@ static PHYSFS_Io *ISO9660_openRead(void *opaque, const char *filename)
     fhandle->cacheddata = NULL;
     fhandle->io = NULL;
 
-    if (descriptor.datalen <= ISO9660_FULLCACHEMAXSIZE)
+    /* past the memory limit, read small files from the image, too. */
+    if ((descriptor.datalen <= ISO9660_FULLCACHEMAXSIZE) &&
+        (!__PHYSFS_memOverLimit()))
         rc = iso_file_open_mem(handle, fhandle);
     else
         rc = iso_file_open_foreign(handle, fhandle);
@@ -812,6 +835,45 @@ errorhandling:
  * Information gathering functions
  ******************************************************************************/
 
+static int iso_stat_descriptor(ISO9660Handle *handle,
+                               ISO9660FileDescriptor *descriptor,
+                               PHYSFS_Stat *stat)
+{
+    ISO9660ExtAttributeRec extattr;
+
+    stat->readonly = 1;
+
+    /* try to get extended info */
+    if (descriptor->extattributelen)
+    {
+        BAIL_IF_MACRO(iso_read_ext_attributes(handle,
+                descriptor->extentpos, &extattr), ERRPASS, 0);
+        stat->createtime = iso_volume_mktime(&extattr.create_time);
+        stat->modtime = iso_volume_mktime(&extattr.mod_time);
+        stat->accesstime = iso_volume_mktime(&extattr.mod_time);
+    } /* if */
+    else
+    {
+        stat->createtime = iso_mktime(&descriptor->recordtime);
+        stat->modtime = iso_mktime(&descriptor->recordtime);
+        stat->accesstime = iso_mktime(&descriptor->recordtime);
+    } /* else */
+
+    if (descriptor->flags.directory)
+    {
+        stat->filesize = 0;
+        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+    } /* if */
+    else
+    {
+        stat->filesize = descriptor->datalen;
+        stat->filetype = PHYSFS_FILETYPE_REGULAR;
+    } /* else */
+
+    return 1;
+} /* iso_stat_descriptor */
+
+
 static void ISO9660_enumerateFiles(void *opaque, const char *dname,
                                    PHYSFS_EnumFilesCallback cb,
                                    const char *origdir, void *callbackdata)
@@ -822,6 +884,7 @@ static void ISO9660_enumerateFiles(void *opaque, const char *dname,
     PHYSFS_uint64 end_of_dir;
     char filename[130]; /* ISO allows 31, Joliet 128 -> 128 + 2 eol bytes */
     int version = 0;
+    PHYSFS_Stat stat;
 
     if (*dname == '\0')
     {
@@ -830,7 +893,6 @@ static void ISO9660_enumerateFiles(void *opaque, const char *dname,
     } /* if */
     else
     {
-        printf("pfad %s\n",dname);
         BAIL_IF_MACRO(iso_find_dir_entry(handle,dname, &descriptor), ERRPASS,);
         BAIL_IF_MACRO(!descriptor.flags.directory, ERRPASS,);
 
@@ -861,7 +923,10 @@ static void ISO9660_enumerateFiles(void *opaque, const char *dname,
 
         strncpy(filename,descriptor.filename,descriptor.filenamelen);
         iso_extractfilename(handle, &descriptor, filename, &version);
-        cb(callbackdata, origdir,filename, NULL);
+        if (iso_stat_descriptor(handle, &descriptor, &stat))
+            cb(callbackdata, origdir, filename, &stat);
+        else
+            cb(callbackdata, origdir, filename, NULL);
     } /* while */
 } /* ISO9660_enumerateFiles */
 
@@ -870,38 +935,8 @@ static int ISO9660_stat(void *opaque, const char *name, PHYSFS_Stat *stat)
 {
     ISO9660Handle *handle = (ISO9660Handle*) opaque;
     ISO9660FileDescriptor descriptor;
-    ISO9660ExtAttributeRec extattr;
-    BAIL_IF_MACRO(iso_find_dir_entry(handle, name, &descriptor), ERRPASS, -1);
-
-    stat->readonly = 1;
-
-    /* try to get extended info */
-    if (descriptor.extattributelen)
-    {
-        BAIL_IF_MACRO(iso_read_ext_attributes(handle,
-                descriptor.extentpos, &extattr), ERRPASS, -1);
-        stat->createtime = iso_volume_mktime(&extattr.create_time);
-        stat->modtime = iso_volume_mktime(&extattr.mod_time);
-        stat->accesstime = iso_volume_mktime(&extattr.mod_time);
-    } /* if */
-    else
-    {
-        stat->createtime = iso_mktime(&descriptor.recordtime);
-        stat->modtime = iso_mktime(&descriptor.recordtime);
-        stat->accesstime = iso_mktime(&descriptor.recordtime);
-    } /* else */
-
-    if (descriptor.flags.directory)
-    {
-        stat->filesize = 0;
-        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
-    } /* if */
-    else
-    {
-        stat->filesize = descriptor.datalen;
-        stat->filetype = PHYSFS_FILETYPE_REGULAR;
-    } /* else */
-
+    BAIL_IF_MACRO(iso_find_dir_entry(handle, name, &descriptor), ERRPASS, 0);
+    BAIL_IF_MACRO(!iso_stat_descriptor(handle, &descriptor, stat), ERRPASS, 0);
     return 1;
 } /* ISO9660_stat */
 
@@ -952,7 +987,12 @@ const PHYSFS_Archiver __PHYSFS_Archiver_ISO9660 =
     ISO9660_remove,
     ISO9660_mkdir,
     ISO9660_stat,
-    ISO9660_closeArchive
+    ISO9660_closeArchive,
+    NULL,  /* walk */
+    NULL,  /* enumerateFilesPrefix */
+    NULL,  /* locate */
+    NULL,  /* enumerateFilesWithStats */
+    NULL  /* openArchiveWithFlags */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_ISO9660 */
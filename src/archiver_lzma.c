@@ -62,9 +62,15 @@ typedef struct _LZMAarchive
     LZMAfolder *folders; /* Array of folders, size == archive->db.Database.NumFolders */
     CArchiveDatabaseEx db; /* For 7z: Database */
     FileInputStream stream; /* For 7z: Input file incl. read and seek callbacks */
+    __PHYSFS_MemAccount *memory; /* Where decompressed folders are charged */
+    __PHYSFS_Stats *stats; /* I/O counters for this archive */
+    void *lock; /* Guards (stream) and every folder's cache and references */
 } LZMAarchive;
 
-/* Set by LZMA_openArchive(), except offset which is set by LZMA_read() */
+/*
+ * Set by LZMA_openArchive(). Each open handle gets its own copy of one of
+ *  these, so (position) isn't shared between them.
+ */
 typedef struct _LZMAfile
 {
     PHYSFS_uint32 index; /* Index of file in archive */
@@ -224,7 +230,12 @@ static int lzma_file_init(LZMAarchive *archive, PHYSFS_uint32 fileIndex)
     file->folder = (folderIndex != (PHYSFS_uint32)-1 ? &archive->folders[folderIndex] : NULL); /* Directories don't have a folder (they contain no own data...) */
     file->item = &archive->db.Database.Files[fileIndex]; /* Holds crucial data and is often referenced -> Store link */
     file->position = 0;
-    file->offset = 0; /* Offset will be set by LZMA_read() */
+
+    /* Files in a folder are stored back to back, in index order. */
+    if ((fileIndex > 0) && (file->folder != NULL) && (file[-1].folder == file->folder))
+        file->offset = file[-1].offset + (size_t) file[-1].item->Size;
+    else
+        file->offset = 0;
 
     return 1;
 } /* lzma_load_file */
@@ -275,6 +286,9 @@ static void lzma_archive_init(LZMAarchive *archive)
  */
 static void lzma_archive_exit(LZMAarchive *archive)
 {
+    if (archive->lock != NULL)
+        __PHYSFS_platformDestroyMutex(archive->lock);
+
     /* Free arrays */
     allocator.Free(archive->folders);
     allocator.Free(archive->files);
@@ -316,6 +330,22 @@ static int lzma_err(SZ_RESULT rc)
 } /* lzma_err */
 
 
+/* Free every cached folder but (keep); LZMA_read() extracts them again. */
+static void lzma_drop_caches(LZMAarchive *archive, const LZMAfolder *keep)
+{
+    PHYSFS_uint32 i;
+    for (i = 0; i < archive->db.Database.NumFolders; i++)
+    {
+        LZMAfolder *folder = &archive->folders[i];
+        if ((folder != keep) && (folder->cache != NULL))
+        {
+            allocator.Free(folder->cache);
+            folder->cache = NULL;
+        } /* if */
+    } /* for */
+} /* lzma_drop_caches */
+
+
 static PHYSFS_sint64 LZMA_read(PHYSFS_Io *io, void *outBuf, PHYSFS_uint64 len)
 {
     LZMAfile *file = (LZMAfile *) io->opaque;
@@ -330,10 +360,26 @@ static PHYSFS_sint64 LZMA_read(PHYSFS_Io *io, void *outBuf, PHYSFS_uint64 len)
     if (wantedSize > remainingSize)
         wantedSize = remainingSize;
 
+    __PHYSFS_platformGrabMutex(file->archive->lock);
+
     /* Only decompress the folder if it is not already cached */
-    if (file->folder->cache == NULL)
+    if (file->folder->cache != NULL)
+        __PHYSFS_statAdd(file->archive->stats, PHYSFS_STAT_CACHE_HITS, 1);
+    else
     {
-        const int rc = lzma_err(SzExtract(
+        const PHYSFS_uint64 start = __PHYSFS_statTimeStart();
+        __PHYSFS_MemCharge charge;
+        size_t offset = 0;
+        int rc;
+
+        __PHYSFS_statAdd(file->archive->stats, PHYSFS_STAT_CACHE_MISSES, 1);
+
+        /* Over the memory limit? Other folders can be decompressed again. */
+        if (__PHYSFS_memOverLimit())
+            lzma_drop_caches(file->archive, file->folder);
+
+        __PHYSFS_memCharge(file->archive->memory, PHYSFS_MEMORY_CACHE, &charge);
+        rc = lzma_err(SzExtract(
             &file->archive->stream.inStream, /* compressed data */
             &file->archive->db, /* 7z's database, containing everything */
             file->index, /* Index into database arrays */
@@ -343,19 +389,26 @@ static PHYSFS_sint64 LZMA_read(PHYSFS_Io *io, void *outBuf, PHYSFS_uint64 len)
             &file->folder->cache,
             /* Size of cache, will be changed by SzExtract */
             &file->folder->size,
-            /* Offset of this file inside the cache, set by SzExtract */
-            &file->offset,
+            /* Offset of this file inside the cache; we know it already */
+            &offset,
             &fileSize, /* Size of this file */
             &file->archive->stream.allocImp,
             &file->archive->stream.allocTempImp));
+        __PHYSFS_memRestore(&charge);
 
-        if (rc != SZ_OK)
-            return -1;
+        __PHYSFS_statAddTime(file->archive->stats, PHYSFS_STAT_NS_DECOMPRESS,
+                             start);
+        BAIL_IF_MACRO_MUTEX(rc != SZ_OK, ERRPASS, file->archive->lock, -1);
+        assert(offset == file->offset);
+
+        __PHYSFS_statAdd(file->archive->stats, PHYSFS_STAT_BYTES_DECOMPRESSED,
+                         file->folder->size);
     } /* if */
 
     /* Copy wanted bytes over from cache to outBuf */
     memcpy(outBuf, (file->folder->cache + file->offset + file->position),
             wantedSize);
+    __PHYSFS_platformReleaseMutex(file->archive->lock);
     file->position += wantedSize; /* Increase virtual position */
 
     return wantedSize;
@@ -394,11 +447,36 @@ static PHYSFS_sint64 LZMA_length(PHYSFS_Io *io)
 } /* LZMA_length */
 
 
+static const PHYSFS_Io LZMA_Io;
+
+/* A new handle on (file), with its own position. */
+static PHYSFS_Io *lzma_file_io(const LZMAfile *file)
+{
+    PHYSFS_Io *io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
+    LZMAfile *copy = (LZMAfile *) allocator.Malloc(sizeof (LZMAfile));
+    if ((io == NULL) || (copy == NULL))
+    {
+        if (io != NULL) allocator.Free(io);
+        if (copy != NULL) allocator.Free(copy);
+        BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    } /* if */
+
+    memcpy(copy, file, sizeof (*copy));
+    copy->position = 0;
+    memcpy(io, &LZMA_Io, sizeof (*io));
+    io->opaque = copy;
+
+    __PHYSFS_platformGrabMutex(file->archive->lock);
+    file->folder->references++; /* Increase refcount for automatic cleanup... */
+    __PHYSFS_platformReleaseMutex(file->archive->lock);
+
+    return io;
+} /* lzma_file_io */
+
+
 static PHYSFS_Io *LZMA_duplicate(PHYSFS_Io *_io)
 {
-    /* !!! FIXME: this archiver needs to be reworked to allow multiple
-     * !!! FIXME:  opens before we worry about duplication. */
-    BAIL_MACRO(PHYSFS_ERR_UNSUPPORTED, NULL);
+    return lzma_file_io((const LZMAfile *) _io->opaque);
 } /* LZMA_duplicate */
 
 
@@ -408,20 +486,22 @@ static int LZMA_flush(PHYSFS_Io *io) { return 1;  /* no write support. */ }
 static void LZMA_destroy(PHYSFS_Io *io)
 {
     LZMAfile *file = (LZMAfile *) io->opaque;
+    LZMAarchive *archive = file->archive;
 
-    if (file->folder != NULL)
+    __PHYSFS_platformGrabMutex(archive->lock);
+    /* Only decrease refcount if someone actually requested this file... Prevents from overflows and close-on-open... */
+    if (file->folder->references > 0)
+        file->folder->references--;
+    if (file->folder->references == 0)
     {
-        /* Only decrease refcount if someone actually requested this file... Prevents from overflows and close-on-open... */
-        if (file->folder->references > 0)
-            file->folder->references--;
-        if (file->folder->references == 0)
-        {
-            /* Free the cache which might have been allocated by LZMA_read() */
-            allocator.Free(file->folder->cache);
-            file->folder->cache = NULL;
-        }
-        /* !!! FIXME: we don't free (file) or (file->folder)?! */
+        /* Free the cache which might have been allocated by LZMA_read() */
+        allocator.Free(file->folder->cache);
+        file->folder->cache = NULL;
     } /* if */
+    __PHYSFS_platformReleaseMutex(archive->lock);
+
+    allocator.Free(file);
+    allocator.Free(io);
 } /* LZMA_destroy */
 
 
@@ -458,7 +538,15 @@ static void *LZMA_openArchive(PHYSFS_Io *io, const char *name, int forWriting)
     BAIL_IF_MACRO(archive == NULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
 
     lzma_archive_init(archive);
+    archive->lock = __PHYSFS_platformCreateMutex();
+    if (archive->lock == NULL)
+    {
+        lzma_archive_exit(archive);
+        return NULL;
+    } /* if */
     archive->stream.io = io;
+    archive->memory = __PHYSFS_memCurrentAccount();
+    archive->stats = __PHYSFS_statsCurrent();
 
     CrcGenerateTable();
     SzArDbExInit(&archive->db);
@@ -513,26 +601,35 @@ static void *LZMA_openArchive(PHYSFS_Io *io, const char *name, int forWriting)
 } /* LZMA_openArchive */
 
 
-/*
- * Moved to seperate function so we can use alloca then immediately throw
- *  away the allocated stack space...
- */
-static void doEnumCallback(PHYSFS_EnumFilesCallback cb, void *callbackdata,
-                           const char *odir, const char *str, size_t flen)
+static void lzma_stat_file(const LZMAfile *file, PHYSFS_Stat *stat)
 {
-    char *newstr = __PHYSFS_smallAlloc(flen + 1);
-    if (newstr == NULL)
-        return;
+    if(file->item->IsDirectory)
+    {
+        stat->filesize = 0;
+        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+    } /* if */
+    else
+    {
+        stat->filesize = (PHYSFS_sint64) file->item->Size;
+        stat->filetype = PHYSFS_FILETYPE_REGULAR;
+    } /* else */
 
-    memcpy(newstr, str, flen);
-    newstr[flen] = '\0';
-    cb(callbackdata, odir, newstr, NULL);
-    __PHYSFS_smallFree(newstr);
-} /* doEnumCallback */
+    /* !!! FIXME: the 0's should be -1's? */
+    if (file->item->IsLastWriteTimeDefined)
+        stat->modtime = lzma_filetime_to_unix_timestamp(&file->item->LastWriteTime);
+    else
+        stat->modtime = 0;
+
+    /* real create and accesstype are currently not in the lzma SDK */
+    stat->createtime = stat->modtime;
+    stat->accesstime = 0;
+
+    stat->readonly = 1;  /* 7zips are always read only */
+} /* lzma_stat_file */
 
 
 static void LZMA_enumerateFiles(void *opaque, const char *dname,
-                                PHYSFS_EnumFilesCallback cb, int withStats,
+                                PHYSFS_EnumFilesCallback cb,
                                 const char *origdir, void *callbackdata)
 {
     size_t dlen = strlen(dname),
@@ -540,6 +637,8 @@ static void LZMA_enumerateFiles(void *opaque, const char *dname,
     LZMAarchive *archive = (LZMAarchive *) opaque;
     LZMAfile *file = NULL,
             *lastFile = &archive->files[archive->db.Database.NumFiles];
+    PHYSFS_Stat stat;
+
         if (dlen)
         {
             file = lzma_find_file(archive, dname);
@@ -567,32 +666,223 @@ static void LZMA_enumerateFiles(void *opaque, const char *dname,
             continue;
         }
 
-        /* Do the actual callback... */
-        doEnumCallback(cb, callbackdata, origdir, dirNameEnd, strlen(dirNameEnd));
+        /* Do the actual callback; dirNameEnd is already the bare name. */
+        lzma_stat_file(file, &stat);
+        cb(callbackdata, origdir, dirNameEnd, &stat);
 
         file++;
     }
 } /* LZMA_enumerateFiles */
 
 
+/* Number of codepoints in the first (len) bytes of a UTF-8 string. */
+static PHYSFS_uint32 lzma_utf8_codepoints(const char *str, size_t len)
+{
+    PHYSFS_uint32 retval = 0;
+    while (len--)
+    {
+        if ((((PHYSFS_uint8) *(str++)) & 0xC0) != 0x80)
+            retval++;
+    } /* while */
+    return retval;
+} /* lzma_utf8_codepoints */
+
+
+typedef struct
+{
+    const char *name;
+    size_t len;
+    PHYSFS_uint32 codepoints;
+} LZMAskip;
+
+/*
+ * archive->files is sorted, so a whole subtree is one contiguous run and
+ *  we walk it with one linear scan. Directory entries are explicit in 7z,
+ *  but a directory doesn't necessarily sit right before its children
+ *  ("a" < "a b" < "a/x"), so skipped directories are remembered until the
+ *  scan has moved past where their contents would be.
+ */
+static int LZMA_walk(void *opaque, const char *dname,
+                     PHYSFS_WalkCallback cb, void *callbackdata)
+{
+    LZMAarchive *archive = (LZMAarchive *) opaque;
+    const size_t dlen = strlen(dname);
+    const PHYSFS_uint32 dcodepoints = lzma_utf8_codepoints(dname, dlen);
+    LZMAfile *file = archive->files;
+    LZMAfile *lastFile = &archive->files[archive->db.Database.NumFiles];
+    LZMAskip *skips = NULL;
+    size_t skipcount = 0;
+    size_t skipalloc = 0;
+    char *dirbuf = NULL;
+    size_t dirbufalloc = 0;
+    int retval = 1;
+
+    if (dlen)
+    {
+        file = lzma_find_file(archive, dname);
+        if (file == NULL)
+            return 1;  /* nothing to walk. */
+        file++;
+    } /* if */
+
+    for (; file < lastFile; file++)
+    {
+        const char *name = file->item->Name;
+        const char *fname = strrchr(name, '/');
+        const char *dir = "";
+        int skipped = 0;
+        PHYSFS_Stat stat;
+        size_t i;
+        int rc;
+
+        if (dlen)
+        {
+            if (__PHYSFS_utf8strnicmp(dname, name, dcodepoints) != 0)
+                break;  /* past the end of this dir; we're done. */
+            else if (name[dlen] != '/')
+                continue;  /* "a b" when we're walking "a". */
+        } /* if */
+
+        for (i = 0; i < skipcount; )
+        {
+            const LZMAskip *skip = &skips[i];
+            const int cmp = __PHYSFS_utf8strnicmp(name, skip->name, skip->codepoints);
+            if (cmp > 0)  /* we're past this one for good. */
+            {
+                skips[i] = skips[--skipcount];
+                continue;
+            } /* if */
+
+            if ((cmp == 0) && (name[skip->len] == '/'))
+                skipped = 1;
+            i++;
+        } /* for */
+
+        if (skipped)
+            continue;
+
+        if (fname == NULL)
+            fname = name;
+        else
+        {
+            const size_t len = (size_t) (fname - name);
+            if (len >= dirbufalloc)
+            {
+                void *ptr = allocator.Realloc(dirbuf, len + 1);
+                GOTO_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, walk_failed);
+                dirbuf = (char *) ptr;
+                dirbufalloc = len + 1;
+            } /* if */
+            memcpy(dirbuf, name, len);
+            dirbuf[len] = '\0';
+            dir = dirbuf;
+            fname++;
+        } /* else */
+
+        lzma_stat_file(file, &stat);
+        rc = cb(callbackdata, dir, fname, &stat);
+        if (rc == PHYSFS_WALK_STOP)
+        {
+            retval = 0;
+            break;
+        } /* if */
+
+        else if ((rc == PHYSFS_WALK_SKIP_SUBTREE) && (file->item->IsDirectory))
+        {
+            if (skipcount == skipalloc)
+            {
+                const size_t newalloc = skipalloc ? skipalloc * 2 : 8;
+                void *ptr = allocator.Realloc(skips, newalloc * sizeof (LZMAskip));
+                GOTO_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, walk_failed);
+                skips = (LZMAskip *) ptr;
+                skipalloc = newalloc;
+            } /* if */
+            skips[skipcount].name = name;
+            skips[skipcount].len = strlen(name);
+            skips[skipcount].codepoints = lzma_utf8_codepoints(name, skips[skipcount].len);
+            skipcount++;
+        } /* else if */
+    } /* for */
+
+    allocator.Free(skips);
+    allocator.Free(dirbuf);
+    return retval;
+
+walk_failed:
+    allocator.Free(skips);
+    allocator.Free(dirbuf);
+    return 0;
+} /* LZMA_walk */
+
+
+/*
+ * archive->files is sorted, so the names in (dname) that start with
+ *  (prefix) are one contiguous run; binary search for the start of it.
+ */
+static void LZMA_enumerateFilesPrefix(void *opaque, const char *dname,
+                                      const char *prefix,
+                                      PHYSFS_EnumFilesCallback cb,
+                                      const char *origdir, void *callbackdata)
+{
+    LZMAarchive *archive = (LZMAarchive *) opaque;
+    const size_t dlen = strlen(dname);
+    const size_t dlen_inc = dlen + ((dlen > 0) ? 1 : 0);
+    const size_t keylen = dlen_inc + strlen(prefix);
+    const size_t max = (size_t) archive->db.Database.NumFiles;
+    size_t lo = 0;
+    size_t hi = max;
+    PHYSFS_uint32 keychars;
+    char *key;
+
+    if (*prefix == '\0')
+    {
+        LZMA_enumerateFiles(opaque, dname, cb, origdir, callbackdata);
+        return;
+    } /* if */
+
+    key = (char *) __PHYSFS_smallAlloc(keylen + 1);
+    BAIL_IF_MACRO(!key, PHYSFS_ERR_OUT_OF_MEMORY, );
+    sprintf(key, "%s%s%s", dname, (dlen > 0) ? "/" : "", prefix);
+    keychars = lzma_utf8_codepoints(key, keylen);
+
+    while (lo < hi)
+    {
+        const size_t middle = lo + ((hi - lo) / 2);
+        const char *name = archive->files[middle].item->Name;
+        if (__PHYSFS_utf8strnicmp(name, key, keychars) < 0)
+            lo = middle + 1;
+        else
+            hi = middle;
+    } /* while */
+
+    for (; lo < max; lo++)
+    {
+        const LZMAfile *file = &archive->files[lo];
+        const char *fname = file->item->Name + dlen_inc;
+        PHYSFS_Stat stat;
+
+        if (__PHYSFS_utf8strnicmp(file->item->Name, key, keychars) != 0)
+            break;  /* past the names that can match; we're done. */
+        else if (strchr(fname, '/'))
+            continue;  /* inside a subdir. */
+
+        lzma_stat_file(file, &stat);
+        cb(callbackdata, origdir, fname, &stat);
+    } /* for */
+
+    __PHYSFS_smallFree(key);
+} /* LZMA_enumerateFilesPrefix */
+
+
 static PHYSFS_Io *LZMA_openRead(void *opaque, const char *name)
 {
     LZMAarchive *archive = (LZMAarchive *) opaque;
     LZMAfile *file = lzma_find_file(archive, name);
-    PHYSFS_Io *io = NULL;
 
     BAIL_IF_MACRO(file == NULL, PHYSFS_ERR_NOT_FOUND, NULL);
     BAIL_IF_MACRO(file->folder == NULL, PHYSFS_ERR_NOT_A_FILE, NULL);
 
-    file->position = 0;
-    file->folder->references++; /* Increase refcount for automatic cleanup... */
-
-    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    BAIL_IF_MACRO(io == NULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    memcpy(io, &LZMA_Io, sizeof (*io));
-    io->opaque = file;
-
-    return io;
+    return lzma_file_io(file);
 } /* LZMA_openRead */
 
 
@@ -645,29 +935,7 @@ static int LZMA_stat(void *opaque, const char *filename, PHYSFS_Stat *stat)
     if (!file)
         return 0;
 
-    if(file->item->IsDirectory)
-    {
-        stat->filesize = 0;
-        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
-    } /* if */
-    else
-    {
-        stat->filesize = (PHYSFS_sint64) file->item->Size;
-        stat->filetype = PHYSFS_FILETYPE_REGULAR;
-    } /* else */
-
-    /* !!! FIXME: the 0's should be -1's? */
-    if (file->item->IsLastWriteTimeDefined)
-        stat->modtime = lzma_filetime_to_unix_timestamp(&file->item->LastWriteTime);
-    else
-        stat->modtime = 0;
-
-    /* real create and accesstype are currently not in the lzma SDK */
-    stat->createtime = stat->modtime;
-    stat->accesstime = 0;
-
-    stat->readonly = 1;  /* 7zips are always read only */
-
+    lzma_stat_file(file, stat);
     return 1;
 } /* LZMA_stat */
 
@@ -690,7 +958,12 @@ const PHYSFS_Archiver __PHYSFS_Archiver_LZMA =
     LZMA_remove,
     LZMA_mkdir,
     LZMA_stat,
-    LZMA_closeArchive
+    LZMA_closeArchive,
+    LZMA_walk,
+    LZMA_enumerateFilesPrefix,
+    NULL,  /* locate */
+    NULL,  /* enumerateFilesWithStats */
+    NULL  /* openArchiveWithFlags */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_7Z */
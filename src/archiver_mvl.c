@@ -96,7 +96,12 @@ const PHYSFS_Archiver __PHYSFS_Archiver_MVL =
     UNPK_remove,
     UNPK_mkdir,
     UNPK_stat,
-    UNPK_closeArchive
+    UNPK_closeArchive,
+    UNPK_walk,
+    UNPK_enumerateFilesPrefix,
+    UNPK_locate,
+    NULL,  /* enumerateFilesWithStats */
+    NULL  /* openArchiveWithFlags */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_MVL */
@@ -23,6 +23,7 @@ typedef struct
     PHYSFS_Io *io;
     PHYSFS_uint32 entryCount;
     UNPKentry *entries;
+    __PHYSFS_Stats *stats;
 } UNPKinfo;
 
 
@@ -33,6 +34,8 @@ typedef struct
     PHYSFS_uint32 curPos;
 } UNPKfileinfo;
 
+static __PHYSFS_Pool fileInfoPool = __PHYSFS_POOL_INIT(sizeof (UNPKfileinfo), 64);
+
 
 void UNPK_closeArchive(void *opaque)
 {
@@ -79,7 +82,7 @@ static int UNPK_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
     const UNPKentry *entry = finfo->entry;
     int rc;
 
-    BAIL_IF_MACRO(offset >= entry->size, PHYSFS_ERR_PAST_EOF, 0);
+    BAIL_IF_MACRO(offset > entry->size, PHYSFS_ERR_PAST_EOF, 0);
     rc = finfo->io->seek(finfo->io, entry->startPos + offset);
     if (rc)
         finfo->curPos = (PHYSFS_uint32) offset;
@@ -99,10 +102,10 @@ static PHYSFS_Io *UNPK_duplicate(PHYSFS_Io *_io)
 {
     UNPKfileinfo *origfinfo = (UNPKfileinfo *) _io->opaque;
     PHYSFS_Io *io = NULL;
-    PHYSFS_Io *retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    UNPKfileinfo *finfo = (UNPKfileinfo *) allocator.Malloc(sizeof (UNPKfileinfo));
-    GOTO_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, UNPK_duplicate_failed);
-    GOTO_IF_MACRO(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, UNPK_duplicate_failed);
+    PHYSFS_Io *retval = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    UNPKfileinfo *finfo = (UNPKfileinfo *) __PHYSFS_poolAlloc(&fileInfoPool);
+    GOTO_IF_MACRO(!retval, ERRPASS, UNPK_duplicate_failed);
+    GOTO_IF_MACRO(!finfo, ERRPASS, UNPK_duplicate_failed);
 
     io = origfinfo->io->duplicate(origfinfo->io);
     if (!io) goto UNPK_duplicate_failed;
@@ -114,8 +117,8 @@ static PHYSFS_Io *UNPK_duplicate(PHYSFS_Io *_io)
     return retval;
 
 UNPK_duplicate_failed:
-    if (finfo != NULL) allocator.Free(finfo);
-    if (retval != NULL) allocator.Free(retval);
+    __PHYSFS_poolFree(&fileInfoPool, finfo);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, retval);
     if (io != NULL) io->destroy(io);
     return NULL;
 } /* UNPK_duplicate */
@@ -126,8 +129,8 @@ static void UNPK_destroy(PHYSFS_Io *io)
 {
     UNPKfileinfo *finfo = (UNPKfileinfo *) io->opaque;
     finfo->io->destroy(finfo->io);
-    allocator.Free(finfo);
-    allocator.Free(io);
+    __PHYSFS_poolFree(&fileInfoPool, finfo);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
 } /* UNPK_destroy */
 
 
@@ -145,6 +148,22 @@ static const PHYSFS_Io UNPK_Io =
 };
 
 
+int UNPK_dataRange(PHYSFS_Io *io, PHYSFS_DataRange *range)
+{
+    const UNPKfileinfo *finfo;
+
+    if (io->read != UNPK_read)
+        return 0;
+
+    finfo = (const UNPKfileinfo *) io->opaque;
+    range->io = finfo->io;
+    range->offset = finfo->entry->startPos;
+    range->len = finfo->entry->size;
+    range->raw = 1;
+    return 1;
+} /* UNPK_dataRange */
+
+
 static int entryCmp(void *_a, size_t one, size_t two)
 {
     if (one != two)
@@ -224,34 +243,58 @@ static PHYSFS_sint32 findStartOfDir(UNPKinfo *info, const char *path,
 } /* findStartOfDir */
 
 
+/* (entry) is NULL for directories, which only exist implicitly here. */
+static void statEntry(const UNPKentry *entry, PHYSFS_Stat *stat)
+{
+    if (entry == NULL)
+    {
+        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+        stat->filesize = 0;
+    } /* if */
+    else
+    {
+        stat->filetype = PHYSFS_FILETYPE_REGULAR;
+        stat->filesize = entry->size;
+    } /* else */
+
+    stat->modtime = -1;
+    stat->createtime = -1;
+    stat->accesstime = -1;
+    stat->readonly = 1;
+} /* statEntry */
+
+
 /*
  * Moved to seperate function so we can use alloca then immediately throw
  *  away the allocated stack space...
  */
 static void doEnumCallback(PHYSFS_EnumFilesCallback cb, void *callbackdata,
-                           const char *odir, const char *str, PHYSFS_sint32 ln)
+                           const char *odir, const char *str, PHYSFS_sint32 ln,
+                           const UNPKentry *entry)
 {
+    PHYSFS_Stat stat;
     char *newstr = __PHYSFS_smallAlloc(ln + 1);
     if (newstr == NULL)
         return;
 
     memcpy(newstr, str, ln);
     newstr[ln] = '\0';
-    cb(callbackdata, odir, newstr, NULL);
+    statEntry(entry, &stat);
+    cb(callbackdata, odir, newstr, &stat);
     __PHYSFS_smallFree(newstr);
 } /* doEnumCallback */
 
 
-void UNPK_enumerateFiles(void *opaque, const char *dname,
-                         PHYSFS_EnumFilesCallback cb,
-                         const char *origdir, void *callbackdata)
+/*
+ * Report the entries of (dname) from index (i) on, stopping at the end of
+ *  the directory or at the first name that doesn't start with (prefix).
+ */
+static void doEnumerate(UNPKinfo *info, PHYSFS_sint32 i, const char *dname,
+                        const char *prefix, PHYSFS_EnumFilesCallback cb,
+                        const char *origdir, void *callbackdata)
 {
-    UNPKinfo *info = ((UNPKinfo *) opaque);
-    PHYSFS_sint32 dlen, dlen_inc, max, i;
-
-    i = findStartOfDir(info, dname, 0);
-    if (i == -1)  /* no such directory. */
-        return;
+    const PHYSFS_uint32 prefixlen = (PHYSFS_uint32) strlen(prefix);
+    PHYSFS_sint32 dlen, dlen_inc, max;
 
     dlen = (PHYSFS_sint32) strlen(dname);
     if ((dlen > 0) && (dname[dlen - 1] == '/')) /* ignore trailing slash. */
@@ -272,9 +315,13 @@ void UNPK_enumerateFiles(void *opaque, const char *dname,
         } /* if */
 
         add = e + dlen_inc;
+        if (__PHYSFS_strnicmpASCII(add, prefix, prefixlen) != 0)
+            break;  /* past the names that can match; we're done. */
+
         ptr = strchr(add, '/');
         ln = (PHYSFS_sint32) ((ptr) ? ptr-add : strlen(add));
-        doEnumCallback(cb, callbackdata, origdir, add, ln);
+        doEnumCallback(cb, callbackdata, origdir, add, ln,
+                       (ptr) ? NULL : &info->entries[i]);
         ln += dlen_inc;  /* point past entry to children... */
 
         /* increment counter and skip children of subdirs... */
@@ -288,9 +335,190 @@ void UNPK_enumerateFiles(void *opaque, const char *dname,
             } /* if */
         } /* while */
     } /* while */
+} /* doEnumerate */
+
+
+void UNPK_enumerateFiles(void *opaque, const char *dname,
+                         PHYSFS_EnumFilesCallback cb,
+                         const char *origdir, void *callbackdata)
+{
+    UNPKinfo *info = ((UNPKinfo *) opaque);
+    const PHYSFS_sint32 i = findStartOfDir(info, dname, 0);
+    if (i != -1)  /* -1 == no such directory. */
+        doEnumerate(info, i, dname, "", cb, origdir, callbackdata);
 } /* UNPK_enumerateFiles */
 
 
+/*
+ * The entries are sorted, so the names in (dname) that start with (prefix)
+ *  are one contiguous run; binary search for the start of it.
+ */
+void UNPK_enumerateFilesPrefix(void *opaque, const char *dname,
+                               const char *prefix, PHYSFS_EnumFilesCallback cb,
+                               const char *origdir, void *callbackdata)
+{
+    UNPKinfo *info = ((UNPKinfo *) opaque);
+    char key[sizeof (info->entries->name) + 1];
+    PHYSFS_sint32 lo, hi, dlen;
+    PHYSFS_uint32 keylen;
+    const char *ptr;
+
+    /* we sort with ASCII-only case folding; don't guess at anything else. */
+    for (ptr = prefix; *ptr; ptr++)
+    {
+        if (((PHYSFS_uint8) *ptr) >= 0x80)
+            break;
+    } /* for */
+
+    if ((*ptr) || (ptr == prefix))  /* non-ASCII, or no prefix at all. */
+    {
+        UNPK_enumerateFiles(opaque, dname, cb, origdir, callbackdata);
+        return;
+    } /* if */
+
+    dlen = (PHYSFS_sint32) strlen(dname);
+    if ((dlen > 0) && (dname[dlen - 1] == '/')) /* ignore trailing slash. */
+        dlen--;
+
+    keylen = (PHYSFS_uint32) (dlen + ((dlen > 0) ? 1 : 0) + (ptr - prefix));
+    if (keylen >= sizeof (key))
+        return;  /* longer than any name we can hold; nothing matches. */
+
+    memcpy(key, dname, dlen);
+    if (dlen > 0)
+        key[dlen++] = '/';
+    strcpy(key + dlen, prefix);
+
+    lo = 0;
+    hi = (PHYSFS_sint32) info->entryCount;
+    while (lo < hi)
+    {
+        const PHYSFS_sint32 middle = lo + ((hi - lo) / 2);
+        if (__PHYSFS_strnicmpASCII(info->entries[middle].name, key, keylen) < 0)
+            lo = middle + 1;
+        else
+            hi = middle;
+    } /* while */
+
+    doEnumerate(info, lo, dname, prefix, cb, origdir, callbackdata);
+} /* UNPK_enumerateFilesPrefix */
+
+
+/*
+ * The entries are sorted, so everything under a directory is one
+ *  contiguous run; we walk the whole subtree with one linear scan.
+ *  Directories only exist implicitly, so we report each one when we hit
+ *  the first entry inside it, and skipping it means hopping over the rest
+ *  of its run. (prev) is the deepest directory we've reported so far that
+ *  we're still inside of.
+ */
+int UNPK_walk(void *opaque, const char *dname, PHYSFS_WalkCallback cb,
+              void *callbackdata)
+{
+    UNPKinfo *info = ((UNPKinfo *) opaque);
+    char path[sizeof (info->entries->name) + 1];
+    char prev[sizeof (info->entries->name) + 1];
+    PHYSFS_sint32 dlen, prevlen, max, i;
+    PHYSFS_Stat dirstat;
+
+    i = findStartOfDir(info, dname, 0);
+    if (i == -1)  /* no such directory. */
+        return 1;
+
+    dlen = (PHYSFS_sint32) strlen(dname);
+    if ((dlen > 0) && (dname[dlen - 1] == '/')) /* ignore trailing slash. */
+        dlen--;
+    BAIL_IF_MACRO(dlen >= (PHYSFS_sint32) sizeof (prev), PHYSFS_ERR_NOT_FOUND, 1);
+
+    memcpy(prev, dname, dlen);
+    prev[dlen] = '\0';
+    prevlen = dlen;
+    statEntry(NULL, &dirstat);
+
+    max = (PHYSFS_sint32) info->entryCount;
+    while (i < max)
+    {
+        const UNPKentry *entry = &info->entries[i];
+        PHYSFS_Stat stat;
+        char *sep;
+        PHYSFS_sint32 pos;
+        int rc;
+
+        if ((dlen) &&
+            ((__PHYSFS_strnicmpASCII(entry->name, dname, dlen)) ||
+             (entry->name[dlen] != '/')))
+        {
+            break;  /* past end of this dir; we're done. */
+        } /* if */
+
+        memcpy(path, entry->name, sizeof (entry->name));
+        path[sizeof (entry->name)] = '\0';
+
+        /* back out of directories this entry isn't inside of. */
+        while ( (prevlen > dlen) &&
+                ((__PHYSFS_strnicmpASCII(path, prev, prevlen) != 0) ||
+                 (path[prevlen] != '/')) )
+        {
+            while ((prevlen > dlen) && (prev[prevlen] != '/'))
+                prevlen--;
+            prev[prevlen] = '\0';
+        } /* while */
+
+        /* report any directories between (prev) and this entry. */
+        pos = (prevlen > 0) ? prevlen + 1 : 0;
+        rc = PHYSFS_WALK_CONTINUE;
+        while ((sep = strchr(path + pos, '/')) != NULL)
+        {
+            *sep = '\0';
+            if (pos > 0)
+                path[pos - 1] = '\0';
+            rc = cb(callbackdata, (pos > 0) ? path : "", path + pos, &dirstat);
+            if (pos > 0)
+                path[pos - 1] = '/';
+
+            if (rc != PHYSFS_WALK_CONTINUE)
+                break;
+
+            *sep = '/';
+            prevlen = (PHYSFS_sint32) (sep - path);
+            memcpy(prev, path, prevlen);
+            prev[prevlen] = '\0';
+            pos = prevlen + 1;
+        } /* while */
+
+        if (rc == PHYSFS_WALK_STOP)
+            return 0;
+
+        else if (rc == PHYSFS_WALK_SKIP_SUBTREE)
+        {
+            /* (path) is cut off at the skipped dir; hop over its run. */
+            const PHYSFS_sint32 skiplen = (PHYSFS_sint32) strlen(path);
+            while ((++i < max) &&
+                   (__PHYSFS_strnicmpASCII(info->entries[i].name, path, skiplen) == 0) &&
+                   (info->entries[i].name[skiplen] == '/'))
+            {
+                /* do nothing. */
+            } /* while */
+            continue;
+        } /* else if */
+
+        if (path[pos] != '\0')  /* not just an explicit directory entry? */
+        {
+            if (pos > 0)
+                path[pos - 1] = '\0';
+            statEntry(entry, &stat);
+            rc = cb(callbackdata, (pos > 0) ? path : "", path + pos, &stat);
+            if (rc == PHYSFS_WALK_STOP)
+                return 0;
+        } /* if */
+
+        i++;
+    } /* while */
+
+    return 1;
+} /* UNPK_walk */
+
+
 /*
  * This will find the UNPKentry associated with a path in platform-independent
  *  notation. Directories don't have UNPKentries associated with them, but 
@@ -306,8 +534,11 @@ static UNPKentry *findEntry(const UNPKinfo *info, const char *path, int *isDir)
     const char *thispath = NULL;
     int rc;
 
+    __PHYSFS_statAdd(info->stats, PHYSFS_STAT_LOOKUPS, 1);
+
     while (lo <= hi)
     {
+        __PHYSFS_statAdd(info->stats, PHYSFS_STAT_LOOKUP_PROBES, 1);
         middle = lo + ((hi - lo) / 2);
         thispath = a[middle].name;
         rc = __PHYSFS_strnicmpASCII(path, thispath, pathlen);
@@ -355,11 +586,11 @@ PHYSFS_Io *UNPK_openRead(void *opaque, const char *name)
     GOTO_IF_MACRO(isdir, PHYSFS_ERR_NOT_A_FILE, UNPK_openRead_failed);
     GOTO_IF_MACRO(!entry, ERRPASS, UNPK_openRead_failed);
 
-    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, UNPK_openRead_failed);
+    retval = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    GOTO_IF_MACRO(!retval, ERRPASS, UNPK_openRead_failed);
 
-    finfo = (UNPKfileinfo *) allocator.Malloc(sizeof (UNPKfileinfo));
-    GOTO_IF_MACRO(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, UNPK_openRead_failed);
+    finfo = (UNPKfileinfo *) __PHYSFS_poolAlloc(&fileInfoPool);
+    GOTO_IF_MACRO(!finfo, ERRPASS, UNPK_openRead_failed);
 
     finfo->io = info->io->duplicate(info->io);
     GOTO_IF_MACRO(!finfo->io, ERRPASS, UNPK_openRead_failed);
@@ -379,16 +610,31 @@ UNPK_openRead_failed:
     {
         if (finfo->io != NULL)
             finfo->io->destroy(finfo->io);
-        allocator.Free(finfo);
+        __PHYSFS_poolFree(&fileInfoPool, finfo);
     } /* if */
 
-    if (retval != NULL)
-        allocator.Free(retval);
-
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, retval);
     return NULL;
 } /* UNPK_openRead */
 
 
+int UNPK_locate(void *opaque, const char *name, PHYSFS_DataRange *range)
+{
+    UNPKinfo *info = (UNPKinfo *) opaque;
+    int isdir = 0;
+    UNPKentry *entry = findEntry(info, name, &isdir);
+
+    BAIL_IF_MACRO(isdir, PHYSFS_ERR_NOT_A_FILE, -1);
+    BAIL_IF_MACRO(!entry, ERRPASS, -1);
+
+    range->io = info->io;
+    range->offset = entry->startPos;
+    range->len = entry->size;
+    range->raw = 1;
+    return 1;
+} /* UNPK_locate */
+
+
 PHYSFS_Io *UNPK_openWrite(void *opaque, const char *name)
 {
     BAIL_MACRO(PHYSFS_ERR_READ_ONLY, NULL);
@@ -419,26 +665,10 @@ int UNPK_stat(void *opaque, const char *filename, PHYSFS_Stat *stat)
     const UNPKinfo *info = (const UNPKinfo *) opaque;
     const UNPKentry *entry = findEntry(info, filename, &isDir);
 
-    if (isDir)
-    {
-        stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
-        stat->filesize = 0;
-    } /* if */
-    else if (entry != NULL)
-    {
-        stat->filetype = PHYSFS_FILETYPE_REGULAR;
-        stat->filesize = entry->size;
-    } /* else if */
-    else
-    {
+    if ((!isDir) && (entry == NULL))
         return 0;
-    } /* else */
-
-    stat->modtime = -1;
-    stat->createtime = -1;
-    stat->accesstime = -1;
-    stat->readonly = 1;
 
+    statEntry(isDir ? NULL : entry, stat);
     return 1;
 } /* UNPK_stat */
 
@@ -456,6 +686,7 @@ void *UNPK_openArchive(PHYSFS_Io *io, UNPKentry *e, const PHYSFS_uint32 num)
     info->io = io;
     info->entryCount = num;
     info->entries = e;
+    info->stats = __PHYSFS_statsCurrent();
 
     return info;
 } /* UNPK_openArchive */
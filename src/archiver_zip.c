@@ -20,8 +20,8 @@
 
 /*
  * A buffer of ZIP_READBUFSIZE is allocated for each compressed file opened,
- *  and is freed when you close the file; compressed data is read into
- *  this buffer, and then is decompressed into the buffer passed to
+ *  and is handed back to a pool when you close the file; compressed data is
+ *  read into this buffer, and then is decompressed into the buffer passed to
  *  PHYSFS_read().
  *
  * Uncompressed entries in a zipfile do not allocate this buffer; they just
@@ -32,6 +32,14 @@
  */
 #define ZIP_READBUFSIZE   (16 * 1024)
 
+/*
+ * Closing a compressed file keeps its decoder state (about 43K, mostly the
+ *  inflate dictionary) and its read buffer for the next open to reuse, up
+ *  to this many of each. Opening lots of small files then costs a reset,
+ *  not a trip through the allocator.
+ */
+#define ZIP_POOLED_DECODERS  8
+
 
 /*
  * Entries are "unresolved" until they are first opened. At that time,
@@ -61,28 +69,35 @@ typedef struct _ZIP_AES_Data
 } ZIP_AES_Data;
 
 
+/* marks an empty link between ZIPentries; a valid index is never this. */
+#define ZIP_NO_ENTRY 0xFFFFFFFF
+
 /*
- * One ZIPentry is kept for each file in an open ZIP archive.
+ * One ZIPentry is kept for each file in an open ZIP archive. They all live
+ *  in one array (ZIPinfo::entries), so links between them are 32-bit indices
+ *  into that array instead of pointers, and names are offsets into a shared
+ *  string table. Fields most entries don't need (AES data) are in side tables.
  */
 typedef struct _ZIPentry
 {
-    char *name;                         /* Name of file in archive        */
-    struct _ZIPentry *symlink;          /* NULL or file we symlink to     */
-    ZipResolveType resolved;            /* Have we resolved file/symlink? */
     PHYSFS_uint64 offset;               /* offset of data in archive      */
+    PHYSFS_uint64 compressed_size;      /* compressed size                */
+    PHYSFS_uint64 uncompressed_size;    /* uncompressed size              */
+    PHYSFS_uint32 name;                 /* Name of file in string table   */
+    PHYSFS_uint32 hash;                 /* zip_hash_string() of name      */
+    PHYSFS_uint32 symlink;              /* ZIP_NO_ENTRY or file we link to*/
+    PHYSFS_uint32 hashnext;             /* next item in this hash bucket  */
+    PHYSFS_uint32 children;             /* linked list of kids, if dir    */
+    PHYSFS_uint32 sibling;              /* next item in same dir          */
+    PHYSFS_uint32 aes;                  /* ZIP_NO_ENTRY or AES table index*/
+    PHYSFS_uint32 crc;                  /* crc-32                         */
+    PHYSFS_uint32 dos_mod_time;         /* original MS-DOS style mod time */
     PHYSFS_uint16 version;              /* version made by                */
     PHYSFS_uint16 version_needed;       /* version needed to extract      */
     PHYSFS_uint16 general_bits;         /* general purpose bits           */
     PHYSFS_uint16 compression_method;   /* compression method             */
-    PHYSFS_uint32 crc;                  /* crc-32                         */
-    PHYSFS_uint64 compressed_size;      /* compressed size                */
-    PHYSFS_uint64 uncompressed_size;    /* uncompressed size              */
-    PHYSFS_sint64 last_mod_time;        /* last file mod time             */
-    PHYSFS_uint32 dos_mod_time;         /* original MS-DOS style mod time */
-    struct _ZIPentry *hashnext;         /* next item in this hash bucket  */
-    struct _ZIPentry *children;         /* linked list of kids, if dir    */
-    struct _ZIPentry *sibling;          /* next item in same dir          */
-    ZIP_AES_Data aes_data;
+    PHYSFS_uint8 resolved;              /* Have we resolved file/symlink? */
+    PHYSFS_uint8 implicit;              /* non-zero: placeholder, no time */
 } ZIPentry;
 
 /*
@@ -91,11 +106,20 @@ typedef struct _ZIPentry
 typedef struct
 {
     PHYSFS_Io *io;            /* the i/o interface for this archive.    */
-    ZIPentry root;            /* root of directory tree.                */
-    ZIPentry **hash;          /* all entries hashed for fast lookup.    */
+    ZIPentry *entries;        /* every entry. entries[0] is the root.   */
+    PHYSFS_uint32 entryCount; /* number of used slots in (entries).     */
+    PHYSFS_uint32 entryAlloc; /* number of allocated slots in (entries).*/
+    char *strings;            /* entry names, null-terminated.          */
+    PHYSFS_uint32 stringsLen; /* bytes used in (strings).               */
+    PHYSFS_uint32 stringsAlloc; /* bytes allocated for (strings).       */
+    ZIP_AES_Data *aes;        /* AES data for encrypted entries.        */
+    PHYSFS_uint32 aesCount;   /* number of used slots in (aes).         */
+    PHYSFS_uint32 aesAlloc;   /* number of allocated slots in (aes).    */
+    PHYSFS_uint32 *hash;      /* all entries hashed for fast lookup.    */
     size_t hashBuckets;       /* number of buckets in hash.             */
     int zip64;                /* non-zero if this is a Zip64 archive.   */
     int has_crypto;           /* non-zero if any entry uses encryption. */
+    __PHYSFS_Stats *stats;    /* i/o counters for this archive.         */
 } ZIPinfo;
 
 /*
@@ -104,6 +128,7 @@ typedef struct
 typedef struct
 {
     ZIPentry *entry;                      /* Info on file.              */
+    ZIP_AES_Data *aes;                    /* NULL if not AES encrypted. */
     PHYSFS_Io *io;                        /* physical file handle.      */
     PHYSFS_uint32 compressed_position;    /* offset in compressed data. */
     PHYSFS_uint32 uncompressed_position;  /* tell() position.           */
@@ -112,9 +137,27 @@ typedef struct
     PHYSFS_uint32 initial_crypto_keys[3]; /* for "traditional" crypto.  */
     z_stream stream;                      /* zlib stream state.         */
     fcrypt_ctx aes_ctx;
+    __PHYSFS_Stats *stats;                /* the archive's counters.    */
 
 } ZIPfileinfo;
 
+/* opens and closes come in bursts, so keep some of these around. */
+static __PHYSFS_Pool fileInfoPool = __PHYSFS_POOL_INIT(sizeof (ZIPfileinfo), 64);
+static __PHYSFS_Pool readBufferPool = __PHYSFS_POOL_INIT(ZIP_READBUFSIZE, ZIP_POOLED_DECODERS);
+
+/*
+ * Every block we hand zlib has one of these in front of it, so
+ *  zlibPhysfsFree() knows where it came from. It's 16 bytes on every
+ *  platform, so zlib's pointer is as aligned as the real allocator made it.
+ */
+typedef union
+{
+    int pooled;  /* non-zero if it's from inflatePool. */
+    PHYSFS_uint64 align[2];
+} ZlibBlockHeader;
+
+static __PHYSFS_Pool inflatePool = __PHYSFS_POOL_INIT(sizeof (ZlibBlockHeader) + sizeof (inflate_state), ZIP_POOLED_DECODERS);
+
 
 /* Magic numbers... */
 #define ZIP_LOCAL_FILE_SIG                          0x04034b50
@@ -131,7 +174,7 @@ typedef struct
 #define ZIP_AES_128_BITS			                0x01
 #define ZIP_AES_192_BITS			                0x02
 #define ZIP_AES_256_BITS	                        0x03
-#define ZIP_IS_AES(entry) (entry->aes_data.key_strength > ZIP_AES_128_BITS)
+#define ZIP_IS_AES(aes) (((aes) != NULL) && ((aes)->key_strength > ZIP_AES_128_BITS))
 
 // this password need to be in sync with the buildbot that packs the files
 // please note to note have '"% in there as it breaks the buildbot
@@ -158,11 +201,11 @@ static int zip_entry_is_tradional_crypto(const ZIPentry *entry)
 
 static int zip_entry_update_aes_offset(ZIPfileinfo *finfo)
 {
-    ZIPentry *entry = finfo->entry;
+    const ZIP_AES_Data *aes = finfo->aes;
     PHYSFS_uint16 pass_verifier;
 
-    fcrypt_init(entry->aes_data.key_strength, ZIP_AES_DEFAULT_PASSWORD, strlen(ZIP_AES_DEFAULT_PASSWORD), entry->aes_data.salt, (unsigned char *)&pass_verifier, &finfo->aes_ctx);
-    BAIL_IF_MACRO(entry->aes_data.pass_verification != pass_verifier, PHYSFS_ERR_CORRUPT, 0);
+    fcrypt_init(aes->key_strength, ZIP_AES_DEFAULT_PASSWORD, strlen(ZIP_AES_DEFAULT_PASSWORD), aes->salt, (unsigned char *)&pass_verifier, &finfo->aes_ctx);
+    BAIL_IF_MACRO(aes->pass_verification != pass_verifier, PHYSFS_ERR_CORRUPT, 0);
 
     {
         fcrypt_ctx *cx = &finfo->aes_ctx;
@@ -221,7 +264,8 @@ static PHYSFS_sint64 zip_read_decrypt(ZIPfileinfo *finfo, void *buf, PHYSFS_uint
     /* Decompression the new data if necessary. */
     if (zip_entry_is_tradional_crypto(finfo->entry) && (br > 0))
     {
-        if (ZIP_IS_AES(finfo->entry)) {
+        const PHYSFS_uint64 start = __PHYSFS_statTimeStart();
+        if (ZIP_IS_AES(finfo->aes)) {
             if (finfo->aes_ctx.encr_pos > AES_BLOCK_SIZE) {
                 if (!zip_entry_update_aes_offset(finfo)) {
                     return -1;
@@ -249,6 +293,9 @@ static PHYSFS_sint64 zip_read_decrypt(ZIPfileinfo *finfo, void *buf, PHYSFS_uint
                 *ptr = ch;
             } /* for */
         }
+
+        __PHYSFS_statAddTime(finfo->stats, PHYSFS_STAT_NS_DECRYPT, start);
+        __PHYSFS_statAdd(finfo->stats, PHYSFS_STAT_BYTES_DECRYPTED, br);
     } /* if  */
 
     return br;
@@ -295,10 +342,33 @@ static int zip_prep_crypto_keys(ZIPfileinfo *finfo, const PHYSFS_uint8 *crypto_h
 
 /*
  * Bridge physfs allocation functions to zlib's format...
+ *
+ * The only thing miniz's inflate allocates is its inflate_state, so
+ *  (opaque) is a pool of those. inflateInit2() resets whatever it's given,
+ *  so a recycled one is as good as new. Anything else (a different zlib,
+ *  or a different inflate_state than we were built with) just goes to the
+ *  allocator.
  */
 static voidpf zlibPhysfsAlloc(voidpf opaque, uInt items, uInt size)
 {
-    return ((PHYSFS_Allocator *) opaque)->Malloc(items * size);
+    __PHYSFS_Pool *pool = (__PHYSFS_Pool *) opaque;
+    const size_t len = ((size_t) items) * size;
+    ZlibBlockHeader *hdr;
+
+    if ((sizeof (ZlibBlockHeader) + len) == pool->size)
+    {
+        hdr = (ZlibBlockHeader *) __PHYSFS_poolAlloc(pool);
+        BAIL_IF_MACRO(!hdr, ERRPASS, NULL);
+        hdr->pooled = 1;
+    } /* if */
+    else
+    {
+        hdr = (ZlibBlockHeader *) allocator.Malloc(sizeof (*hdr) + len);
+        BAIL_IF_MACRO(!hdr, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        hdr->pooled = 0;
+    } /* else */
+
+    return hdr + 1;
 } /* zlibPhysfsAlloc */
 
 /*
@@ -306,7 +376,11 @@ static voidpf zlibPhysfsAlloc(voidpf opaque, uInt items, uInt size)
  */
 static void zlibPhysfsFree(voidpf opaque, voidpf address)
 {
-    ((PHYSFS_Allocator *) opaque)->Free(address);
+    ZlibBlockHeader *hdr = ((ZlibBlockHeader *) address) - 1;
+    if (hdr->pooled)
+        __PHYSFS_poolFree((__PHYSFS_Pool *) opaque, hdr);
+    else
+        allocator.Free(hdr);
 } /* zlibPhysfsFree */
 
 
@@ -318,7 +392,7 @@ static void initializeZStream(z_stream *pstr)
     memset(pstr, '\0', sizeof (z_stream));
     pstr->zalloc = zlibPhysfsAlloc;
     pstr->zfree = zlibPhysfsFree;
-    pstr->opaque = &allocator;
+    pstr->opaque = &inflatePool;
 } /* initializeZStream */
 
 
@@ -345,13 +419,27 @@ static int zlib_err(const int rc)
 } /* zlib_err */
 
 /*
- * Hash a string for lookup an a ZIPinfo hashtable.
+ * Hash a string for lookup in a ZIPinfo hashtable. Take this modulo the
+ *  number of buckets to pick one; entries keep the whole thing, so most
+ *  mismatches in a bucket are rejected without comparing names.
  */
-static inline PHYSFS_uint32 zip_hash_string(const ZIPinfo *info, const char *s)
+static inline PHYSFS_uint32 zip_hash_string(const char *s)
 {
-    return __PHYSFS_hashString(s, strlen(s)) % info->hashBuckets;
+    return __PHYSFS_hashString(s, strlen(s));
 } /* zip_hash_string */
 
+static inline const char *zip_entry_name(const ZIPinfo *info,
+                                         const ZIPentry *entry)
+{
+    return info->strings + entry->name;
+} /* zip_entry_name */
+
+static inline ZIP_AES_Data *zip_entry_aes(const ZIPinfo *info,
+                                          const ZIPentry *entry)
+{
+    return (entry->aes == ZIP_NO_ENTRY) ? NULL : &info->aes[entry->aes];
+} /* zip_entry_aes */
+
 /*
  * Read an unsigned 64-bit int and swap to native byte order.
  */
@@ -398,6 +486,22 @@ static int readui8(PHYSFS_Io *io, PHYSFS_uint8 *val)
 } /* readui8*/
 
 
+/*
+ * Pull little-endian ints out of a record we already read in one piece.
+ */
+static inline PHYSFS_uint16 getui16(const PHYSFS_uint8 *buf)
+{
+    return (PHYSFS_uint16) (((PHYSFS_uint16) buf[0]) |
+                            (((PHYSFS_uint16) buf[1]) << 8));
+} /* getui16 */
+
+static inline PHYSFS_uint32 getui32(const PHYSFS_uint8 *buf)
+{
+    return ((PHYSFS_uint32) buf[0]) | (((PHYSFS_uint32) buf[1]) << 8) |
+           (((PHYSFS_uint32) buf[2]) << 16) | (((PHYSFS_uint32) buf[3]) << 24);
+} /* getui32 */
+
+
 static PHYSFS_sint64 ZIP_read(PHYSFS_Io *_io, void *buf, PHYSFS_uint64 len)
 {
     ZIPfileinfo *finfo = (ZIPfileinfo *) _io->opaque;
@@ -422,6 +526,7 @@ static PHYSFS_sint64 ZIP_read(PHYSFS_Io *_io, void *buf, PHYSFS_uint64 len)
         while (retval < maxread)
         {
             PHYSFS_uint32 before = finfo->stream.total_out;
+            PHYSFS_uint64 start;
             int rc;
 
             if (finfo->stream.avail_in == 0)
@@ -444,7 +549,11 @@ static PHYSFS_sint64 ZIP_read(PHYSFS_Io *_io, void *buf, PHYSFS_uint64 len)
                 } /* if */
             } /* if */
 
+            start = __PHYSFS_statTimeStart();
             rc = zlib_err(inflate(&finfo->stream, Z_SYNC_FLUSH));
+            __PHYSFS_statAddTime(finfo->stats, PHYSFS_STAT_NS_DECOMPRESS, start);
+            __PHYSFS_statAdd(finfo->stats, PHYSFS_STAT_BYTES_DECOMPRESSED,
+                             finfo->stream.total_out - before);
             retval += (finfo->stream.total_out - before);
 
             if (rc != Z_OK)
@@ -486,7 +595,7 @@ static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
         BAIL_IF_MACRO(!io->seek(io, newpos), ERRPASS, 0);
         finfo->uncompressed_position = (PHYSFS_uint32) offset;
     } /* if */
-    else if (ZIP_IS_AES(entry))
+    else if (ZIP_IS_AES(finfo->aes))
     {
         finfo->aes_ctx.encr_pos = AES_BLOCK_SIZE + 1;
         PHYSFS_sint64 newpos = offset + entry->offset;
@@ -505,6 +614,7 @@ static int ZIP_seek(PHYSFS_Io *_io, PHYSFS_uint64 offset)
         {
             /* we do a copy so state is sane if inflateInit2() fails. */
             z_stream str;
+            __PHYSFS_statAdd(finfo->stats, PHYSFS_STAT_SEEKS_REDECODE, 1);
             initializeZStream(&str);
             if (zlib_err(inflateInit2(&str, -MAX_WBITS)) != Z_OK)
                 return 0;
@@ -550,20 +660,23 @@ static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, ZIPinfo *inf, ZIPentry *entry);
 static PHYSFS_Io *ZIP_duplicate(PHYSFS_Io *io)
 {
     ZIPfileinfo *origfinfo = (ZIPfileinfo *) io->opaque;
-    PHYSFS_Io *retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    ZIPfileinfo *finfo = (ZIPfileinfo *) allocator.Malloc(sizeof (ZIPfileinfo));
-    GOTO_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, failed);
-    GOTO_IF_MACRO(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, failed);
+    PHYSFS_Io *retval = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    ZIPfileinfo *finfo = (ZIPfileinfo *) __PHYSFS_poolAlloc(&fileInfoPool);
+    GOTO_IF_MACRO(!retval, ERRPASS, failed);
+    GOTO_IF_MACRO(!finfo, ERRPASS, failed);
     memset(finfo, '\0', sizeof (*finfo));
 
     finfo->entry = origfinfo->entry;
+    finfo->aes = origfinfo->aes;
+    finfo->stats = origfinfo->stats;
     finfo->io = zip_get_io(origfinfo->io, NULL, finfo->entry);
     GOTO_IF_MACRO(!finfo->io, ERRPASS, failed);
+    initializeZStream(&finfo->stream);
 
     if (finfo->entry->compression_method != COMPMETH_NONE)
     {
-        finfo->buffer = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
-        GOTO_IF_MACRO(!finfo->buffer, PHYSFS_ERR_OUT_OF_MEMORY, failed);
+        finfo->buffer = (PHYSFS_uint8 *) __PHYSFS_poolAlloc(&readBufferPool);
+        GOTO_IF_MACRO(!finfo->buffer, ERRPASS, failed);
         if (zlib_err(inflateInit2(&finfo->stream, -MAX_WBITS)) != Z_OK)
             goto failed;
     } /* if */
@@ -580,16 +693,14 @@ failed:
 
         if (finfo->buffer != NULL)
         {
-            allocator.Free(finfo->buffer);
+            __PHYSFS_poolFree(&readBufferPool, finfo->buffer);
             inflateEnd(&finfo->stream);
         } /* if */
 
-        allocator.Free(finfo);
+        __PHYSFS_poolFree(&fileInfoPool, finfo);
     } /* if */
 
-    if (retval != NULL)
-        allocator.Free(retval);
-
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, retval);
     return NULL;
 } /* ZIP_duplicate */
 
@@ -604,10 +715,10 @@ static void ZIP_destroy(PHYSFS_Io *io)
         inflateEnd(&finfo->stream);
 
     if (finfo->buffer != NULL)
-        allocator.Free(finfo->buffer);
+        __PHYSFS_poolFree(&readBufferPool, finfo->buffer);
 
-    allocator.Free(finfo);
-    allocator.Free(io);
+    __PHYSFS_poolFree(&fileInfoPool, finfo);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
 } /* ZIP_destroy */
 
 
@@ -625,6 +736,29 @@ static const PHYSFS_Io ZIP_Io =
 };
 
 
+int __PHYSFS_ZIP_dataRange(PHYSFS_Io *io, PHYSFS_DataRange *range)
+{
+    const ZIPfileinfo *finfo;
+    const ZIPentry *entry;
+
+    if (io->read != ZIP_read)
+        return 0;
+
+    /* openRead resolved the entry, so (offset) is past the local header. */
+    finfo = (const ZIPfileinfo *) io->opaque;
+    entry = finfo->entry;
+    range->io = finfo->io;
+    range->offset = entry->offset;
+    range->len = entry->compressed_size;
+
+    /* AES entries aren't COMPMETH_NONE here, even if stored underneath. */
+    range->raw = ( (entry->compression_method == COMPMETH_NONE) &&
+                   (!zip_entry_is_tradional_crypto(entry)) &&
+                   (finfo->aes == NULL) );
+    return 1;
+} /* __PHYSFS_ZIP_dataRange */
+
+
 
 static PHYSFS_sint64 zip_find_end_of_central_dir(PHYSFS_Io *io, PHYSFS_sint64 *len)
 {
@@ -740,32 +874,43 @@ static int isZip(PHYSFS_Io *io)
 } /* isZip */
 
 
-/* Find the ZIPentry for a path in platform-independent notation. */
+/*
+ * Find the ZIPentry for a path in platform-independent notation. The
+ *  pointer is good until more entries are added to the archive.
+ */
 static ZIPentry *zip_find_entry(ZIPinfo *info, const char *path)
 {
+    ZIPentry *entries = info->entries;
+    PHYSFS_uint32 hash;
     PHYSFS_uint32 hashval;
-    ZIPentry *prev = NULL;
-    ZIPentry *retval;
+    PHYSFS_uint32 prev = ZIP_NO_ENTRY;
+    PHYSFS_uint32 i;
 
     if (*path == '\0')
-        return &info->root;
+        return &entries[0];
 
-    hashval = zip_hash_string(info, path);
-    for (retval = info->hash[hashval]; retval; retval = retval->hashnext)
+    __PHYSFS_statAdd(info->stats, PHYSFS_STAT_LOOKUPS, 1);
+
+    hash = zip_hash_string(path);
+    hashval = hash % info->hashBuckets;
+    for (i = info->hash[hashval]; i != ZIP_NO_ENTRY; i = entries[i].hashnext)
     {
-        if (__PHYSFS_utf8stricmp(retval->name, path) == 0)
+        ZIPentry *retval = &entries[i];
+        __PHYSFS_statAdd(info->stats, PHYSFS_STAT_LOOKUP_PROBES, 1);
+        if ((retval->hash == hash) &&
+            (__PHYSFS_utf8stricmp(zip_entry_name(info, retval), path) == 0))
         {
-            if (prev != NULL)  /* move this to the front of the list */
+            if (prev != ZIP_NO_ENTRY)  /* move this to the front of the list */
             {
-                prev->hashnext = retval->hashnext;
+                entries[prev].hashnext = retval->hashnext;
                 retval->hashnext = info->hash[hashval];
-                info->hash[hashval] = retval;
+                info->hash[hashval] = i;
             } /* if */
 
             return retval;
         } /* if */
 
-        prev = retval;
+        prev = i;
     } /* for */
 
     BAIL_MACRO(PHYSFS_ERR_NOT_FOUND, NULL);
@@ -867,8 +1012,8 @@ static ZIPentry *zip_follow_symlink(PHYSFS_Io *io, ZIPinfo *info, char *path)
             entry = NULL;
         else
         {
-            if (entry->symlink != NULL)
-                entry = entry->symlink;
+            if (entry->symlink != ZIP_NO_ENTRY)
+                entry = &info->entries[entry->symlink];
         } /* else */
     } /* if */
 
@@ -879,6 +1024,7 @@ static ZIPentry *zip_follow_symlink(PHYSFS_Io *io, ZIPinfo *info, char *path)
 static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
 {
     const PHYSFS_uint64 size = entry->uncompressed_size;
+    ZIPentry *target = NULL;
     char *path = NULL;
     int rc = 0;
 
@@ -927,20 +1073,23 @@ static int zip_resolve_symlink(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
     {
         path[entry->uncompressed_size] = '\0';    /* null-terminate it. */
         zip_convert_dos_path(entry, path);
-        entry->symlink = zip_follow_symlink(io, info, path);
+        target = zip_follow_symlink(io, info, path);
+        if (target != NULL)
+            entry->symlink = (PHYSFS_uint32) (target - info->entries);
     } /* else */
 
     __PHYSFS_smallFree(path);
 
-    return (entry->symlink != NULL);
+    return (entry->symlink != ZIP_NO_ENTRY);
 } /* zip_resolve_symlink */
 
 
 /*
  * Parse the local file header of an entry, and update entry->offset.
  */
-static int zip_parse_local(PHYSFS_Io *io, ZIPentry *entry)
+static int zip_parse_local(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
 {
+    ZIP_AES_Data *aes = zip_entry_aes(info, entry);
     PHYSFS_uint32 ui32;
     PHYSFS_uint16 ui16;
     PHYSFS_uint16 fnamelen;
@@ -967,7 +1116,7 @@ static int zip_parse_local(PHYSFS_Io *io, ZIPentry *entry)
     BAIL_IF_MACRO(ui16 != entry->version_needed, PHYSFS_ERR_CORRUPT, 0);
     BAIL_IF_MACRO(!readui16(io, &ui16), ERRPASS, 0);  /* general bits. */
     BAIL_IF_MACRO(!readui16(io, &ui16), ERRPASS, 0);
-    BAIL_IF_MACRO(ZIP_IS_AES(entry) && !ui16 != entry->compression_method, PHYSFS_ERR_CORRUPT, 0);
+    BAIL_IF_MACRO(ZIP_IS_AES(aes) && !ui16 != entry->compression_method, PHYSFS_ERR_CORRUPT, 0);
     BAIL_IF_MACRO(!readui32(io, &ui32), ERRPASS, 0);  /* date/time */
     BAIL_IF_MACRO(!readui32(io, &ui32), ERRPASS, 0);
     BAIL_IF_MACRO(ui32 && (ui32 != entry->crc), PHYSFS_ERR_CORRUPT, 0);
@@ -985,38 +1134,38 @@ static int zip_parse_local(PHYSFS_Io *io, ZIPentry *entry)
 
     entry->offset += fnamelen + extralen + 30;
 
-    if (ZIP_IS_AES(entry)) {
+    if (ZIP_IS_AES(aes)) {
         int i;
         BAIL_IF_MACRO(COMPMETH_NONE != entry->compression_method, PHYSFS_ERR_CORRUPT, 0);
         BAIL_IF_MACRO(!io->seek(io, entry->offset), PHYSFS_ERR_CORRUPT, 0);
 
         /* Read Salt value (8, 12 or 16 bytes) */
-        if (entry->aes_data.key_strength == ZIP_AES_128_BITS) {
+        if (aes->key_strength == ZIP_AES_128_BITS) {
             for (i = 0; i < 8; i++)
             {
                 BAIL_IF_MACRO(!readui8(io, &ui8), PHYSFS_ERR_CORRUPT, 0);
-                entry->aes_data.salt[i] = ui8;
+                aes->salt[i] = ui8;
             }
             entry->offset += 8;
         }
-        if (entry->aes_data.key_strength == ZIP_AES_192_BITS) {
+        if (aes->key_strength == ZIP_AES_192_BITS) {
             for (i = 0; i < 12; i++)
             {
                 BAIL_IF_MACRO(!readui8(io, &ui8), PHYSFS_ERR_CORRUPT, 0);
-                entry->aes_data.salt[i] = ui8;
+                aes->salt[i] = ui8;
             }
             entry->offset += 12;
         }
-        if (entry->aes_data.key_strength == ZIP_AES_256_BITS) {
+        if (aes->key_strength == ZIP_AES_256_BITS) {
             for (i = 0; i < 16; i++)
             {
                 BAIL_IF_MACRO(!readui8(io, &ui8), PHYSFS_ERR_CORRUPT, 0);
-                entry->aes_data.salt[i] = ui8;
+                aes->salt[i] = ui8;
             }
             entry->offset += 16;
         }
 
-        BAIL_IF_MACRO(!readui16(io, &entry->aes_data.pass_verification), PHYSFS_ERR_CORRUPT, 0);
+        BAIL_IF_MACRO(!readui16(io, &aes->pass_verification), PHYSFS_ERR_CORRUPT, 0);
         entry->offset += 2;
         /* FIXME save auth code and check integrity */
         /* Lets ignore the CRC and Auth code for simplicity */
@@ -1052,7 +1201,7 @@ static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
     {
         entry->resolved = ZIP_RESOLVING;
 
-        retval = zip_parse_local(io, entry);
+        retval = zip_parse_local(io, info, entry);
         if (retval)
         {
             /*
@@ -1074,73 +1223,132 @@ static int zip_resolve(PHYSFS_Io *io, ZIPinfo *info, ZIPentry *entry)
 } /* zip_resolve */
 
 
-static int zip_hash_entry(ZIPinfo *info, ZIPentry *entry);
-
-/* Fill in missing parent directories. */
-static ZIPentry *zip_hash_ancestors(ZIPinfo *info, char *name)
+/* Reserve room for a (len) byte string; returns its offset, or 0 on error. */
+static PHYSFS_uint32 zip_alloc_string(ZIPinfo *info, const size_t len)
 {
-    ZIPentry *retval = &info->root;
-    char *sep = strrchr(name, '/');
+    const PHYSFS_uint64 needed = ((PHYSFS_uint64) info->stringsLen) + len + 1;
+    PHYSFS_uint32 retval;
 
-    if (sep)
+    if (needed > info->stringsAlloc)
     {
-        const size_t namelen = (sep - name) +1;
+        PHYSFS_uint64 newalloc = ((PHYSFS_uint64) info->stringsAlloc) * 2;
+        void *ptr;
+
+        if (newalloc < needed)
+            newalloc = needed;
+        if (newalloc > 0xFFFFFFFF)
+            newalloc = 0xFFFFFFFF;
+        BAIL_IF_MACRO(needed > newalloc, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+        ptr = allocator.Realloc(info->strings, newalloc);
+        BAIL_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+        info->strings = (char *) ptr;
+        info->stringsAlloc = (PHYSFS_uint32) newalloc;
+    } /* if */
 
-        *sep = '\0';  /* chop off last piece. */
-        retval = zip_find_entry(info, name);
-        *sep = '/';
+    retval = info->stringsLen;
+    info->strings[retval + len] = '\0';
+    info->stringsLen = (PHYSFS_uint32) needed;
+    return retval;
+} /* zip_alloc_string */
 
-        if (retval != NULL)
-        {
-            if (retval->resolved != ZIP_DIRECTORY)
-                BAIL_MACRO(PHYSFS_ERR_CORRUPT, NULL);
-            return retval;  /* already hashed. */
-        } /* if */
 
-        /* okay, this is a new dir. Build and hash us. */
-        retval = (ZIPentry *) allocator.Malloc(sizeof (ZIPentry) + namelen);
-        BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-        memset(retval, '\0', sizeof (*retval));
-        retval->name = ((char *) retval) + sizeof (ZIPentry);
-        memcpy(retval->name, name, namelen);
-        retval->name[namelen - 1] = '\0';
-        retval->resolved = ZIP_DIRECTORY;
-        if (!zip_hash_entry(info, retval))
-        {
-            allocator.Free(retval);
-            return NULL;
-        } /* if */
-    } /* else */
+/* Append an entry to the archive's table; returns its index. */
+static PHYSFS_uint32 zip_alloc_entry(ZIPinfo *info, const ZIPentry *entry)
+{
+    if (info->entryCount == info->entryAlloc)
+    {
+        PHYSFS_uint64 newalloc = ((PHYSFS_uint64) info->entryAlloc) * 3 / 2;
+        void *ptr;
+
+        if (newalloc < info->entryAlloc + 16)
+            newalloc = info->entryAlloc + 16;
+        if (newalloc >= ZIP_NO_ENTRY)
+            newalloc = ZIP_NO_ENTRY - 1;
+        BAIL_IF_MACRO(newalloc <= info->entryCount, PHYSFS_ERR_OUT_OF_MEMORY, ZIP_NO_ENTRY);
+
+        ptr = allocator.Realloc(info->entries, newalloc * sizeof (ZIPentry));
+        BAIL_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, ZIP_NO_ENTRY);
+        info->entries = (ZIPentry *) ptr;
+        info->entryAlloc = (PHYSFS_uint32) newalloc;
+    } /* if */
 
-    return retval;
+    memcpy(&info->entries[info->entryCount], entry, sizeof (ZIPentry));
+    return info->entryCount++;
+} /* zip_alloc_entry */
+
+
+static PHYSFS_uint32 zip_hash_entry(ZIPinfo *info, const ZIPentry *entry);
+
+/*
+ * Fill in missing parent directories of the entry named at (name) in the
+ *  string table. Returns the parent's index, or ZIP_NO_ENTRY on error.
+ */
+static PHYSFS_uint32 zip_hash_ancestors(ZIPinfo *info, const PHYSFS_uint32 name)
+{
+    const char *sep = strrchr(info->strings + name, '/');
+    const ZIPentry *find;
+    PHYSFS_uint32 dirname;
+    size_t namelen;
+    ZIPentry dir;
+
+    if (!sep)
+        return 0;  /* the root. */
+
+    namelen = (size_t) (sep - (info->strings + name));
+    dirname = zip_alloc_string(info, namelen);
+    BAIL_IF_MACRO(!dirname, ERRPASS, ZIP_NO_ENTRY);
+    memcpy(info->strings + dirname, info->strings + name, namelen);
+
+    find = zip_find_entry(info, info->strings + dirname);
+    if (find != NULL)
+    {
+        info->stringsLen = dirname;  /* don't need the copy after all. */
+        BAIL_IF_MACRO(find->resolved != ZIP_DIRECTORY, PHYSFS_ERR_CORRUPT, ZIP_NO_ENTRY);
+        return (PHYSFS_uint32) (find - info->entries);  /* already hashed. */
+    } /* if */
+
+    /* okay, this is a new dir. Build and hash us. */
+    memset(&dir, '\0', sizeof (dir));
+    dir.name = dirname;
+    dir.symlink = dir.hashnext = dir.children = dir.sibling = ZIP_NO_ENTRY;
+    dir.aes = ZIP_NO_ENTRY;
+    dir.resolved = ZIP_DIRECTORY;
+    dir.implicit = 1;
+    return zip_hash_entry(info, &dir);
 } /* zip_hash_ancestors */
 
 
-static int zip_hash_entry(ZIPinfo *info, ZIPentry *entry)
+/*
+ * Copy (entry) into the archive's table, and link it into the hash and its
+ *  parent directory. Returns its index, or ZIP_NO_ENTRY on error.
+ */
+static PHYSFS_uint32 zip_hash_entry(ZIPinfo *info, const ZIPentry *entry)
 {
     PHYSFS_uint32 hashval;
-    ZIPentry *parent;
+    PHYSFS_uint32 parent;
+    PHYSFS_uint32 retval;
+    ZIPentry *ptr;
 
-    assert(!zip_find_entry(info, entry->name));  /* checked elsewhere */
+    assert(!zip_find_entry(info, zip_entry_name(info, entry)));  /* checked elsewhere */
 
     parent = zip_hash_ancestors(info, entry->name);
-    if (!parent)
-        return 0;
+    if (parent == ZIP_NO_ENTRY)
+        return ZIP_NO_ENTRY;
 
-    size_t len = strlen(entry->name);
-    if (entry->name[len -1] == '/') {
+    retval = zip_alloc_entry(info, entry);
+    if (retval == ZIP_NO_ENTRY)
+        return ZIP_NO_ENTRY;
 
-        int i = 0;
-    }
-
-
-    hashval = zip_hash_string(info, entry->name);
-    entry->hashnext = info->hash[hashval];
-    info->hash[hashval] = entry;
+    ptr = &info->entries[retval];
+    ptr->hash = zip_hash_string(zip_entry_name(info, ptr));
+    hashval = ptr->hash % info->hashBuckets;
+    ptr->hashnext = info->hash[hashval];
+    info->hash[hashval] = retval;
 
-    entry->sibling = parent->children;
-    parent->children = entry;
-    return 1;
+    ptr->sibling = info->entries[parent].children;
+    info->entries[parent].children = retval;
+    return retval;
 } /* zip_hash_entry */
 
 
@@ -1148,7 +1356,7 @@ static int zip_entry_is_symlink(const ZIPentry *entry)
 {
     return ((entry->resolved == ZIP_UNRESOLVED_SYMLINK) ||
             (entry->resolved == ZIP_BROKEN_SYMLINK) ||
-            (entry->symlink));
+            (entry->symlink != ZIP_NO_ENTRY));
 } /* zip_entry_is_symlink */
 
 
@@ -1219,166 +1427,146 @@ static PHYSFS_sint64 zip_dos_time_to_physfs_time(PHYSFS_uint32 dostime)
 } /* zip_dos_time_to_physfs_time */
 
 
-static ZIPentry *zip_load_entry(PHYSFS_Io *io, const int zip64,
-                                const PHYSFS_uint64 ofs_fixup)
+/*
+ * Read the next central directory record into (entry), and its name into
+ *  the archive's string table. If it has AES data, that goes in (aes).
+ */
+static int zip_load_entry(ZIPinfo *info, const PHYSFS_uint64 ofs_fixup,
+                          ZIPentry *entry, ZIP_AES_Data *aes)
 {
-    ZIPentry entry;
-    ZIPentry *retval = NULL;
+    PHYSFS_Io *io = info->io;
+    PHYSFS_uint8 rec[46];  /* fixed-size part of a central dir record. */
     PHYSFS_uint16 fnamelen, extralen, commentlen;
     PHYSFS_uint32 external_attr;
     PHYSFS_uint32 starting_disk;
     PHYSFS_uint64 offset;
-    PHYSFS_uint16 ui16;
-    PHYSFS_uint32 ui32;
     PHYSFS_sint64 si64;
-    //PHYSFS_uint32 entrySize;
+    char *name;
+
+    memset(entry, '\0', sizeof (*entry));
+    memset(aes, '\0', sizeof (*aes));
+    entry->symlink = entry->hashnext = ZIP_NO_ENTRY;
+    entry->children = entry->sibling = ZIP_NO_ENTRY;
+    entry->aes = ZIP_NO_ENTRY;
 
-    memset(&entry, '\0', sizeof (entry));
+    /* One read for the whole record, instead of one per field. */
+    BAIL_IF_MACRO(!__PHYSFS_readAll(io, rec, sizeof (rec)), ERRPASS, 0);
 
     /* sanity check with central directory signature... */
-    if (!readui32(io, &ui32)) return NULL;
-    BAIL_IF_MACRO(ui32 != ZIP_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, NULL);
+    BAIL_IF_MACRO(getui32(rec) != ZIP_CENTRAL_DIR_SIG, PHYSFS_ERR_CORRUPT, 0);
 
     /* Get the pertinent parts of the record... */
-    if (!readui16(io, &entry.version)) return NULL;
-    if (!readui16(io, &entry.version_needed)) return NULL;
-    if (!readui16(io, &entry.general_bits)) return NULL;  /* general bits */
-    if (!readui16(io, &entry.compression_method)) return NULL;
-    if (!readui32(io, &entry.dos_mod_time)) return NULL;
-    entry.last_mod_time = zip_dos_time_to_physfs_time(entry.dos_mod_time);
-    if (!readui32(io, &entry.crc)) return NULL;
-    if (!readui32(io, &ui32)) return NULL;
-    entry.compressed_size = (PHYSFS_uint64) ui32;
-    if (!readui32(io, &ui32)) return NULL;
-    entry.uncompressed_size = (PHYSFS_uint64) ui32;
-    if (!readui16(io, &fnamelen)) return NULL;
-    if (!readui16(io, &extralen)) return NULL;
-    if (!readui16(io, &commentlen)) return NULL;
-    if (!readui16(io, &ui16)) return NULL;
-    starting_disk = (PHYSFS_uint32) ui16;
-    if (!readui16(io, &ui16)) return NULL;  /* internal file attribs */
-    if (!readui32(io, &external_attr)) return NULL;
-    if (!readui32(io, &ui32)) return NULL;
-    offset = (PHYSFS_uint64) ui32;
-
-    retval = (ZIPentry *) allocator.Malloc(sizeof (ZIPentry) + fnamelen + 1);
-    BAIL_IF_MACRO(retval == NULL, PHYSFS_ERR_OUT_OF_MEMORY, 0);
-    memcpy(retval, &entry, sizeof (*retval));
-    retval->name = ((char *) retval) + sizeof (ZIPentry);
-
-    if (!__PHYSFS_readAll(io, retval->name, fnamelen))
-        goto zip_load_entry_puked;
-
-    retval->name[fnamelen] = '\0';  /* null-terminate the filename. */
-    zip_convert_dos_path(retval, retval->name);
-
-    retval->symlink = NULL;  /* will be resolved later, if necessary. */
-
-    if (retval->name[fnamelen - 1] == '/')
+    entry->version = getui16(rec + 4);
+    entry->version_needed = getui16(rec + 6);
+    entry->general_bits = getui16(rec + 8);
+    entry->compression_method = getui16(rec + 10);
+    entry->dos_mod_time = getui32(rec + 12);
+    entry->crc = getui32(rec + 16);
+    entry->compressed_size = (PHYSFS_uint64) getui32(rec + 20);
+    entry->uncompressed_size = (PHYSFS_uint64) getui32(rec + 24);
+    fnamelen = getui16(rec + 28);
+    extralen = getui16(rec + 30);
+    commentlen = getui16(rec + 32);
+    starting_disk = (PHYSFS_uint32) getui16(rec + 34);
+    /* rec + 36 is internal file attribs */
+    external_attr = getui32(rec + 38);
+    offset = (PHYSFS_uint64) getui32(rec + 42);
+
+    entry->name = zip_alloc_string(info, fnamelen);
+    BAIL_IF_MACRO(!entry->name, ERRPASS, 0);
+    name = info->strings + entry->name;
+    BAIL_IF_MACRO(!__PHYSFS_readAll(io, name, fnamelen), ERRPASS, 0);
+    zip_convert_dos_path(entry, name);
+
+    if ((fnamelen > 0) && (name[fnamelen - 1] == '/'))
     {
-        retval->name[fnamelen - 1] = '\0';
-        retval->resolved = ZIP_DIRECTORY;
+        name[fnamelen - 1] = '\0';
+        entry->resolved = ZIP_DIRECTORY;
     } /* if */
     else
     {
-        retval->resolved = (zip_has_symlink_attr(&entry, external_attr)) ?
+        entry->resolved = (zip_has_symlink_attr(entry, external_attr)) ?
                                 ZIP_UNRESOLVED_SYMLINK : ZIP_UNRESOLVED_FILE;
     } /* else */
 
-    si64 = io->tell(io);
-    if (si64 == -1)
-        goto zip_load_entry_puked;
-
     /*
      * The actual sizes didn't fit in 32-bits; look for the Zip64
      *  extended information extra field...
      */
+    if ((extralen > 0) || (commentlen > 0))
     {
-        int found = 0;
         PHYSFS_uint16 sig, len;
         PHYSFS_uint16 extralen2 = extralen;
         PHYSFS_sint64 si64_2;
+
+        si64 = io->tell(io);
+        BAIL_IF_MACRO(si64 == -1, ERRPASS, 0);
+
         while (extralen2 > 4)
         {
-            if (!readui16(io, &sig))
-                goto zip_load_entry_puked;
-            else if (!readui16(io, &len))
-                goto zip_load_entry_puked;
+            BAIL_IF_MACRO(!readui16(io, &sig), ERRPASS, 0);
+            BAIL_IF_MACRO(!readui16(io, &len), ERRPASS, 0);
 
             si64_2 = io->tell(io) + len;
             extralen2 -= 4 + len;
             if (sig == ZIP64_EXTENDED_INFO_EXTRA_FIELD_SIG)
             {
-                if (retval->uncompressed_size == 0xFFFFFFFF)
+                if (entry->uncompressed_size == 0xFFFFFFFF)
                 {
-                    GOTO_IF_MACRO(len < 8, PHYSFS_ERR_CORRUPT, zip_load_entry_puked);
-                    if (!readui64(io, &retval->uncompressed_size))
-                        goto zip_load_entry_puked;
+                    BAIL_IF_MACRO(len < 8, PHYSFS_ERR_CORRUPT, 0);
+                    BAIL_IF_MACRO(!readui64(io, &entry->uncompressed_size), ERRPASS, 0);
                     len -= 8;
                 } /* if */
 
-                if (retval->compressed_size == 0xFFFFFFFF)
+                if (entry->compressed_size == 0xFFFFFFFF)
                 {
-                    GOTO_IF_MACRO(len < 8, PHYSFS_ERR_CORRUPT, zip_load_entry_puked);
-                    if (!readui64(io, &retval->compressed_size))
-                        goto zip_load_entry_puked;
+                    BAIL_IF_MACRO(len < 8, PHYSFS_ERR_CORRUPT, 0);
+                    BAIL_IF_MACRO(!readui64(io, &entry->compressed_size), ERRPASS, 0);
                     len -= 8;
                 } /* if */
 
                 if (offset == 0xFFFFFFFF)
                 {
-                    GOTO_IF_MACRO(len < 8, PHYSFS_ERR_CORRUPT, zip_load_entry_puked);
-                    if (!readui64(io, &offset))
-                        goto zip_load_entry_puked;
+                    BAIL_IF_MACRO(len < 8, PHYSFS_ERR_CORRUPT, 0);
+                    BAIL_IF_MACRO(!readui64(io, &offset), ERRPASS, 0);
                     len -= 8;
                 } /* if */
 
                 if (starting_disk == 0xFFFFFFFF)
                 {
-                    GOTO_IF_MACRO(len < 8, PHYSFS_ERR_CORRUPT, zip_load_entry_puked);
-                    if (!readui32(io, &starting_disk))
-                        goto zip_load_entry_puked;
+                    BAIL_IF_MACRO(len < 8, PHYSFS_ERR_CORRUPT, 0);
+                    BAIL_IF_MACRO(!readui32(io, &starting_disk), ERRPASS, 0);
                     len -= 4;
                 } /* if */
 
-                GOTO_IF_MACRO(len != 0, PHYSFS_ERR_CORRUPT, zip_load_entry_puked);
+                BAIL_IF_MACRO(len != 0, PHYSFS_ERR_CORRUPT, 0);
             } /* if */
-            else if (sig == ZIP_AES_HEADER_EXTRA_FIELD_SIG && retval->compression_method == COMPMETH_AES) {
+            else if (sig == ZIP_AES_HEADER_EXTRA_FIELD_SIG && entry->compression_method == COMPMETH_AES) {
                 PHYSFS_uint16 zip_vendor; // extra_header
                 BAIL_IF_MACRO(!readui16(io, &zip_vendor), PHYSFS_ERR_CORRUPT, 0);
 
                 BAIL_IF_MACRO(((zip_vendor != ZIP_AE1_VENDOR_VERSION) && (zip_vendor != ZIP_AE2_VENDOR_VERSION)), PHYSFS_ERR_CORRUPT, 0);
                 BAIL_IF_MACRO(!readui16(io, &zip_vendor), PHYSFS_ERR_CORRUPT, 0); /* 'AE' */
                 BAIL_IF_MACRO(zip_vendor != ZIP_AES_VENDOR_ID, PHYSFS_ERR_CORRUPT, 0);
-                BAIL_IF_MACRO(!readui8(io, &retval->aes_data.key_strength), PHYSFS_ERR_CORRUPT, 0);		/* Key Strength */
-                BAIL_IF_MACRO(!readui16(io, &retval->aes_data.compression), PHYSFS_ERR_CORRUPT, 0);  /* Compression method */
-                BAIL_IF_MACRO(retval->aes_data.compression != 0, PHYSFS_ERR_CORRUPT, 0); /* Not supported compression */
-                retval->compression_method = COMPMETH_NONE;
+                BAIL_IF_MACRO(!readui8(io, &aes->key_strength), PHYSFS_ERR_CORRUPT, 0);		/* Key Strength */
+                BAIL_IF_MACRO(!readui16(io, &aes->compression), PHYSFS_ERR_CORRUPT, 0);  /* Compression method */
+                BAIL_IF_MACRO(aes->compression != 0, PHYSFS_ERR_CORRUPT, 0); /* Not supported compression */
+                entry->compression_method = COMPMETH_NONE;
             }
             else {
-                if (!io->seek(io, si64_2))
-                    goto zip_load_entry_puked;
+                BAIL_IF_MACRO(!io->seek(io, si64_2), ERRPASS, 0);
             }
-            
-            //break;
         } /* while */
 
-        
+        /* seek to the start of the next entry in the central directory... */
+        BAIL_IF_MACRO(!io->seek(io, si64 + extralen + commentlen), ERRPASS, 0);
     } /* if */
 
-    GOTO_IF_MACRO(starting_disk != 0, PHYSFS_ERR_CORRUPT, zip_load_entry_puked);
-
-    retval->offset = offset + ofs_fixup;
-
-    /* seek to the start of the next entry in the central directory... */
-    if (!io->seek(io, si64 + extralen + commentlen))
-        goto zip_load_entry_puked;
+    BAIL_IF_MACRO(starting_disk != 0, PHYSFS_ERR_CORRUPT, 0);
 
-    return retval;  /* success. */
+    entry->offset = offset + ofs_fixup;
 
-zip_load_entry_puked:
-    allocator.Free(retval);
-    return NULL;  /* failure. */
+    return 1;  /* success. */
 } /* zip_load_entry */
 
 
@@ -1389,7 +1577,6 @@ static int zip_load_entries(ZIPinfo *info,
                             const PHYSFS_uint64 entry_count)
 {
     PHYSFS_Io *io = info->io;
-    const int zip64 = info->zip64;
     PHYSFS_uint64 i;
 
     if (!io->seek(io, central_ofs))
@@ -1397,42 +1584,50 @@ static int zip_load_entries(ZIPinfo *info,
 
     for (i = 0; i < entry_count; i++)
     {
-        ZIPentry *entry = zip_load_entry(io, zip64, data_ofs);
+        ZIPentry entry;
+        ZIP_AES_Data aes;
         ZIPentry *find;
 
-        if (!entry)
+        if (!zip_load_entry(info, data_ofs, &entry, &aes))
             return 0;
 
-        find = zip_find_entry(info, entry->name);
+        find = zip_find_entry(info, zip_entry_name(info, &entry));
         if (find != NULL)  /* duplicate? */
         {
-            if (find->last_mod_time != 0)  /* duplicate? */
+            BAIL_IF_MACRO(!find->implicit, PHYSFS_ERR_CORRUPT, 0);
+
+            /* we filled this in as a placeholder. Update it. */
+            find->offset = entry.offset;
+            find->version = entry.version;
+            find->version_needed = entry.version_needed;
+            find->compression_method = entry.compression_method;
+            find->crc = entry.crc;
+            find->compressed_size = entry.compressed_size;
+            find->uncompressed_size = entry.uncompressed_size;
+            find->dos_mod_time = entry.dos_mod_time;
+            find->implicit = 0;
+            info->stringsLen = entry.name;  /* already have the name. */
+            continue;
+        } /* if */
+
+        if (aes.key_strength != 0)  /* rare, so these go in a side table. */
+        {
+            if (info->aesCount == info->aesAlloc)
             {
-                allocator.Free(entry);
-                BAIL_MACRO(PHYSFS_ERR_CORRUPT, 0);
+                const PHYSFS_uint32 newalloc = (info->aesAlloc * 2) + 8;
+                void *ptr = allocator.Realloc(info->aes, newalloc * sizeof (ZIP_AES_Data));
+                BAIL_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+                info->aes = (ZIP_AES_Data *) ptr;
+                info->aesAlloc = newalloc;
             } /* if */
-            else  /* we filled this in as a placeholder. Update it. */
-            {
-                find->offset = entry->offset;
-                find->version = entry->version;
-                find->version_needed = entry->version_needed;
-                find->compression_method = entry->compression_method;
-                find->crc = entry->crc;
-                find->compressed_size = entry->compressed_size;
-                find->uncompressed_size = entry->uncompressed_size;
-                find->last_mod_time = entry->last_mod_time;
-                allocator.Free(entry);
-                continue;
-            } /* else */
+            memcpy(&info->aes[info->aesCount], &aes, sizeof (aes));
+            entry.aes = info->aesCount++;
         } /* if */
 
-        if (!zip_hash_entry(info, entry))
-        {
-            allocator.Free(entry);
+        if (zip_hash_entry(info, &entry) == ZIP_NO_ENTRY)
             return 0;
-        } /* if */
 
-        if (zip_entry_is_tradional_crypto(entry))
+        if (zip_entry_is_tradional_crypto(&entry))
             info->has_crypto = 1;
     } /* for */
 
@@ -1713,21 +1908,72 @@ static int zip_parse_end_of_central_dir(ZIPinfo *info,
 } /* zip_parse_end_of_central_dir */
 
 
-static int zip_alloc_hashtable(ZIPinfo *info, const PHYSFS_uint64 entry_count)
+static int zip_alloc_tables(ZIPinfo *info, const PHYSFS_uint64 entry_count)
 {
+    ZIPentry root;
     size_t alloclen;
 
+    /* (entry_count) is untrusted, so just use it as a hint past a point. */
+    const PHYSFS_uint64 hint = (entry_count < 0x100000) ? entry_count : 0x100000;
+
+    BAIL_IF_MACRO(entry_count >= ZIP_NO_ENTRY, PHYSFS_ERR_CORRUPT, 0);
+
     info->hashBuckets = (size_t) (entry_count / 5);
     if (!info->hashBuckets)
         info->hashBuckets = 1;
 
-    alloclen = info->hashBuckets * sizeof (ZIPentry *);
-    info->hash = (ZIPentry **) allocator.Malloc(alloclen);
+    alloclen = info->hashBuckets * sizeof (PHYSFS_uint32);
+    info->hash = (PHYSFS_uint32 *) allocator.Malloc(alloclen);
     BAIL_IF_MACRO(!info->hash, PHYSFS_ERR_OUT_OF_MEMORY, 0);
-    memset(info->hash, '\0', alloclen);
+    memset(info->hash, 0xFF, alloclen);  /* all ZIP_NO_ENTRY. */
+
+    /* one slot per entry, plus the root; implicit dirs will grow it. */
+    info->entryAlloc = (PHYSFS_uint32) hint + 1;
+    info->entries = (ZIPentry *) allocator.Malloc(info->entryAlloc * sizeof (ZIPentry));
+    BAIL_IF_MACRO(!info->entries, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    info->stringsAlloc = (PHYSFS_uint32) ((hint * 32) + 1);
+    info->strings = (char *) allocator.Malloc(info->stringsAlloc);
+    BAIL_IF_MACRO(!info->strings, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    info->strings[0] = '\0';  /* the root's name. */
+    info->stringsLen = 1;
+
+    memset(&root, '\0', sizeof (root));
+    root.symlink = root.hashnext = root.children = root.sibling = ZIP_NO_ENTRY;
+    root.aes = ZIP_NO_ENTRY;
+    root.resolved = ZIP_DIRECTORY;
+    root.implicit = 1;
+    zip_alloc_entry(info, &root);  /* can't fail, we have the space. */
 
     return 1;
-} /* zip_alloc_hashtable */
+} /* zip_alloc_tables */
+
+
+/* Give back what we overallocated while loading; the tables are final now. */
+static void zip_trim_tables(ZIPinfo *info)
+{
+    void *ptr;
+
+    if (info->entryCount < info->entryAlloc)
+    {
+        ptr = allocator.Realloc(info->entries, info->entryCount * sizeof (ZIPentry));
+        if (ptr != NULL)
+        {
+            info->entries = (ZIPentry *) ptr;
+            info->entryAlloc = info->entryCount;
+        } /* if */
+    } /* if */
+
+    if (info->stringsLen < info->stringsAlloc)
+    {
+        ptr = allocator.Realloc(info->strings, info->stringsLen);
+        if (ptr != NULL)
+        {
+            info->strings = (char *) ptr;
+            info->stringsAlloc = info->stringsLen;
+        } /* if */
+    } /* if */
+} /* zip_trim_tables */
 
 static void ZIP_closeArchive(void *opaque);
 
@@ -1746,17 +1992,19 @@ static void *ZIP_openArchive(PHYSFS_Io *io, const char *name, int forWriting)
     info = (ZIPinfo *) allocator.Malloc(sizeof (ZIPinfo));
     BAIL_IF_MACRO(!info, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
     memset(info, '\0', sizeof (ZIPinfo));
-    info->root.resolved = ZIP_DIRECTORY;
     info->io = io;
+    info->stats = __PHYSFS_statsCurrent();
 
     if (!zip_parse_end_of_central_dir(info, &dstart, &cdir_ofs, &entry_count))
         goto ZIP_openarchive_failed;
-    else if (!zip_alloc_hashtable(info, entry_count))
+    else if (!zip_alloc_tables(info, entry_count))
         goto ZIP_openarchive_failed;
     else if (!zip_load_entries(info, dstart, cdir_ofs, entry_count))
         goto ZIP_openarchive_failed;
 
-    assert(info->root.sibling == NULL);
+    zip_trim_tables(info);
+
+    assert(info->entries[0].sibling == ZIP_NO_ENTRY);
     return info;
 
 ZIP_openarchive_failed:
@@ -1775,18 +2023,63 @@ static void ZIP_enumerateFiles(void *opaque, const char *dname,
     const ZIPentry *entry = zip_find_entry(info, dname);
     if (entry && (entry->resolved == ZIP_DIRECTORY))
     {
-        for (entry = entry->children; entry; entry = entry->sibling)
+        PHYSFS_uint32 i;
+        for (i = entry->children; i != ZIP_NO_ENTRY; i = entry->sibling)
         {
-            PHYSFS_Stat stat = {0};
-            stat.filesize = -1;
-            stat.filetype = (entry->resolved == ZIP_DIRECTORY) ? PHYSFS_FILETYPE_DIRECTORY : PHYSFS_FILETYPE_REGULAR;
-            const char *ptr = strrchr(entry->name, '/');
-            cb(callbackdata, origdir, ptr ? ptr + 1 : entry->name, &stat);
+            const char *name;
+            const char *ptr;
+            PHYSFS_Stat stat;
+            entry = &info->entries[i];
+            name = zip_entry_name(info, entry);
+            ptr = strrchr(name, '/');
+            ZIP_statEntry(entry, &stat);
+            cb(callbackdata, origdir, ptr ? ptr + 1 : name, &stat);
         } /* for */
     } /* if */
 } /* ZIP_enumerateFiles */
 
 
+/* Returns zero if (cb) asked us to stop. */
+static int zip_walk_dir(const ZIPinfo *info, const ZIPentry *dir,
+                        PHYSFS_WalkCallback cb, void *callbackdata)
+{
+    const char *dname = zip_entry_name(info, dir);
+    PHYSFS_uint32 i;
+
+    for (i = dir->children; i != ZIP_NO_ENTRY; i = info->entries[i].sibling)
+    {
+        const ZIPentry *entry = &info->entries[i];
+        const char *name = zip_entry_name(info, entry);
+        const char *ptr = strrchr(name, '/');
+        PHYSFS_Stat stat;
+        int rc;
+
+        ZIP_statEntry(entry, &stat);
+        rc = cb(callbackdata, dname, ptr ? ptr + 1 : name, &stat);
+        if (rc == PHYSFS_WALK_STOP)
+            return 0;
+        else if ((rc == PHYSFS_WALK_CONTINUE) && (entry->resolved == ZIP_DIRECTORY))
+        {
+            if (!zip_walk_dir(info, entry, cb, callbackdata))
+                return 0;
+        } /* else if */
+    } /* for */
+
+    return 1;
+} /* zip_walk_dir */
+
+
+static int ZIP_walk(void *opaque, const char *dname,
+                    PHYSFS_WalkCallback cb, void *callbackdata)
+{
+    ZIPinfo *info = ((ZIPinfo *) opaque);
+    const ZIPentry *entry = zip_find_entry(info, dname);
+    if ((entry == NULL) || (entry->resolved != ZIP_DIRECTORY))
+        return 1;  /* nothing to walk. */
+    return zip_walk_dir(info, entry, cb, callbackdata);
+} /* ZIP_walk */
+
+
 static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, ZIPinfo *inf, ZIPentry *entry)
 {
     int success;
@@ -1799,8 +2092,12 @@ static PHYSFS_Io *zip_get_io(PHYSFS_Io *io, ZIPinfo *inf, ZIPentry *entry)
     success = (inf == NULL) || zip_resolve(retval, inf, entry);
     if (success)
     {
-        PHYSFS_sint64 offset;
-        offset = ((entry->symlink) ? entry->symlink->offset : entry->offset);
+        PHYSFS_sint64 offset = entry->offset;
+        if (entry->symlink != ZIP_NO_ENTRY)
+        {
+            assert(inf != NULL);  /* duplicates only get resolved entries. */
+            offset = inf->entries[entry->symlink].offset;
+        } /* if */
         success = retval->seek(retval, offset);
     } /* if */
 
@@ -1842,24 +2139,29 @@ static PHYSFS_Io *ZIP_openRead(void *opaque, const char *filename)
 
     BAIL_IF_MACRO(!entry, ERRPASS, NULL);
 
-    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
+    retval = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    GOTO_IF_MACRO(!retval, ERRPASS, ZIP_openRead_failed);
 
-    finfo = (ZIPfileinfo *) allocator.Malloc(sizeof (ZIPfileinfo));
-    GOTO_IF_MACRO(!finfo, PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
+    finfo = (ZIPfileinfo *) __PHYSFS_poolAlloc(&fileInfoPool);
+    GOTO_IF_MACRO(!finfo, ERRPASS, ZIP_openRead_failed);
     memset(finfo, '\0', sizeof (ZIPfileinfo));
 
     io = zip_get_io(info->io, info, entry);
     GOTO_IF_MACRO(!io, ERRPASS, ZIP_openRead_failed);
     finfo->io = io;
-    finfo->entry = ((entry->symlink != NULL) ? entry->symlink : entry);
+    if (entry->symlink != ZIP_NO_ENTRY)
+        finfo->entry = &info->entries[entry->symlink];
+    else
+        finfo->entry = entry;
+    finfo->aes = zip_entry_aes(info, finfo->entry);
+    finfo->stats = info->stats;
     initializeZStream(&finfo->stream);
 
     if (finfo->entry->compression_method != COMPMETH_NONE)
     {
-        finfo->buffer = (PHYSFS_uint8 *) allocator.Malloc(ZIP_READBUFSIZE);
+        finfo->buffer = (PHYSFS_uint8 *) __PHYSFS_poolAlloc(&readBufferPool);
         if (!finfo->buffer)
-            GOTO_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, ZIP_openRead_failed);
+            GOTO_MACRO(ERRPASS, ZIP_openRead_failed);
         else if (zlib_err(inflateInit2(&finfo->stream, -MAX_WBITS)) != Z_OK)
             goto ZIP_openRead_failed;
     } /* if */
@@ -1868,7 +2170,7 @@ static PHYSFS_Io *ZIP_openRead(void *opaque, const char *filename)
         GOTO_IF_MACRO(password != NULL, PHYSFS_ERR_BAD_PASSWORD, ZIP_openRead_failed);
     else
     {
-        if (ZIP_IS_AES(entry)) {
+        if (ZIP_IS_AES(zip_entry_aes(info, entry))) {
             finfo->aes_ctx.encr_pos = AES_BLOCK_SIZE + 1;
         }
         else {
@@ -1894,20 +2196,59 @@ ZIP_openRead_failed:
 
         if (finfo->buffer != NULL)
         {
-            allocator.Free(finfo->buffer);
+            __PHYSFS_poolFree(&readBufferPool, finfo->buffer);
             inflateEnd(&finfo->stream);
         } /* if */
 
-        allocator.Free(finfo);
+        __PHYSFS_poolFree(&fileInfoPool, finfo);
     } /* if */
 
-    if (retval != NULL)
-        allocator.Free(retval);
-
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, retval);
     return NULL;
 } /* ZIP_openRead */
 
 
+/*
+ * An entry we haven't opened yet still points at its local header, and we
+ *  won't know how long that header's extra field is until we read it.
+ *  This is enough for the usual ones; prefetching is only a hint anyhow.
+ */
+#define ZIP_LOCAL_EXTRA_GUESS 256
+
+static int ZIP_locate(void *opaque, const char *name, PHYSFS_DataRange *range)
+{
+    ZIPinfo *info = (ZIPinfo *) opaque;
+    ZIPentry *entry = zip_find_entry(info, name);
+
+    if (entry == NULL)  /* "file$PASSWORD" needs a real open to sort out. */
+        return ((info->has_crypto) && (strchr(name, '$') != NULL)) ? 0 : -1;
+
+    BAIL_IF_MACRO(entry->resolved == ZIP_DIRECTORY, PHYSFS_ERR_NOT_A_FILE, -1);
+
+    if (entry->resolved == ZIP_UNRESOLVED_FILE)  /* take the header, too. */
+    {
+        range->offset = entry->offset;
+        range->len = 30 + strlen(name) +
+                     ZIP_LOCAL_EXTRA_GUESS + entry->compressed_size;
+    } /* if */
+    else if (entry->resolved == ZIP_RESOLVED)
+    {
+        if (entry->symlink != ZIP_NO_ENTRY)
+            entry = &info->entries[entry->symlink];
+        range->offset = entry->offset;
+        range->len = entry->compressed_size;
+    } /* else if */
+    else
+    {
+        return 0;  /* a symlink we haven't followed, or broken: open it. */
+    } /* else */
+
+    range->io = info->io;
+    range->raw = 0;  /* not promising anything; this is just for prefetch. */
+    return 1;
+} /* ZIP_locate */
+
+
 static PHYSFS_Io *ZIP_openWrite(void *opaque, const char *filename)
 {
     BAIL_MACRO(PHYSFS_ERR_READ_ONLY, NULL);
@@ -1930,25 +2271,10 @@ static void ZIP_closeArchive(void *opaque)
     if (info->io)
         info->io->destroy(info->io);
 
-    assert(info->root.sibling == NULL);
-    assert(info->hash || (info->root.children == NULL));
-
-    if (info->hash)
-    {
-        size_t i;
-        for (i = 0; i < info->hashBuckets; i++)
-        {
-            ZIPentry *entry;
-            ZIPentry *next;
-            for (entry = info->hash[i]; entry; entry = next)
-            {
-                next = entry->hashnext;
-                allocator.Free(entry);
-            } /* for */
-        } /* for */
-        allocator.Free(info->hash);
-    } /* if */
-
+    allocator.Free(info->hash);
+    allocator.Free(info->entries);
+    allocator.Free(info->strings);
+    allocator.Free(info->aes);
     allocator.Free(info);
 } /* ZIP_closeArchive */
 
@@ -1989,7 +2315,11 @@ static int ZIP_statEntry(const ZIPentry *entry, PHYSFS_Stat *stat)
         stat->filetype = PHYSFS_FILETYPE_REGULAR;
     } /* else */
 
-    stat->modtime = ((entry) ? entry->last_mod_time : 0);
+    /* converted here, not at mount, since mktime() is slow on big zips. */
+    if (entry->implicit)
+        stat->modtime = 0;
+    else
+        stat->modtime = zip_dos_time_to_physfs_time(entry->dos_mod_time);
     stat->createtime = stat->modtime;
     stat->accesstime = 0;
     stat->readonly = 1; /* .zip files are always read only */
@@ -2024,7 +2354,12 @@ const PHYSFS_Archiver __PHYSFS_Archiver_ZIP =
     ZIP_remove,
     ZIP_mkdir,
     ZIP_stat,
-    ZIP_closeArchive
+    ZIP_closeArchive,
+    ZIP_walk,
+    NULL,  /* enumerateFilesPrefix */
+    ZIP_locate,
+    NULL,  /* enumerateFilesWithStats */
+    NULL  /* openArchiveWithFlags */
 };
 
 #endif  /* defined PHYSFS_SUPPORTS_ZIP */
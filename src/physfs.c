@@ -13,15 +13,29 @@
 
 #define __PHYSICSFS_INTERNAL__
 #include "physfs_internal.h"
-#include <wctype.h>
 
 
+typedef struct
+{
+    PHYSFS_uint32 hash;  /* __PHYSFS_hashString() of (path). */
+    char *path;  /* NULL if this bucket is empty. */
+} VerifiedPath;
+
 typedef struct __PHYSFS_DIRHANDLE__
 {
     void *opaque;  /* Instance data unique to the archiver. */
     char *dirName;  /* Path to archive in platform-dependent notation. */
     char *mountPoint; /* Mountpoint in virtual file tree. */
     const PHYSFS_Archiver *funcs;  /* Ptr to archiver info for this handle. */
+    VerifiedPath *verified;  /* dirs verifyPath() found no symlinks in. */
+    PHYSFS_uint32 verifiedcount;  /* paths in (verified). */
+    PHYSFS_uint32 verifiedbuckets;  /* zero or a power of two. */
+    PHYSFS_uint32 verifiedgen;  /* (verifyGeneration) when it was filled. */
+    PHYSFS_uint32 openFiles;  /* FileHandles from this. Hold openListLock! */
+    int inMemory;  /* mounted with PHYSFS_mountMemory(). */
+    int fromIo;  /* opened from a PHYSFS_Io, so it won't change under us. */
+    __PHYSFS_MemAccount *memory;  /* what this archive has allocated. */
+    __PHYSFS_Stats *stats;  /* what this archive has been doing. */
     struct __PHYSFS_DIRHANDLE__ *next;  /* linked list stuff. */
 } DirHandle;
 
@@ -30,26 +44,41 @@ typedef struct __PHYSFS_FILEHANDLE__
 {
     PHYSFS_Io *io;  /* Instance data unique to the archiver for this file. */
     PHYSFS_uint8 forReading; /* Non-zero if reading, zero if write/append */
-    const DirHandle *dirHandle;  /* Archiver instance that created this */
+    DirHandle *dirHandle;  /* Archiver instance that created this */
     PHYSFS_uint8 *buffer;  /* Buffer, if set (NULL otherwise). Don't touch! */
     PHYSFS_uint32 bufsize;  /* Bufsize, if set (0 otherwise). Don't touch! */
     PHYSFS_uint32 buffill;  /* Buffer fill size. Don't touch! */
     PHYSFS_uint32 bufpos;  /* Buffer position. Don't touch! */
+    PHYSFS_uint32 bufalloc;  /* Bytes allocated for buffer. Don't touch! */
+    PHYSFS_uint32 bufbase;  /* Bufsize the app asked for. Don't touch! */
+    PHYSFS_uint8 bufflags;  /* PHYSFS_BufferFlags. Don't touch! */
+    PHYSFS_uint8 bufstreak;  /* Refills since the last seek. Don't touch! */
+    PHYSFS_uint8 hint;  /* Last PHYSFS_setAccessHint() pattern. */
+    PHYSFS_uint8 *backbuf;  /* Double buffering: the next chunk. */
+    PHYSFS_uint32 backalloc;  /* Bytes allocated for backbuf. */
+    PHYSFS_uint32 backfill;  /* Bytes waiting in backbuf, once settled. */
+    PHYSFS_ErrorCode fillerr;  /* Why the last background refill failed. */
+    struct PHYSFS_AsyncRequest *fill;  /* Reading into backbuf, or NULL. */
+    PHYSFS_uint64 fillpos;  /* Where the Io was when (fill) started. */
+    PHYSFS_uint8 asyncBusy;  /* A thread is doing async reads. asyncLock! */
+    PHYSFS_uint8 asyncFilling;  /* (fill) isn't finished yet. asyncLock! */
+    struct __PHYSFS_FILEHANDLE__ *prev;  /* linked list stuff. */
     struct __PHYSFS_FILEHANDLE__ *next;  /* linked list stuff. */
 } FileHandle;
 
 
+#ifndef __PHYSFS_THREAD_LOCAL
 typedef struct __PHYSFS_ERRSTATETYPE__
 {
     void *tid;
     PHYSFS_ErrorCode code;
     struct __PHYSFS_ERRSTATETYPE__ *next;
 } ErrState;
+#endif
 
 
 /* General PhysicsFS state ... */
 static int initialized = 0;
-static ErrState *errorStates = NULL;
 static DirHandle *searchPath = NULL;
 static DirHandle *writeDir = NULL;
 static FileHandle *openWriteList = NULL;
@@ -58,17 +87,565 @@ static char *baseDir = NULL;
 static char *userDir = NULL;
 static char *prefDir = NULL;
 static int allowSymLinks = 0;
+static PHYSFS_uint32 verifyGeneration = 0;  /* bump to forget verifyPath() results. */
 static const PHYSFS_Archiver **archivers = NULL;
 static const PHYSFS_ArchiveInfo **archiveInfo = NULL;
 static volatile size_t numArchivers = 0;
 
+/* DIR is always there, ahead of the registered archivers; see openDirectory(). */
+extern const PHYSFS_Archiver __PHYSFS_Archiver_DIR;
+
+/* Each thread's last error. Without thread-local storage, it's a list. */
+#ifdef __PHYSFS_THREAD_LOCAL
+static __PHYSFS_THREAD_LOCAL PHYSFS_ErrorCode threadErrorCode = PHYSFS_ERR_OK;
+#else
+static ErrState *errorStates = NULL;
+#endif
+
 /* mutexes ... */
 static void *errorLock = NULL;     /* protects error message list.        */
 static void *stateLock = NULL;     /* protects other PhysFS static state. */
+static void *openListLock = NULL;  /* protects open file lists and counts. */
+static void *poolLock = NULL;      /* protects every __PHYSFS_Pool.       */
+static void *memLock = NULL;       /* protects memory accounts, if there  */
+                                   /*  are no 64-bit atomics (MEM_ATOMIC). */
+static void *asyncLock = NULL;     /* protects async requests and workers. */
+static void *traceLock = NULL;     /* held across every trace callback.   */
 
 /* allocator ... */
 static int externalAllocator = 0;
-PHYSFS_Allocator allocator;
+static PHYSFS_Allocator realAllocator;  /* the app's, or the platform's. */
+PHYSFS_Allocator allocator;  /* accounts for, then calls, realAllocator. */
+
+/* memory accounting ... */
+
+/*
+ * Every allocation credits or debits an account, so with 64-bit atomics
+ *  that's all it does: no lock, and threads only meet on the cache lines of
+ *  the accounts they share. Without them, memLock covers it.
+ */
+#if (defined __GNUC__) && (defined __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8) && \
+    (defined __ATOMIC_RELAXED)
+#define MEM_ATOMIC 1
+#define MEM_ADD(ptr, n) __atomic_add_fetch(ptr, n, __ATOMIC_RELAXED)
+#define MEM_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#define MEM_STORE(ptr, n) __atomic_store_n(ptr, n, __ATOMIC_RELAXED)
+#define MEM_GRAB()
+#define MEM_RELEASE()
+#else
+#define MEM_ATOMIC 0
+#define MEM_ADD(ptr, n) (*(ptr) += (n))
+#define MEM_LOAD(ptr) (*(ptr))
+#define MEM_STORE(ptr, n) (*(ptr) = (n))
+#define MEM_GRAB() if (memLock) __PHYSFS_platformGrabMutex(memLock)
+#define MEM_RELEASE() if (memLock) __PHYSFS_platformReleaseMutex(memLock)
+#endif
+
+/*
+ * An archive's account counts one extra byte in (total) for as long as its
+ *  DirHandle is around. Whatever takes (total) to zero, that last free or
+ *  memOrphanAccount(), frees the account, so exactly one thing ever does.
+ */
+struct __PHYSFS_MemAccount
+{
+    PHYSFS_uint64 bytes[PHYSFS_MEMORY_CATEGORY_COUNT];
+    PHYSFS_uint64 total;
+};
+
+/*
+ * Every block (allocator) hands out has one of these in front of it. It's
+ *  16 bytes on every platform, so the caller's pointer is as aligned as the
+ *  real allocator made it.
+ */
+typedef union
+{
+    struct
+    {
+        __PHYSFS_MemAccount *account;
+        PHYSFS_uint64 sizecat;  /* size in low 56 bits, category in top 8. */
+    } info;
+    PHYSFS_uint64 align[2];
+} MemHeader;
+
+#define MEMHEADER_SIZE(h) ((h)->info.sizecat & 0x00FFFFFFFFFFFFFFULL)
+#define MEMHEADER_CATEGORY(h) ((PHYSFS_MemoryCategory) ((h)->info.sizecat >> 56))
+#define MEMHEADER_SET(h, size, cat) (h)->info.sizecat = (((PHYSFS_uint64) (size)) | (((PHYSFS_uint64) (cat)) << 56))
+
+static __PHYSFS_MemAccount allMemory;  /* every account added together. */
+static __PHYSFS_MemAccount unownedMemory;  /* not charged to an archive. */
+static PHYSFS_uint64 memLimit = 0;  /* PHYSFS_setMemoryLimit(); 0 is none. */
+
+/* What this thread is charging allocations to right now. */
+#ifdef __PHYSFS_THREAD_LOCAL
+static __PHYSFS_THREAD_LOCAL __PHYSFS_MemCharge memCharge;  /* all zero. */
+#endif
+
+
+/* Without MEM_ATOMIC, MAKE SURE you hold memLock before calling this! */
+static void memCredit(__PHYSFS_MemAccount *account,
+                      const PHYSFS_MemoryCategory category,
+                      const PHYSFS_uint64 len)
+{
+    MEM_ADD(&account->bytes[category], len);
+    MEM_ADD(&account->total, len);
+    MEM_ADD(&allMemory.bytes[category], len);
+    MEM_ADD(&allMemory.total, len);
+} /* memCredit */
+
+
+/* Without MEM_ATOMIC, MAKE SURE you hold memLock before calling this! */
+static void memDebit(__PHYSFS_MemAccount *account,
+                     const PHYSFS_MemoryCategory category,
+                     const PHYSFS_uint64 len)
+{
+    const PHYSFS_uint64 neg = ((PHYSFS_uint64) 0) - len;
+    MEM_ADD(&allMemory.bytes[category], neg);
+    MEM_ADD(&allMemory.total, neg);
+    MEM_ADD(&account->bytes[category], neg);
+
+    /* last, since (account) might be gone after this. */
+    if ((MEM_ADD(&account->total, neg) == 0) && (account != &unownedMemory))
+        realAllocator.Free(account);
+} /* memDebit */
+
+
+static __PHYSFS_MemAccount *memChargedAccount(PHYSFS_MemoryCategory *cat)
+{
+#ifdef __PHYSFS_THREAD_LOCAL
+    *cat = memCharge.category;
+    return (memCharge.account != NULL) ? memCharge.account : &unownedMemory;
+#else
+    *cat = PHYSFS_MEMORY_OTHER;
+    return &unownedMemory;
+#endif
+} /* memChargedAccount */
+
+
+void __PHYSFS_memCharge(__PHYSFS_MemAccount *account,
+                        const PHYSFS_MemoryCategory category,
+                        __PHYSFS_MemCharge *prev)
+{
+#ifdef __PHYSFS_THREAD_LOCAL
+    *prev = memCharge;
+    memCharge.account = account;
+    memCharge.category = category;
+#endif
+} /* __PHYSFS_memCharge */
+
+
+void __PHYSFS_memRestore(const __PHYSFS_MemCharge *prev)
+{
+#ifdef __PHYSFS_THREAD_LOCAL
+    memCharge = *prev;
+#endif
+} /* __PHYSFS_memRestore */
+
+
+__PHYSFS_MemAccount *__PHYSFS_memCurrentAccount(void)
+{
+#ifdef __PHYSFS_THREAD_LOCAL
+    return memCharge.account;
+#else
+    return NULL;
+#endif
+} /* __PHYSFS_memCurrentAccount */
+
+
+int __PHYSFS_memOverLimit(void)
+{
+    const PHYSFS_uint64 limit = MEM_LOAD(&memLimit);
+    return ((limit != 0) && (MEM_LOAD(&allMemory.total) > limit));
+} /* __PHYSFS_memOverLimit */
+
+
+/* Move a block from (allocator) to another account and category. */
+static void memRecharge(void *ptr, __PHYSFS_MemAccount *account,
+                        const PHYSFS_MemoryCategory category)
+{
+    MemHeader *hdr = ((MemHeader *) ptr) - 1;
+    const PHYSFS_uint64 len = MEMHEADER_SIZE(hdr);
+
+    MEM_GRAB();
+    memCredit(account, category, len);
+    memDebit(hdr->info.account, MEMHEADER_CATEGORY(hdr), len);
+    hdr->info.account = account;
+    MEMHEADER_SET(hdr, len, category);
+    MEM_RELEASE();
+} /* memRecharge */
+
+
+static __PHYSFS_MemAccount *memCreateAccount(void)
+{
+    __PHYSFS_MemAccount *retval;
+    retval = (__PHYSFS_MemAccount *) realAllocator.Malloc(sizeof (*retval));
+    BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(retval, '\0', sizeof (*retval));
+    retval->total = 1;  /* the owner's byte; see memOrphanAccount(). */
+    return retval;
+} /* memCreateAccount */
+
+
+/* The owner is done with (account); it goes away when it's empty. */
+static void memOrphanAccount(__PHYSFS_MemAccount *account)
+{
+    int empty;
+
+    if (account == NULL)
+        return;
+
+    MEM_GRAB();
+    empty = (MEM_ADD(&account->total, ((PHYSFS_uint64) 0) - 1) == 0);
+    MEM_RELEASE();
+
+    if (empty)
+        realAllocator.Free(account);
+} /* memOrphanAccount */
+
+
+static void *accountMalloc(PHYSFS_uint64 s)
+{
+    PHYSFS_MemoryCategory category;
+    __PHYSFS_MemAccount *account;
+    MemHeader *hdr;
+
+    BAIL_IF_MACRO(s > 0x00FFFFFFFFFFFFFFULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    hdr = (MemHeader *) realAllocator.Malloc(s + sizeof (MemHeader));
+    if (hdr == NULL)
+        return NULL;
+
+    account = memChargedAccount(&category);
+    MEM_GRAB();
+    memCredit(account, category, s);
+    MEM_RELEASE();
+
+    hdr->info.account = account;
+    MEMHEADER_SET(hdr, s, category);
+    return hdr + 1;
+} /* accountMalloc */
+
+
+static void *accountRealloc(void *ptr, PHYSFS_uint64 s)
+{
+    MemHeader *hdr;
+    PHYSFS_uint64 oldsize;
+
+    if (ptr == NULL)
+        return accountMalloc(s);
+
+    BAIL_IF_MACRO(s > 0x00FFFFFFFFFFFFFFULL, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    hdr = ((MemHeader *) ptr) - 1;
+    oldsize = MEMHEADER_SIZE(hdr);
+    hdr = (MemHeader *) realAllocator.Realloc(hdr, s + sizeof (MemHeader));
+    if (hdr == NULL)
+        return NULL;
+
+    /* a block stays with whoever allocated it, however it grows. */
+    MEM_GRAB();
+    memCredit(hdr->info.account, MEMHEADER_CATEGORY(hdr), s);
+    memDebit(hdr->info.account, MEMHEADER_CATEGORY(hdr), oldsize);
+    MEMHEADER_SET(hdr, s, MEMHEADER_CATEGORY(hdr));
+    MEM_RELEASE();
+
+    return hdr + 1;
+} /* accountRealloc */
+
+
+static void accountFree(void *ptr)
+{
+    MemHeader *hdr;
+
+    if (ptr == NULL)
+        return;
+
+    hdr = ((MemHeader *) ptr) - 1;
+    MEM_GRAB();
+    memDebit(hdr->info.account, MEMHEADER_CATEGORY(hdr), MEMHEADER_SIZE(hdr));
+    MEM_RELEASE();
+
+    realAllocator.Free(hdr);
+} /* accountFree */
+
+
+/* statistics ... */
+
+#define STAT_SHARDS 8  /* power of two. */
+
+/* 64-bit atomics, if we've got them. */
+#if (defined __GNUC__) && (defined __GCC_HAVE_SYNC_COMPARE_AND_SWAP_8) && \
+    (defined __ATOMIC_RELAXED)
+#define STAT_ADD(ptr, n) __atomic_fetch_add(ptr, n, __ATOMIC_RELAXED)
+#define STAT_LOAD(ptr) __atomic_load_n(ptr, __ATOMIC_RELAXED)
+#else
+#define STAT_ADD(ptr, n) (*(ptr) += (n))  /* might lose a count, rarely. */
+#define STAT_LOAD(ptr) (*(ptr))
+#endif
+
+/* Each shard gets its own cache lines, so threads don't fight over them. */
+typedef struct
+{
+    PHYSFS_uint64 counters[PHYSFS_STAT_COUNT];
+    PHYSFS_uint8 pad[64 - ((PHYSFS_STAT_COUNT * 8) % 64)];
+} StatShard;
+
+struct __PHYSFS_Stats
+{
+    StatShard shard[STAT_SHARDS];
+};
+
+typedef struct
+{
+    PHYSFS_Archiver archiver;  /* must be first; archivers[] points here. */
+    PHYSFS_Stats retired;  /* archives of this type that were unmounted. */
+} RegisteredArchiver;
+
+static PHYSFS_Stats retiredStats;  /* every unmounted archive. */
+static int statsTiming = 0;  /* PHYSFS_setStatsTiming(); survives deinit. */
+static PHYSFS_Stats retiredDirStats;  /* unmounted plain directories. */
+
+/* What the API calls plain directories, where it asks for an extension. */
+#define DIR_ARCHIVER_TYPE "DIR"
+static PHYSFS_uint32 nextStatShard = 0;
+
+#ifdef __PHYSFS_THREAD_LOCAL
+static __PHYSFS_THREAD_LOCAL __PHYSFS_Stats *currentStats;
+static __PHYSFS_THREAD_LOCAL PHYSFS_uint32 statShard;  /* shard + 1. */
+#endif
+
+static PHYSFS_uint32 pickStatShard(void)
+{
+#ifdef __PHYSFS_THREAD_LOCAL
+    /* racy, but the worst that can happen is two threads share a shard. */
+    if (statShard == 0)
+        statShard = ((nextStatShard++) & (STAT_SHARDS - 1)) + 1;
+    return statShard - 1;
+#else
+    const size_t tid = (size_t) __PHYSFS_platformGetThreadID();
+    return (PHYSFS_uint32) ((tid ^ (tid >> 12)) & (STAT_SHARDS - 1));
+#endif
+} /* pickStatShard */
+
+
+void __PHYSFS_statAdd(__PHYSFS_Stats *stats, const PHYSFS_StatCounter which,
+                      const PHYSFS_uint64 n)
+{
+    if (stats != NULL)
+        STAT_ADD(&stats->shard[pickStatShard()].counters[which], n);
+} /* __PHYSFS_statAdd */
+
+
+PHYSFS_uint64 __PHYSFS_statTimeStart(void)
+{
+    return MEM_LOAD(&statsTiming) ? __PHYSFS_platformGetTicks() : 0;
+} /* __PHYSFS_statTimeStart */
+
+
+void __PHYSFS_statAddTime(__PHYSFS_Stats *stats,
+                          const PHYSFS_StatCounter which,
+                          const PHYSFS_uint64 start)
+{
+    if ((stats != NULL) && (start != 0))
+    {
+        const PHYSFS_uint64 now = __PHYSFS_platformGetTicks();
+        STAT_ADD(&stats->shard[pickStatShard()].counters[which], now - start);
+    } /* if */
+} /* __PHYSFS_statAddTime */
+
+
+void PHYSFS_setStatsTiming(int enable)
+{
+    MEM_STORE(&statsTiming, enable ? 1 : 0);
+} /* PHYSFS_setStatsTiming */
+
+
+__PHYSFS_Stats *__PHYSFS_statsCurrent(void)
+{
+#ifdef __PHYSFS_THREAD_LOCAL
+    return currentStats;
+#else
+    return NULL;
+#endif
+} /* __PHYSFS_statsCurrent */
+
+
+/* Native Ios made from now on count toward (stats). Returns the old ones. */
+static __PHYSFS_Stats *setCurrentStats(__PHYSFS_Stats *stats)
+{
+#ifdef __PHYSFS_THREAD_LOCAL
+    __PHYSFS_Stats *retval = currentStats;
+    currentStats = stats;
+    return retval;
+#else
+    return NULL;
+#endif
+} /* setCurrentStats */
+
+
+static void addStats(PHYSFS_Stats *dst, const __PHYSFS_Stats *stats)
+{
+    int i, j;
+    for (i = 0; i < STAT_SHARDS; i++)
+    {
+        for (j = 0; j < PHYSFS_STAT_COUNT; j++)
+            dst->counters[j] += STAT_LOAD(&stats->shard[i].counters[j]);
+    } /* for */
+} /* addStats */
+
+
+static void addStatsSnapshot(PHYSFS_Stats *dst, const PHYSFS_Stats *src)
+{
+    int i;
+    for (i = 0; i < PHYSFS_STAT_COUNT; i++)
+        dst->counters[i] += src->counters[i];
+} /* addStatsSnapshot */
+
+
+/* Where an archiver's counters go when one of its archives goes away. */
+static PHYSFS_Stats *retiredStatsFor(const PHYSFS_Archiver *funcs)
+{
+    if (funcs == &__PHYSFS_Archiver_DIR)
+        return &retiredDirStats;
+    return &((RegisteredArchiver *) funcs)->retired;
+} /* retiredStatsFor */
+
+
+static __PHYSFS_Stats *createStats(void)
+{
+    __PHYSFS_Stats *retval;
+    retval = (__PHYSFS_Stats *) allocator.Malloc(sizeof (*retval));
+    BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(retval, '\0', sizeof (*retval));
+    return retval;
+} /* createStats */
+
+
+/* pools ... */
+static __PHYSFS_Pool *pools = NULL;  /* every pool that's held onto memory. */
+__PHYSFS_Pool __PHYSFS_ioPool = __PHYSFS_POOL_INIT(sizeof (PHYSFS_Io), 64);
+static __PHYSFS_Pool fileHandlePool = __PHYSFS_POOL_INIT(sizeof (FileHandle), 64);
+
+
+void *__PHYSFS_poolAlloc(__PHYSFS_Pool *pool)
+{
+    void *retval = NULL;
+
+    if (poolLock != NULL)
+    {
+        __PHYSFS_platformGrabMutex(poolLock);
+        retval = pool->freelist;
+        if (retval != NULL)
+        {
+            pool->freelist = *((void **) retval);
+            pool->freecount--;
+        } /* if */
+        __PHYSFS_platformReleaseMutex(poolLock);
+        if (retval != NULL)
+        {
+            PHYSFS_MemoryCategory category;
+            __PHYSFS_MemAccount *account = memChargedAccount(&category);
+            memRecharge(retval, account, category);
+            return retval;
+        } /* if */
+    } /* if */
+
+    /* we keep a pointer in free objects, so they have to be that big. */
+    retval = allocator.Malloc((pool->size < sizeof (void *)) ?
+                               sizeof (void *) : pool->size);
+    BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    return retval;
+} /* __PHYSFS_poolAlloc */
+
+
+/* Free every idle pooled object, but leave the pools registered. */
+static void trimPools(void)
+{
+    __PHYSFS_Pool *pool;
+
+    if (poolLock == NULL)
+        return;
+
+    __PHYSFS_platformGrabMutex(poolLock);
+    for (pool = pools; pool != NULL; pool = pool->next)
+    {
+        void *item = pool->freelist;
+        while (item != NULL)
+        {
+            void *nextitem = *((void **) item);
+            allocator.Free(item);
+            item = nextitem;
+        } /* while */
+        pool->freelist = NULL;
+        pool->freecount = 0;
+    } /* for */
+    __PHYSFS_platformReleaseMutex(poolLock);
+} /* trimPools */
+
+
+void __PHYSFS_poolFree(__PHYSFS_Pool *pool, void *ptr)
+{
+    if (ptr == NULL)
+        return;
+
+    if (__PHYSFS_memOverLimit())
+    {
+        /* don't sit on memory the app asked us to give back. */
+        allocator.Free(ptr);
+        trimPools();
+        return;
+    } /* if */
+
+    if (poolLock != NULL)
+    {
+        int kept = 0;
+        __PHYSFS_platformGrabMutex(poolLock);
+        if (pool->freecount < pool->maxfree)
+        {
+            /* idle objects belong to nobody until they're handed out. */
+            memRecharge(ptr, &unownedMemory, PHYSFS_MEMORY_CACHE);
+            *((void **) ptr) = pool->freelist;
+            pool->freelist = ptr;
+            pool->freecount++;
+            if (!pool->registered)
+            {
+                pool->registered = 1;
+                pool->next = pools;
+                pools = pool;
+            } /* if */
+            kept = 1;
+        } /* if */
+        __PHYSFS_platformReleaseMutex(poolLock);
+        if (kept)
+            return;
+    } /* if */
+
+    allocator.Free(ptr);
+} /* __PHYSFS_poolFree */
+
+
+/* MAKE SURE nothing else is using the pools when you call this! */
+static void drainPools(void)
+{
+    __PHYSFS_Pool *pool;
+    __PHYSFS_Pool *next;
+
+    for (pool = pools; pool != NULL; pool = next)
+    {
+        void *item = pool->freelist;
+        while (item != NULL)
+        {
+            void *nextitem = *((void **) item);
+            allocator.Free(item);
+            item = nextitem;
+        } /* while */
+
+        next = pool->next;
+        pool->freelist = NULL;
+        pool->freecount = 0;
+        pool->registered = 0;
+        pool->next = NULL;
+    } /* for */
+
+    pools = NULL;
+} /* drainPools */
 
 
 /* PHYSFS_Io implementation for i/o to physical filesystem... */
@@ -77,32 +654,124 @@ PHYSFS_Allocator allocator;
 typedef struct __PHYSFS_NativeIoInfo
 {
     void *handle;
+    void *dirhandle;  /* if not NULL, (path) is relative to this. */
     const char *path;
     int mode;   /* 'r', 'w', or 'a' */
+    __PHYSFS_Stats *stats;  /* the archive we're reading for, or NULL. */
+    PHYSFS_uint64 pos;  /* where (handle) is. Only kept for 'r' handles. */
+
+    /*
+     * Async batches read neighbouring files' bytes in one go, then lend us
+     *  the part we're in with nativeIoSetWindow(). While we have it, reads
+     *  inside it are copies, seeks just move (windowPos), and (handle) only
+     *  moves when someone leaves the window.
+     */
+    const PHYSFS_uint8 *window;
+    PHYSFS_uint64 windowStart;
+    PHYSFS_uint64 windowLen;
+    PHYSFS_uint64 windowPos;
 } NativeIoInfo;
 
+static __PHYSFS_Pool nativeIoInfoPool = __PHYSFS_POOL_INIT(sizeof (NativeIoInfo), 64);
+
+static PHYSFS_Io *createNativeIo(void *dirhandle, const char *path,
+                                 const int mode);
+
+static PHYSFS_sint64 nativeIoReadHandle(NativeIoInfo *info, void *buf,
+                                        PHYSFS_uint64 len)
+{
+    const PHYSFS_uint64 start = __PHYSFS_statTimeStart();
+    const PHYSFS_sint64 rc = __PHYSFS_platformRead(info->handle, buf, len);
+    __PHYSFS_statAddTime(info->stats, PHYSFS_STAT_NS_SYSCALL, start);
+    if (rc > 0)
+    {
+        info->pos += rc;
+        __PHYSFS_statAdd(info->stats, PHYSFS_STAT_BYTES_PHYSICAL, rc);
+    } /* if */
+    return rc;
+} /* nativeIoReadHandle */
+
+static int nativeIoSeekHandle(NativeIoInfo *info, PHYSFS_uint64 offset)
+{
+    const PHYSFS_uint64 start = __PHYSFS_statTimeStart();
+    const int rc = __PHYSFS_platformSeek(info->handle, offset);
+    __PHYSFS_statAddTime(info->stats, PHYSFS_STAT_NS_SYSCALL, start);
+    if (rc)
+        info->pos = offset;
+    return rc;
+} /* nativeIoSeekHandle */
+
+static PHYSFS_sint64 nativeIoReadWindow(NativeIoInfo *info, void *buf,
+                                        PHYSFS_uint64 len)
+{
+    const PHYSFS_uint64 end = info->windowStart + info->windowLen;
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_sint64 rc;
+
+    if ((info->windowPos >= info->windowStart) && (info->windowPos < end))
+    {
+        const PHYSFS_uint64 avail = end - info->windowPos;
+        const PHYSFS_uint64 cpy = (len < avail) ? len : avail;
+        memcpy(buf, info->window + (info->windowPos - info->windowStart),
+               (size_t) cpy);
+        info->windowPos += cpy;
+        buf = ((PHYSFS_uint8 *) buf) + cpy;
+        len -= cpy;
+        retval = (PHYSFS_sint64) cpy;
+    } /* if */
+
+    if (len == 0)
+        return retval;
+
+    /* the rest is outside what we were lent; really read it. */
+    if (info->pos != info->windowPos)
+    {
+        if (!nativeIoSeekHandle(info, info->windowPos))
+            return (retval > 0) ? retval : -1;
+    } /* if */
+
+    rc = nativeIoReadHandle(info, buf, len);
+    if (rc < 0)
+        return (retval > 0) ? retval : rc;
+
+    info->windowPos += rc;
+    return retval + rc;
+} /* nativeIoReadWindow */
+
 static PHYSFS_sint64 nativeIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformRead(info->handle, buf, len);
+    if (info->window != NULL)
+        return nativeIoReadWindow(info, buf, len);
+    return nativeIoReadHandle(info, buf, len);
 } /* nativeIo_read */
 
 static PHYSFS_sint64 nativeIo_write(PHYSFS_Io *io, const void *buffer,
                                     PHYSFS_uint64 len)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformWrite(info->handle, buffer, len);
+    const PHYSFS_uint64 start = __PHYSFS_statTimeStart();
+    const PHYSFS_sint64 rc = __PHYSFS_platformWrite(info->handle, buffer, len);
+    __PHYSFS_statAddTime(info->stats, PHYSFS_STAT_NS_SYSCALL, start);
+    return rc;
 } /* nativeIo_write */
 
 static int nativeIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_platformSeek(info->handle, offset);
+    if (info->window != NULL)
+    {
+        info->windowPos = offset;  /* the handle catches up if it has to. */
+        return 1;
+    } /* if */
+    return nativeIoSeekHandle(info, offset);
 } /* nativeIo_seek */
 
 static PHYSFS_sint64 nativeIo_tell(PHYSFS_Io *io)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    if (info->window != NULL)
+        return (PHYSFS_sint64) info->windowPos;
     return __PHYSFS_platformTell(info->handle);
 } /* nativeIo_tell */
 
@@ -115,12 +784,16 @@ static PHYSFS_sint64 nativeIo_length(PHYSFS_Io *io)
 static PHYSFS_Io *nativeIo_duplicate(PHYSFS_Io *io)
 {
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
-    return __PHYSFS_createNativeIo(info->path, info->mode);
+    PHYSFS_Io *retval = createNativeIo(info->dirhandle, info->path, info->mode);
+    if (retval != NULL)  /* whoever duplicates it, it's the same archive. */
+        ((NativeIoInfo *) retval->opaque)->stats = info->stats;
+    return retval;
 } /* nativeIo_duplicate */
 
 static int nativeIo_flush(PHYSFS_Io *io)
 {
-    return __PHYSFS_platformFlush(io->opaque);
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    return __PHYSFS_platformFlush(info->handle);
 } /* nativeIo_flush */
 
 static void nativeIo_destroy(PHYSFS_Io *io)
@@ -128,8 +801,8 @@ static void nativeIo_destroy(PHYSFS_Io *io)
     NativeIoInfo *info = (NativeIoInfo *) io->opaque;
     __PHYSFS_platformClose(info->handle);
     allocator.Free((void *) info->path);
-    allocator.Free(info);
-    allocator.Free(io);
+    __PHYSFS_poolFree(&nativeIoInfoPool, info);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
 } /* nativeIo_destroy */
 
 static const PHYSFS_Io __PHYSFS_nativeIoInterface =
@@ -145,35 +818,61 @@ static const PHYSFS_Io __PHYSFS_nativeIoInterface =
     nativeIo_destroy
 };
 
-PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode)
+static void *openNativeHandle(void *dirhandle, const char *path,
+                              const int mode)
 {
-    PHYSFS_Io *io = NULL;
-    NativeIoInfo *info = NULL;
-    void *handle = NULL;
-    char *pathdup = NULL;
-
-    assert((mode == 'r') || (mode == 'w') || (mode == 'a'));
-
-    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF_MACRO(!io, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
-    info = (NativeIoInfo *) allocator.Malloc(sizeof (NativeIoInfo));
-    GOTO_IF_MACRO(!info, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
-    pathdup = (char *) allocator.Malloc(strlen(path) + 1);
-    GOTO_IF_MACRO(!pathdup, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
+#if PHYSFS_HAVE_DIRHANDLES
+    if (dirhandle != NULL)
+    {
+        if (mode == 'r')
+            return __PHYSFS_platformOpenReadAt(dirhandle, path);
+        else if (mode == 'w')
+            return __PHYSFS_platformOpenWriteAt(dirhandle, path);
+        else if (mode == 'a')
+            return __PHYSFS_platformOpenAppendAt(dirhandle, path);
+        return NULL;
+    } /* if */
+#else
+    assert(dirhandle == NULL);
+#endif
 
     if (mode == 'r')
-        handle = __PHYSFS_platformOpenRead(path);
+        return __PHYSFS_platformOpenRead(path);
     else if (mode == 'w')
-        handle = __PHYSFS_platformOpenWrite(path);
+        return __PHYSFS_platformOpenWrite(path);
     else if (mode == 'a')
-        handle = __PHYSFS_platformOpenAppend(path);
+        return __PHYSFS_platformOpenAppend(path);
+    return NULL;
+} /* openNativeHandle */
+
+static PHYSFS_Io *createNativeIo(void *dirhandle, const char *path,
+                                 const int mode)
+{
+    PHYSFS_Io *io = NULL;
+    NativeIoInfo *info = NULL;
+    void *handle = NULL;
+    char *pathdup = NULL;
+
+    assert((mode == 'r') || (mode == 'w') || (mode == 'a'));
 
+    io = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    GOTO_IF_MACRO(!io, ERRPASS, createNativeIo_failed);
+    info = (NativeIoInfo *) __PHYSFS_poolAlloc(&nativeIoInfoPool);
+    GOTO_IF_MACRO(!info, ERRPASS, createNativeIo_failed);
+    pathdup = (char *) allocator.Malloc(strlen(path) + 1);
+    GOTO_IF_MACRO(!pathdup, PHYSFS_ERR_OUT_OF_MEMORY, createNativeIo_failed);
+
+    handle = openNativeHandle(dirhandle, path, mode);
     GOTO_IF_MACRO(!handle, ERRPASS, createNativeIo_failed);
 
     strcpy(pathdup, path);
     info->handle = handle;
+    info->dirhandle = dirhandle;
     info->path = pathdup;
     info->mode = mode;
+    info->stats = __PHYSFS_statsCurrent();
+    info->pos = 0;
+    info->window = NULL;
     memcpy(io, &__PHYSFS_nativeIoInterface, sizeof (*io));
     io->opaque = info;
     return io;
@@ -181,11 +880,85 @@ PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode)
 createNativeIo_failed:
     if (handle != NULL) __PHYSFS_platformClose(handle);
     if (pathdup != NULL) allocator.Free(pathdup);
-    if (info != NULL) allocator.Free(info);
-    if (io != NULL) allocator.Free(io);
+    __PHYSFS_poolFree(&nativeIoInfoPool, info);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
     return NULL;
+} /* createNativeIo */
+
+/*
+ * Lend (io), a native Io opened for reading, (len) bytes of its file that
+ *  start at (start), already read into (window). Pass a NULL (window) to
+ *  take them back; (window) has to stay put until then. Returns zero if (io)
+ *  can't take a window, and then it doesn't have one.
+ */
+static int nativeIoSetWindow(PHYSFS_Io *io, const PHYSFS_uint8 *window,
+                             PHYSFS_uint64 start, PHYSFS_uint64 len)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+
+    if ((io->read != nativeIo_read) || (info->mode != 'r'))
+        return 0;
+
+    if (window == NULL)
+    {
+        if (info->window == NULL)
+            return 1;
+
+        info->window = NULL;
+        if (info->pos != info->windowPos)
+            return nativeIoSeekHandle(info, info->windowPos);
+        return 1;
+    } /* if */
+
+    assert(info->window == NULL);
+    info->windowPos = info->pos;
+    info->window = window;
+    info->windowStart = start;
+    info->windowLen = len;
+    return 1;
+} /* nativeIoSetWindow */
+
+/* Do two native Ios read the same file? */
+static int nativeIoSameFile(const PHYSFS_Io *a, const PHYSFS_Io *b)
+{
+    const NativeIoInfo *ainfo = (const NativeIoInfo *) a->opaque;
+    const NativeIoInfo *binfo = (const NativeIoInfo *) b->opaque;
+    if (ainfo->dirhandle != binfo->dirhandle)
+        return 0;
+    return ( (ainfo->path == binfo->path) ||
+             (strcmp(ainfo->path, binfo->path) == 0) );
+} /* nativeIoSameFile */
+
+/* Pass an access hint for part of a native Io's file down to the OS. */
+static int nativeIoAdvise(PHYSFS_Io *io, PHYSFS_uint64 offset,
+                          PHYSFS_uint64 len, PHYSFS_AccessHint hint)
+{
+    NativeIoInfo *info = (NativeIoInfo *) io->opaque;
+    PHYSFS_uint64 start;
+    int rc;
+
+    if (io->read != nativeIo_read)
+        return 1;  /* not a file we can talk about; quietly ignore it. */
+
+    start = __PHYSFS_statTimeStart();
+    rc = __PHYSFS_platformAdvise(info->handle, offset, len, hint);
+    __PHYSFS_statAddTime(info->stats, PHYSFS_STAT_NS_SYSCALL, start);
+    return rc;
+} /* nativeIoAdvise */
+
+PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode)
+{
+    return createNativeIo(NULL, path, mode);
 } /* __PHYSFS_createNativeIo */
 
+#if PHYSFS_HAVE_DIRHANDLES
+PHYSFS_Io *__PHYSFS_createNativeIoAt(void *dirhandle, const char *path,
+                                     const int mode)
+{
+    return createNativeIo(dirhandle, path, mode);
+} /* __PHYSFS_createNativeIoAt */
+#endif
+
 
 /* PHYSFS_Io implementation for i/o to a memory buffer... */
 
@@ -199,6 +972,8 @@ typedef struct __PHYSFS_MemoryIoInfo
     void (*destruct)(void *);
 } MemoryIoInfo;
 
+static __PHYSFS_Pool memoryIoInfoPool = __PHYSFS_POOL_INIT(sizeof (MemoryIoInfo), 64);
+
 static PHYSFS_sint64 memoryIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
 {
     MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
@@ -258,13 +1033,13 @@ static PHYSFS_Io *memoryIo_duplicate(PHYSFS_Io *io)
 
     /* we're the parent. */
 
-    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    newinfo = (MemoryIoInfo *) allocator.Malloc(sizeof (MemoryIoInfo));
+    retval = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    BAIL_IF_MACRO(!retval, ERRPASS, NULL);
+    newinfo = (MemoryIoInfo *) __PHYSFS_poolAlloc(&memoryIoInfoPool);
     if (!newinfo)
     {
-        allocator.Free(retval);
-        BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        __PHYSFS_poolFree(&__PHYSFS_ioPool, retval);
+        BAIL_MACRO(ERRPASS, NULL);
     } /* if */
 
     /* !!! FIXME: want lockless atomic increment. */
@@ -299,8 +1074,8 @@ static void memoryIo_destroy(PHYSFS_Io *io)
         assert(info->len == ((MemoryIoInfo *) info->parent->opaque)->len);
         assert(info->refcount == 0);
         assert(info->destruct == NULL);
-        allocator.Free(info);
-        allocator.Free(io);
+        __PHYSFS_poolFree(&memoryIoInfoPool, info);
+        __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
         parent->destroy(parent);  /* decrements refcount. */
         return;
     } /* if */
@@ -319,8 +1094,8 @@ static void memoryIo_destroy(PHYSFS_Io *io)
         void (*destruct)(void *) = info->destruct;
         void *buf = (void *) info->buf;
         io->opaque = NULL;  /* kill this here in case of race. */
-        allocator.Free(info);
-        allocator.Free(io);
+        __PHYSFS_poolFree(&memoryIoInfoPool, info);
+        __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
         if (destruct != NULL)
             destruct(buf);
     } /* if */
@@ -346,10 +1121,10 @@ PHYSFS_Io *__PHYSFS_createMemoryIo(const void *buf, PHYSFS_uint64 len,
     PHYSFS_Io *io = NULL;
     MemoryIoInfo *info = NULL;
 
-    io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF_MACRO(!io, PHYSFS_ERR_OUT_OF_MEMORY, createMemoryIo_failed);
-    info = (MemoryIoInfo *) allocator.Malloc(sizeof (MemoryIoInfo));
-    GOTO_IF_MACRO(!info, PHYSFS_ERR_OUT_OF_MEMORY, createMemoryIo_failed);
+    io = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    GOTO_IF_MACRO(!io, ERRPASS, createMemoryIo_failed);
+    info = (MemoryIoInfo *) __PHYSFS_poolAlloc(&memoryIoInfoPool);
+    GOTO_IF_MACRO(!info, ERRPASS, createMemoryIo_failed);
 
     memset(info, '\0', sizeof (*info));
     info->buf = (const PHYSFS_uint8 *) buf;
@@ -364,12 +1139,329 @@ PHYSFS_Io *__PHYSFS_createMemoryIo(const void *buf, PHYSFS_uint64 len,
     return io;
 
 createMemoryIo_failed:
-    if (info != NULL) allocator.Free(info);
-    if (io != NULL) allocator.Free(io);
+    __PHYSFS_poolFree(&memoryIoInfoPool, info);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
     return NULL;
 } /* __PHYSFS_createMemoryIo */
 
 
+/*
+ * Every open PHYSFS_File is also in this open-addressed set, so
+ *  PHYSFS_close() can tell whether it was handed a real handle without
+ *  reading through a pointer that might already be freed. Sized to a power
+ *  of two and kept at most half full. Protected by openListLock.
+ * The table stays around once it exists, so opening and closing one file
+ *  over and over doesn't allocate anything; it only shrinks when it's
+ *  mostly empty after a burst of opens, and goes away in PHYSFS_deinit().
+ */
+#define OPEN_HANDLE_MIN_SLOTS 64
+
+static FileHandle **openHandles = NULL;
+static size_t openHandleSlots = 0;
+static size_t openHandleCount = 0;
+
+static size_t openHandleBucket(const FileHandle *fh, const size_t mask)
+{
+    const size_t key = ((size_t) fh) / sizeof (void *);
+    return (size_t) (key * 2654435761u) & mask;
+} /* openHandleBucket */
+
+
+/* MAKE SURE you hold openListLock before calling this! */
+static int isOpenHandle(const FileHandle *fh)
+{
+    size_t mask, i;
+
+    if (openHandleCount == 0)
+        return 0;
+
+    mask = openHandleSlots - 1;
+    for (i = openHandleBucket(fh, mask); openHandles[i]; i = (i + 1) & mask)
+    {
+        if (openHandles[i] == fh)
+            return 1;
+    } /* for */
+
+    return 0;
+} /* isOpenHandle */
+
+
+/* MAKE SURE you hold openListLock before calling this! */
+static int resizeOpenHandles(const size_t slots)
+{
+    const size_t mask = slots - 1;
+    FileHandle **ptr;
+    size_t i;
+
+    ptr = (FileHandle **) allocator.Malloc(slots * sizeof (FileHandle *));
+    BAIL_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    memset(ptr, '\0', slots * sizeof (FileHandle *));
+
+    for (i = 0; i < openHandleSlots; i++)
+    {
+        if (openHandles[i] != NULL)
+        {
+            size_t j = openHandleBucket(openHandles[i], mask);
+            while (ptr[j] != NULL)
+                j = (j + 1) & mask;
+            ptr[j] = openHandles[i];
+        } /* if */
+    } /* for */
+
+    allocator.Free(openHandles);
+    openHandles = ptr;
+    openHandleSlots = slots;
+    return 1;
+} /* resizeOpenHandles */
+
+
+/* MAKE SURE you hold openListLock before calling this! */
+static int addOpenHandle(FileHandle *fh)
+{
+    size_t mask, i;
+
+    if ((openHandleCount + 1) * 2 > openHandleSlots)
+    {
+        const size_t slots = openHandleSlots ? openHandleSlots * 2 :
+                                               OPEN_HANDLE_MIN_SLOTS;
+        BAIL_IF_MACRO(!resizeOpenHandles(slots), ERRPASS, 0);
+    } /* if */
+
+    mask = openHandleSlots - 1;
+    for (i = openHandleBucket(fh, mask); openHandles[i]; i = (i + 1) & mask)
+        /* keep probing. */ ;
+    openHandles[i] = fh;
+    openHandleCount++;
+    return 1;
+} /* addOpenHandle */
+
+
+/* MAKE SURE you hold openListLock before calling this! */
+static void removeOpenHandle(const FileHandle *fh)
+{
+    const size_t mask = openHandleSlots - 1;
+    size_t i, j;
+
+    for (i = openHandleBucket(fh, mask); openHandles[i] != fh; i = (i + 1) & mask)
+        assert(openHandles[i] != NULL);
+
+    /* shift later members of the probe run back, so nothing gets orphaned. */
+    openHandles[i] = NULL;
+    for (j = (i + 1) & mask; openHandles[j] != NULL; j = (j + 1) & mask)
+    {
+        const size_t home = openHandleBucket(openHandles[j], mask);
+        if (((j - home) & mask) >= ((j - i) & mask))
+        {
+            openHandles[i] = openHandles[j];
+            openHandles[j] = NULL;
+            i = j;
+        } /* if */
+    } /* for */
+
+    openHandleCount--;
+
+    /* sparse after a burst of opens? Give some back. Fine if this fails. */
+    if ( (openHandleSlots > OPEN_HANDLE_MIN_SLOTS) &&
+         (openHandleCount * 8 < openHandleSlots) )
+        resizeOpenHandles(openHandleSlots / 2);
+} /* removeOpenHandle */
+
+
+/* MAKE SURE nothing's open when you call this! */
+static void freeOpenHandles(void)
+{
+    if (openHandles != NULL)
+    {
+        allocator.Free(openHandles);
+        openHandles = NULL;
+        openHandleSlots = 0;
+        openHandleCount = 0;
+    } /* if */
+} /* freeOpenHandles */
+
+
+/*
+ * Open files live in doubly-linked lists, so closing one doesn't have to
+ *  search for it, and each DirHandle counts its open files, so unmounting
+ *  doesn't have to search either. These only need openListLock, not
+ *  stateLock, but if you need both, grab stateLock first.
+ */
+static int registerFileHandle(FileHandle *fh)
+{
+    FileHandle **list = fh->forReading ? &openReadList : &openWriteList;
+
+    __PHYSFS_platformGrabMutex(openListLock);
+    if (!addOpenHandle(fh))
+        BAIL_MACRO_MUTEX(ERRPASS, openListLock, 0);
+    fh->prev = NULL;
+    fh->next = *list;
+    if (*list != NULL)
+        (*list)->prev = fh;
+    *list = fh;
+    fh->dirHandle->openFiles++;
+    __PHYSFS_platformReleaseMutex(openListLock);
+    return 1;
+} /* registerFileHandle */
+
+
+/* MAKE SURE you hold openListLock before calling this! */
+static void unregisterFileHandle(FileHandle **list, FileHandle *fh)
+{
+    removeOpenHandle(fh);
+
+    if (fh->prev == NULL)
+        *list = fh->next;
+    else
+        fh->prev->next = fh->next;
+
+    if (fh->next != NULL)
+        fh->next->prev = fh->prev;
+
+    fh->prev = fh->next = NULL;
+    assert(fh->dirHandle->openFiles > 0);
+    fh->dirHandle->openFiles--;
+} /* unregisterFileHandle */
+
+
+/* buffering ... */
+
+#define BUFFER_ADAPTIVE_MIN (4 * 1024)  /* adaptive buffers start here... */
+#define BUFFER_ADAPTIVE_MAX (1024 * 1024)  /* ...and double up to this... */
+#define BUFFER_ADAPTIVE_STREAK 2  /* ...after this many refills in a row. */
+
+/*
+ * File buffers come in power-of-two sizes from these, so opening and
+ *  closing lots of buffered files doesn't keep hitting the allocator.
+ *  Anything bigger than the biggest goes straight to the allocator.
+ */
+#define BUFFER_POOL_MIN (4 * 1024)
+static __PHYSFS_Pool bufferPools[] = {
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN, 32),
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN << 1, 16),
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN << 2, 16),
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN << 3, 8),
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN << 4, 8),
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN << 5, 4),
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN << 6, 4),
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN << 7, 2),
+    __PHYSFS_POOL_INIT(BUFFER_POOL_MIN << 8, 2)  /* BUFFER_ADAPTIVE_MAX */
+};
+
+/* What a new file from a given kind of archive gets for a buffer. */
+typedef struct BufferPolicy
+{
+    char *type;  /* archiver extension, "DIR", "MEMORY"; NULL for default. */
+    PHYSFS_uint32 bufsize;
+    PHYSFS_uint32 flags;
+} BufferPolicy;
+
+/* All of this is protected by stateLock. */
+static BufferPolicy defaultBufferPolicy = { NULL, 0, 0 };
+static BufferPolicy *bufferPolicies = NULL;
+static PHYSFS_uint32 bufferPolicyCount = 0;
+
+
+/* A buffer of at least (len) bytes. (*alloc) gets how many there are. */
+static PHYSFS_uint8 *bufferAlloc(const PHYSFS_uint32 len, PHYSFS_uint32 *alloc)
+{
+    const size_t count = sizeof (bufferPools) / sizeof (bufferPools[0]);
+    PHYSFS_uint8 *retval;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (bufferPools[i].size >= len)
+        {
+            retval = (PHYSFS_uint8 *) __PHYSFS_poolAlloc(&bufferPools[i]);
+            BAIL_IF_MACRO(!retval, ERRPASS, NULL);
+            *alloc = (PHYSFS_uint32) bufferPools[i].size;
+            return retval;
+        } /* if */
+    } /* for */
+
+    retval = (PHYSFS_uint8 *) allocator.Malloc(len);
+    BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    *alloc = len;
+    return retval;
+} /* bufferAlloc */
+
+
+/* Give back a buffer from bufferAlloc(), with the (alloc) it reported. */
+static void bufferFree(PHYSFS_uint8 *buf, const PHYSFS_uint32 alloc)
+{
+    const size_t count = sizeof (bufferPools) / sizeof (bufferPools[0]);
+    size_t i;
+
+    if (buf == NULL)
+        return;
+
+    for (i = 0; i < count; i++)
+    {
+        if (bufferPools[i].size == alloc)
+        {
+            __PHYSFS_poolFree(&bufferPools[i], buf);
+            return;
+        } /* if */
+    } /* for */
+
+    allocator.Free(buf);
+} /* bufferFree */
+
+
+/* MAKE SURE you hold stateLock before calling this! */
+static BufferPolicy *findBufferPolicy(const char *type)
+{
+    PHYSFS_uint32 i;
+    for (i = 0; i < bufferPolicyCount; i++)
+    {
+        if (__PHYSFS_utf8stricmp(bufferPolicies[i].type, type) == 0)
+            return &bufferPolicies[i];
+    } /* for */
+    return NULL;
+} /* findBufferPolicy */
+
+
+/*
+ * Give a newly-opened (fh) whatever buffer its archive's kind asks for.
+ *  If that fails, it just stays unbuffered; the open still worked.
+ *  MAKE SURE you hold stateLock before calling this!
+ */
+static void applyBufferPolicy(FileHandle *fh)
+{
+    const DirHandle *dh = fh->dirHandle;
+    const BufferPolicy *policy = NULL;
+
+    if (bufferPolicyCount > 0)
+    {
+        if (dh->inMemory)
+            policy = findBufferPolicy("MEMORY");
+        if ((policy == NULL) && (dh->funcs == &__PHYSFS_Archiver_DIR))
+            policy = findBufferPolicy(DIR_ARCHIVER_TYPE);
+        else if (policy == NULL)
+            policy = findBufferPolicy(dh->funcs->info.extension);
+    } /* if */
+
+    if (policy == NULL)
+        policy = &defaultBufferPolicy;
+
+    if ((policy->bufsize != 0) || (policy->flags != 0))
+        PHYSFS_setBufferMode((PHYSFS_File *) fh, policy->bufsize, policy->flags);
+} /* applyBufferPolicy */
+
+
+/* MAKE SURE you hold stateLock before calling this! */
+static void freeBufferPolicies(void)
+{
+    PHYSFS_uint32 i;
+    for (i = 0; i < bufferPolicyCount; i++)
+        allocator.Free(bufferPolicies[i].type);
+    allocator.Free(bufferPolicies);
+    bufferPolicies = NULL;
+    bufferPolicyCount = 0;
+    defaultBufferPolicy.bufsize = defaultBufferPolicy.flags = 0;
+} /* freeBufferPolicies */
+
+
 /* PHYSFS_Io implementation for i/o to a PHYSFS_File... */
 
 static PHYSFS_sint64 handleIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
@@ -405,14 +1497,14 @@ static PHYSFS_Io *handleIo_duplicate(PHYSFS_Io *io)
      *  abstraction. We're allowed to: we're physfs.c!
      */
     FileHandle *origfh = (FileHandle *) io->opaque;
-    FileHandle *newfh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
+    FileHandle *newfh = (FileHandle *) __PHYSFS_poolAlloc(&fileHandlePool);
     PHYSFS_Io *retval = NULL;
 
-    GOTO_IF_MACRO(!newfh, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+    GOTO_IF_MACRO(!newfh, ERRPASS, handleIo_dupe_failed);
     memset(newfh, '\0', sizeof (*newfh));
 
-    retval = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    GOTO_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, handleIo_dupe_failed);
+    retval = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    GOTO_IF_MACRO(!retval, ERRPASS, handleIo_dupe_failed);
 
 #if 0  /* we don't buffer the duplicate, at least not at the moment. */
     if (origfh->buffer != NULL)
@@ -429,19 +1521,7 @@ static PHYSFS_Io *handleIo_duplicate(PHYSFS_Io *io)
 
     newfh->forReading = origfh->forReading;
     newfh->dirHandle = origfh->dirHandle;
-
-    __PHYSFS_platformGrabMutex(stateLock);
-    if (newfh->forReading)
-    {
-        newfh->next = openReadList;
-        openReadList = newfh;
-    } /* if */
-    else
-    {
-        newfh->next = openWriteList;
-        openWriteList = newfh;
-    } /* else */
-    __PHYSFS_platformReleaseMutex(stateLock);
+    GOTO_IF_MACRO(!registerFileHandle(newfh), ERRPASS, handleIo_dupe_failed);
 
     memcpy(retval, io, sizeof (PHYSFS_Io));
     retval->opaque = newfh;
@@ -452,9 +1532,10 @@ handleIo_dupe_failed:
     {
         if (newfh->io != NULL) newfh->io->destroy(newfh->io);
         if (newfh->buffer != NULL) allocator.Free(newfh->buffer);
-        allocator.Free(newfh);
+        __PHYSFS_poolFree(&fileHandlePool, newfh);
     } /* if */
 
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, retval);
     return NULL;
 } /* handleIo_duplicate */
 
@@ -467,7 +1548,7 @@ static void handleIo_destroy(PHYSFS_Io *io)
 {
     if (io->opaque != NULL)
         PHYSFS_close((PHYSFS_File *) io->opaque);
-    allocator.Free(io);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
 } /* handleIo_destroy */
 
 static const PHYSFS_Io __PHYSFS_handleIoInterface =
@@ -485,2465 +1566,5727 @@ static const PHYSFS_Io __PHYSFS_handleIoInterface =
 
 static PHYSFS_Io *__PHYSFS_createHandleIo(PHYSFS_File *f)
 {
-    PHYSFS_Io *io = (PHYSFS_Io *) allocator.Malloc(sizeof (PHYSFS_Io));
-    BAIL_IF_MACRO(!io, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    PHYSFS_Io *io = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    BAIL_IF_MACRO(!io, ERRPASS, NULL);
     memcpy(io, &__PHYSFS_handleIoInterface, sizeof (*io));
     io->opaque = f;
     return io;
 } /* __PHYSFS_createHandleIo */
 
 
-/* functions ... */
+/* Tracing... */
 
+/*
+ * The callback and its data are published together, as one pointer, and
+ *  only read while holding traceLock, which is also held for the whole
+ *  callback. So once PHYSFS_setTraceCallback() returns, the old callback
+ *  isn't running and never will again, and its data can go away. Callbacks
+ *  can't call back into PhysicsFS, so holding a lock there is safe.
+ *
+ * Everything else just checks TRACE_HOOKED() to skip the work of building
+ *  events; a stale answer there only costs (or saves) a timestamp.
+ */
 typedef struct
 {
-    char **list;
-    PHYSFS_uint32 size;
-    PHYSFS_ErrorCode errcode;
-} EnumStringListCallbackData;
+    PHYSFS_TraceCallback cb;
+    void *data;
+} TraceHook;
 
-static void enumStringListCallback(void *data, const char *str)
+static TraceHook traceHookStorage;  /* protected by traceLock. */
+static TraceHook *traceHook = NULL;  /* written with traceLock held. */
+static PHYSFS_uint64 lastTraceId = 0;  /* protected by stateLock. */
+
+#if MEM_ATOMIC
+#define TRACE_HOOKED() (__atomic_load_n(&traceHook, __ATOMIC_RELAXED) != NULL)
+#define TRACE_PUBLISH(hook) __atomic_store_n(&traceHook, hook, __ATOMIC_RELAXED)
+#else
+#define TRACE_HOOKED() (traceHook != NULL)
+#define TRACE_PUBLISH(hook) (traceHook = (hook))
+#endif
+
+static void traceEvent(const PHYSFS_TraceEventType type, PHYSFS_uint64 id,
+                       const char *path, const char *archive,
+                       PHYSFS_uint64 offset, PHYSFS_uint64 requested,
+                       PHYSFS_sint64 result, PHYSFS_uint64 start)
 {
-    void *ptr;
-    char *newstr;
-    EnumStringListCallbackData *pecd = (EnumStringListCallbackData *) data;
+    PHYSFS_TraceEvent event;
+    const TraceHook *hook;
 
-    if (pecd->errcode)
+    if (!TRACE_HOOKED())
         return;
 
-    ptr = allocator.Realloc(pecd->list, (pecd->size + 2) * sizeof (char *));
-    newstr = (char *) allocator.Malloc(strlen(str) + 1);
-    if (ptr != NULL)
-        pecd->list = (char **) ptr;
+    event.type = type;
+    event.id = id;
+    event.path = path;
+    event.archive = archive;
+    event.offset = offset;
+    event.requested = requested;
+    event.result = result;
+    event.start = start;
+    event.end = __PHYSFS_platformGetTicks();  /* before waiting on the lock. */
 
-    if ((ptr == NULL) || (newstr == NULL))
-    {
-        pecd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
-        pecd->list[pecd->size] = NULL;
-        PHYSFS_freeList(pecd->list);
-        return;
-    } /* if */
+    if (traceLock) __PHYSFS_platformGrabMutex(traceLock);
+    hook = traceHook;
+    if (hook != NULL)
+        hook->cb(hook->data, &event);
+    if (traceLock) __PHYSFS_platformReleaseMutex(traceLock);
+} /* traceEvent */
 
-    strcpy(newstr, str);
-    pecd->list[pecd->size] = newstr;
-    pecd->size++;
-} /* enumStringListCallback */
 
+/* PHYSFS_Io implementation that reports everything done to another Io... */
 
-static char **doEnumStringList(void (*func)(PHYSFS_StringCallback, void *))
+typedef struct __PHYSFS_TraceIoInfo
 {
-    EnumStringListCallbackData ecd;
-    memset(&ecd, '\0', sizeof (ecd));
-    ecd.list = (char **) allocator.Malloc(sizeof (char *));
-    BAIL_IF_MACRO(!ecd.list, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    func(enumStringListCallback, &ecd);
-
-    if (ecd.errcode)
-    {
-        PHYSFS_setErrorCode(ecd.errcode);
-        return NULL;
-    } /* if */
+    PHYSFS_Io *io;  /* the one we're watching. */
+    PHYSFS_uint64 id;
+    PHYSFS_uint64 pos;
+    char *path;
+    const char *archive;  /* the DirHandle's, which outlives us. */
+} TraceIoInfo;
+
+static PHYSFS_Io *createTraceIo(PHYSFS_Io *io, PHYSFS_uint64 id,
+                                const char *path, const char *archive);
+
+static PHYSFS_sint64 traceIo_read(PHYSFS_Io *io, void *buf, PHYSFS_uint64 len)
+{
+    TraceIoInfo *info = (TraceIoInfo *) io->opaque;
+    const PHYSFS_uint64 start = __PHYSFS_platformGetTicks();
+    const PHYSFS_sint64 rc = info->io->read(info->io, buf, len);
+    traceEvent(PHYSFS_TRACE_READ, info->id, info->path, info->archive,
+               info->pos, len, rc, start);
+    if (rc > 0)
+        info->pos += rc;
+    return rc;
+} /* traceIo_read */
+
+static PHYSFS_sint64 traceIo_write(PHYSFS_Io *io, const void *buffer,
+                                   PHYSFS_uint64 len)
+{
+    TraceIoInfo *info = (TraceIoInfo *) io->opaque;
+    const PHYSFS_uint64 start = __PHYSFS_platformGetTicks();
+    const PHYSFS_sint64 rc = info->io->write(info->io, buffer, len);
+    traceEvent(PHYSFS_TRACE_WRITE, info->id, info->path, info->archive,
+               info->pos, len, rc, start);
+    if (rc > 0)
+        info->pos += rc;
+    return rc;
+} /* traceIo_write */
+
+static int traceIo_seek(PHYSFS_Io *io, PHYSFS_uint64 offset)
+{
+    TraceIoInfo *info = (TraceIoInfo *) io->opaque;
+    const PHYSFS_uint64 start = __PHYSFS_platformGetTicks();
+    const int rc = info->io->seek(info->io, offset);
+    traceEvent(PHYSFS_TRACE_SEEK, info->id, info->path, info->archive,
+               offset, 0, rc, start);
+    if (rc)
+        info->pos = offset;
+    return rc;
+} /* traceIo_seek */
+
+static PHYSFS_sint64 traceIo_tell(PHYSFS_Io *io)
+{
+    TraceIoInfo *info = (TraceIoInfo *) io->opaque;
+    return info->io->tell(info->io);
+} /* traceIo_tell */
+
+static PHYSFS_sint64 traceIo_length(PHYSFS_Io *io)
+{
+    TraceIoInfo *info = (TraceIoInfo *) io->opaque;
+    return info->io->length(info->io);
+} /* traceIo_length */
+
+static PHYSFS_Io *traceIo_duplicate(PHYSFS_Io *io)
+{
+    TraceIoInfo *info = (TraceIoInfo *) io->opaque;
+    PHYSFS_Io *dup = info->io->duplicate(info->io);
+    PHYSFS_Io *retval;
+    PHYSFS_uint64 id;
+
+    BAIL_IF_MACRO(!dup, ERRPASS, NULL);
 
-    ecd.list[ecd.size] = NULL;
-    return ecd.list;
-} /* doEnumStringList */
+    __PHYSFS_platformGrabMutex(stateLock);
+    id = ++lastTraceId;
+    __PHYSFS_platformReleaseMutex(stateLock);
 
+    retval = createTraceIo(dup, id, info->path, info->archive);
+    if (retval == NULL)
+        dup->destroy(dup);
+    return retval;
+} /* traceIo_duplicate */
 
-static void __PHYSFS_bubble_sort(void *a, size_t lo, size_t hi,
-                                 int (*cmpfn)(void *, size_t, size_t),
-                                 void (*swapfn)(void *, size_t, size_t))
+static int traceIo_flush(PHYSFS_Io *io)
 {
-    size_t i;
-    int sorted;
+    TraceIoInfo *info = (TraceIoInfo *) io->opaque;
+    return info->io->flush(info->io);
+} /* traceIo_flush */
 
-    do
-    {
-        sorted = 1;
-        for (i = lo; i < hi; i++)
-        {
-            if (cmpfn(a, i, i + 1) > 0)
-            {
-                swapfn(a, i, i + 1);
-                sorted = 0;
-            } /* if */
-        } /* for */
-    } while (!sorted);
-} /* __PHYSFS_bubble_sort */
+static void traceIo_destroy(PHYSFS_Io *io)
+{
+    TraceIoInfo *info = (TraceIoInfo *) io->opaque;
+    const PHYSFS_uint64 start = __PHYSFS_platformGetTicks();
+    info->io->destroy(info->io);
+    traceEvent(PHYSFS_TRACE_CLOSE, info->id, info->path, info->archive,
+               info->pos, 0, 1, start);
+    allocator.Free(info->path);
+    allocator.Free(info);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, io);
+} /* traceIo_destroy */
 
+static const PHYSFS_Io __PHYSFS_traceIoInterface =
+{
+    CURRENT_PHYSFS_IO_API_VERSION, NULL,
+    traceIo_read,
+    traceIo_write,
+    traceIo_seek,
+    traceIo_tell,
+    traceIo_length,
+    traceIo_duplicate,
+    traceIo_flush,
+    traceIo_destroy
+};
 
-static void __PHYSFS_quick_sort(void *a, size_t lo, size_t hi,
-                         int (*cmpfn)(void *, size_t, size_t),
-                         void (*swapfn)(void *, size_t, size_t))
+static PHYSFS_Io *createTraceIo(PHYSFS_Io *io, PHYSFS_uint64 id,
+                                const char *path, const char *archive)
 {
-    size_t i;
-    size_t j;
-    size_t v;
+    PHYSFS_Io *retval = NULL;
+    TraceIoInfo *info = NULL;
+    const PHYSFS_sint64 pos = io->tell(io);
+
+    retval = (PHYSFS_Io *) __PHYSFS_poolAlloc(&__PHYSFS_ioPool);
+    GOTO_IF_MACRO(!retval, ERRPASS, createTraceIo_failed);
+    info = (TraceIoInfo *) allocator.Malloc(sizeof (TraceIoInfo));
+    GOTO_IF_MACRO(!info, PHYSFS_ERR_OUT_OF_MEMORY, createTraceIo_failed);
+    info->path = __PHYSFS_strdup(path);
+    GOTO_IF_MACRO(!info->path, PHYSFS_ERR_OUT_OF_MEMORY, createTraceIo_failed);
+
+    info->io = io;
+    info->id = id;
+    info->pos = (pos > 0) ? (PHYSFS_uint64) pos : 0;
+    info->archive = archive;
+    memcpy(retval, &__PHYSFS_traceIoInterface, sizeof (*retval));
+    retval->opaque = info;
+    return retval;
 
-    if ((hi - lo) <= PHYSFS_QUICKSORT_THRESHOLD)
-        __PHYSFS_bubble_sort(a, lo, hi, cmpfn, swapfn);
-    else
-    {
-        i = (hi + lo) / 2;
+createTraceIo_failed:
+    allocator.Free(info);
+    __PHYSFS_poolFree(&__PHYSFS_ioPool, retval);
+    return NULL;
+} /* createTraceIo */
 
-        if (cmpfn(a, lo, i) > 0) swapfn(a, lo, i);
-        if (cmpfn(a, lo, hi) > 0) swapfn(a, lo, hi);
-        if (cmpfn(a, i, hi) > 0) swapfn(a, i, hi);
 
-        j = hi - 1;
-        swapfn(a, i, j);
-        i = lo;
-        v = j;
-        while (1)
-        {
-            while(cmpfn(a, ++i, v) < 0) { /* do nothing */ }
-            while(cmpfn(a, --j, v) > 0) { /* do nothing */ }
-            if (j < i)
-                break;
-            swapfn(a, i, j);
-        } /* while */
-        if (i != (hi-1))
-            swapfn(a, i, hi-1);
-        __PHYSFS_quick_sort(a, lo, j, cmpfn, swapfn);
-        __PHYSFS_quick_sort(a, i+1, hi, cmpfn, swapfn);
-    } /* else */
-} /* __PHYSFS_quick_sort */
+/*
+ * Report an open of (fname) in (dh), and wrap (io) so we hear about
+ *  everything else done to it. If we can't, the file just isn't traced.
+ *  (io) is NULL and (dh) is where we stopped looking if the open failed.
+ *  MAKE SURE you hold stateLock before calling this!
+ */
+static PHYSFS_Io *traceOpen(PHYSFS_Io *io, const DirHandle *dh,
+                            const char *fname, PHYSFS_uint64 start)
+{
+    const PHYSFS_uint64 id = ++lastTraceId;
+    PHYSFS_Io *retval = NULL;
+    __PHYSFS_MemCharge charge;
+
+    if (io == NULL)
+    {
+        traceEvent(PHYSFS_TRACE_OPEN, id, fname, NULL, 0, 0, 0, start);
+        return NULL;
+    } /* if */
 
+    traceEvent(PHYSFS_TRACE_OPEN, id, fname, dh->dirName, 0, 0, 1, start);
+    __PHYSFS_memCharge(dh->memory, PHYSFS_MEMORY_HANDLES, &charge);
+    retval = createTraceIo(io, id, fname, dh->dirName);
+    __PHYSFS_memRestore(&charge);
+    return (retval != NULL) ? retval : io;
+} /* traceOpen */
 
-void __PHYSFS_sort(void *entries, size_t max,
-                   int (*cmpfn)(void *, size_t, size_t),
-                   void (*swapfn)(void *, size_t, size_t))
+
+/* The built-in trace callback, writing Chrome's trace-event JSON... */
+
+#define TRACEFILE_BUFSIZE (64 * 1024)
+
+/* Only touched by traceFileCallback(), under traceLock, until it's unhooked. */
+typedef struct
 {
-    /*
-     * Quicksort w/ Bubblesort fallback algorithm inspired by code from here:
-     *   https://www.cs.ubc.ca/spider/harrison/Java/sorting-demo.html
-     */
-    if (max > 0)
-        __PHYSFS_quick_sort(entries, 0, max - 1, cmpfn, swapfn);
-} /* __PHYSFS_sort */
+    PHYSFS_Io *io;
+    size_t buflen;
+    int empty;  /* no events yet, so no comma before the next one. */
+    char buf[TRACEFILE_BUFSIZE];
+} TraceFile;
 
+static TraceFile *traceFile = NULL;
 
-static ErrState *findErrorForCurrentThread(void)
+static void traceFileFlush(TraceFile *tf)
 {
-    ErrState *i;
-    void *tid;
+    if (tf->buflen > 0)
+    {
+        tf->io->write(tf->io, tf->buf, tf->buflen);  /* nothing to do if it fails. */
+        tf->buflen = 0;
+    } /* if */
+} /* traceFileFlush */
 
-    if (errorLock != NULL)
-        __PHYSFS_platformGrabMutex(errorLock);
+static void traceFileAppend(TraceFile *tf, const char *str, size_t len)
+{
+    if ((tf->buflen + len) > TRACEFILE_BUFSIZE)
+        traceFileFlush(tf);
 
-    if (errorStates != NULL)
+    if (len > TRACEFILE_BUFSIZE)
+        tf->io->write(tf->io, str, len);
+    else
     {
-        tid = __PHYSFS_platformGetThreadID();
+        memcpy(tf->buf + tf->buflen, str, len);
+        tf->buflen += len;
+    } /* else */
+} /* traceFileAppend */
 
-        for (i = errorStates; i != NULL; i = i->next)
+static void traceFileAppendStr(TraceFile *tf, const char *str)
+{
+    traceFileAppend(tf, str, strlen(str));
+} /* traceFileAppendStr */
+
+static void traceFileAppendUInt(TraceFile *tf, PHYSFS_uint64 val)
+{
+    char buf[24];
+    char *ptr = buf + sizeof (buf);
+    do
+    {
+        *(--ptr) = (char) ('0' + (val % 10));
+        val /= 10;
+    } while (val != 0);
+    traceFileAppend(tf, ptr, (size_t) ((buf + sizeof (buf)) - ptr));
+} /* traceFileAppendUInt */
+
+/* Chrome wants microseconds; keep the nanoseconds as decimals. */
+static void traceFileAppendMicroseconds(TraceFile *tf, const PHYSFS_uint64 ns)
+{
+    char frac[5];
+    const PHYSFS_uint32 rem = (PHYSFS_uint32) (ns % 1000);
+    traceFileAppendUInt(tf, ns / 1000);
+    frac[0] = '.';
+    frac[1] = (char) ('0' + (rem / 100));
+    frac[2] = (char) ('0' + ((rem / 10) % 10));
+    frac[3] = (char) ('0' + (rem % 10));
+    frac[4] = '\0';
+    traceFileAppendStr(tf, frac);
+} /* traceFileAppendMicroseconds */
+
+static void traceFileAppendJsonStr(TraceFile *tf, const char *str)
+{
+    traceFileAppend(tf, "\"", 1);
+    if (str != NULL)
+    {
+        const char *start = str;
+        for (; *str; str++)
         {
-            if (i->tid == tid)
+            const PHYSFS_uint8 ch = (PHYSFS_uint8) *str;
+            if ((ch < 0x20) || (ch == '"') || (ch == '\\'))
             {
-                if (errorLock != NULL)
-                    __PHYSFS_platformReleaseMutex(errorLock);
-                return i;
+                static const char hex[] = "0123456789abcdef";
+                char esc[7] = { '\\', 'u', '0', '0', 0, 0, 0 };
+                esc[4] = hex[ch >> 4];
+                esc[5] = hex[ch & 0xF];
+                traceFileAppend(tf, start, (size_t) (str - start));
+                traceFileAppend(tf, esc, 6);
+                start = str + 1;
             } /* if */
         } /* for */
+        traceFileAppend(tf, start, (size_t) (str - start));
     } /* if */
+    traceFileAppend(tf, "\"", 1);
+} /* traceFileAppendJsonStr */
+
+static void traceFileCallback(void *data, const PHYSFS_TraceEvent *event)
+{
+    static const char *names[] = {
+        "mount", "unmount", "open", "read", "write", "seek", "close"
+    };
+    TraceFile *tf = (TraceFile *) data;
+    const size_t tid = (size_t) __PHYSFS_platformGetThreadID();
+
+    traceFileAppendStr(tf, tf->empty ? "\n{\"name\":\"" : ",\n{\"name\":\"");
+    tf->empty = 0;
+    traceFileAppendStr(tf, names[event->type]);
+    traceFileAppendStr(tf, "\",\"cat\":\"physfs\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+    traceFileAppendUInt(tf, (PHYSFS_uint64) tid);
+    traceFileAppendStr(tf, ",\"ts\":");
+    traceFileAppendMicroseconds(tf, event->start);
+    traceFileAppendStr(tf, ",\"dur\":");
+    traceFileAppendMicroseconds(tf, event->end - event->start);
+    traceFileAppendStr(tf, ",\"args\":{\"path\":");
+    traceFileAppendJsonStr(tf, event->path);
+    traceFileAppendStr(tf, ",\"archive\":");
+    traceFileAppendJsonStr(tf, event->archive);
+    traceFileAppendStr(tf, ",\"id\":");
+    traceFileAppendUInt(tf, event->id);
+    traceFileAppendStr(tf, ",\"offset\":");
+    traceFileAppendUInt(tf, event->offset);
+    traceFileAppendStr(tf, ",\"requested\":");
+    traceFileAppendUInt(tf, event->requested);
+    traceFileAppendStr(tf, ",\"result\":");
+    if (event->result < 0)
+        traceFileAppendStr(tf, "-1");
+    else
+        traceFileAppendUInt(tf, (PHYSFS_uint64) event->result);
+    traceFileAppendStr(tf, "}}");
+} /* traceFileCallback */
 
-    if (errorLock != NULL)
-        __PHYSFS_platformReleaseMutex(errorLock);
-
-    return NULL;   /* no error available. */
-} /* findErrorForCurrentThread */
+static void closeTraceFile(void)
+{
+    TraceFile *tf = traceFile;
+    if (tf == NULL)
+        return;
 
+    /* once this returns, no callback is still writing to (tf). */
+    if (traceLock) __PHYSFS_platformGrabMutex(traceLock);
+    if ((traceHook != NULL) && (traceHook->data == tf))
+        PHYSFS_setTraceCallback(NULL, NULL);
+    if (traceLock) __PHYSFS_platformReleaseMutex(traceLock);
 
-/* this doesn't reset the error state. */
-static inline PHYSFS_ErrorCode currentErrorCode(void)
-{
-    const ErrState *err = findErrorForCurrentThread();
-    return err ? err->code : PHYSFS_ERR_OK;
-} /* currentErrorCode */
+    traceFileAppendStr(tf, "\n]}\n");
+    traceFileFlush(tf);
+    tf->io->flush(tf->io);
+    tf->io->destroy(tf->io);
+    allocator.Free(tf);
+    traceFile = NULL;
+} /* closeTraceFile */
 
 
-PHYSFS_ErrorCode PHYSFS_getLastErrorCode(void)
-{
-    ErrState *err = findErrorForCurrentThread();
-    const PHYSFS_ErrorCode retval = (err) ? err->code : PHYSFS_ERR_OK;
-    if (err)
-        err->code = PHYSFS_ERR_OK;
-    return retval;
-} /* PHYSFS_getLastErrorCode */
+/* asynchronous requests ... */
 
+#define ASYNC_MAX_THREADS 64
+#define ASYNC_BATCH_MAX 32
+#define ASYNC_MERGE_GAP (64 * 1024)  /* read through holes this small... */
+#define ASYNC_MERGE_MAX (4 * 1024 * 1024)  /* ...up to this much at once. */
 
-PHYSFS_DECL const char *PHYSFS_getErrorByCode(PHYSFS_ErrorCode code)
+struct PHYSFS_AsyncRequest
 {
-    switch (code)
-    {
-        case PHYSFS_ERR_OK: return "no error";
-        case PHYSFS_ERR_OTHER_ERROR: return "unknown error";
-        case PHYSFS_ERR_OUT_OF_MEMORY: return "out of memory";
-        case PHYSFS_ERR_NOT_INITIALIZED: return "not initialized";
-        case PHYSFS_ERR_IS_INITIALIZED: return "already initialized";
-        case PHYSFS_ERR_ARGV0_IS_NULL: return "argv[0] is NULL";
-        case PHYSFS_ERR_UNSUPPORTED: return "unsupported";
-        case PHYSFS_ERR_PAST_EOF: return "past end of file";
-        case PHYSFS_ERR_FILES_STILL_OPEN: return "files still open";
-        case PHYSFS_ERR_INVALID_ARGUMENT: return "invalid argument";
-        case PHYSFS_ERR_NOT_MOUNTED: return "not mounted";
-        case PHYSFS_ERR_NOT_FOUND: return "not found";
-        case PHYSFS_ERR_SYMLINK_FORBIDDEN: return "symlinks are forbidden";
-        case PHYSFS_ERR_NO_WRITE_DIR: return "write directory is not set";
-        case PHYSFS_ERR_OPEN_FOR_READING: return "file open for reading";
-        case PHYSFS_ERR_OPEN_FOR_WRITING: return "file open for writing";
-        case PHYSFS_ERR_NOT_A_FILE: return "not a file";
-        case PHYSFS_ERR_READ_ONLY: return "read-only filesystem";
-        case PHYSFS_ERR_CORRUPT: return "corrupted";
-        case PHYSFS_ERR_SYMLINK_LOOP: return "infinite symbolic link loop";
-        case PHYSFS_ERR_IO: return "i/o error";
-        case PHYSFS_ERR_PERMISSION: return "permission denied";
-        case PHYSFS_ERR_NO_SPACE: return "no space available for writing";
-        case PHYSFS_ERR_BAD_FILENAME: return "filename is illegal or insecure";
-        case PHYSFS_ERR_BUSY: return "tried to modify a file the OS needs";
-        case PHYSFS_ERR_DIR_NOT_EMPTY: return "directory isn't empty";
-        case PHYSFS_ERR_OS_ERROR: return "OS reported an error";
-        case PHYSFS_ERR_DUPLICATE: return "duplicate resource";
-        case PHYSFS_ERR_BAD_PASSWORD: return "bad password";
-    } /* switch */
+    PHYSFS_AsyncStatus status;  /* RUNNING until the callback returns. */
+    FileHandle *fh;  /* file to read, or the file an open produced. */
+    char *fname;  /* file to open; NULL for reads. */
+    DirHandle *archive;  /* batches are one archive's reads. NULL for opens. */
+    void *buffer;
+    PHYSFS_uint64 offset;
+    PHYSFS_uint64 len;
+    PHYSFS_uint64 physpos;  /* where the bytes are in (archive), roughly. */
+    PHYSFS_uint64 serial;  /* order of submission, to break ties. */
+    PHYSFS_sint64 result;
+    PHYSFS_ErrorCode error;
+    PHYSFS_AsyncCallback callback;
+    void *callbackData;
+    void *waitSem;  /* created the first time someone has to wait. */
+    PHYSFS_uint32 waiters;  /* threads waiting on (waitSem). */
+    int freed;  /* PHYSFS_freeAsync() was called while it was running. */
+    int fill;  /* a buffer refill: read (fh)'s Io from wherever it is. */
+    struct PHYSFS_AsyncRequest *prev;  /* the queue, while it's PENDING. */
+    struct PHYSFS_AsyncRequest *next;
+    struct PHYSFS_AsyncRequest *prevLive;  /* every request not yet freed. */
+    struct PHYSFS_AsyncRequest *nextLive;
+};
 
-    return NULL;  /* don't know this error code. */
-} /* PHYSFS_getErrorByCode */
+/* All of this is protected by asyncLock. */
+static __PHYSFS_Pool asyncPool = __PHYSFS_POOL_INIT(sizeof (PHYSFS_AsyncRequest), 64);
+static PHYSFS_AsyncRequest *asyncQueue = NULL;  /* oldest first. */
+static PHYSFS_AsyncRequest *asyncQueueTail = NULL;
+static PHYSFS_AsyncRequest *asyncLive = NULL;
+static PHYSFS_uint64 asyncSerial = 0;
+static PHYSFS_uint32 asyncWanted = 4;  /* from PHYSFS_setAsyncThreads(). */
+static PHYSFS_uint32 asyncThreadCount = 0;  /* workers actually running. */
+static void *asyncThreads[ASYNC_MAX_THREADS];
+static void *asyncWork = NULL;  /* posted once for every queued request. */
+static int asyncQuit = 0;  /* non-zero tells the workers to return. */
+static int asyncNoThreads = 0;  /* couldn't start any; don't keep trying. */
 
 
-void PHYSFS_setErrorCode(PHYSFS_ErrorCode errcode)
+/* Where (io)'s bytes are stored, if we can tell. */
+static int ioDataRange(PHYSFS_Io *io, PHYSFS_DataRange *range)
 {
-    ErrState *err;
-
-    if (!errcode)
-        return;
+    if (io->read == traceIo_read)
+        io = ((TraceIoInfo *) io->opaque)->io;
 
-    err = findErrorForCurrentThread();
-    if (err == NULL)
+    if (io->read == nativeIo_read)  /* a file straight out of a directory. */
     {
-        err = (ErrState *) allocator.Malloc(sizeof (ErrState));
-        if (err == NULL)
-            return;   /* uhh...? */
+        const PHYSFS_sint64 len = io->length(io);
+        range->io = io;
+        range->offset = 0;
+        range->len = (len > 0) ? (PHYSFS_uint64) len : 0;
+        range->raw = 1;
+        return 1;
+    } /* if */
 
-        memset(err, '\0', sizeof (ErrState));
-        err->tid = __PHYSFS_platformGetThreadID();
+    #if PHYSFS_SUPPORTS_ZIP
+    if (__PHYSFS_ZIP_dataRange(io, range))
+        return 1;
+    #endif
 
-        if (errorLock != NULL)
-            __PHYSFS_platformGrabMutex(errorLock);
+    #if PHYSFS_SUPPORTS_ISO9660
+    if (__PHYSFS_ISO9660_dataRange(io, range))
+        return 1;
+    #endif
 
-        err->next = errorStates;
-        errorStates = err;
+    return UNPK_dataRange(io, range);
+} /* ioDataRange */
 
-        if (errorLock != NULL)
-            __PHYSFS_platformReleaseMutex(errorLock);
-    } /* if */
 
-    err->code = errcode;
-} /* PHYSFS_setErrorCode */
+/* MAKE SURE you hold asyncLock before calling this! */
+static void asyncDequeue(PHYSFS_AsyncRequest *req)
+{
+    if (req->prev != NULL)
+        req->prev->next = req->next;
+    else
+        asyncQueue = req->next;
 
+    if (req->next != NULL)
+        req->next->prev = req->prev;
+    else
+        asyncQueueTail = req->prev;
 
-const char *PHYSFS_getLastError(void)
-{
-    const PHYSFS_ErrorCode err = PHYSFS_getLastErrorCode();
-    return (err) ? PHYSFS_getErrorByCode(err) : NULL;
-} /* PHYSFS_getLastError */
+    req->prev = req->next = NULL;
+} /* asyncDequeue */
 
 
-/* MAKE SURE that errorLock is held before calling this! */
-static void freeErrorStates(void)
+/*
+ * MAKE SURE you hold asyncLock before calling this! A read waits for the
+ *  file's background refill too, since that's moving the same Io. The
+ *  refill itself never waits: whoever started it might be waiting on it.
+ */
+static int asyncRunnable(const PHYSFS_AsyncRequest *req)
 {
-    ErrState *i;
-    ErrState *next;
+    if ((req->fname != NULL) || (req->fill))
+        return 1;
+    return ((!req->fh->asyncBusy) && (!req->fh->asyncFilling));
+} /* asyncRunnable */
 
-    for (i = errorStates; i != NULL; i = next)
-    {
-        next = i->next;
-        allocator.Free(i);
-    } /* for */
 
-    errorStates = NULL;
-} /* freeErrorStates */
+/* MAKE SURE you hold asyncLock before calling this! */
+static void asyncStartRequest(PHYSFS_AsyncRequest *req)
+{
+    asyncDequeue(req);
+    req->status = PHYSFS_ASYNC_RUNNING;
+    if ((req->fname == NULL) && (!req->fill))
+        req->fh->asyncBusy = 1;
+} /* asyncStartRequest */
 
 
-void PHYSFS_getLinkedVersion(PHYSFS_Version *ver)
+/*
+ * MAKE SURE you hold asyncLock before calling this! Returns the file an open
+ *  request produced, if nobody took it; close that after letting go.
+ */
+static PHYSFS_File *asyncFree(PHYSFS_AsyncRequest *req)
 {
-    if (ver != NULL)
+    PHYSFS_File *retval = NULL;
+
+    if (req->fname != NULL)
     {
-        ver->major = PHYSFS_VER_MAJOR;
-        ver->minor = PHYSFS_VER_MINOR;
-        ver->patch = PHYSFS_VER_PATCH;
+        retval = (PHYSFS_File *) req->fh;
+        allocator.Free(req->fname);
     } /* if */
-} /* PHYSFS_getLinkedVersion */
-
 
-static const char *find_filename_extension(const char *fname)
-{
-    const char *retval = NULL;
-    if (fname != NULL)
-    {
-        const char *p = strchr(fname, '.');
-        retval = p;
+    if (req->prevLive != NULL)
+        req->prevLive->nextLive = req->nextLive;
+    else
+        asyncLive = req->nextLive;
 
-        while (p != NULL)
-        {
-            p = strchr(p + 1, '.');
-            if (p != NULL)
-                retval = p;
-        } /* while */
+    if (req->nextLive != NULL)
+        req->nextLive->prevLive = req->prevLive;
 
-        if (retval != NULL)
-            retval++;  /* skip '.' */
-    } /* if */
+    if (req->waitSem != NULL)
+        __PHYSFS_platformDestroySemaphore(req->waitSem);
 
+    __PHYSFS_poolFree(&asyncPool, req);
     return retval;
-} /* find_filename_extension */
+} /* asyncFree */
 
 
-static DirHandle *tryOpenDir(PHYSFS_Io *io, const PHYSFS_Archiver *funcs,
-                             const char *d, int forWriting)
+/* Do the actual work. No locks held; the caller owns (req) right now. */
+static PHYSFS_AsyncStatus asyncRun(PHYSFS_AsyncRequest *req)
 {
-    DirHandle *retval = NULL;
-    void *opaque = NULL;
+    if (req->fname != NULL)
+    {
+        req->fh = (FileHandle *) PHYSFS_openRead(req->fname);
+        req->result = (req->fh != NULL) ? 1 : -1;
+    } /* if */
 
-    if (io != NULL)
-        BAIL_IF_MACRO(!io->seek(io, 0), ERRPASS, NULL);
+    else if (req->fill)  /* the handle's owner is reading the other buffer. */
+    {
+        PHYSFS_Io *io = req->fh->io;
+        req->result = io->read(io, req->buffer, req->len);
+    } /* else if */
 
-    opaque = funcs->openArchive(io, d, forWriting);
-    if (opaque != NULL)
+    else
     {
-        retval = (DirHandle *) allocator.Malloc(sizeof (DirHandle));
-        if (retval == NULL)
-            funcs->closeArchive(opaque);
+        /* follow-on reads keep streaming; no seek, no inflate restart. */
+        PHYSFS_File *f = (PHYSFS_File *) req->fh;
+        const PHYSFS_sint64 pos = PHYSFS_tell(f);
+        if ((pos >= 0) && ((PHYSFS_uint64) pos == req->offset))
+            req->result = PHYSFS_readBytes(f, req->buffer, req->len);
+        else if (PHYSFS_seek(f, req->offset))
+            req->result = PHYSFS_readBytes(f, req->buffer, req->len);
         else
-        {
-            memset(retval, '\0', sizeof (DirHandle));
-            retval->mountPoint = NULL;
-            retval->funcs = funcs;
-            retval->opaque = opaque;
-        } /* else */
-    } /* if */
+            req->result = -1;
+    } /* else */
 
-    return retval;
-} /* tryOpenDir */
+    if (req->result >= 0)
+        return PHYSFS_ASYNC_DONE;
+
+    req->error = PHYSFS_getLastErrorCode();
+    if (req->error == PHYSFS_ERR_OK)
+        req->error = PHYSFS_ERR_OTHER_ERROR;
+    return PHYSFS_ASYNC_FAILED;
+} /* asyncRun */
 
 
-static DirHandle *openDirectory(PHYSFS_Io *io, const char *d, int forWriting)
+/* Call back, then publish (status). (req) might be gone after this. */
+static void asyncFinish(PHYSFS_AsyncRequest *req, PHYSFS_AsyncStatus status)
 {
-    DirHandle *retval = NULL;
-    const PHYSFS_Archiver **i;
-    const char *ext;
-    int created_io = 0;
+    PHYSFS_File *orphan = NULL;
 
-    assert((io != NULL) || (d != NULL));
+    if (req->callback != NULL)
+        req->callback(req->callbackData, req, status);
 
-    if (io == NULL)
-    {
-        /* DIR gets first shot (unlike the rest, it doesn't deal with files). */
-        extern const PHYSFS_Archiver __PHYSFS_Archiver_DIR;
-        retval = tryOpenDir(io, &__PHYSFS_Archiver_DIR, d, forWriting);
-        if (retval != NULL)
-            return retval;
+    __PHYSFS_platformGrabMutex(asyncLock);
+    if (req->fill)  /* the Io is the handle's own again. */
+        req->fh->asyncFilling = 0;
+    req->status = status;
+    for (; req->waiters > 0; req->waiters--)
+        __PHYSFS_platformPostSemaphore(req->waitSem);
+    if (req->freed)
+        orphan = asyncFree(req);
+    __PHYSFS_platformReleaseMutex(asyncLock);
 
-        io = __PHYSFS_createNativeIo(d, forWriting ? 'w' : 'r');
-        BAIL_IF_MACRO(!io, ERRPASS, 0);
-        created_io = 1;
-    } /* if */
+    if (orphan != NULL)
+        PHYSFS_close(orphan);
+} /* asyncFinish */
 
-    ext = find_filename_extension(d);
-    if (ext != NULL)
-    {
-        /* Look for archivers with matching file extensions first... */
-        for (i = archivers; (*i != NULL) && (retval == NULL); i++)
-        {
-            if (__PHYSFS_utf8stricmp(ext, (*i)->info.extension) == 0)
-                retval = tryOpenDir(io, *i, d, forWriting);
-        } /* for */
 
-        /* failing an exact file extension match, try all the others... */
-        for (i = archivers; (*i != NULL) && (retval == NULL); i++)
-        {
-            if (__PHYSFS_utf8stricmp(ext, (*i)->info.extension) != 0)
-                retval = tryOpenDir(io, *i, d, forWriting);
-        } /* for */
-    } /* if */
+static int asyncBatchCmp(void *_batch, size_t one, size_t two)
+{
+    PHYSFS_AsyncRequest **batch = (PHYSFS_AsyncRequest **) _batch;
+    const PHYSFS_AsyncRequest *a = batch[one];
+    const PHYSFS_AsyncRequest *b = batch[two];
 
-    else  /* no extension? Try them all. */
-    {
-        for (i = archivers; (*i != NULL) && (retval == NULL); i++)
-            retval = tryOpenDir(io, *i, d, forWriting);
-    } /* else */
+    if (a->physpos != b->physpos)
+        return (a->physpos < b->physpos) ? -1 : 1;
+    else if (a->serial != b->serial)
+        return (a->serial < b->serial) ? -1 : 1;
+    return 0;
+} /* asyncBatchCmp */
 
-    if ((!retval) && (created_io))
-        io->destroy(io);
 
-    BAIL_IF_MACRO(!retval, PHYSFS_ERR_UNSUPPORTED, NULL);
-    return retval;
-} /* openDirectory */
+static void asyncBatchSwap(void *_batch, size_t one, size_t two)
+{
+    PHYSFS_AsyncRequest **batch = (PHYSFS_AsyncRequest **) _batch;
+    PHYSFS_AsyncRequest *tmp = batch[one];
+    batch[one] = batch[two];
+    batch[two] = tmp;
+} /* asyncBatchSwap */
 
 
 /*
- * Make a platform-independent path string sane. Doesn't actually check the
- *  file hierarchy, it just cleans up the string.
- *  (dst) must be a buffer at least as big as (src), as this is where the
- *  cleaned up string is deposited.
- * If there are illegal bits in the path (".." entries, etc) then we
- *  return zero and (dst) is undefined. Non-zero if the path was sanitized.
+ * MAKE SURE you hold asyncLock before calling this! Takes the oldest request
+ *  that can run, and everything else queued for the same archive that can,
+ *  in the order it's laid out there. Files in use elsewhere are skipped;
+ *  whoever's using them comes back for the rest when they're done.
  */
-static int sanitizePlatformIndependentPath(const char *src, char *dst)
+static PHYSFS_uint32 asyncTakeBatch(PHYSFS_AsyncRequest **batch)
 {
-    char *prev;
-    char ch;
+    PHYSFS_AsyncRequest *i;
+    PHYSFS_AsyncRequest *next;
+    DirHandle *archive = NULL;
+    PHYSFS_uint32 count = 0;
+    PHYSFS_uint32 j;
 
-    while (*src == '/')  /* skip initial '/' chars... */
-        src++;
+    for (i = asyncQueue; i != NULL; i = i->next)
+    {
+        if (asyncRunnable(i))
+            break;
+    } /* for */
 
-    prev = dst;
-    do
+    if (i == NULL)
+        return 0;
+
+    /* collect first: several requests can share a file we'll mark busy. */
+    archive = i->archive;
+    for (; (i != NULL) && (count < ASYNC_BATCH_MAX); i = next)
     {
-        ch = *(src++);
+        next = i->next;
+        if ((i->archive == archive) && (asyncRunnable(i)))
+            batch[count++] = i;
+    } /* for */
 
-        if ((ch == ':') || (ch == '\\'))  /* illegal chars in a physfs path. */
-            BAIL_MACRO(PHYSFS_ERR_BAD_FILENAME, 0);
+    for (j = 0; j < count; j++)
+        asyncStartRequest(batch[j]);
 
-        if (ch == '/')   /* path separator. */
-        {
-            *dst = '\0';  /* "." and ".." are illegal pathnames. */
-            if ((__PHYSFS_utf8stricmp(prev, ".") == 0) || (__PHYSFS_utf8stricmp(prev, "..") == 0))
-                BAIL_MACRO(PHYSFS_ERR_BAD_FILENAME, 0);
+    __PHYSFS_sort(batch, count, asyncBatchCmp, asyncBatchSwap);
+    return count;
+} /* asyncTakeBatch */
 
-            while (*src == '/')   /* chop out doubles... */
-                src++;
 
-            if (*src == '\0') /* ends with a pathsep? */
-                break;  /* we're done, don't add final pathsep to dst. */
+/* What asyncRunBatch() works out about each request in a batch. */
+typedef struct AsyncBatchInfo
+{
+    PHYSFS_DataRange range;
+    PHYSFS_Io *native;  /* (range.io), if it's a native file; else NULL. */
+    int direct;  /* asyncReadDirect() took care of it. */
+    PHYSFS_sint32 span;  /* which AsyncSpan it reads from, or -1. */
+} AsyncBatchInfo;
 
-            prev = dst + 1;
-        } /* if */
+/* Neighbouring requests' bytes, read from their archive in one go. */
+typedef struct AsyncSpan
+{
+    PHYSFS_uint32 first;  /* first and last request in the batch using it. */
+    PHYSFS_uint32 last;
+    PHYSFS_uint32 members;
+    PHYSFS_uint64 start;
+    PHYSFS_uint64 end;
+    PHYSFS_uint8 *buffer;  /* NULL if it couldn't be read; nobody uses it. */
+} AsyncSpan;
 
-        *(dst++) = ch;
-    } while (ch != '\0');
 
-    return 1;
-} /* sanitizePlatformIndependentPath */
+static void asyncBatchInfo(PHYSFS_AsyncRequest **batch,
+                           const PHYSFS_uint32 count, AsyncBatchInfo *info)
+{
+    PHYSFS_uint32 i;
+    for (i = 0; i < count; i++)
+    {
+        const PHYSFS_AsyncRequest *req = batch[i];
+        AsyncBatchInfo *bi = &info[i];
+
+        bi->native = NULL;
+        bi->direct = 0;
+        bi->span = -1;
+
+        if ((req->fname != NULL) || (req->fill) || (req->len == 0))
+            continue;
+        else if (!ioDataRange(req->fh->io, &bi->range))
+            continue;
+        else if ((bi->range.io != NULL) && (bi->range.io->read == nativeIo_read))
+            bi->native = bi->range.io;
+    } /* for */
+} /* asyncBatchInfo */
 
 
 /*
- * Figure out if (fname) is part of (h)'s mountpoint. (fname) must be an
- *  output from sanitizePlatformIndependentPath(), so that it is in a known
- *  state.
- *
- * This only finds legitimate segments of a mountpoint. If the mountpoint is
- *  "/a/b/c" and (fname) is "/a/b/c", "/", or "/a/b/c/d", then the results are
- *  all zero. "/a/b" will succeed, though.
+ * Read whatever we can straight out of the archive's file, all at once,
+ *  through (queue): plain files, and entries stored raw (not compressed or
+ *  encrypted). The ones this finishes are marked (direct); the rest still
+ *  need asyncRun(). Short reads go that way too, so the archiver gets to
+ *  decide what a truncated archive means.
  */
-static int partOfMountPoint(DirHandle *h, char *fname)
+static void asyncReadDirect(void *queue, PHYSFS_AsyncRequest **batch,
+                            const PHYSFS_uint32 count, AsyncBatchInfo *info)
 {
-    /* !!! FIXME: This code feels gross. */
-    int rc;
-    size_t len, mntpntlen;
+    __PHYSFS_PlatformRead reads[ASYNC_BATCH_MAX];
+    PHYSFS_uint32 slots[ASYNC_BATCH_MAX];
+    PHYSFS_uint32 total = 0;
+    PHYSFS_uint64 start;
+    PHYSFS_uint32 i;
 
-    if (h->mountPoint == NULL)
-        return 0;
-    else if (*fname == '\0')
-        return 1;
+    for (i = 0; i < count; i++)
+    {
+        const PHYSFS_AsyncRequest *req = batch[i];
+        const PHYSFS_DataRange *range = &info[i].range;
+        __PHYSFS_PlatformRead *r = &reads[total];
+
+        if ((info[i].native == NULL) || (!range->raw))
+            continue;
+        else if (req->fh->io->read == traceIo_read)
+            continue;  /* these reads belong in the trace. */
+        else if (req->offset >= range->len)
+            continue;
+
+        r->handle = ((NativeIoInfo *) info[i].native->opaque)->handle;
+        r->offset = range->offset + req->offset;
+        r->buffer = req->buffer;
+        r->len = range->len - req->offset;
+        if (r->len > req->len)
+            r->len = req->len;
+        slots[total++] = i;
+    } /* for */
 
-    len = strlen(fname);
-    mntpntlen = strlen(h->mountPoint);
-    if (len > mntpntlen)  /* can't be a subset of mountpoint. */
-        return 0;
+    if (total == 0)
+        return;
 
-    /* if true, must be not a match or a complete match, but not a subset. */
-    if ((len + 1) == mntpntlen)
-        return 0;
+    start = __PHYSFS_statTimeStart();
+    if (!__PHYSFS_platformReadBatch(queue, reads, total))
+        return;
 
-    rc = strncmp(fname, h->mountPoint, len); /* !!! FIXME: case insensitive? */
-    if (rc != 0)
-        return 0;  /* not a match. */
+    /* one wait for the whole batch, and a batch is one archive. */
+    __PHYSFS_statAddTime(((NativeIoInfo *) info[slots[0]].native->opaque)->stats,
+                         PHYSFS_STAT_NS_SYSCALL, start);
 
-    /* make sure /a/b matches /a/b/ and not /a/bc ... */
-    return h->mountPoint[len] == '/';
-} /* partOfMountPoint */
+    for (i = 0; i < total; i++)
+    {
+        PHYSFS_AsyncRequest *req = batch[slots[i]];
+        AsyncBatchInfo *bi = &info[slots[i]];
+        if (reads[i].result != (PHYSFS_sint64) reads[i].len)
+            continue;
+
+        req->result = reads[i].result;
+        bi->direct = 1;
+        __PHYSFS_statAdd(((NativeIoInfo *) bi->native->opaque)->stats,
+                         PHYSFS_STAT_BYTES_PHYSICAL, reads[i].len);
+        __PHYSFS_statAdd(req->fh->dirHandle->stats, PHYSFS_STAT_BYTES_READ,
+                         reads[i].len);
+    } /* for */
+} /* asyncReadDirect */
 
 
-static DirHandle *createDirHandle(PHYSFS_Io *io, const char *newDir,
-                                  const char *mountPoint, int forWriting)
+/*
+ * Group what's left of a sorted batch into spans: runs of requests whose
+ *  bytes are near each other in the same file, so asyncOpenSpan() can read
+ *  them with one big read instead of a seek and a read or two apiece. This is
+ *  what turns a pile of small loads into something close to sequential i/o,
+ *  and it works for compressed entries too, since the archiver just finds
+ *  its bytes already waiting. Returns the number of spans.
+ */
+static PHYSFS_uint32 asyncPlanSpans(PHYSFS_AsyncRequest **batch,
+                                    const PHYSFS_uint32 count,
+                                    AsyncBatchInfo *info, AsyncSpan *spans)
 {
-    DirHandle *dirHandle = NULL;
-    char *tmpmntpnt = NULL;
+    AsyncSpan *span = NULL;
+    PHYSFS_uint32 total = 0;
+    PHYSFS_uint32 i, j;
 
-    if (mountPoint != NULL)
+    for (i = 0; i < count; i++)
     {
-        const size_t len = strlen(mountPoint) + 1;
-        tmpmntpnt = (char *) __PHYSFS_smallAlloc(len);
-        GOTO_IF_MACRO(!tmpmntpnt, PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
-        if (!sanitizePlatformIndependentPath(mountPoint, tmpmntpnt))
-            goto badDirHandle;
-        mountPoint = tmpmntpnt;  /* sanitized version. */
-    } /* if */
+        const PHYSFS_AsyncRequest *req = batch[i];
+        AsyncBatchInfo *bi = &info[i];
+        const PHYSFS_DataRange *range = &bi->range;
+        PHYSFS_uint64 start, end;
 
-    dirHandle = openDirectory(io, newDir, forWriting);
-    GOTO_IF_MACRO(!dirHandle, ERRPASS, badDirHandle);
+        if ((bi->direct) || (bi->native == NULL))
+            continue;
 
-    if (newDir == NULL)
-        dirHandle->dirName = NULL;
-    else
-    {
-        dirHandle->dirName = (char *) allocator.Malloc(strlen(newDir) + 1);
-        if (!dirHandle->dirName)
-            GOTO_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
-        strcpy(dirHandle->dirName, newDir);
-    } /* else */
+        /* several reads of one file here stream in order anyhow. */
+        for (j = 0; j < count; j++)
+        {
+            if ((j != i) && (batch[j]->fh == req->fh))
+                break;
+        } /* for */
+        if (j < count)
+            continue;
 
-    if ((mountPoint != NULL) && (*mountPoint != '\0'))
+        if (!range->raw)  /* we can't tell what part of it they'll want. */
+        {
+            start = range->offset;
+            end = range->offset + range->len;
+        } /* if */
+        else if (req->offset < range->len)
+        {
+            start = range->offset + req->offset;
+            end = start + ((range->len - req->offset < req->len) ?
+                                range->len - req->offset : req->len);
+        } /* else if */
+        else
+        {
+            continue;
+        } /* else */
+
+        if ((end == start) || (end - start > ASYNC_MERGE_MAX))
+            continue;
+
+        if ( (span != NULL) &&
+             (nativeIoSameFile(info[span->first].native, bi->native)) &&
+             (start >= span->start) &&
+             (start <= span->end + ASYNC_MERGE_GAP) &&
+             (((end > span->end) ? end : span->end) - span->start <= ASYNC_MERGE_MAX) )
+        {
+            span->last = i;
+            span->members++;
+            if (end > span->end)
+                span->end = end;
+            bi->span = (PHYSFS_sint32) (span - spans);
+            continue;
+        } /* if */
+
+        if ((span != NULL) && (span->members < 2))  /* reuse it. */
+        {
+            info[span->first].span = -1;
+            total--;
+        } /* if */
+
+        span = &spans[total];
+        span->first = span->last = i;
+        span->members = 1;
+        span->start = start;
+        span->end = end;
+        span->buffer = NULL;
+        bi->span = (PHYSFS_sint32) total++;
+    } /* for */
+
+    if ((span != NULL) && (span->members < 2))
     {
-        dirHandle->mountPoint = (char *)allocator.Malloc(strlen(mountPoint)+2);
-        if (!dirHandle->mountPoint)
-            GOTO_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
-        strcpy(dirHandle->mountPoint, mountPoint);
-        strcat(dirHandle->mountPoint, "/");
+        info[span->first].span = -1;
+        total--;
     } /* if */
 
-    __PHYSFS_smallFree(tmpmntpnt);
-    return dirHandle;
+    return total;
+} /* asyncPlanSpans */
 
-badDirHandle:
-    if (dirHandle != NULL)
+
+/* Read (span) and lend it to every request using it, if we can. */
+static void asyncOpenSpan(AsyncSpan *span, const PHYSFS_sint32 which,
+                          AsyncBatchInfo *info)
+{
+    const PHYSFS_uint64 len = span->end - span->start;
+    PHYSFS_Io *io = info[span->first].native;
+    NativeIoInfo *reader = (NativeIoInfo *) io->opaque;
+    PHYSFS_uint64 got = 0;
+    PHYSFS_sint64 rc;
+    PHYSFS_uint32 i;
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        return;
+
+    span->buffer = (PHYSFS_uint8 *) allocator.Malloc((size_t) len);
+    if (span->buffer == NULL)
+        return;  /* not an error; they'll read the usual way. */
+
+    /* the window remembers where the reader was while we move its handle. */
+    nativeIoSetWindow(io, span->buffer, span->start, 0);
+    if (nativeIoSeekHandle(reader, span->start))
     {
-        dirHandle->funcs->closeArchive(dirHandle->opaque);
-        allocator.Free(dirHandle->dirName);
-        allocator.Free(dirHandle->mountPoint);
-        allocator.Free(dirHandle);
+        while (got < len)
+        {
+            rc = nativeIoReadHandle(reader, span->buffer + got, len - got);
+            if (rc <= 0)
+                break;
+            got += (PHYSFS_uint64) rc;
+        } /* while */
     } /* if */
 
-    __PHYSFS_smallFree(tmpmntpnt);
-    return NULL;
-} /* createDirHandle */
+    if (got == 0)
+    {
+        nativeIoSetWindow(io, NULL, 0, 0);
+        allocator.Free(span->buffer);
+        span->buffer = NULL;
+        return;
+    } /* if */
+
+    reader->windowLen = got;
+    for (i = span->first + 1; i <= span->last; i++)
+    {
+        if (info[i].span == which)
+            nativeIoSetWindow(info[i].native, span->buffer, span->start, got);
+    } /* for */
+} /* asyncOpenSpan */
 
 
-/* MAKE SURE you've got the stateLock held before calling this! */
-static int freeDirHandle(DirHandle *dh, FileHandle *openList)
+/* (queue) is the calling worker's read queue, if it has one. */
+static void asyncRunBatch(PHYSFS_AsyncRequest **batch, PHYSFS_uint32 count,
+                          void *queue)
 {
-    FileHandle *i;
+    AsyncBatchInfo info[ASYNC_BATCH_MAX];
+    AsyncSpan spans[(ASYNC_BATCH_MAX / 2) + 1];
+    PHYSFS_uint32 i, j;
 
-    if (dh == NULL)
-        return 1;
+    asyncBatchInfo(batch, count, info);
+    if (queue != NULL)
+        asyncReadDirect(queue, batch, count, info);
+    asyncPlanSpans(batch, count, info, spans);
 
-    for (i = openList; i != NULL; i = i->next)
-        BAIL_IF_MACRO(i->dirHandle == dh, PHYSFS_ERR_FILES_STILL_OPEN, 0);
+    for (i = 0; i < count; i++)
+    {
+        PHYSFS_AsyncRequest *req = batch[i];
+        const PHYSFS_sint32 which = info[i].span;
+        AsyncSpan *span = (which >= 0) ? &spans[which] : NULL;
+        PHYSFS_AsyncStatus status = PHYSFS_ASYNC_DONE;
 
-    dh->funcs->closeArchive(dh->opaque);
-    allocator.Free(dh->dirName);
-    allocator.Free(dh->mountPoint);
-    allocator.Free(dh);
-    return 1;
-} /* freeDirHandle */
+        if (!info[i].direct)
+        {
+            if ((span != NULL) && (i == span->first))
+                asyncOpenSpan(span, which, info);
 
+            status = asyncRun(req);
 
-static char *calculateBaseDir(const char *argv0)
+            if ((span != NULL) && (span->buffer != NULL))
+            {
+                nativeIoSetWindow(info[i].native, NULL, 0, 0);
+                if (i == span->last)
+                    allocator.Free(span->buffer);
+            } /* if */
+        } /* if */
+
+        /*
+         * Let go of the file before the last callback that uses it, since
+         *  that callback is allowed to close it.
+         */
+        if ((req->fname == NULL) && (!req->fill))
+        {
+            for (j = i + 1; j < count; j++)
+            {
+                if (batch[j]->fh == req->fh)
+                    break;
+            } /* for */
+
+            if (j == count)
+            {
+                __PHYSFS_platformGrabMutex(asyncLock);
+                req->fh->asyncBusy = 0;
+                __PHYSFS_platformReleaseMutex(asyncLock);
+            } /* if */
+        } /* if */
+
+        asyncFinish(req, status);
+    } /* for */
+} /* asyncRunBatch */
+
+
+/* Run everything that's queued on the calling thread. */
+static void asyncDrain(void)
 {
-    const char dirsep = __PHYSFS_platformDirSeparator;
-    char *retval = NULL;
-    char *ptr = NULL;
+    PHYSFS_AsyncRequest *batch[ASYNC_BATCH_MAX];
+    PHYSFS_uint32 count;
 
-    /* Give the platform layer first shot at this. */
-    retval = __PHYSFS_platformCalcBaseDir(argv0);
-    if (retval != NULL)
-        return retval;
+    do
+    {
+        __PHYSFS_platformGrabMutex(asyncLock);
+        count = asyncTakeBatch(batch);
+        __PHYSFS_platformReleaseMutex(asyncLock);
+        asyncRunBatch(batch, count, NULL);
+    } while (count > 0);
+} /* asyncDrain */
 
-    /* We need argv0 to go on. */
-    BAIL_IF_MACRO(argv0 == NULL, PHYSFS_ERR_ARGV0_IS_NULL, NULL);
 
-    ptr = strrchr(argv0, dirsep);
-    if (ptr != NULL)
+static void asyncWorker(void *unused)
+{
+    PHYSFS_AsyncRequest *batch[ASYNC_BATCH_MAX];
+    void *queue = __PHYSFS_platformCreateReadQueue(ASYNC_BATCH_MAX);
+    PHYSFS_uint32 count;
+    int quit = 0;
+
+    while ((!quit) && (__PHYSFS_platformWaitSemaphore(asyncWork)))
     {
-        const size_t size = ((size_t) (ptr - argv0)) + 1;
-        retval = (char *) allocator.Malloc(size + 1);
-        BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-        memcpy(retval, argv0, size);
-        retval[size] = '\0';
-        return retval;
-    } /* if */
+        /* keep going until there's nothing we can take. */
+        do
+        {
+            __PHYSFS_platformGrabMutex(asyncLock);
+            quit = asyncQuit;
+            count = quit ? 0 : asyncTakeBatch(batch);
+            __PHYSFS_platformReleaseMutex(asyncLock);
+            asyncRunBatch(batch, count, queue);
+        } while (count > 0);
+    } /* while */
 
-    /* argv0 wasn't helpful. */
-    BAIL_MACRO(PHYSFS_ERR_INVALID_ARGUMENT, NULL);
-} /* calculateBaseDir */
+    if (queue != NULL)
+        __PHYSFS_platformDestroyReadQueue(queue);
+} /* asyncWorker */
 
 
-static int initializeMutexes(void)
+/* MAKE SURE you hold asyncLock before calling this! */
+static void asyncStartThreads(void)
 {
-    errorLock = __PHYSFS_platformCreateMutex();
-    if (errorLock == NULL)
-        goto initializeMutexes_failed;
-
-    stateLock = __PHYSFS_platformCreateMutex();
-    if (stateLock == NULL)
-        goto initializeMutexes_failed;
+    PHYSFS_AsyncRequest *i;
 
-    return 1;  /* success. */
+    if ((asyncThreadCount > 0) || (asyncWanted == 0) || (asyncNoThreads))
+        return;
 
-initializeMutexes_failed:
-    if (errorLock != NULL)
-        __PHYSFS_platformDestroyMutex(errorLock);
+    if (asyncWork == NULL)
+    {
+        asyncWork = __PHYSFS_platformCreateSemaphore(0);
+        if (asyncWork == NULL)
+            return;  /* run requests on the caller's thread, then. */
+    } /* if */
 
-    if (stateLock != NULL)
-        __PHYSFS_platformDestroyMutex(stateLock);
+    while (asyncThreadCount < asyncWanted)
+    {
+        void *thread = __PHYSFS_platformCreateThread(asyncWorker, NULL);
+        if (thread == NULL)
+            break;
+        asyncThreads[asyncThreadCount++] = thread;
+    } /* while */
 
-    errorLock = stateLock = NULL;
-    return 0;  /* failed. */
-} /* initializeMutexes */
+    if (asyncThreadCount == 0)
+        asyncNoThreads = 1;
 
+    /* anything left over from the last set of workers. */
+    for (i = asyncQueue; i != NULL; i = i->next)
+        __PHYSFS_platformPostSemaphore(asyncWork);
+} /* asyncStartThreads */
 
-static int doRegisterArchiver(const PHYSFS_Archiver *_archiver);
 
-static int initStaticArchivers(void)
+/* Wait for the workers to finish what they're doing, and return. */
+static void asyncStopThreads(void)
 {
-    #define REGISTER_STATIC_ARCHIVER(arc) { \
-        extern const PHYSFS_Archiver __PHYSFS_Archiver_##arc; \
-        if (!doRegisterArchiver(&__PHYSFS_Archiver_##arc)) { \
-            return 0; \
-        } \
-    }
+    PHYSFS_uint32 count;
+    PHYSFS_uint32 i;
 
-    #if PHYSFS_SUPPORTS_ZIP
-        REGISTER_STATIC_ARCHIVER(ZIP);
-    #endif
-    #if PHYSFS_SUPPORTS_7Z
-        REGISTER_STATIC_ARCHIVER(LZMA);
-    #endif
-    #if PHYSFS_SUPPORTS_GRP
-        REGISTER_STATIC_ARCHIVER(GRP);
-    #endif
-    #if PHYSFS_SUPPORTS_QPAK
-        REGISTER_STATIC_ARCHIVER(QPAK);
-    #endif
-    #if PHYSFS_SUPPORTS_HOG
-        REGISTER_STATIC_ARCHIVER(HOG);
-    #endif
-    #if PHYSFS_SUPPORTS_MVL
-        REGISTER_STATIC_ARCHIVER(MVL);
-    #endif
-    #if PHYSFS_SUPPORTS_WAD
-        REGISTER_STATIC_ARCHIVER(WAD);
-    #endif
-    #if PHYSFS_SUPPORTS_SLB
-        REGISTER_STATIC_ARCHIVER(SLB);
-    #endif
-    #if PHYSFS_SUPPORTS_ISO9660
-        REGISTER_STATIC_ARCHIVER(ISO9660);
-    #endif
-
-    #undef REGISTER_STATIC_ARCHIVER
+    __PHYSFS_platformGrabMutex(asyncLock);
+    asyncQuit = 1;
+    count = asyncThreadCount;
+    __PHYSFS_platformReleaseMutex(asyncLock);
 
-    return 1;
-} /* initStaticArchivers */
+    for (i = 0; i < count; i++)
+        __PHYSFS_platformPostSemaphore(asyncWork);
+    for (i = 0; i < count; i++)
+        __PHYSFS_platformJoinThread(asyncThreads[i]);
 
+    __PHYSFS_platformGrabMutex(asyncLock);
+    asyncThreadCount = 0;
+    asyncQuit = 0;
+    __PHYSFS_platformReleaseMutex(asyncLock);
+} /* asyncStopThreads */
 
-static void setDefaultAllocator(void);
-static int doDeinit(void);
 
-int PHYSFS_init(const char *argv0)
+static void shutdownAsync(void)
 {
-    BAIL_IF_MACRO(initialized, PHYSFS_ERR_IS_INITIALIZED, 0);
-
-    if (!externalAllocator)
-        setDefaultAllocator();
+    asyncStopThreads();
 
-    if ((allocator.Init != NULL) && (!allocator.Init())) return 0;
+    /* unclaimed files from opens are still on openReadList; deinit closes them. */
+    __PHYSFS_platformGrabMutex(asyncLock);
+    while (asyncLive != NULL)
+        asyncFree(asyncLive);
+    asyncQueue = asyncQueueTail = NULL;
+    asyncSerial = 0;
+    asyncWanted = 4;
+    asyncNoThreads = 0;
+    __PHYSFS_platformReleaseMutex(asyncLock);
 
-    if (!__PHYSFS_platformInit())
+    if (asyncWork != NULL)
     {
-        if (allocator.Deinit != NULL) allocator.Deinit();
-        return 0;
+        __PHYSFS_platformDestroySemaphore(asyncWork);
+        asyncWork = NULL;
+    } /* if */
+} /* shutdownAsync */
+
+
+static PHYSFS_AsyncRequest *asyncAlloc(PHYSFS_AsyncCallback cb, void *data)
+{
+    PHYSFS_AsyncRequest *req;
+    req = (PHYSFS_AsyncRequest *) __PHYSFS_poolAlloc(&asyncPool);
+    BAIL_IF_MACRO(!req, ERRPASS, NULL);
+    memset(req, '\0', sizeof (*req));
+    req->status = PHYSFS_ASYNC_PENDING;
+    req->result = -1;
+    req->callback = cb;
+    req->callbackData = data;
+    return req;
+} /* asyncAlloc */
+
+
+/* A read request for (fh), not yet submitted. */
+static PHYSFS_AsyncRequest *asyncReadRequest(FileHandle *fh,
+                                             PHYSFS_uint64 offset,
+                                             void *buffer, PHYSFS_uint64 len,
+                                             PHYSFS_AsyncCallback cb,
+                                             void *data)
+{
+    PHYSFS_AsyncRequest *req = asyncAlloc(cb, data);
+    PHYSFS_DataRange range;
+
+    BAIL_IF_MACRO(!req, ERRPASS, NULL);
+    req->fh = fh;
+    req->archive = fh->dirHandle;
+    req->buffer = buffer;
+    req->offset = offset;
+    req->len = len;
+    req->physpos = offset;
+    if (ioDataRange(fh->io, &range))
+        req->physpos += range.offset;
+    return req;
+} /* asyncReadRequest */
+
+
+/* MAKE SURE you hold asyncLock before calling this! */
+static void asyncLink(PHYSFS_AsyncRequest *req)
+{
+    req->serial = asyncSerial++;
+    req->nextLive = asyncLive;
+    if (asyncLive != NULL)
+        asyncLive->prevLive = req;
+    asyncLive = req;
+} /* asyncLink */
+
+
+/* Queue (req), or run it right here if there are no workers. */
+static PHYSFS_AsyncRequest *asyncSubmit(PHYSFS_AsyncRequest *req)
+{
+    int queued = 0;
+
+    __PHYSFS_platformGrabMutex(asyncLock);
+    asyncLink(req);
+    if (req->fill)
+        req->fh->asyncFilling = 1;
+    asyncStartThreads();
+    if (asyncThreadCount > 0)
+    {
+        req->prev = asyncQueueTail;
+        if (asyncQueueTail != NULL)
+            asyncQueueTail->next = req;
+        else
+            asyncQueue = req;
+        asyncQueueTail = req;
+        queued = 1;
     } /* if */
+    else
+    {
+        req->status = PHYSFS_ASYNC_RUNNING;
+    } /* else */
+    __PHYSFS_platformReleaseMutex(asyncLock);
 
-    /* everything below here can be cleaned up safely by doDeinit(). */
+    if (queued)
+        __PHYSFS_platformPostSemaphore(asyncWork);
+    else
+        asyncFinish(req, asyncRun(req));
 
-    if (!initializeMutexes()) goto initFailed;
+    return req;
+} /* asyncSubmit */
 
-    baseDir = calculateBaseDir(argv0);
-    if (!baseDir) goto initFailed;
 
-    userDir = __PHYSFS_platformCalcUserDir();
-    if (!userDir) goto initFailed;
+/* PHYSFS_loadMany() ... */
 
-    /* Platform layer is required to append a dirsep. */
-    assert(baseDir[strlen(baseDir) - 1] == __PHYSFS_platformDirSeparator);
-    assert(userDir[strlen(userDir) - 1] == __PHYSFS_platformDirSeparator);
+#define LOADMANY_MAX_BYTES (64 * 1024 * 1024)  /* don't read further ahead */
+#define LOADMANY_MAX_FILES 256                 /*  than either of these. */
 
-    if (!initStaticArchivers()) goto initFailed;
+/*
+ * Every open file in an archive holds its own duplicate of the archive's
+ *  file descriptor, so the list is opened, sorted and loaded LOADMANY_MAX_FILES
+ *  at a time, and a long list doesn't run the process out of descriptors.
+ */
 
-    initialized = 1;
+typedef struct LoadManyState
+{
+    const char * const *paths;
+    PHYSFS_LoadCallback callback;
+    void *data;
+} LoadManyState;
 
-    /* This makes sure that the error subsystem is initialized. */
-    PHYSFS_setErrorCode(PHYSFS_getLastErrorCode());
+typedef struct LoadManyFile
+{
+    const LoadManyState *state;
+    PHYSFS_uint32 index;  /* in (state->paths). */
+    FileHandle *fh;
+    PHYSFS_uint64 physpos;
+    PHYSFS_uint64 len;
+    void *buffer;
+    PHYSFS_AsyncRequest *req;
+    int loaded;  /* set by loadManyDone(), read after the request's done. */
+} LoadManyFile;
 
-    return 1;
 
-initFailed:
-    doDeinit();
-    return 0;
-} /* PHYSFS_init */
+static void loadManyFailed(const LoadManyState *state, PHYSFS_uint32 index,
+                           PHYSFS_ErrorCode err)
+{
+    if (err == PHYSFS_ERR_OK)
+        err = PHYSFS_ERR_OTHER_ERROR;
+    state->callback(state->data, index, state->paths[index], NULL, -1, err);
+} /* loadManyFailed */
 
 
-/* MAKE SURE you hold stateLock before calling this! */
-static int closeFileHandleList(FileHandle **list)
+/* Archives together, then each archive in the order it's laid out. */
+static int loadManyCmp(void *_files, size_t one, size_t two)
 {
-    FileHandle *i;
-    FileHandle *next = NULL;
-
-    for (i = *list; i != NULL; i = next)
-    {
-        PHYSFS_Io *io = i->io;
-        next = i->next;
+    const LoadManyFile *files = (const LoadManyFile *) _files;
+    const LoadManyFile *a = &files[one];
+    const LoadManyFile *b = &files[two];
+    const size_t adir = (size_t) a->fh->dirHandle;
+    const size_t bdir = (size_t) b->fh->dirHandle;
 
-        if (io->flush && !io->flush(io))
-        {
-            *list = i;
-            return 0;
-        } /* if */
+    if (adir != bdir)
+        return (adir < bdir) ? -1 : 1;
+    else if (a->physpos != b->physpos)
+        return (a->physpos < b->physpos) ? -1 : 1;
+    else if (a->index != b->index)
+        return (a->index < b->index) ? -1 : 1;
+    return 0;
+} /* loadManyCmp */
 
-        io->destroy(io);
-        allocator.Free(i);
-    } /* for */
 
-    *list = NULL;
-    return 1;
-} /* closeFileHandleList */
+static void loadManySwap(void *_files, size_t one, size_t two)
+{
+    LoadManyFile *files = (LoadManyFile *) _files;
+    LoadManyFile tmp;
+    memcpy(&tmp, &files[one], sizeof (LoadManyFile));
+    memcpy(&files[one], &files[two], sizeof (LoadManyFile));
+    memcpy(&files[two], &tmp, sizeof (LoadManyFile));
+} /* loadManySwap */
 
 
-/* MAKE SURE you hold the stateLock before calling this! */
-static void freeSearchPath(void)
+/* Async callback: hand the file over, then let go of it. */
+static void loadManyDone(void *_file, PHYSFS_AsyncRequest *req,
+                         PHYSFS_AsyncStatus status)
 {
-    DirHandle *i;
-    DirHandle *next = NULL;
-
-    closeFileHandleList(&openReadList);
+    LoadManyFile *file = (LoadManyFile *) _file;
+    const LoadManyState *state = file->state;
 
-    if (searchPath != NULL)
+    if (status != PHYSFS_ASYNC_DONE)
+        loadManyFailed(state, file->index, req->error);
+    else
     {
-        for (i = searchPath; i != NULL; i = next)
-        {
-            next = i->next;
-            freeDirHandle(i, openReadList);
-        } /* for */
-        searchPath = NULL;
-    } /* if */
-} /* freeSearchPath */
+        file->loaded = 1;
+        state->callback(state->data, file->index, state->paths[file->index],
+                        file->buffer, req->result, PHYSFS_ERR_OK);
+    } /* else */
 
+    allocator.Free(file->buffer);
+    file->buffer = NULL;
+    PHYSFS_close((PHYSFS_File *) file->fh);
+    file->fh = NULL;
+} /* loadManyDone */
 
-/* MAKE SURE you hold stateLock before calling this! */
-static int archiverInUse(const PHYSFS_Archiver *arc, const DirHandle *list)
+
+/* Make (file)'s read request. On failure, (file) is dealt with. */
+static int loadManyPrepare(LoadManyFile *file)
 {
-    const DirHandle *i;
-    for (i = list; i != NULL; i = i->next)
+    /* malloc(0) might be NULL, and we want a real pointer to hand out. */
+    file->buffer = allocator.Malloc((file->len > 0) ? file->len : 1);
+    if (file->buffer == NULL)
+        PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+    else
     {
-        if (i->funcs == arc)
+        file->req = asyncReadRequest(file->fh, 0, file->buffer, file->len,
+                                     loadManyDone, file);
+        if (file->req != NULL)
             return 1;
-    } /* for */
+        allocator.Free(file->buffer);
+        file->buffer = NULL;
+    } /* else */
 
-    return 0;  /* not in use */
-} /* archiverInUse */
+    loadManyFailed(file->state, file->index, PHYSFS_getLastErrorCode());
+    PHYSFS_close((PHYSFS_File *) file->fh);
+    file->fh = NULL;
+    return 0;
+} /* loadManyPrepare */
 
 
-/* MAKE SURE you hold stateLock before calling this! */
-static int doDeregisterArchiver(const size_t idx)
+/*
+ * Keep the workers fed in order, but only so far ahead of the oldest file
+ *  that isn't done yet, so we don't need every file's buffer at once.
+ */
+static void loadManyQueued(LoadManyFile *files, const PHYSFS_uint32 total)
 {
-    const size_t len = (numArchivers - idx) * sizeof (void *);
-    const PHYSFS_ArchiveInfo *info = archiveInfo[idx];
-    const PHYSFS_Archiver *arc = archivers[idx];
+    PHYSFS_uint64 inflight = 0;
+    PHYSFS_uint32 oldest = 0;
+    PHYSFS_uint32 next = 0;
 
-    /* make sure nothing is still using this archiver */
-    if (archiverInUse(arc, searchPath) || archiverInUse(arc, writeDir))
-        BAIL_MACRO(PHYSFS_ERR_FILES_STILL_OPEN, 0);
+    while (oldest < total)
+    {
+        while ( (next < total) &&
+                ( (next == oldest) ||
+                  ( (next - oldest < LOADMANY_MAX_FILES) &&
+                    (inflight + files[next].len <= LOADMANY_MAX_BYTES) ) ) )
+        {
+            LoadManyFile *file = &files[next++];
+            if (loadManyPrepare(file))
+            {
+                inflight += file->len;
+                asyncSubmit(file->req);
+            } /* if */
+        } /* while */
 
-    allocator.Free((void *) info->extension);
-    allocator.Free((void *) info->description);
-    allocator.Free((void *) info->author);
-    allocator.Free((void *) info->url);
-    allocator.Free((void *) arc);
+        if (files[oldest].req != NULL)
+        {
+            PHYSFS_waitAsync(files[oldest].req);
+            PHYSFS_freeAsync(files[oldest].req);
+            files[oldest].req = NULL;
+            inflight -= files[oldest].len;
+        } /* if */
+        oldest++;
+    } /* while */
+} /* loadManyQueued */
 
-    memmove(&archiveInfo[idx], &archiveInfo[idx+1], len);
-    memmove(&archivers[idx], &archivers[idx+1], len);
 
-    assert(numArchivers > 0);
-    numArchivers--;
+/* No workers: run it all right here, still a batch at a time. */
+static void loadManyHere(LoadManyFile *files, const PHYSFS_uint32 total)
+{
+    PHYSFS_AsyncRequest *batch[ASYNC_BATCH_MAX];
+    PHYSFS_uint32 count;
+    PHYSFS_uint32 i = 0;
+    PHYSFS_uint32 j;
 
-    return 1;
-} /* doDeregisterArchiver */
+    while (i < total)
+    {
+        count = 0;
+        for (; (i < total) && (count < ASYNC_BATCH_MAX); i++)
+        {
+            if (loadManyPrepare(&files[i]))
+                batch[count++] = files[i].req;
+        } /* for */
+
+        __PHYSFS_platformGrabMutex(asyncLock);
+        for (j = 0; j < count; j++)
+        {
+            asyncLink(batch[j]);
+            batch[j]->status = PHYSFS_ASYNC_RUNNING;
+            batch[j]->fh->asyncBusy = 1;
+        } /* for */
+        __PHYSFS_platformReleaseMutex(asyncLock);
 
+        /* asyncRunBatch() wants them in the order they're stored. */
+        __PHYSFS_sort(batch, count, asyncBatchCmp, asyncBatchSwap);
+        asyncRunBatch(batch, count, NULL);
 
-/* Does NOT hold the state lock; we're shutting down. */
-static void freeArchivers(void)
-{
-    while (numArchivers > 0)
-    {
-        if (!doDeregisterArchiver(numArchivers - 1))
-            assert(!"nothing should be mounted during shutdown.");
+        for (j = 0; j < count; j++)
+            PHYSFS_freeAsync(batch[j]);
     } /* while */
 
-    allocator.Free(archivers);
-    allocator.Free(archiveInfo);
-    archivers = NULL;
-    archiveInfo = NULL;
-} /* freeArchivers */
+    for (i = 0; i < total; i++)
+        files[i].req = NULL;
+} /* loadManyHere */
 
 
-static int doDeinit(void)
+/* One span of one file that PHYSFS_prefetchMany() is going to ask for. */
+typedef struct
 {
-    closeFileHandleList(&openWriteList);
-    BAIL_IF_MACRO(!PHYSFS_setWriteDir(NULL), PHYSFS_ERR_FILES_STILL_OPEN, 0);
+    PHYSFS_uint32 owner;  /* the archive's place in the search path. */
+    PHYSFS_Io *io;
+    PHYSFS_uint64 start;
+    PHYSFS_uint64 end;
+} PrefetchSpan;
+
+static int prefetchCmp(void *_a, size_t one, size_t two)
+{
+    const PrefetchSpan *a = ((const PrefetchSpan *) _a) + one;
+    const PrefetchSpan *b = ((const PrefetchSpan *) _a) + two;
+    if (a->owner != b->owner)
+        return (a->owner < b->owner) ? -1 : 1;
+    else if (a->start != b->start)
+        return (a->start < b->start) ? -1 : 1;
+    return 0;
+} /* prefetchCmp */
 
-    freeSearchPath();
-    freeArchivers();
-    freeErrorStates();
+static void prefetchSwap(void *_a, size_t one, size_t two)
+{
+    PrefetchSpan *a = (PrefetchSpan *) _a;
+    PrefetchSpan tmp;
+    memcpy(&tmp, &a[one], sizeof (tmp));
+    memcpy(&a[one], &a[two], sizeof (tmp));
+    memcpy(&a[two], &tmp, sizeof (tmp));
+} /* prefetchSwap */
 
-    if (baseDir != NULL)
-    {
-        allocator.Free(baseDir);
-        baseDir = NULL;
-    } /* if */
 
-    if (userDir != NULL)
-    {
-        allocator.Free(userDir);
-        userDir = NULL;
-    } /* if */
+/*
+ * Ask for each run of (spans) that sit close together in the same file as
+ *  one range, so the OS sees a few big reads instead of lots of little ones.
+ *  (spans) has to be sorted already.
+ */
+static int prefetchSpans(const PrefetchSpan *spans, const PHYSFS_uint32 count)
+{
+    int retval = 1;
+    PHYSFS_uint32 i = 0;
 
-    if (prefDir != NULL)
+    while (i < count)
     {
-        allocator.Free(prefDir);
-        prefDir = NULL;
-    } /* if */
+        const PrefetchSpan *span = &spans[i];
+        PHYSFS_uint64 end = span->end;
 
-    if (archiveInfo != NULL)
-    {
-        allocator.Free(archiveInfo);
-        archiveInfo = NULL;
-    } /* if */
+        for (i++; i < count; i++)
+        {
+            if (spans[i].owner != span->owner)
+                break;
+            else if (spans[i].start > end + ASYNC_MERGE_GAP)
+                break;
+            else if (spans[i].end > end)
+                end = spans[i].end;
+        } /* for */
 
-    if (archivers != NULL)
-    {
-        allocator.Free(archivers);
-        archivers = NULL;
-    } /* if */
+        if (!nativeIoAdvise(span->io, span->start, end - span->start,
+                            PHYSFS_ACCESS_WILLNEED))
+            retval = 0;
+    } /* while */
 
-    allowSymLinks = 0;
-    initialized = 0;
+    return retval;
+} /* prefetchSpans */
 
-    if (errorLock) __PHYSFS_platformDestroyMutex(errorLock);
-    if (stateLock) __PHYSFS_platformDestroyMutex(stateLock);
 
-    if (allocator.Deinit != NULL)
-        allocator.Deinit();
+/* functions ... */
 
-    errorLock = stateLock = NULL;
+/*
+ * String lists handed to the application are built as a single allocation:
+ *  the NULL-terminated pointer array comes first, followed by the strings it
+ *  points to, so PHYSFS_freeList() is one free no matter how long the list
+ *  is. While a list is being built, the strings sit back-to-back in a
+ *  growable arena and entries refer to them by offset, since the arena
+ *  moves when it grows.
+ */
+typedef struct
+{
+    size_t offset;  /* start of this string in the arena. */
+    PHYSFS_uint32 hash;  /* __PHYSFS_hashString() value, for deduping. */
+} StringListEntry;
 
-    /* !!! FIXME: what on earth are you supposed to do if this fails? */
-    BAIL_IF_MACRO(!__PHYSFS_platformDeinit(), ERRPASS, 0);
+typedef struct
+{
+    char *arena;
+    size_t arenalen;
+    size_t arenaalloc;
+    StringListEntry *entries;
+    PHYSFS_uint32 count;
+    PHYSFS_uint32 entriesalloc;
+    PHYSFS_uint32 *buckets;  /* open addressing: entry index + 1, 0 == empty. */
+    PHYSFS_uint32 bucketcount;  /* zero or a power of two. */
+    PHYSFS_ErrorCode errcode;
+} EnumStringListCallbackData;
 
+static int appendToStringList(EnumStringListCallbackData *pecd,
+                              const char *str, const size_t len,
+                              const PHYSFS_uint32 hash)
+{
+    StringListEntry *entry;
+
+    if (pecd->count == pecd->entriesalloc)
+    {
+        const PHYSFS_uint32 newalloc = pecd->entriesalloc ?
+                                            pecd->entriesalloc * 2 : 64;
+        void *ptr;
+        GOTO_IF_MACRO(newalloc < pecd->entriesalloc, PHYSFS_ERR_OUT_OF_MEMORY, failed);
+        ptr = allocator.Realloc(pecd->entries, newalloc * sizeof (StringListEntry));
+        GOTO_IF_MACRO(ptr == NULL, PHYSFS_ERR_OUT_OF_MEMORY, failed);
+        pecd->entries = (StringListEntry *) ptr;
+        pecd->entriesalloc = newalloc;
+    } /* if */
+
+    if ((pecd->arenaalloc - pecd->arenalen) <= len)
+    {
+        size_t newalloc = pecd->arenaalloc ? pecd->arenaalloc * 2 : 1024;
+        void *ptr;
+        while ((newalloc - pecd->arenalen) <= len)
+            newalloc *= 2;
+        ptr = allocator.Realloc(pecd->arena, newalloc);
+        GOTO_IF_MACRO(ptr == NULL, PHYSFS_ERR_OUT_OF_MEMORY, failed);
+        pecd->arena = (char *) ptr;
+        pecd->arenaalloc = newalloc;
+    } /* if */
+
+    entry = &pecd->entries[pecd->count++];
+    entry->offset = pecd->arenalen;
+    entry->hash = hash;
+    memcpy(pecd->arena + pecd->arenalen, str, len + 1);
+    pecd->arenalen += len + 1;
     return 1;
-} /* doDeinit */
+
+failed:
+    pecd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+    return 0;
+} /* appendToStringList */
 
 
-int PHYSFS_deinit(void)
+static int stringListCmp(void *_pecd, size_t one, size_t two)
 {
-    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
-    return doDeinit();
-} /* PHYSFS_deinit */
+    const EnumStringListCallbackData *pecd = (EnumStringListCallbackData *) _pecd;
+    const char *arena = pecd->arena;
+    return __PHYSFS_utf8stricmp(arena + pecd->entries[one].offset,
+                                arena + pecd->entries[two].offset);
+} /* stringListCmp */
 
 
-int PHYSFS_isInit(void)
+static void stringListSwap(void *_pecd, size_t one, size_t two)
 {
-    return initialized;
-} /* PHYSFS_isInit */
+    EnumStringListCallbackData *pecd = (EnumStringListCallbackData *) _pecd;
+    StringListEntry tmp;
+    memcpy(&tmp, &pecd->entries[one], sizeof (StringListEntry));
+    memcpy(&pecd->entries[one], &pecd->entries[two], sizeof (StringListEntry));
+    memcpy(&pecd->entries[two], &tmp, sizeof (StringListEntry));
+} /* stringListSwap */
 
 
-char *__PHYSFS_strdup(const char *str)
+static void freeStringListData(EnumStringListCallbackData *pecd)
 {
-    char *retval = (char *) allocator.Malloc(strlen(str) + 1);
-    if (retval)
-        strcpy(retval, str);
-    return retval;
-} /* __PHYSFS_strdup */
+    allocator.Free(pecd->arena);
+    allocator.Free(pecd->entries);
+    allocator.Free(pecd->buckets);
+} /* freeStringListData */
 
 
-PHYSFS_uint32 __PHYSFS_hashString(const char *str, size_t len)
+/* Pack the list into one block, and free the build state either way. */
+static char **finishStringList(EnumStringListCallbackData *pecd)
 {
-    wchar_t bufferW[1024];
-    wchar_t *dBufferW = len > 1024 ? allocator.Malloc(len * 2) : NULL;
-    PHYSFS_uint32 hash = 5381;
-    wchar_t *strW = dBufferW ? dBufferW : bufferW;
-    PHYSFS_utf8ToUtf16(str, strW, len * 2);
-    len = wcslen(strW);
-    while (len--) {
-        *strW = towupper(*strW);
-        hash = ((hash << 5) + hash) ^ (*(((char*)strW) + 0));
-        hash = ((hash << 5) + hash) ^ (*(((char*)strW) + 1));
-        ++strW;
-    }
+    const size_t ptrlen = (((size_t) pecd->count) + 1) * sizeof (char *);
+    char **retval = NULL;
 
-    allocator.Free(dBufferW);
-    return hash;
-} /* __PHYSFS_hashString */
+    if (!pecd->errcode)
+    {
+        retval = (char **) allocator.Malloc(ptrlen + pecd->arenalen);
+        if (retval == NULL)
+            pecd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+        else
+        {
+            char *strings = ((char *) retval) + ptrlen;
+            PHYSFS_uint32 i;
+            if (pecd->arenalen > 0)
+                memcpy(strings, pecd->arena, pecd->arenalen);
+            for (i = 0; i < pecd->count; i++)
+                retval[i] = strings + pecd->entries[i].offset;
+            retval[pecd->count] = NULL;
+        } /* else */
+    } /* if */
 
+    freeStringListData(pecd);
 
-/* MAKE SURE you hold stateLock before calling this! */
+    BAIL_IF_MACRO(pecd->errcode, pecd->errcode, NULL);
+    return retval;
+} /* finishStringList */
+
+
+static void enumStringListCallback(void *data, const char *str)
+{
+    EnumStringListCallbackData *pecd = (EnumStringListCallbackData *) data;
+    if (!pecd->errcode)
+        appendToStringList(pecd, str, strlen(str), 0);
+} /* enumStringListCallback */
+
+
+static char **doEnumStringList(void (*func)(PHYSFS_StringCallback, void *))
+{
+    EnumStringListCallbackData ecd;
+    memset(&ecd, '\0', sizeof (ecd));
+    func(enumStringListCallback, &ecd);
+    return finishStringList(&ecd);
+} /* doEnumStringList */
+
+
+static void __PHYSFS_bubble_sort(void *a, size_t lo, size_t hi,
+                                 int (*cmpfn)(void *, size_t, size_t),
+                                 void (*swapfn)(void *, size_t, size_t))
+{
+    size_t i;
+    int sorted;
+
+    do
+    {
+        sorted = 1;
+        for (i = lo; i < hi; i++)
+        {
+            if (cmpfn(a, i, i + 1) > 0)
+            {
+                swapfn(a, i, i + 1);
+                sorted = 0;
+            } /* if */
+        } /* for */
+    } while (!sorted);
+} /* __PHYSFS_bubble_sort */
+
+
+static void __PHYSFS_quick_sort(void *a, size_t lo, size_t hi,
+                         int (*cmpfn)(void *, size_t, size_t),
+                         void (*swapfn)(void *, size_t, size_t))
+{
+    size_t i;
+    size_t j;
+    size_t v;
+
+    if ((hi - lo) <= PHYSFS_QUICKSORT_THRESHOLD)
+        __PHYSFS_bubble_sort(a, lo, hi, cmpfn, swapfn);
+    else
+    {
+        i = (hi + lo) / 2;
+
+        if (cmpfn(a, lo, i) > 0) swapfn(a, lo, i);
+        if (cmpfn(a, lo, hi) > 0) swapfn(a, lo, hi);
+        if (cmpfn(a, i, hi) > 0) swapfn(a, i, hi);
+
+        j = hi - 1;
+        swapfn(a, i, j);
+        i = lo;
+        v = j;
+        while (1)
+        {
+            while(cmpfn(a, ++i, v) < 0) { /* do nothing */ }
+            while(cmpfn(a, --j, v) > 0) { /* do nothing */ }
+            if (j < i)
+                break;
+            swapfn(a, i, j);
+        } /* while */
+        if (i != (hi-1))
+            swapfn(a, i, hi-1);
+        __PHYSFS_quick_sort(a, lo, j, cmpfn, swapfn);
+        __PHYSFS_quick_sort(a, i+1, hi, cmpfn, swapfn);
+    } /* else */
+} /* __PHYSFS_quick_sort */
+
+
+void __PHYSFS_sort(void *entries, size_t max,
+                   int (*cmpfn)(void *, size_t, size_t),
+                   void (*swapfn)(void *, size_t, size_t))
+{
+    /*
+     * Quicksort w/ Bubblesort fallback algorithm inspired by code from here:
+     *   https://www.cs.ubc.ca/spider/harrison/Java/sorting-demo.html
+     */
+    if (max > 0)
+        __PHYSFS_quick_sort(entries, 0, max - 1, cmpfn, swapfn);
+} /* __PHYSFS_sort */
+
+
+#ifdef __PHYSFS_THREAD_LOCAL
+
+/* this doesn't reset the error state. */
+static inline PHYSFS_ErrorCode currentErrorCode(void)
+{
+    return threadErrorCode;
+} /* currentErrorCode */
+
+
+PHYSFS_ErrorCode PHYSFS_getLastErrorCode(void)
+{
+    const PHYSFS_ErrorCode retval = threadErrorCode;
+    threadErrorCode = PHYSFS_ERR_OK;
+    return retval;
+} /* PHYSFS_getLastErrorCode */
+
+#else
+
+static ErrState *findErrorForCurrentThread(void)
+{
+    ErrState *i;
+    void *tid;
+
+    if (errorLock != NULL)
+        __PHYSFS_platformGrabMutex(errorLock);
+
+    if (errorStates != NULL)
+    {
+        tid = __PHYSFS_platformGetThreadID();
+
+        for (i = errorStates; i != NULL; i = i->next)
+        {
+            if (i->tid == tid)
+            {
+                if (errorLock != NULL)
+                    __PHYSFS_platformReleaseMutex(errorLock);
+                return i;
+            } /* if */
+        } /* for */
+    } /* if */
+
+    if (errorLock != NULL)
+        __PHYSFS_platformReleaseMutex(errorLock);
+
+    return NULL;   /* no error available. */
+} /* findErrorForCurrentThread */
+
+
+/* this doesn't reset the error state. */
+static inline PHYSFS_ErrorCode currentErrorCode(void)
+{
+    const ErrState *err = findErrorForCurrentThread();
+    return err ? err->code : PHYSFS_ERR_OK;
+} /* currentErrorCode */
+
+
+PHYSFS_ErrorCode PHYSFS_getLastErrorCode(void)
+{
+    ErrState *err = findErrorForCurrentThread();
+    const PHYSFS_ErrorCode retval = (err) ? err->code : PHYSFS_ERR_OK;
+    if (err)
+        err->code = PHYSFS_ERR_OK;
+    return retval;
+} /* PHYSFS_getLastErrorCode */
+
+#endif
+
+
+PHYSFS_DECL const char *PHYSFS_getErrorByCode(PHYSFS_ErrorCode code)
+{
+    switch (code)
+    {
+        case PHYSFS_ERR_OK: return "no error";
+        case PHYSFS_ERR_OTHER_ERROR: return "unknown error";
+        case PHYSFS_ERR_OUT_OF_MEMORY: return "out of memory";
+        case PHYSFS_ERR_NOT_INITIALIZED: return "not initialized";
+        case PHYSFS_ERR_IS_INITIALIZED: return "already initialized";
+        case PHYSFS_ERR_ARGV0_IS_NULL: return "argv[0] is NULL";
+        case PHYSFS_ERR_UNSUPPORTED: return "unsupported";
+        case PHYSFS_ERR_PAST_EOF: return "past end of file";
+        case PHYSFS_ERR_FILES_STILL_OPEN: return "files still open";
+        case PHYSFS_ERR_INVALID_ARGUMENT: return "invalid argument";
+        case PHYSFS_ERR_NOT_MOUNTED: return "not mounted";
+        case PHYSFS_ERR_NOT_FOUND: return "not found";
+        case PHYSFS_ERR_SYMLINK_FORBIDDEN: return "symlinks are forbidden";
+        case PHYSFS_ERR_NO_WRITE_DIR: return "write directory is not set";
+        case PHYSFS_ERR_OPEN_FOR_READING: return "file open for reading";
+        case PHYSFS_ERR_OPEN_FOR_WRITING: return "file open for writing";
+        case PHYSFS_ERR_NOT_A_FILE: return "not a file";
+        case PHYSFS_ERR_READ_ONLY: return "read-only filesystem";
+        case PHYSFS_ERR_CORRUPT: return "corrupted";
+        case PHYSFS_ERR_SYMLINK_LOOP: return "infinite symbolic link loop";
+        case PHYSFS_ERR_IO: return "i/o error";
+        case PHYSFS_ERR_PERMISSION: return "permission denied";
+        case PHYSFS_ERR_NO_SPACE: return "no space available for writing";
+        case PHYSFS_ERR_BAD_FILENAME: return "filename is illegal or insecure";
+        case PHYSFS_ERR_BUSY: return "tried to modify a file the OS needs";
+        case PHYSFS_ERR_DIR_NOT_EMPTY: return "directory isn't empty";
+        case PHYSFS_ERR_OS_ERROR: return "OS reported an error";
+        case PHYSFS_ERR_DUPLICATE: return "duplicate resource";
+        case PHYSFS_ERR_BAD_PASSWORD: return "bad password";
+    } /* switch */
+
+    return NULL;  /* don't know this error code. */
+} /* PHYSFS_getErrorByCode */
+
+
+#ifdef __PHYSFS_THREAD_LOCAL
+
+void PHYSFS_setErrorCode(PHYSFS_ErrorCode errcode)
+{
+    if (errcode)
+        threadErrorCode = errcode;
+} /* PHYSFS_setErrorCode */
+
+#else
+
+void PHYSFS_setErrorCode(PHYSFS_ErrorCode errcode)
+{
+    ErrState *err;
+
+    if (!errcode)
+        return;
+
+    err = findErrorForCurrentThread();
+    if (err == NULL)
+    {
+        err = (ErrState *) allocator.Malloc(sizeof (ErrState));
+        if (err == NULL)
+            return;   /* uhh...? */
+
+        memset(err, '\0', sizeof (ErrState));
+        err->tid = __PHYSFS_platformGetThreadID();
+
+        if (errorLock != NULL)
+            __PHYSFS_platformGrabMutex(errorLock);
+
+        err->next = errorStates;
+        errorStates = err;
+
+        if (errorLock != NULL)
+            __PHYSFS_platformReleaseMutex(errorLock);
+    } /* if */
+
+    err->code = errcode;
+} /* PHYSFS_setErrorCode */
+
+#endif
+
+
+const char *PHYSFS_getLastError(void)
+{
+    const PHYSFS_ErrorCode err = PHYSFS_getLastErrorCode();
+    return (err) ? PHYSFS_getErrorByCode(err) : NULL;
+} /* PHYSFS_getLastError */
+
+
+#ifdef __PHYSFS_THREAD_LOCAL
+
+static void freeErrorStates(void)
+{
+    /* other threads keep theirs until they're next set or fetched. */
+    threadErrorCode = PHYSFS_ERR_OK;
+} /* freeErrorStates */
+
+#else
+
+/* MAKE SURE that errorLock is held before calling this! */
+static void freeErrorStates(void)
+{
+    ErrState *i;
+    ErrState *next;
+
+    for (i = errorStates; i != NULL; i = next)
+    {
+        next = i->next;
+        allocator.Free(i);
+    } /* for */
+
+    errorStates = NULL;
+} /* freeErrorStates */
+
+#endif
+
+
+void PHYSFS_getLinkedVersion(PHYSFS_Version *ver)
+{
+    if (ver != NULL)
+    {
+        ver->major = PHYSFS_VER_MAJOR;
+        ver->minor = PHYSFS_VER_MINOR;
+        ver->patch = PHYSFS_VER_PATCH;
+    } /* if */
+} /* PHYSFS_getLinkedVersion */
+
+
+static const char *find_filename_extension(const char *fname)
+{
+    const char *retval = NULL;
+    if (fname != NULL)
+    {
+        const char *p = strchr(fname, '.');
+        retval = p;
+
+        while (p != NULL)
+        {
+            p = strchr(p + 1, '.');
+            if (p != NULL)
+                retval = p;
+        } /* while */
+
+        if (retval != NULL)
+            retval++;  /* skip '.' */
+    } /* if */
+
+    return retval;
+} /* find_filename_extension */
+
+
+static DirHandle *tryOpenDir(PHYSFS_Io *io, const PHYSFS_Archiver *funcs,
+                             const char *d, int forWriting,
+                             PHYSFS_uint32 flags)
+{
+    DirHandle *retval = NULL;
+    void *opaque = NULL;
+
+    if (io != NULL)
+        BAIL_IF_MACRO(!io->seek(io, 0), ERRPASS, NULL);
+
+    if (funcs->openArchiveWithFlags != NULL)
+        opaque = funcs->openArchiveWithFlags(io, d, forWriting, flags);
+    else
+        opaque = funcs->openArchive(io, d, forWriting);
+
+    if (opaque != NULL)
+    {
+        retval = (DirHandle *) allocator.Malloc(sizeof (DirHandle));
+        if (retval == NULL)
+            funcs->closeArchive(opaque);
+        else
+        {
+            memset(retval, '\0', sizeof (DirHandle));
+            retval->mountPoint = NULL;
+            retval->funcs = funcs;
+            retval->opaque = opaque;
+            retval->fromIo = (io != NULL);
+        } /* else */
+    } /* if */
+
+    return retval;
+} /* tryOpenDir */
+
+
+static DirHandle *openDirectory(PHYSFS_Io *io, const char *d, int forWriting,
+                                PHYSFS_uint32 flags)
+{
+    DirHandle *retval = NULL;
+    const PHYSFS_Archiver **i;
+    const char *ext;
+    int created_io = 0;
+
+    assert((io != NULL) || (d != NULL));
+
+    if (io == NULL)
+    {
+        /* DIR gets first shot (unlike the rest, it doesn't deal with files). */
+        retval = tryOpenDir(io, &__PHYSFS_Archiver_DIR, d, forWriting, flags);
+        if (retval != NULL)
+            return retval;
+
+        io = __PHYSFS_createNativeIo(d, forWriting ? 'w' : 'r');
+        BAIL_IF_MACRO(!io, ERRPASS, 0);
+        created_io = 1;
+    } /* if */
+
+    ext = find_filename_extension(d);
+    if (ext != NULL)
+    {
+        /* Look for archivers with matching file extensions first... */
+        for (i = archivers; (*i != NULL) && (retval == NULL); i++)
+        {
+            if (__PHYSFS_utf8stricmp(ext, (*i)->info.extension) == 0)
+                retval = tryOpenDir(io, *i, d, forWriting, flags);
+        } /* for */
+
+        /* failing an exact file extension match, try all the others... */
+        for (i = archivers; (*i != NULL) && (retval == NULL); i++)
+        {
+            if (__PHYSFS_utf8stricmp(ext, (*i)->info.extension) != 0)
+                retval = tryOpenDir(io, *i, d, forWriting, flags);
+        } /* for */
+    } /* if */
+
+    else  /* no extension? Try them all. */
+    {
+        for (i = archivers; (*i != NULL) && (retval == NULL); i++)
+            retval = tryOpenDir(io, *i, d, forWriting, flags);
+    } /* else */
+
+    if ((!retval) && (created_io))
+        io->destroy(io);
+
+    BAIL_IF_MACRO(!retval, PHYSFS_ERR_UNSUPPORTED, NULL);
+    return retval;
+} /* openDirectory */
+
+
+/*
+ * Make a platform-independent path string sane. Doesn't actually check the
+ *  file hierarchy, it just cleans up the string.
+ *  (dst) must be a buffer at least as big as (src), as this is where the
+ *  cleaned up string is deposited.
+ * If there are illegal bits in the path (".." entries, etc) then we
+ *  return zero and (dst) is undefined. Non-zero if the path was sanitized.
+ */
+static int sanitizePlatformIndependentPath(const char *src, char *dst)
+{
+    char *prev;
+    char ch;
+
+    while (*src == '/')  /* skip initial '/' chars... */
+        src++;
+
+    prev = dst;
+    do
+    {
+        ch = *(src++);
+
+        if ((ch == ':') || (ch == '\\'))  /* illegal chars in a physfs path. */
+            BAIL_MACRO(PHYSFS_ERR_BAD_FILENAME, 0);
+
+        if (ch == '/')   /* path separator. */
+        {
+            *dst = '\0';  /* "." and ".." are illegal pathnames. */
+            if ((__PHYSFS_utf8stricmp(prev, ".") == 0) || (__PHYSFS_utf8stricmp(prev, "..") == 0))
+                BAIL_MACRO(PHYSFS_ERR_BAD_FILENAME, 0);
+
+            while (*src == '/')   /* chop out doubles... */
+                src++;
+
+            if (*src == '\0') /* ends with a pathsep? */
+                break;  /* we're done, don't add final pathsep to dst. */
+
+            prev = dst + 1;
+        } /* if */
+
+        *(dst++) = ch;
+    } while (ch != '\0');
+
+    return 1;
+} /* sanitizePlatformIndependentPath */
+
+
+/*
+ * Figure out if (fname) is part of (h)'s mountpoint. (fname) must be an
+ *  output from sanitizePlatformIndependentPath(), so that it is in a known
+ *  state.
+ *
+ * This only finds legitimate segments of a mountpoint. If the mountpoint is
+ *  "/a/b/c" and (fname) is "/a/b/c", "/", or "/a/b/c/d", then the results are
+ *  all zero. "/a/b" will succeed, though.
+ */
+static int partOfMountPoint(DirHandle *h, char *fname)
+{
+    /* !!! FIXME: This code feels gross. */
+    int rc;
+    size_t len, mntpntlen;
+
+    if (h->mountPoint == NULL)
+        return 0;
+    else if (*fname == '\0')
+        return 1;
+
+    len = strlen(fname);
+    mntpntlen = strlen(h->mountPoint);
+    if (len > mntpntlen)  /* can't be a subset of mountpoint. */
+        return 0;
+
+    /* if true, must be not a match or a complete match, but not a subset. */
+    if ((len + 1) == mntpntlen)
+        return 0;
+
+    rc = strncmp(fname, h->mountPoint, len); /* !!! FIXME: case insensitive? */
+    if (rc != 0)
+        return 0;  /* not a match. */
+
+    /* make sure /a/b matches /a/b/ and not /a/bc ... */
+    return h->mountPoint[len] == '/';
+} /* partOfMountPoint */
+
+
+static DirHandle *createDirHandle(PHYSFS_Io *io, const char *newDir,
+                                  const char *mountPoint, int forWriting,
+                                  PHYSFS_uint32 flags)
+{
+    DirHandle *dirHandle = NULL;
+    char *tmpmntpnt = NULL;
+    __PHYSFS_MemAccount *memory = NULL;
+    __PHYSFS_Stats *stats = NULL;
+    __PHYSFS_Stats *prevstats = NULL;
+    __PHYSFS_MemCharge charge;
+
+    if (mountPoint != NULL)
+    {
+        const size_t len = strlen(mountPoint) + 1;
+        tmpmntpnt = (char *) __PHYSFS_smallAlloc(len);
+        GOTO_IF_MACRO(!tmpmntpnt, PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
+        if (!sanitizePlatformIndependentPath(mountPoint, tmpmntpnt))
+            goto badDirHandle;
+        mountPoint = tmpmntpnt;  /* sanitized version. */
+    } /* if */
+
+    memory = memCreateAccount();
+    GOTO_IF_MACRO(!memory, ERRPASS, badDirHandle);
+
+    /* whatever the archiver allocates while opening is this mount's index. */
+    __PHYSFS_memCharge(memory, PHYSFS_MEMORY_INDEX, &charge);
+
+    stats = createStats();
+    GOTO_IF_MACRO(!stats, ERRPASS, badDirHandle);
+
+    prevstats = setCurrentStats(stats);
+    dirHandle = openDirectory(io, newDir, forWriting, flags);
+    setCurrentStats(prevstats);
+    GOTO_IF_MACRO(!dirHandle, ERRPASS, badDirHandle);
+
+    dirHandle->memory = memory;
+    dirHandle->stats = stats;
+    dirHandle->inMemory = ((io != NULL) && (io->read == memoryIo_read));
+
+    if (newDir == NULL)
+        dirHandle->dirName = NULL;
+    else
+    {
+        dirHandle->dirName = (char *) allocator.Malloc(strlen(newDir) + 1);
+        if (!dirHandle->dirName)
+            GOTO_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
+        strcpy(dirHandle->dirName, newDir);
+    } /* else */
+
+    if ((mountPoint != NULL) && (*mountPoint != '\0'))
+    {
+        dirHandle->mountPoint = (char *)allocator.Malloc(strlen(mountPoint)+2);
+        if (!dirHandle->mountPoint)
+            GOTO_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, badDirHandle);
+        strcpy(dirHandle->mountPoint, mountPoint);
+        strcat(dirHandle->mountPoint, "/");
+    } /* if */
+
+    __PHYSFS_memRestore(&charge);
+    __PHYSFS_smallFree(tmpmntpnt);
+    return dirHandle;
+
+badDirHandle:
+    if (memory != NULL)
+        __PHYSFS_memRestore(&charge);
+
+    if (dirHandle != NULL)
+    {
+        dirHandle->funcs->closeArchive(dirHandle->opaque);
+        allocator.Free(dirHandle->dirName);
+        allocator.Free(dirHandle->mountPoint);
+        allocator.Free(dirHandle);
+    } /* if */
+
+    allocator.Free(stats);
+    memOrphanAccount(memory);
+    __PHYSFS_smallFree(tmpmntpnt);
+    return NULL;
+} /* createDirHandle */
+
+
+static void flushVerifiedPaths(DirHandle *h)
+{
+    PHYSFS_uint32 i;
+    for (i = 0; i < h->verifiedbuckets; i++)
+        allocator.Free(h->verified[i].path);
+    allocator.Free(h->verified);
+    h->verified = NULL;
+    h->verifiedcount = 0;
+    h->verifiedbuckets = 0;
+} /* flushVerifiedPaths */
+
+
+/* MAKE SURE you've got the stateLock held before calling this! */
+static int freeDirHandle(DirHandle *dh)
+{
+    __PHYSFS_MemAccount *memory;
+    int inUse;
+
+    if (dh == NULL)
+        return 1;
+
+    /* nothing can open a new file here while we hold stateLock. */
+    __PHYSFS_platformGrabMutex(openListLock);
+    inUse = (dh->openFiles > 0);
+    __PHYSFS_platformReleaseMutex(openListLock);
+    BAIL_IF_MACRO(inUse, PHYSFS_ERR_FILES_STILL_OPEN, 0);
+
+    dh->funcs->closeArchive(dh->opaque);
+    flushVerifiedPaths(dh);
+    addStats(&retiredStats, dh->stats);
+    addStats(retiredStatsFor(dh->funcs), dh->stats);
+    allocator.Free(dh->stats);
+    allocator.Free(dh->dirName);
+    allocator.Free(dh->mountPoint);
+    memory = dh->memory;
+    allocator.Free(dh);
+    memOrphanAccount(memory);  /* goes away with anything still charged. */
+    return 1;
+} /* freeDirHandle */
+
+
+static char *calculateBaseDir(const char *argv0)
+{
+    const char dirsep = __PHYSFS_platformDirSeparator;
+    char *retval = NULL;
+    char *ptr = NULL;
+
+    /* Give the platform layer first shot at this. */
+    retval = __PHYSFS_platformCalcBaseDir(argv0);
+    if (retval != NULL)
+        return retval;
+
+    /* We need argv0 to go on. */
+    BAIL_IF_MACRO(argv0 == NULL, PHYSFS_ERR_ARGV0_IS_NULL, NULL);
+
+    ptr = strrchr(argv0, dirsep);
+    if (ptr != NULL)
+    {
+        const size_t size = ((size_t) (ptr - argv0)) + 1;
+        retval = (char *) allocator.Malloc(size + 1);
+        BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        memcpy(retval, argv0, size);
+        retval[size] = '\0';
+        return retval;
+    } /* if */
+
+    /* argv0 wasn't helpful. */
+    BAIL_MACRO(PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+} /* calculateBaseDir */
+
+
+static int initializeMutexes(void)
+{
+    errorLock = __PHYSFS_platformCreateMutex();
+    if (errorLock == NULL)
+        goto initializeMutexes_failed;
+
+    stateLock = __PHYSFS_platformCreateMutex();
+    if (stateLock == NULL)
+        goto initializeMutexes_failed;
+
+    openListLock = __PHYSFS_platformCreateMutex();
+    if (openListLock == NULL)
+        goto initializeMutexes_failed;
+
+    poolLock = __PHYSFS_platformCreateMutex();
+    if (poolLock == NULL)
+        goto initializeMutexes_failed;
+
+    memLock = __PHYSFS_platformCreateMutex();
+    if (memLock == NULL)
+        goto initializeMutexes_failed;
+
+    asyncLock = __PHYSFS_platformCreateMutex();
+    if (asyncLock == NULL)
+        goto initializeMutexes_failed;
+
+    traceLock = __PHYSFS_platformCreateMutex();
+    if (traceLock == NULL)
+        goto initializeMutexes_failed;
+
+    return 1;  /* success. */
+
+initializeMutexes_failed:
+    if (errorLock != NULL)
+        __PHYSFS_platformDestroyMutex(errorLock);
+
+    if (stateLock != NULL)
+        __PHYSFS_platformDestroyMutex(stateLock);
+
+    if (openListLock != NULL)
+        __PHYSFS_platformDestroyMutex(openListLock);
+
+    if (poolLock != NULL)
+        __PHYSFS_platformDestroyMutex(poolLock);
+
+    if (memLock != NULL)
+        __PHYSFS_platformDestroyMutex(memLock);
+
+    if (asyncLock != NULL)
+        __PHYSFS_platformDestroyMutex(asyncLock);
+
+    errorLock = stateLock = openListLock = poolLock = memLock = NULL;
+    asyncLock = NULL;
+    return 0;  /* failed. */
+} /* initializeMutexes */
+
+
+static int doRegisterArchiver(const PHYSFS_Archiver *_archiver);
+
+static int initStaticArchivers(void)
+{
+    #define REGISTER_STATIC_ARCHIVER(arc) { \
+        extern const PHYSFS_Archiver __PHYSFS_Archiver_##arc; \
+        if (!doRegisterArchiver(&__PHYSFS_Archiver_##arc)) { \
+            return 0; \
+        } \
+    }
+
+    #if PHYSFS_SUPPORTS_ZIP
+        REGISTER_STATIC_ARCHIVER(ZIP);
+    #endif
+    #if PHYSFS_SUPPORTS_7Z
+        REGISTER_STATIC_ARCHIVER(LZMA);
+    #endif
+    #if PHYSFS_SUPPORTS_GRP
+        REGISTER_STATIC_ARCHIVER(GRP);
+    #endif
+    #if PHYSFS_SUPPORTS_QPAK
+        REGISTER_STATIC_ARCHIVER(QPAK);
+    #endif
+    #if PHYSFS_SUPPORTS_HOG
+        REGISTER_STATIC_ARCHIVER(HOG);
+    #endif
+    #if PHYSFS_SUPPORTS_MVL
+        REGISTER_STATIC_ARCHIVER(MVL);
+    #endif
+    #if PHYSFS_SUPPORTS_WAD
+        REGISTER_STATIC_ARCHIVER(WAD);
+    #endif
+    #if PHYSFS_SUPPORTS_SLB
+        REGISTER_STATIC_ARCHIVER(SLB);
+    #endif
+    #if PHYSFS_SUPPORTS_ISO9660
+        REGISTER_STATIC_ARCHIVER(ISO9660);
+    #endif
+
+    #undef REGISTER_STATIC_ARCHIVER
+
+    return 1;
+} /* initStaticArchivers */
+
+
+static void setDefaultAllocator(void);
+static int doDeinit(void);
+
+int PHYSFS_init(const char *argv0)
+{
+    BAIL_IF_MACRO(initialized, PHYSFS_ERR_IS_INITIALIZED, 0);
+
+    if (!externalAllocator)
+        setDefaultAllocator();
+
+    if ((realAllocator.Init != NULL) && (!realAllocator.Init())) return 0;
+
+    /* everything goes through the accounting hooks from here on. */
+    allocator.Init = NULL;
+    allocator.Deinit = NULL;
+    allocator.Malloc = accountMalloc;
+    allocator.Realloc = accountRealloc;
+    allocator.Free = accountFree;
+
+    if (!__PHYSFS_platformInit())
+    {
+        if (realAllocator.Deinit != NULL) realAllocator.Deinit();
+        return 0;
+    } /* if */
+
+    /* everything below here can be cleaned up safely by doDeinit(). */
+
+    if (!initializeMutexes()) goto initFailed;
+
+    baseDir = calculateBaseDir(argv0);
+    if (!baseDir) goto initFailed;
+
+    userDir = __PHYSFS_platformCalcUserDir();
+    if (!userDir) goto initFailed;
+
+    /* Platform layer is required to append a dirsep. */
+    assert(baseDir[strlen(baseDir) - 1] == __PHYSFS_platformDirSeparator);
+    assert(userDir[strlen(userDir) - 1] == __PHYSFS_platformDirSeparator);
+
+    if (!initStaticArchivers()) goto initFailed;
+
+    initialized = 1;
+
+    /* This makes sure that the error subsystem is initialized. */
+    PHYSFS_setErrorCode(PHYSFS_getLastErrorCode());
+
+    return 1;
+
+initFailed:
+    doDeinit();
+    return 0;
+} /* PHYSFS_init */
+
+
+/* MAKE SURE you hold stateLock before calling this! */
+static int closeFileHandleList(FileHandle **list)
+{
+    FileHandle *i;
+    FileHandle *next = NULL;
+    int retval = 1;
+
+    __PHYSFS_platformGrabMutex(openListLock);
+    for (i = *list; i != NULL; i = next)
+    {
+        PHYSFS_Io *io = i->io;
+        next = i->next;
+
+        if (io->flush && !io->flush(io))
+        {
+            retval = 0;
+            break;
+        } /* if */
+
+        unregisterFileHandle(list, i);
+        io->destroy(io);
+        bufferFree(i->buffer, i->bufalloc);
+        bufferFree(i->backbuf, i->backalloc);
+        __PHYSFS_poolFree(&fileHandlePool, i);
+    } /* for */
+    __PHYSFS_platformReleaseMutex(openListLock);
+
+    return retval;
+} /* closeFileHandleList */
+
+
+/* MAKE SURE you hold the stateLock before calling this! */
+static void freeSearchPath(void)
+{
+    DirHandle *i;
+    DirHandle *next = NULL;
+
+    closeFileHandleList(&openReadList);
+
+    if (searchPath != NULL)
+    {
+        for (i = searchPath; i != NULL; i = next)
+        {
+            next = i->next;
+            freeDirHandle(i);
+        } /* for */
+        searchPath = NULL;
+    } /* if */
+} /* freeSearchPath */
+
+
+/* MAKE SURE you hold stateLock before calling this! */
+static int archiverInUse(const PHYSFS_Archiver *arc, const DirHandle *list)
+{
+    const DirHandle *i;
+    for (i = list; i != NULL; i = i->next)
+    {
+        if (i->funcs == arc)
+            return 1;
+    } /* for */
+
+    return 0;  /* not in use */
+} /* archiverInUse */
+
+
+/* MAKE SURE you hold stateLock before calling this! */
+static int doDeregisterArchiver(const size_t idx)
+{
+    const size_t len = (numArchivers - idx) * sizeof (void *);
+    const PHYSFS_ArchiveInfo *info = archiveInfo[idx];
+    const PHYSFS_Archiver *arc = archivers[idx];
+
+    /* make sure nothing is still using this archiver */
+    if (archiverInUse(arc, searchPath) || archiverInUse(arc, writeDir))
+        BAIL_MACRO(PHYSFS_ERR_FILES_STILL_OPEN, 0);
+
+    allocator.Free((void *) info->extension);
+    allocator.Free((void *) info->description);
+    allocator.Free((void *) info->author);
+    allocator.Free((void *) info->url);
+    allocator.Free((void *) arc);
+
+    memmove(&archiveInfo[idx], &archiveInfo[idx+1], len);
+    memmove(&archivers[idx], &archivers[idx+1], len);
+
+    assert(numArchivers > 0);
+    numArchivers--;
+
+    return 1;
+} /* doDeregisterArchiver */
+
+
+/* Does NOT hold the state lock; we're shutting down. */
+static void freeArchivers(void)
+{
+    while (numArchivers > 0)
+    {
+        if (!doDeregisterArchiver(numArchivers - 1))
+            assert(!"nothing should be mounted during shutdown.");
+    } /* while */
+
+    allocator.Free(archivers);
+    allocator.Free(archiveInfo);
+    archivers = NULL;
+    archiveInfo = NULL;
+} /* freeArchivers */
+
+
+static int doDeinit(void)
+{
+    shutdownAsync();
+    closeFileHandleList(&openWriteList);
+    BAIL_IF_MACRO(!PHYSFS_setWriteDir(NULL), PHYSFS_ERR_FILES_STILL_OPEN, 0);
+
+    freeSearchPath();
+    freeOpenHandles();
+    freeBufferPolicies();
+    closeTraceFile();
+    freeArchivers();
+    freeErrorStates();
+
+    if (baseDir != NULL)
+    {
+        allocator.Free(baseDir);
+        baseDir = NULL;
+    } /* if */
+
+    if (userDir != NULL)
+    {
+        allocator.Free(userDir);
+        userDir = NULL;
+    } /* if */
+
+    if (prefDir != NULL)
+    {
+        allocator.Free(prefDir);
+        prefDir = NULL;
+    } /* if */
+
+    if (archiveInfo != NULL)
+    {
+        allocator.Free(archiveInfo);
+        archiveInfo = NULL;
+    } /* if */
+
+    if (archivers != NULL)
+    {
+        allocator.Free(archivers);
+        archivers = NULL;
+    } /* if */
+
+    allowSymLinks = 0;
+    initialized = 0;
+
+    memset(&retiredStats, '\0', sizeof (retiredStats));
+    memset(&retiredDirStats, '\0', sizeof (retiredDirStats));
+
+    drainPools();
+
+    /* freeing a mutex goes through accountFree(), so drop this one first. */
+    if (memLock)
+    {
+        void *lock = memLock;
+        memLock = NULL;
+        __PHYSFS_platformDestroyMutex(lock);
+    } /* if */
+
+    if (errorLock) __PHYSFS_platformDestroyMutex(errorLock);
+    if (stateLock) __PHYSFS_platformDestroyMutex(stateLock);
+    if (openListLock) __PHYSFS_platformDestroyMutex(openListLock);
+    if (poolLock) __PHYSFS_platformDestroyMutex(poolLock);
+    if (asyncLock) __PHYSFS_platformDestroyMutex(asyncLock);
+    if (traceLock) __PHYSFS_platformDestroyMutex(traceLock);
+
+    if (realAllocator.Deinit != NULL)
+        realAllocator.Deinit();
+
+    errorLock = stateLock = openListLock = poolLock = asyncLock = NULL;
+    traceLock = NULL;
+
+    /* !!! FIXME: what on earth are you supposed to do if this fails? */
+    BAIL_IF_MACRO(!__PHYSFS_platformDeinit(), ERRPASS, 0);
+
+    return 1;
+} /* doDeinit */
+
+
+int PHYSFS_deinit(void)
+{
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    return doDeinit();
+} /* PHYSFS_deinit */
+
+
+int PHYSFS_isInit(void)
+{
+    return initialized;
+} /* PHYSFS_isInit */
+
+
+char *__PHYSFS_strdup(const char *str)
+{
+    char *retval = (char *) allocator.Malloc(strlen(str) + 1);
+    if (retval)
+        strcpy(retval, str);
+    return retval;
+} /* __PHYSFS_strdup */
+
+
+/* MAKE SURE you hold stateLock before calling this! */
 static int doRegisterArchiver(const PHYSFS_Archiver *_archiver)
 {
-    const PHYSFS_uint32 maxver = CURRENT_PHYSFS_ARCHIVER_API_VERSION;
-    const size_t len = (numArchivers + 2) * sizeof (void *);
-    PHYSFS_Archiver *archiver = NULL;
-    PHYSFS_ArchiveInfo *info = NULL;
-    const char *ext = NULL;
-    void *ptr = NULL;
-    size_t i;
+    const PHYSFS_uint32 maxver = CURRENT_PHYSFS_ARCHIVER_API_VERSION;
+    const size_t len = (numArchivers + 2) * sizeof (void *);
+    RegisteredArchiver *reg = NULL;
+    PHYSFS_Archiver *archiver = NULL;
+    PHYSFS_ArchiveInfo *info = NULL;
+    const char *ext = NULL;
+    void *ptr = NULL;
+    size_t i;
+
+    BAIL_IF_MACRO(!_archiver, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(_archiver->version > maxver, PHYSFS_ERR_UNSUPPORTED, 0);
+    BAIL_IF_MACRO(!_archiver->info.extension, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->info.description, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->info.author, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->info.url, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->openArchive, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->enumerateFiles, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->openRead, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->openWrite, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->openAppend, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->remove, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->mkdir, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->closeArchive, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_archiver->stat, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    ext = _archiver->info.extension;
+    if (__PHYSFS_utf8stricmp(ext, DIR_ARCHIVER_TYPE) == 0)
+        BAIL_MACRO(PHYSFS_ERR_DUPLICATE, 0);  /* that's plain directories. */
+    for (i = 0; i < numArchivers; i++)
+    {
+        if (__PHYSFS_utf8stricmp(archiveInfo[i]->extension, ext) == 0)
+            BAIL_MACRO(PHYSFS_ERR_DUPLICATE, 0);  /* !!! FIXME: better error? ERR_IN_USE? */
+    } /* for */
+
+    /* make a copy of the data. */
+    reg = (RegisteredArchiver *) allocator.Malloc(sizeof (*reg));
+    GOTO_IF_MACRO(!reg, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
+    memset(reg, '\0', sizeof (*reg));
+    archiver = &reg->archiver;
+
+    /* Must copy sizeof (OLD_VERSION_OF_STRUCT) when version changes! */
+    if (_archiver->version == 0)
+        memcpy(archiver, _archiver, offsetof(PHYSFS_Archiver, walk));
+    else if (_archiver->version == 1)
+        memcpy(archiver, _archiver, offsetof(PHYSFS_Archiver, enumerateFilesPrefix));
+    else if (_archiver->version == 2)
+        memcpy(archiver, _archiver, offsetof(PHYSFS_Archiver, locate));
+    else if (_archiver->version == 3)
+        memcpy(archiver, _archiver, offsetof(PHYSFS_Archiver, enumerateFilesWithStats));
+    else if (_archiver->version == 4)
+        memcpy(archiver, _archiver, offsetof(PHYSFS_Archiver, openArchiveWithFlags));
+    else
+        memcpy(archiver, _archiver, sizeof (*archiver));
+
+    info = (PHYSFS_ArchiveInfo *) &archiver->info;
+    memset(info, '\0', sizeof (*info));  /* NULL in case an alloc fails. */
+    #define CPYSTR(item) \
+        info->item = __PHYSFS_strdup(_archiver->info.item); \
+        GOTO_IF_MACRO(!info->item, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
+    CPYSTR(extension);
+    CPYSTR(description);
+    CPYSTR(author);
+    CPYSTR(url);
+    info->supportsSymlinks = _archiver->info.supportsSymlinks;
+    #undef CPYSTR
+
+    ptr = allocator.Realloc(archiveInfo, len);
+    GOTO_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
+    archiveInfo = (const PHYSFS_ArchiveInfo **) ptr;
+
+    ptr = allocator.Realloc(archivers, len);
+    GOTO_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
+    archivers = (const PHYSFS_Archiver **) ptr;
+
+    archiveInfo[numArchivers] = info;
+    archiveInfo[numArchivers + 1] = NULL;
+
+    archivers[numArchivers] = archiver;
+    archivers[numArchivers + 1] = NULL;
+
+    numArchivers++;
+
+    return 1;
+
+regfailed:
+    if (info != NULL)
+    {
+        allocator.Free((void *) info->extension);
+        allocator.Free((void *) info->description);
+        allocator.Free((void *) info->author);
+        allocator.Free((void *) info->url);
+    } /* if */
+    allocator.Free(reg);
+
+    return 0;
+} /* doRegisterArchiver */
+
+
+int PHYSFS_registerArchiver(const PHYSFS_Archiver *archiver)
+{
+    int retval;
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    __PHYSFS_platformGrabMutex(stateLock);
+    retval = doRegisterArchiver(archiver);
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return retval;
+} /* PHYSFS_registerArchiver */
+
+
+int PHYSFS_deregisterArchiver(const char *ext)
+{
+    size_t i;
+
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    BAIL_IF_MACRO(!ext, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    for (i = 0; i < numArchivers; i++)
+    {
+        if (__PHYSFS_utf8stricmp(archiveInfo[i]->extension, ext) == 0)
+        {
+            const int retval = doDeregisterArchiver(i);
+            __PHYSFS_platformReleaseMutex(stateLock);
+            return retval;
+        } /* if */
+    } /* for */
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    BAIL_MACRO(PHYSFS_ERR_NOT_FOUND, 0);
+} /* PHYSFS_deregisterArchiver */
+
+
+const PHYSFS_ArchiveInfo **PHYSFS_supportedArchiveTypes(void)
+{
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, NULL);
+    return archiveInfo;
+} /* PHYSFS_supportedArchiveTypes */
+
+
+void PHYSFS_freeList(void *list)
+{
+    /* every list we hand out is a single block; see finishStringList(). */
+    allocator.Free(list);
+} /* PHYSFS_freeList */
+
+
+const char *PHYSFS_getDirSeparator(void)
+{
+    static char retval[2] = { __PHYSFS_platformDirSeparator, '\0' };
+    return retval;
+} /* PHYSFS_getDirSeparator */
+
+
+char **PHYSFS_getCdRomDirs(void)
+{
+    return doEnumStringList(__PHYSFS_platformDetectAvailableCDs);
+} /* PHYSFS_getCdRomDirs */
+
+
+void PHYSFS_getCdRomDirsCallback(PHYSFS_StringCallback callback, void *data)
+{
+    __PHYSFS_platformDetectAvailableCDs(callback, data);
+} /* PHYSFS_getCdRomDirsCallback */
+
+
+const char *PHYSFS_getPrefDir(const char *org, const char *app)
+{
+    const char dirsep = __PHYSFS_platformDirSeparator;
+    PHYSFS_Stat statbuf;
+    char *ptr = NULL;
+    char *endstr = NULL;
+
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    BAIL_IF_MACRO(!org, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF_MACRO(*org == '\0', PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF_MACRO(!app, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF_MACRO(*app == '\0', PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+
+    allocator.Free(prefDir);
+    prefDir = __PHYSFS_platformCalcPrefDir(org, app);
+    BAIL_IF_MACRO(!prefDir, ERRPASS, NULL);
+
+    assert(strlen(prefDir) > 0);
+    endstr = prefDir + (strlen(prefDir) - 1);
+    assert(*endstr == dirsep);
+    *endstr = '\0';  /* mask out the final dirsep for now. */
+
+    if (!__PHYSFS_platformStat(prefDir, &statbuf))
+    {
+        for (ptr = strchr(prefDir, dirsep); ptr; ptr = strchr(ptr+1, dirsep))
+        {
+            *ptr = '\0';
+            __PHYSFS_platformMkDir(prefDir);
+            *ptr = dirsep;
+        } /* for */
+
+        if (!__PHYSFS_platformMkDir(prefDir))
+        {
+            allocator.Free(prefDir);
+            prefDir = NULL;
+        } /* if */
+    } /* if */
+
+    *endstr = dirsep;  /* readd the final dirsep. */
+
+    return prefDir;
+} /* PHYSFS_getPrefDir */
+
+
+const char *PHYSFS_getBaseDir(void)
+{
+    return baseDir;   /* this is calculated in PHYSFS_init()... */
+} /* PHYSFS_getBaseDir */
+
+
+const char *__PHYSFS_getUserDir(void)  /* not deprecated internal version. */
+{
+    return userDir;   /* this is calculated in PHYSFS_init()... */
+} /* __PHYSFS_getUserDir */
+
+
+const char *PHYSFS_getUserDir(void)
+{
+    return __PHYSFS_getUserDir();
+} /* PHYSFS_getUserDir */
+
+
+const char *PHYSFS_getWriteDir(void)
+{
+    const char *retval = NULL;
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    if (writeDir != NULL)
+        retval = writeDir->dirName;
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    return retval;
+} /* PHYSFS_getWriteDir */
+
+
+int PHYSFS_setWriteDir(const char *newDir)
+{
+    int retval = 1;
+
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    if (writeDir != NULL)
+    {
+        BAIL_IF_MACRO_MUTEX(!freeDirHandle(writeDir), ERRPASS, stateLock, 0);
+        writeDir = NULL;
+    } /* if */
+
+    if (newDir != NULL)
+    {
+        /* !!! FIXME: PHYSFS_Io shouldn't be NULL */
+        writeDir = createDirHandle(NULL, newDir, NULL, 1, 0);
+        retval = (writeDir != NULL);
+    } /* if */
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    return retval;
+} /* PHYSFS_setWriteDir */
+
+
+static int doMount(PHYSFS_Io *io, const char *fname, const char *mountPoint,
+                   int appendToPath, PHYSFS_uint32 flags)
+{
+    DirHandle *dh;
+    DirHandle *prev = NULL;
+    DirHandle *i;
+
+    if (mountPoint == NULL)
+        mountPoint = "/";
+
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    if (fname != NULL)
+    {
+        for (i = searchPath; i != NULL; i = i->next)
+        {
+            /* already in search path? */
+            if ((i->dirName != NULL) && (__PHYSFS_utf8stricmp(fname, i->dirName) == 0))
+                BAIL_MACRO_MUTEX(ERRPASS, stateLock, 1);
+            prev = i;
+        } /* for */
+    } /* if */
+
+    if (!TRACE_HOOKED())
+        dh = createDirHandle(io, fname, mountPoint, 0, flags);
+    else
+    {
+        const PHYSFS_uint64 start = __PHYSFS_platformGetTicks();
+        dh = createDirHandle(io, fname, mountPoint, 0, flags);
+        traceEvent(PHYSFS_TRACE_MOUNT, 0, mountPoint, fname, 0, 0,
+                   (dh != NULL), start);
+    } /* else */
+    BAIL_IF_MACRO_MUTEX(!dh, ERRPASS, stateLock, 0);
+
+    if (appendToPath)
+    {
+        if (prev == NULL)
+            searchPath = dh;
+        else
+            prev->next = dh;
+    } /* if */
+    else
+    {
+        dh->next = searchPath;
+        searchPath = dh;
+    } /* else */
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return 1;
+} /* doMount */
+
+
+int PHYSFS_mountIo(PHYSFS_Io *io, const char *fname,
+                   const char *mountPoint, int appendToPath)
+{
+    BAIL_IF_MACRO(!io, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(io->version != 0, PHYSFS_ERR_UNSUPPORTED, 0);
+    return doMount(io, fname, mountPoint, appendToPath, 0);
+} /* PHYSFS_mountIo */
+
+
+int PHYSFS_mountMemory(const void *buf, PHYSFS_uint64 len, void (*del)(void *),
+                       const char *fname, const char *mountPoint,
+                       int appendToPath)
+{
+    int retval = 0;
+    PHYSFS_Io *io = NULL;
+
+    BAIL_IF_MACRO(!buf, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    io = __PHYSFS_createMemoryIo(buf, len, del);
+    BAIL_IF_MACRO(!io, ERRPASS, 0);
+    retval = doMount(io, fname, mountPoint, appendToPath, 0);
+    if (!retval)
+    {
+        /* docs say not to call (del) in case of failure, so cheat. */
+        MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
+        info->destruct = NULL;
+        io->destroy(io);
+    } /* if */
+
+    return retval;
+} /* PHYSFS_mountMemory */
+
+
+int PHYSFS_mountHandle(PHYSFS_File *file, const char *fname,
+                       const char *mountPoint, int appendToPath)
+{
+    int retval = 0;
+    PHYSFS_Io *io = NULL;
+
+    BAIL_IF_MACRO(file == NULL, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    io = __PHYSFS_createHandleIo(file);
+    BAIL_IF_MACRO(!io, ERRPASS, 0);
+    retval = doMount(io, fname, mountPoint, appendToPath, 0);
+    if (!retval)
+    {
+        /* docs say not to destruct in case of failure, so cheat. */
+        io->opaque = NULL;
+        io->destroy(io);
+    } /* if */
+
+    return retval;
+} /* PHYSFS_mountHandle */
+
+
+int PHYSFS_mount(const char *newDir, const char *mountPoint, int appendToPath)
+{
+    BAIL_IF_MACRO(!newDir, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    return doMount(NULL, newDir, mountPoint, appendToPath, 0);
+} /* PHYSFS_mount */
+
+
+int PHYSFS_mountWithFlags(const char *newDir, const char *mountPoint,
+                          int appendToPath, PHYSFS_uint32 flags)
+{
+    BAIL_IF_MACRO(!newDir, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    return doMount(NULL, newDir, mountPoint, appendToPath, flags);
+} /* PHYSFS_mountWithFlags */
+
+
+int PHYSFS_addToSearchPath(const char *newDir, int appendToPath)
+{
+    return doMount(NULL, newDir, NULL, appendToPath, 0);
+} /* PHYSFS_addToSearchPath */
+
+
+int PHYSFS_removeFromSearchPath(const char *oldDir)
+{
+    return PHYSFS_unmount(oldDir);
+} /* PHYSFS_removeFromSearchPath */
+
+
+/* freeDirHandle(), reporting it to the trace callback. */
+static int traceUnmount(DirHandle *dh)
+{
+    const PHYSFS_uint64 start = __PHYSFS_platformGetTicks();
+    char *mountPoint = __PHYSFS_strdup(dh->mountPoint ? dh->mountPoint : "/");
+    char *dirName = __PHYSFS_strdup(dh->dirName);
+    const int retval = freeDirHandle(dh);
+    traceEvent(PHYSFS_TRACE_UNMOUNT, 0, mountPoint, dirName, 0, 0,
+               retval, start);
+    allocator.Free(dirName);
+    allocator.Free(mountPoint);
+    return retval;
+} /* traceUnmount */
+
+
+int PHYSFS_unmount(const char *oldDir)
+{
+    DirHandle *i;
+    DirHandle *prev = NULL;
+    DirHandle *next = NULL;
+
+    BAIL_IF_MACRO(oldDir == NULL, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (__PHYSFS_utf8stricmp(i->dirName, oldDir) == 0)
+        {
+            next = i->next;
+            if (!TRACE_HOOKED())
+                BAIL_IF_MACRO_MUTEX(!freeDirHandle(i), ERRPASS, stateLock, 0);
+            else
+                BAIL_IF_MACRO_MUTEX(!traceUnmount(i), ERRPASS, stateLock, 0);
+
+            if (prev == NULL)
+                searchPath = next;
+            else
+                prev->next = next;
+
+            BAIL_MACRO_MUTEX(ERRPASS, stateLock, 1);
+        } /* if */
+        prev = i;
+    } /* for */
+
+    BAIL_MACRO_MUTEX(PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
+} /* PHYSFS_unmount */
+
+
+char **PHYSFS_getSearchPath(void)
+{
+    return doEnumStringList(PHYSFS_getSearchPathCallback);
+} /* PHYSFS_getSearchPath */
+
+
+const char *PHYSFS_getMountPoint(const char *dir)
+{
+    DirHandle *i;
+    __PHYSFS_platformGrabMutex(stateLock);
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (__PHYSFS_utf8stricmp(i->dirName, dir) == 0)
+        {
+            const char *retval = ((i->mountPoint) ? i->mountPoint : "/");
+            __PHYSFS_platformReleaseMutex(stateLock);
+            return retval;
+        } /* if */
+    } /* for */
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    BAIL_MACRO(PHYSFS_ERR_NOT_MOUNTED, NULL);
+} /* PHYSFS_getMountPoint */
+
+
+void PHYSFS_getSearchPathCallback(PHYSFS_StringCallback callback, void *data)
+{
+    DirHandle *i;
+
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    for (i = searchPath; i != NULL; i = i->next)
+        callback(data, i->dirName);
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+} /* PHYSFS_getSearchPathCallback */
+
+
+/* Split out to avoid stack allocation in a loop. */
+static void setSaneCfgAddPath(const char *i, const size_t l, const char *dirsep,
+                              int archivesFirst)
+{
+    const char *d = PHYSFS_getRealDir(i);
+    const size_t allocsize = strlen(d) + strlen(dirsep) + l + 1;
+    char *str = (char *) __PHYSFS_smallAlloc(allocsize);
+    if (str != NULL)
+    {
+        sprintf(str, "%s%s%s", d, dirsep, i);
+        PHYSFS_mount(str, NULL, archivesFirst == 0);
+        __PHYSFS_smallFree(str);
+    } /* if */
+} /* setSaneCfgAddPath */
+
+
+int PHYSFS_setSaneConfig(const char *organization, const char *appName,
+                         const char *archiveExt, int includeCdRoms,
+                         int archivesFirst)
+{
+    const char *dirsep = PHYSFS_getDirSeparator();
+    const char *basedir;
+    const char *prefdir;
+
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+
+    prefdir = PHYSFS_getPrefDir(organization, appName);
+    BAIL_IF_MACRO(!prefdir, ERRPASS, 0);
+
+    basedir = PHYSFS_getBaseDir();
+    BAIL_IF_MACRO(!basedir, ERRPASS, 0);
+
+    BAIL_IF_MACRO(!PHYSFS_setWriteDir(prefdir), PHYSFS_ERR_NO_WRITE_DIR, 0);
+
+    /* Put write dir first in search path... */
+    PHYSFS_mount(prefdir, NULL, 0);
+
+    /* Put base path on search path... */
+    PHYSFS_mount(basedir, NULL, 1);
+
+    /* handle CD-ROMs... */
+    if (includeCdRoms)
+    {
+        char **cds = PHYSFS_getCdRomDirs();
+        char **i;
+        for (i = cds; *i != NULL; i++)
+            PHYSFS_mount(*i, NULL, 1);
+        PHYSFS_freeList(cds);
+    } /* if */
+
+    /* Root out archives, and add them to search path... */
+    if (archiveExt != NULL)
+    {
+        char **rc = PHYSFS_enumerateFiles("/");
+        char **i;
+        size_t extlen = strlen(archiveExt);
+        char *ext;
+
+        for (i = rc; *i != NULL; i++)
+        {
+            size_t l = strlen(*i);
+            if ((l > extlen) && ((*i)[l - extlen - 1] == '.'))
+            {
+                ext = (*i) + (l - extlen);
+                if (__PHYSFS_utf8stricmp(ext, archiveExt) == 0)
+                    setSaneCfgAddPath(*i, l, dirsep, archivesFirst);
+            } /* if */
+        } /* for */
+
+        PHYSFS_freeList(rc);
+    } /* if */
+
+    return 1;
+} /* PHYSFS_setSaneConfig */
+
+
+void PHYSFS_permitSymbolicLinks(int allow)
+{
+    __PHYSFS_platformGrabMutex(stateLock);
+    allowSymLinks = allow;
+    verifyGeneration++;
+    __PHYSFS_platformReleaseMutex(stateLock);
+} /* PHYSFS_permitSymbolicLinks */
+
+
+int PHYSFS_symbolicLinksPermitted(void)
+{
+    return allowSymLinks;
+} /* PHYSFS_symbolicLinksPermitted */
+
+
+/*
+ * Each archive remembers the directories verifyPath() has already found
+ *  to be real directories with no symlinks above them, so it doesn't have
+ *  to stat() every element of every path again. Only archives opened from
+ *  a PHYSFS_Io get this: they never change under us, but anyone can swap a
+ *  native directory for a symlink behind our back, so DIR mounts check
+ *  every time. Changing the
+ *  symlink policy bumps verifyGeneration, and every cache is thrown out the
+ *  next time it's used. The cache is capped, and just starts over when it
+ *  fills up.
+ */
+#define VERIFIED_PATH_MAX 4096
+
+static int isVerifiedPath(const DirHandle *h, const char *path)
+{
+    const PHYSFS_uint32 hash = __PHYSFS_hashString(path, strlen(path));
+    const PHYSFS_uint32 mask = h->verifiedbuckets - 1;
+    PHYSFS_uint32 bucket;
+
+    if (h->verifiedcount == 0)
+        return 0;
+
+    for (bucket = hash & mask; h->verified[bucket].path != NULL;
+         bucket = (bucket + 1) & mask)
+    {
+        const VerifiedPath *vp = &h->verified[bucket];
+        if ((vp->hash == hash) && (strcmp(vp->path, path) == 0))
+            return 1;
+    } /* for */
+
+    return 0;
+} /* isVerifiedPath */
+
+
+/* It's just a cache, so if we run out of memory, we just don't remember. */
+static void doAddVerifiedPath(DirHandle *h, const char *path)
+{
+    const PHYSFS_uint32 hash = __PHYSFS_hashString(path, strlen(path));
+    PHYSFS_uint32 mask;
+    PHYSFS_uint32 bucket;
+    char *copy;
+
+    if (h->verifiedcount >= VERIFIED_PATH_MAX)
+        flushVerifiedPaths(h);
+
+    /* keep the table at most half full, so probe chains stay short. */
+    if (h->verifiedcount >= (h->verifiedbuckets / 2))
+    {
+        const PHYSFS_uint32 newcount = h->verifiedbuckets ?
+                                        h->verifiedbuckets * 2 : 64;
+        const size_t len = newcount * sizeof (VerifiedPath);
+        VerifiedPath *verified = (VerifiedPath *) allocator.Malloc(len);
+        PHYSFS_uint32 i;
+
+        if (verified == NULL)
+            return;
+
+        memset(verified, '\0', len);
+        mask = newcount - 1;
+        for (i = 0; i < h->verifiedbuckets; i++)
+        {
+            const VerifiedPath *vp = &h->verified[i];
+            if (vp->path != NULL)
+            {
+                bucket = vp->hash & mask;
+                while (verified[bucket].path != NULL)
+                    bucket = (bucket + 1) & mask;
+                verified[bucket] = *vp;
+            } /* if */
+        } /* for */
+
+        allocator.Free(h->verified);
+        h->verified = verified;
+        h->verifiedbuckets = newcount;
+    } /* if */
+
+    copy = __PHYSFS_strdup(path);
+    if (copy == NULL)
+        return;
+
+    mask = h->verifiedbuckets - 1;
+    bucket = hash & mask;
+    while (h->verified[bucket].path != NULL)
+        bucket = (bucket + 1) & mask;
+    h->verified[bucket].hash = hash;
+    h->verified[bucket].path = copy;
+    h->verifiedcount++;
+} /* doAddVerifiedPath */
+
+
+static void addVerifiedPath(DirHandle *h, const char *path)
+{
+    __PHYSFS_MemCharge charge;
+
+    if (!h->fromIo)
+        return;  /* see above. */
+
+    /* over the memory limit, this is the first thing we can do without. */
+    if (__PHYSFS_memOverLimit())
+    {
+        flushVerifiedPaths(h);
+        return;
+    } /* if */
+
+    __PHYSFS_memCharge(h->memory, PHYSFS_MEMORY_CACHE, &charge);
+    doAddVerifiedPath(h, path);
+    __PHYSFS_memRestore(&charge);
+} /* addVerifiedPath */
+
+
+/*
+ * Verify that (fname) (in platform-independent notation), in relation
+ *  to (h) is secure. That means that each element of fname is checked
+ *  for symlinks (if they aren't permitted). This also allows for quick
+ *  rejection of files that exist outside an archive's mountpoint.
+ *
+ * With some exceptions (like PHYSFS_mkdir(), which builds multiple subdirs
+ *  at a time), you should always pass zero for "allowMissing" for efficiency.
+ *
+ * (fname) must point to an output from sanitizePlatformIndependentPath(),
+ *  since it will make sure that path names are in the right format for
+ *  passing certain checks. It will also do checks for "insecure" pathnames
+ *  like ".." which should be done once instead of once per archive. This also
+ *  gives us license to treat (fname) as scratch space in this function.
+ *
+ * Returns non-zero if string is safe, zero if there's a security issue.
+ *  PHYSFS_getLastError() will specify what was wrong. (*fname) will be
+ *  updated to point past any mount point elements so it is prepared to
+ *  be used with the archiver directly.
+ */
+static int verifyPath(DirHandle *h, char **_fname, int allowMissing)
+{
+    char *fname = *_fname;
+    int retval = 1;
+    char *start;
+    char *end;
+
+    if (*fname == '\0')  /* quick rejection. */
+        return 1;
+
+    /* !!! FIXME: This codeblock sucks. */
+    if (h->mountPoint != NULL)  /* NULL mountpoint means "/". */
+    {
+        size_t mntpntlen = strlen(h->mountPoint);
+        size_t len = strlen(fname);
+        assert(mntpntlen > 1); /* root mount points should be NULL. */
+        /* not under the mountpoint, so skip this archive. */
+        BAIL_IF_MACRO(len < mntpntlen-1, PHYSFS_ERR_NOT_FOUND, 0);
+        /* !!! FIXME: Case insensitive? */
+        retval = strncmp(h->mountPoint, fname, mntpntlen-1);
+        BAIL_IF_MACRO(retval != 0, PHYSFS_ERR_NOT_FOUND, 0);
+        if (len > mntpntlen-1)  /* corner case... */
+            BAIL_IF_MACRO(fname[mntpntlen-1]!='/', PHYSFS_ERR_NOT_FOUND, 0);
+        fname += mntpntlen-1;  /* move to start of actual archive path. */
+        if (*fname == '/')
+            fname++;
+        *_fname = fname;  /* skip mountpoint for later use. */
+        retval = 1;  /* may be reset, below. */
+    } /* if */
+
+    start = fname;
+
+    /* archivers that can't hold symlinks have nothing for us to check. */
+    if ((!allowSymLinks) && (h->funcs->info.supportsSymlinks))
+    {
+        if (h->verifiedgen != verifyGeneration)
+        {
+            flushVerifiedPaths(h);
+            h->verifiedgen = verifyGeneration;
+        } /* if */
+
+        if (isVerifiedPath(h, fname))
+        {
+            __PHYSFS_statAdd(h->stats, PHYSFS_STAT_CACHE_HITS, 1);
+            return 1;  /* a directory we've already checked all the way down. */
+        } /* if */
+        else if (h->fromIo)
+        {
+            __PHYSFS_statAdd(h->stats, PHYSFS_STAT_CACHE_MISSES, 1);
+        } /* else if */
+
+        /* if the parent is known to be safe, only check the last element. */
+        end = strrchr(fname, '/');
+        if (end != NULL)
+        {
+            *end = '\0';
+            if (isVerifiedPath(h, fname))
+                start = end + 1;
+            *end = '/';
+        } /* if */
+
+        while (1)
+        {
+            PHYSFS_Stat statbuf;
+            int rc = 0;
+            end = strchr(start, '/');
+
+            if (end != NULL) *end = '\0';
+            if ((end != NULL) && (isVerifiedPath(h, fname)))
+            {
+                *end = '/';
+                start = end + 1;
+                continue;
+            } /* if */
+
+            rc = h->funcs->stat(h->opaque, fname, &statbuf);
+            if (rc)
+            {
+                rc = (statbuf.filetype == PHYSFS_FILETYPE_SYMLINK);
+                if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+                    addVerifiedPath(h, fname);
+            } /* if */
+            else if (currentErrorCode() == PHYSFS_ERR_NOT_FOUND)
+                retval = 0;
+
+            if (end != NULL) *end = '/';
+
+            /* insecure path (has a disallowed symlink in it)? */
+            BAIL_IF_MACRO(rc, PHYSFS_ERR_SYMLINK_FORBIDDEN, 0);
+
+            /* break out early if path element is missing. */
+            if (!retval)
+            {
+                /*
+                 * We need to clear it if it's the last element of the path,
+                 *  since this might be a non-existant file we're opening
+                 *  for writing...
+                 */
+                if ((end == NULL) || (allowMissing))
+                    retval = 1;
+                break;
+            } /* if */
+
+            if (end == NULL)
+                break;
+
+            start = end + 1;
+        } /* while */
+    } /* if */
+
+    return retval;
+} /* verifyPath */
+
+
+static int doMkdir(const char *_dname, char *dname)
+{
+    DirHandle *h;
+    char *start;
+    char *end;
+    int retval = 0;
+    int exists = 1;  /* force existance check on first path element. */
+
+    BAIL_IF_MACRO(!sanitizePlatformIndependentPath(_dname, dname), ERRPASS, 0);
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    BAIL_IF_MACRO_MUTEX(!writeDir, PHYSFS_ERR_NO_WRITE_DIR, stateLock, 0);
+    h = writeDir;
+    BAIL_IF_MACRO_MUTEX(!verifyPath(h, &dname, 1), ERRPASS, stateLock, 0);
+
+    start = dname;
+    while (1)
+    {
+        end = strchr(start, '/');
+        if (end != NULL)
+            *end = '\0';
+
+        /* only check for existance if all parent dirs existed, too... */
+        if (exists)
+        {
+            PHYSFS_Stat statbuf;
+            const int rc = h->funcs->stat(h->opaque, dname, &statbuf);
+            if ((!rc) && (currentErrorCode() == PHYSFS_ERR_NOT_FOUND))
+                exists = 0;
+            retval = ((rc) && (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY));
+        } /* if */
+
+        if (!exists)
+            retval = h->funcs->mkdir(h->opaque, dname);
+
+        if (!retval)
+            break;
+
+        if (end == NULL)
+            break;
+
+        *end = '/';
+        start = end + 1;
+    } /* while */
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return retval;
+} /* doMkdir */
+
+
+int PHYSFS_mkdir(const char *_dname)
+{
+    int retval = 0;
+    char *dname;
+    size_t len;
+
+    BAIL_IF_MACRO(!_dname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    len = strlen(_dname) + 1;
+    dname = (char *) __PHYSFS_smallAlloc(len);
+    BAIL_IF_MACRO(!dname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    retval = doMkdir(_dname, dname);
+    __PHYSFS_smallFree(dname);
+    return retval;
+} /* PHYSFS_mkdir */
+
+
+static int doDelete(const char *_fname, char *fname)
+{
+    int retval;
+    DirHandle *h;
+    BAIL_IF_MACRO(!sanitizePlatformIndependentPath(_fname, fname), ERRPASS, 0);
+
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    BAIL_IF_MACRO_MUTEX(!writeDir, PHYSFS_ERR_NO_WRITE_DIR, stateLock, 0);
+    h = writeDir;
+    BAIL_IF_MACRO_MUTEX(!verifyPath(h, &fname, 0), ERRPASS, stateLock, 0);
+    retval = h->funcs->remove(h->opaque, fname);
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return retval;
+} /* doDelete */
+
+
+int PHYSFS_delete(const char *_fname)
+{
+    int retval;
+    char *fname;
+    size_t len;
+
+    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    len = strlen(_fname) + 1;
+    fname = (char *) __PHYSFS_smallAlloc(len);
+    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    retval = doDelete(_fname, fname);
+    __PHYSFS_smallFree(fname);
+    return retval;
+} /* PHYSFS_delete */
+
+
+const char *PHYSFS_getRealDir(const char *_fname)
+{
+    const char *retval = NULL;
+    char *fname = NULL;
+    size_t len;
 
-    BAIL_IF_MACRO(!_archiver, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(_archiver->version > maxver, PHYSFS_ERR_UNSUPPORTED, 0);
-    BAIL_IF_MACRO(!_archiver->info.extension, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->info.description, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->info.author, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->info.url, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->openArchive, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->enumerateFiles, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->openRead, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->openWrite, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->openAppend, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->remove, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->mkdir, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->closeArchive, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!_archiver->stat, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    len = strlen(_fname) + 1;
+    fname = __PHYSFS_smallAlloc(len);
+    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    if (sanitizePlatformIndependentPath(_fname, fname))
+    {
+        DirHandle *i;
+        __PHYSFS_platformGrabMutex(stateLock);
+        for (i = searchPath; i != NULL; i = i->next)
+        {
+            char *arcfname = fname;
+            if (partOfMountPoint(i, arcfname))
+            {
+                retval = i->dirName;
+                break;
+            } /* if */
+            else if (verifyPath(i, &arcfname, 0))
+            {
+                PHYSFS_Stat statbuf;
+                if (i->funcs->stat(i->opaque, arcfname, &statbuf))
+                {
+                    retval = i->dirName;
+                    break;
+                } /* if */
+            } /* if */
+        } /* for */
+        __PHYSFS_platformReleaseMutex(stateLock);
+    } /* if */
 
-    ext = _archiver->info.extension;
-    for (i = 0; i < numArchivers; i++)
+    __PHYSFS_smallFree(fname);
+    return retval;
+} /* PHYSFS_getRealDir */
+
+
+/* keep the dedupe table at most half full, so probe chains stay short. */
+static int growStringListBuckets(EnumStringListCallbackData *pecd)
+{
+    const PHYSFS_uint32 newcount = pecd->bucketcount ?
+                                        pecd->bucketcount * 2 : 128;
+    const PHYSFS_uint32 mask = newcount - 1;
+    PHYSFS_uint32 *buckets;
+    PHYSFS_uint32 i;
+
+    if (newcount < pecd->bucketcount)
+        buckets = NULL;  /* overflow. */
+    else
+        buckets = (PHYSFS_uint32 *) allocator.Malloc(newcount * sizeof (PHYSFS_uint32));
+
+    if (buckets == NULL)
     {
-        if (__PHYSFS_utf8stricmp(archiveInfo[i]->extension, ext) == 0)
-            BAIL_MACRO(PHYSFS_ERR_DUPLICATE, 0);  /* !!! FIXME: better error? ERR_IN_USE? */
+        pecd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+        return 0;
+    } /* if */
+
+    memset(buckets, '\0', newcount * sizeof (PHYSFS_uint32));
+    for (i = 0; i < pecd->count; i++)
+    {
+        PHYSFS_uint32 bucket = pecd->entries[i].hash & mask;
+        while (buckets[bucket] != 0)
+            bucket = (bucket + 1) & mask;
+        buckets[bucket] = i + 1;
     } /* for */
 
-    /* make a copy of the data. */
-    archiver = (PHYSFS_Archiver *) allocator.Malloc(sizeof (*archiver));
-    GOTO_IF_MACRO(!archiver, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
+    allocator.Free(pecd->buckets);
+    pecd->buckets = buckets;
+    pecd->bucketcount = newcount;
+    return 1;
+} /* growStringListBuckets */
 
-    /* Must copy sizeof (OLD_VERSION_OF_STRUCT) when version changes! */
-    memcpy(archiver, _archiver, sizeof (*archiver));
 
-    info = (PHYSFS_ArchiveInfo *) &archiver->info;
-    memset(info, '\0', sizeof (*info));  /* NULL in case an alloc fails. */
-    #define CPYSTR(item) \
-        info->item = __PHYSFS_strdup(_archiver->info.item); \
-        GOTO_IF_MACRO(!info->item, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
-    CPYSTR(extension);
-    CPYSTR(description);
-    CPYSTR(author);
-    CPYSTR(url);
-    info->supportsSymlinks = _archiver->info.supportsSymlinks;
-    #undef CPYSTR
+/*
+ * Find (str) in the dedupe table, case-insensitively. If it isn't there,
+ *  (*_bucket) is set to the empty bucket where it belongs.
+ */
+static int stringListFind(const EnumStringListCallbackData *pecd,
+                          const char *str, const PHYSFS_uint32 hash,
+                          PHYSFS_uint32 *_bucket)
+{
+    const PHYSFS_uint32 mask = pecd->bucketcount - 1;
+    PHYSFS_uint32 bucket;
+    PHYSFS_uint32 idx;
 
-    ptr = allocator.Realloc(archiveInfo, len);
-    GOTO_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
-    archiveInfo = (const PHYSFS_ArchiveInfo **) ptr;
+    if (pecd->bucketcount == 0)
+        return 0;
 
-    ptr = allocator.Realloc(archivers, len);
-    GOTO_IF_MACRO(!ptr, PHYSFS_ERR_OUT_OF_MEMORY, regfailed);
-    archivers = (const PHYSFS_Archiver **) ptr;
+    for (bucket = hash & mask; (idx = pecd->buckets[bucket]) != 0;
+         bucket = (bucket + 1) & mask)
+    {
+        const StringListEntry *entry = &pecd->entries[idx - 1];
+        if ( (entry->hash == hash) &&
+             (__PHYSFS_utf8stricmp(pecd->arena + entry->offset, str) == 0) )
+            return 1;
+    } /* for */
 
-    archiveInfo[numArchivers] = info;
-    archiveInfo[numArchivers + 1] = NULL;
+    if (_bucket != NULL)
+        *_bucket = bucket;
+    return 0;
+} /* stringListFind */
 
-    archivers[numArchivers] = archiver;
-    archivers[numArchivers + 1] = NULL;
 
-    numArchivers++;
+/* Append (str) to the list, unless it's already in there. */
+static void addToStringSet(EnumStringListCallbackData *pecd,
+                           const char *str, const size_t len)
+{
+    const PHYSFS_uint32 hash = __PHYSFS_hashString(str, len);
+    PHYSFS_uint32 bucket;
 
-    return 1;
+    if (pecd->errcode)
+        return;
 
-regfailed:
-    if (info != NULL)
+    if ((pecd->count >= (pecd->bucketcount / 2)) && (!growStringListBuckets(pecd)))
+        return;
+
+    if (stringListFind(pecd, str, hash, &bucket))
+        return;  /* already in the list. */
+
+    if (appendToStringList(pecd, str, len, hash))
+        pecd->buckets[bucket] = pecd->count;  /* index + 1 of the new entry. */
+} /* addToStringSet */
+
+
+static void enumFilesCallback(void *data, const char *origdir,
+                              const char *str, PHYSFS_Stat *stat)
+{
+    /*
+     * See if file is in the list already (case-insensitively, as the
+     *  sorted list always was), and if not, append it. We sort once at
+     *  the end instead of inserting in order.
+     */
+    addToStringSet((EnumStringListCallbackData *) data, str, strlen(str));
+} /* enumFilesCallback */
+
+
+/*
+ * Broke out to seperate function so we can use stack allocation gratuitously.
+ */
+static void enumerateFromMountPoint(DirHandle *i, const char *arcfname,
+                                    PHYSFS_EnumFilesCallback callback,
+                                    const char *_fname, void *data)
+{
+    const size_t len = strlen(arcfname);
+    char *ptr = NULL;
+    char *end = NULL;
+    const size_t slen = strlen(i->mountPoint) + 1;
+    char *mountPoint = (char *) __PHYSFS_smallAlloc(slen);
+    PHYSFS_Stat statbuf;
+
+    if (mountPoint == NULL)
+        return;  /* oh well. */
+
+    /* same thing PHYSFS_stat() reports for a piece of a mountpoint. */
+    statbuf.filesize = -1;
+    statbuf.modtime = -1;
+    statbuf.createtime = -1;
+    statbuf.accesstime = -1;
+    statbuf.filetype = PHYSFS_FILETYPE_DIRECTORY;
+    statbuf.readonly = 1;
+
+    strcpy(mountPoint, i->mountPoint);
+    ptr = mountPoint + ((len) ? len + 1 : 0);
+    end = strchr(ptr, '/');
+    assert(end);  /* should always find a terminating '/'. */
+    *end = '\0';
+    callback(data, _fname, ptr, &statbuf);
+    __PHYSFS_smallFree(mountPoint);
+} /* enumerateFromMountPoint */
+
+
+typedef struct SymlinkFilterData
+{
+    PHYSFS_EnumFilesCallback callback;
+    void *callbackData;
+    DirHandle *dirhandle;
+    const char *arcfname;  /* dir being enumerated, relative to the archive. */
+} SymlinkFilterData;
+
+static void enumCallbackFilterSymLinks(void *_data, const char *origdir,
+                                       const char *fname, PHYSFS_Stat *stat)
+{
+    SymlinkFilterData *data = (SymlinkFilterData *) _data;
+    PHYSFS_Stat statbuf;
+
+    /* the enumerator usually knows the type already; ask only if it didn't. */
+    if (stat == NULL)
     {
-        allocator.Free((void *) info->extension);
-        allocator.Free((void *) info->description);
-        allocator.Free((void *) info->author);
-        allocator.Free((void *) info->url);
+        const DirHandle *dh = data->dirhandle;
+        const char *arcfname = data->arcfname;
+        const size_t slen = strlen(arcfname) + strlen(fname) + 2;
+        char *path = (char *) __PHYSFS_smallAlloc(slen);
+        int rc;
+
+        if (path == NULL)
+            return;  /* oh well. */
+
+        sprintf(path, "%s%s%s", arcfname, *arcfname ? "/" : "", fname);
+        rc = dh->funcs->stat(dh->opaque, path, &statbuf);
+        __PHYSFS_smallFree(path);
+        if (!rc)
+            return;
+        stat = &statbuf;
     } /* if */
-    allocator.Free(archiver);
 
-    return 0;
-} /* doRegisterArchiver */
+    /* Pass it on to the application if it's not a symlink. */
+    if (stat->filetype != PHYSFS_FILETYPE_SYMLINK)
+        data->callback(data->callbackData, origdir, fname, stat);
+} /* enumCallbackFilterSymLinks */
 
 
-int PHYSFS_registerArchiver(const PHYSFS_Archiver *archiver)
+typedef struct PatternFilterData
 {
-    int retval;
-    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
-    __PHYSFS_platformGrabMutex(stateLock);
-    retval = doRegisterArchiver(archiver);
-    __PHYSFS_platformReleaseMutex(stateLock);
-    return retval;
-} /* PHYSFS_registerArchiver */
+    const __PHYSFS_Pattern *pattern;
+    PHYSFS_EnumFilesCallback callback;
+    void *callbackData;
+} PatternFilterData;
 
+static void enumCallbackFilterPattern(void *_data, const char *origdir,
+                                      const char *fname, PHYSFS_Stat *stat)
+{
+    const PatternFilterData *data = (const PatternFilterData *) _data;
+    if (__PHYSFS_matchPattern(data->pattern, fname))
+        data->callback(data->callbackData, origdir, fname, stat);
+} /* enumCallbackFilterPattern */
 
-int PHYSFS_deregisterArchiver(const char *ext)
+
+/*
+ * (pattern) may be NULL, to report everything. If (withStats) is zero,
+ *  (callback) only looks at the file type, so archivers with an
+ *  enumerateFilesWithStats method (like native directories) can skip
+ *  stat()ing each entry.
+ */
+static void doEnumerateFiles(const char *_fname, const __PHYSFS_Pattern *pattern,
+                             PHYSFS_EnumFilesCallback callback, int withStats,
+                             void *data)
 {
-    size_t i;
+    size_t len;
+    char *fname;
 
-    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
-    BAIL_IF_MACRO(!ext, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    len = strlen(_fname) + 1;
+    fname = (char *) __PHYSFS_smallAlloc(len);
+    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, ) /*0*/;
 
-    __PHYSFS_platformGrabMutex(stateLock);
-    for (i = 0; i < numArchivers; i++)
+    if (sanitizePlatformIndependentPath(_fname, fname))
     {
-        if (__PHYSFS_utf8stricmp(archiveInfo[i]->extension, ext) == 0)
+        DirHandle *i;
+        SymlinkFilterData filterdata;
+        PatternFilterData patterndata;
+
+        __PHYSFS_platformGrabMutex(stateLock);
+
+        if (!allowSymLinks)
         {
-            const int retval = doDeregisterArchiver(i);
-            __PHYSFS_platformReleaseMutex(stateLock);
-            return retval;
+            memset(&filterdata, '\0', sizeof (filterdata));
+            filterdata.callback = callback;
+            filterdata.callbackData = data;
         } /* if */
-    } /* for */
-    __PHYSFS_platformReleaseMutex(stateLock);
 
-    BAIL_MACRO(PHYSFS_ERR_NOT_FOUND, 0);
-} /* PHYSFS_deregisterArchiver */
+        /* match names first, so we only symlink-check the ones we want. */
+        patterndata.pattern = pattern;
+
+        for (i = searchPath; i != NULL; i = i->next)
+        {
+            char *arcfname = fname;
+            PHYSFS_EnumFilesCallback cb = callback;
+            void *cbdata = data;
+
+            if ((!allowSymLinks) && (i->funcs->info.supportsSymlinks))
+            {
+                filterdata.dirhandle = i;
+                cb = enumCallbackFilterSymLinks;
+                cbdata = &filterdata;
+            } /* if */
+
+            if (pattern != NULL)
+            {
+                patterndata.callback = cb;
+                patterndata.callbackData = cbdata;
+                cb = enumCallbackFilterPattern;
+                cbdata = &patterndata;
+            } /* if */
+
+            if (partOfMountPoint(i, arcfname))
+            {
+                /* no symlinks in a mountpoint; skip straight past that. */
+                if (pattern == NULL)
+                    enumerateFromMountPoint(i, arcfname, callback, _fname, data);
+                else
+                {
+                    patterndata.callback = callback;
+                    patterndata.callbackData = data;
+                    enumerateFromMountPoint(i, arcfname, enumCallbackFilterPattern, _fname, &patterndata);
+                } /* else */
+            } /* if */
+            else if (verifyPath(i, &arcfname, 0))
+            {
+                filterdata.arcfname = arcfname;
+                if ((pattern != NULL) && (i->funcs->enumerateFilesPrefix != NULL))
+                    i->funcs->enumerateFilesPrefix(i->opaque, arcfname, pattern->prefix, cb, _fname, cbdata);
+                else if (i->funcs->enumerateFilesWithStats != NULL)
+                    i->funcs->enumerateFilesWithStats(i->opaque, arcfname, cb, withStats, _fname, cbdata);
+                else
+                    i->funcs->enumerateFiles(i->opaque, arcfname, cb, _fname, cbdata);
+            } /* else if */
+        } /* for */
+        __PHYSFS_platformReleaseMutex(stateLock);
+    } /* if */
+
+    __PHYSFS_smallFree(fname);
+} /* doEnumerateFiles */
+
+
+/* !!! FIXME: this should report error conditions. */
+void PHYSFS_enumerateFilesCallback(const char *_fname, PHYSFS_EnumFilesCallback callback, void *data) {
+    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
+    BAIL_IF_MACRO(!callback, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
+    doEnumerateFiles(_fname, NULL, callback, 0, data);
+} /* PHYSFS_enumerateFilesCallback */
 
 
-const PHYSFS_ArchiveInfo **PHYSFS_supportedArchiveTypes(void)
+void PHYSFS_enumerateFilesCallbackWithStats(const char *_fname,
+                                            PHYSFS_EnumFilesCallback callback,
+                                            void *data)
 {
-    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, NULL);
-    return archiveInfo;
-} /* PHYSFS_supportedArchiveTypes */
+    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
+    BAIL_IF_MACRO(!callback, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
+    doEnumerateFiles(_fname, NULL, callback, 1, data);
+} /* PHYSFS_enumerateFilesCallbackWithStats */
 
 
-void PHYSFS_freeList(void *list)
+void PHYSFS_enumerateFilesPatternCallback(const char *_fname,
+                                          const char *_pattern,
+                                          PHYSFS_EnumFilesCallback callback,
+                                          void *data)
 {
-    void **i;
-    if (list != NULL)
-    {
-        for (i = (void **) list; *i != NULL; i++)
-            allocator.Free(*i);
+    __PHYSFS_Pattern *pattern;
 
-        allocator.Free(list);
-    } /* if */
-} /* PHYSFS_freeList */
+    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
+    BAIL_IF_MACRO(!_pattern, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
+    BAIL_IF_MACRO(!callback, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
 
+    pattern = __PHYSFS_compilePattern(_pattern);
+    BAIL_IF_MACRO(!pattern, ERRPASS, ) /*0*/;
+    doEnumerateFiles(_fname, pattern, callback, 0, data);
+    __PHYSFS_freePattern(pattern);
+} /* PHYSFS_enumerateFilesPatternCallback */
 
-const char *PHYSFS_getDirSeparator(void)
+
+char **PHYSFS_enumerateFiles(const char *path)
 {
-    static char retval[2] = { __PHYSFS_platformDirSeparator, '\0' };
-    return retval;
-} /* PHYSFS_getDirSeparator */
+    EnumStringListCallbackData ecd;
+    memset(&ecd, '\0', sizeof (ecd));
+    if (path == NULL)
+        PHYSFS_setErrorCode(PHYSFS_ERR_INVALID_ARGUMENT);
+    else  /* we only want names, so don't stat everything. */
+        doEnumerateFiles(path, NULL, enumFilesCallback, 0, &ecd);
+    __PHYSFS_sort(&ecd, ecd.count, stringListCmp, stringListSwap);
+    return finishStringList(&ecd);
+} /* PHYSFS_enumerateFiles */
 
 
-char **PHYSFS_getCdRomDirs(void)
+char **PHYSFS_enumerateFilesPattern(const char *path, const char *_pattern)
 {
-    return doEnumStringList(__PHYSFS_platformDetectAvailableCDs);
-} /* PHYSFS_getCdRomDirs */
+    EnumStringListCallbackData ecd;
+    __PHYSFS_Pattern *pattern;
 
+    BAIL_IF_MACRO(!path, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF_MACRO(!_pattern, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
 
-void PHYSFS_getCdRomDirsCallback(PHYSFS_StringCallback callback, void *data)
-{
-    __PHYSFS_platformDetectAvailableCDs(callback, data);
-} /* PHYSFS_getCdRomDirsCallback */
+    pattern = __PHYSFS_compilePattern(_pattern);
+    BAIL_IF_MACRO(!pattern, ERRPASS, NULL);
+
+    memset(&ecd, '\0', sizeof (ecd));
+    doEnumerateFiles(path, pattern, enumFilesCallback, 0, &ecd);
+    __PHYSFS_freePattern(pattern);
+    __PHYSFS_sort(&ecd, ecd.count, stringListCmp, stringListSwap);
+    return finishStringList(&ecd);
+} /* PHYSFS_enumerateFilesPattern */
 
 
-const char *PHYSFS_getPrefDir(const char *org, const char *app)
+typedef struct
 {
-    const char dirsep = __PHYSFS_platformDirSeparator;
-    PHYSFS_Stat statbuf;
-    char *ptr = NULL;
-    char *endstr = NULL;
+    PHYSFS_uint32 flags;
+    PHYSFS_WalkCallback callback;
+    void *callbackData;
+    DirHandle *dirhandle;  /* search path element we're walking right now. */
+    const char *prefix;  /* its mountpoint, without the trailing '/'. */
+    size_t prefixlen;  /* zero if mounted at the root. */
+    char *path;  /* scratch space for building virtual paths. */
+    size_t pathalloc;
+    EnumStringListCallbackData pruned;  /* dirs the app told us to skip. */
+    int stopped;
+    int failed;
+    PHYSFS_ErrorCode errcode;
+} WalkData;
 
-    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
-    BAIL_IF_MACRO(!org, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
-    BAIL_IF_MACRO(*org == '\0', PHYSFS_ERR_INVALID_ARGUMENT, NULL);
-    BAIL_IF_MACRO(!app, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
-    BAIL_IF_MACRO(*app == '\0', PHYSFS_ERR_INVALID_ARGUMENT, NULL);
 
-    allocator.Free(prefDir);
-    prefDir = __PHYSFS_platformCalcPrefDir(org, app);
-    BAIL_IF_MACRO(!prefDir, ERRPASS, NULL);
+/*
+ * Every file reported by every archive goes through here. (arcdir) is
+ *  relative to the current archive's root, so we tack on the mountpoint,
+ *  filter out symlinks and directories the app already skipped, and
+ *  remember any directory it asks us to skip now, so later search path
+ *  elements don't wander back into it.
+ */
+static int walkReport(WalkData *wd, const char *arcdir, const char *fname,
+                      const PHYSFS_Stat *stat)
+{
+    const int isdir = (stat->filetype == PHYSFS_FILETYPE_DIRECTORY);
+    const size_t arcdirlen = strlen(arcdir);
+    const size_t fnamelen = strlen(fname);
+    const size_t len = wd->prefixlen + arcdirlen + fnamelen + 3;
+    size_t dirlen = wd->prefixlen;
+    char *path;
+    char ch;
+    int rc;
 
-    assert(strlen(prefDir) > 0);
-    endstr = prefDir + (strlen(prefDir) - 1);
-    assert(*endstr == dirsep);
-    *endstr = '\0';  /* mask out the final dirsep for now. */
+    if (wd->stopped || wd->errcode)
+        return PHYSFS_WALK_STOP;
 
-    if (!__PHYSFS_platformStat(prefDir, &statbuf))
-    {
-        for (ptr = strchr(prefDir, dirsep); ptr; ptr = strchr(ptr+1, dirsep))
-        {
-            *ptr = '\0';
-            __PHYSFS_platformMkDir(prefDir);
-            *ptr = dirsep;
-        } /* for */
+    if ( (stat->filetype == PHYSFS_FILETYPE_SYMLINK) && (!allowSymLinks) &&
+         (wd->dirhandle->funcs->info.supportsSymlinks) )
+        return PHYSFS_WALK_CONTINUE;
 
-        if (!__PHYSFS_platformMkDir(prefDir))
+    if (len > wd->pathalloc)
+    {
+        void *ptr = allocator.Realloc(wd->path, len);
+        if (ptr == NULL)
         {
-            allocator.Free(prefDir);
-            prefDir = NULL;
+            wd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+            return PHYSFS_WALK_STOP;
         } /* if */
+        wd->path = (char *) ptr;
+        wd->pathalloc = len;
     } /* if */
 
-    *endstr = dirsep;  /* readd the final dirsep. */
-
-    return prefDir;
-} /* PHYSFS_getPrefDir */
+    /* build "prefix/arcdir/fname", leaving out empty pieces. */
+    path = wd->path;
+    memcpy(path, wd->prefix, wd->prefixlen);
+    if (arcdirlen)
+    {
+        if (dirlen)
+            path[dirlen++] = '/';
+        memcpy(path + dirlen, arcdir, arcdirlen);
+        dirlen += arcdirlen;
+    } /* if */
 
+    if (dirlen)
+        path[dirlen] = '/';
+    memcpy(path + dirlen + (dirlen ? 1 : 0), fname, fnamelen + 1);
 
-const char *PHYSFS_getBaseDir(void)
-{
-    return baseDir;   /* this is calculated in PHYSFS_init()... */
-} /* PHYSFS_getBaseDir */
+    if ( (isdir) && (wd->pruned.count) &&
+         (stringListFind(&wd->pruned, path, __PHYSFS_hashString(path, strlen(path)), NULL)) )
+        return PHYSFS_WALK_SKIP_SUBTREE;
 
+    if ((isdir) && (wd->flags & PHYSFS_WALK_FILES_ONLY))
+        return PHYSFS_WALK_CONTINUE;
 
-const char *__PHYSFS_getUserDir(void)  /* not deprecated internal version. */
-{
-    return userDir;   /* this is calculated in PHYSFS_init()... */
-} /* __PHYSFS_getUserDir */
+    ch = path[dirlen];
+    path[dirlen] = '\0';
+    rc = wd->callback(wd->callbackData, path, fname, stat);
+    path[dirlen] = ch;
 
+    if (rc == PHYSFS_WALK_STOP)
+        wd->stopped = 1;
+    else if (rc == PHYSFS_WALK_SKIP_SUBTREE)
+    {
+        if (!isdir)
+            rc = PHYSFS_WALK_CONTINUE;
+        else
+        {
+            addToStringSet(&wd->pruned, path, strlen(path));
+            if (wd->pruned.errcode)
+            {
+                wd->errcode = wd->pruned.errcode;
+                rc = PHYSFS_WALK_STOP;
+            } /* if */
+        } /* else */
+    } /* else if */
+    else
+    {
+        rc = PHYSFS_WALK_CONTINUE;
+    } /* else */
 
-const char *PHYSFS_getUserDir(void)
-{
-    return __PHYSFS_getUserDir();
-} /* PHYSFS_getUserDir */
+    return rc;
+} /* walkReport */
 
 
-const char *PHYSFS_getWriteDir(void)
+static int walkArchiveCallback(void *data, const char *dir,
+                               const char *fname, const PHYSFS_Stat *stat)
 {
-    const char *retval = NULL;
-
-    __PHYSFS_platformGrabMutex(stateLock);
-    if (writeDir != NULL)
-        retval = writeDir->dirName;
-    __PHYSFS_platformReleaseMutex(stateLock);
+    return walkReport((WalkData *) data, dir, fname, stat);
+} /* walkArchiveCallback */
 
-    return retval;
-} /* PHYSFS_getWriteDir */
 
+typedef struct
+{
+    WalkData *wd;
+    const char *arcdir;
+    EnumStringListCallbackData subdirs;
+} WalkEnumData;
 
-int PHYSFS_setWriteDir(const char *newDir)
+static void walkEnumCallback(void *data, const char *origdir,
+                             const char *fname, PHYSFS_Stat *stat)
 {
-    int retval = 1;
+    WalkEnumData *ed = (WalkEnumData *) data;
+    WalkData *wd = ed->wd;
+    const DirHandle *dh = wd->dirhandle;
+    PHYSFS_Stat statbuf;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    if (wd->stopped || wd->errcode || ed->subdirs.errcode)
+        return;
 
-    if (writeDir != NULL)
+    if (stat == NULL)  /* archiver didn't know; ask it directly. */
     {
-        BAIL_IF_MACRO_MUTEX(!freeDirHandle(writeDir, openWriteList), ERRPASS,
-                            stateLock, 0);
-        writeDir = NULL;
-    } /* if */
+        const size_t len = strlen(ed->arcdir) + strlen(fname) + 2;
+        char *path = (char *) __PHYSFS_smallAlloc(len);
+        int rc;
+        if (path == NULL)
+        {
+            wd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+            return;
+        } /* if */
 
-    if (newDir != NULL)
-    {
-        /* !!! FIXME: PHYSFS_Io shouldn't be NULL */
-        writeDir = createDirHandle(NULL, newDir, NULL, 1);
-        retval = (writeDir != NULL);
+        sprintf(path, "%s%s%s", ed->arcdir, *ed->arcdir ? "/" : "", fname);
+        rc = dh->funcs->stat(dh->opaque, path, &statbuf);
+        __PHYSFS_smallFree(path);
+        if (!rc)
+            return;  /* vanished out from under us? Skip it. */
+        stat = &statbuf;
     } /* if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
+    if (walkReport(wd, ed->arcdir, fname, stat) != PHYSFS_WALK_CONTINUE)
+        return;
 
-    return retval;
-} /* PHYSFS_setWriteDir */
+    /* recurse after enumerateFiles returns, so we don't hold its state. */
+    if (stat->filetype == PHYSFS_FILETYPE_DIRECTORY)
+        appendToStringList(&ed->subdirs, fname, strlen(fname), 0);
+} /* walkEnumCallback */
 
 
-static int doMount(PHYSFS_Io *io, const char *fname,
-                   const char *mountPoint, int appendToPath)
+/* Walk an archiver without a walk() method, one directory at a time. */
+static void walkEnumerate(WalkData *wd, const char *arcdir)
 {
-    DirHandle *dh;
-    DirHandle *prev = NULL;
-    DirHandle *i;
+    const DirHandle *dh = wd->dirhandle;
+    const size_t arcdirlen = strlen(arcdir);
+    WalkEnumData ed;
+    PHYSFS_uint32 i;
 
-    if (mountPoint == NULL)
-        mountPoint = "/";
+    memset(&ed, '\0', sizeof (ed));
+    ed.wd = wd;
+    ed.arcdir = arcdir;
+    dh->funcs->enumerateFiles(dh->opaque, arcdir, walkEnumCallback,
+                              arcdir, &ed);
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    if (ed.subdirs.errcode)
+        wd->errcode = ed.subdirs.errcode;
 
-    if (fname != NULL)
+    for (i = 0; (i < ed.subdirs.count) && (!wd->stopped) && (!wd->errcode); i++)
     {
-        for (i = searchPath; i != NULL; i = i->next)
+        const char *name = ed.subdirs.arena + ed.subdirs.entries[i].offset;
+        const size_t len = arcdirlen + strlen(name) + 2;
+        char *subdir = (char *) allocator.Malloc(len);
+        if (subdir == NULL)
         {
-            /* already in search path? */
-            if ((i->dirName != NULL) && (__PHYSFS_utf8stricmp(fname, i->dirName) == 0))
-                BAIL_MACRO_MUTEX(ERRPASS, stateLock, 1);
-            prev = i;
-        } /* for */
-    } /* if */
-
-    dh = createDirHandle(io, fname, mountPoint, 0);
-    BAIL_IF_MACRO_MUTEX(!dh, ERRPASS, stateLock, 0);
+            wd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+            break;
+        } /* if */
 
-    if (appendToPath)
-    {
-        if (prev == NULL)
-            searchPath = dh;
-        else
-            prev->next = dh;
-    } /* if */
-    else
-    {
-        dh->next = searchPath;
-        searchPath = dh;
-    } /* else */
+        sprintf(subdir, "%s%s%s", arcdir, arcdirlen ? "/" : "", name);
+        walkEnumerate(wd, subdir);
+        allocator.Free(subdir);
+    } /* for */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
-    return 1;
-} /* doMount */
+    freeStringListData(&ed.subdirs);
+} /* walkEnumerate */
 
 
-int PHYSFS_mountIo(PHYSFS_Io *io, const char *fname,
-                   const char *mountPoint, int appendToPath)
+static void walkDirHandle(WalkData *wd, const char *arcdir)
 {
-    BAIL_IF_MACRO(!io, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(io->version != 0, PHYSFS_ERR_UNSUPPORTED, 0);
-    return doMount(io, fname, mountPoint, appendToPath);
-} /* PHYSFS_mountIo */
+    const PHYSFS_Archiver *funcs = wd->dirhandle->funcs;
+    if (funcs->walk == NULL)
+        walkEnumerate(wd, arcdir);
+    else if (!funcs->walk(wd->dirhandle->opaque, arcdir, walkArchiveCallback, wd))
+    {
+        if ((!wd->stopped) && (!wd->errcode))
+            wd->failed = 1;  /* archiver set the error state already. */
+    } /* else if */
+} /* walkDirHandle */
 
 
-int PHYSFS_mountMemory(const void *buf, PHYSFS_uint64 len, void (*del)(void *),
-                       const char *fname, const char *mountPoint,
-                       int appendToPath)
+/*
+ * Report the pieces of a mountpoint below (root) as directories, then walk
+ *  the whole archive mounted there. Broke out to seperate function so we
+ *  can use stack allocation gratuitously.
+ */
+static void walkFromMountPoint(WalkData *wd, const char *root)
 {
-    int retval = 0;
-    PHYSFS_Io *io = NULL;
+    const DirHandle *dh = wd->dirhandle;
+    const size_t rootlen = strlen(root);
+    const size_t slen = strlen(dh->mountPoint) + 1;
+    char *mountPoint = (char *) __PHYSFS_smallAlloc(slen);
+    PHYSFS_Stat statbuf;
+    char *ptr;
+    char *end;
 
-    BAIL_IF_MACRO(!buf, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    if (mountPoint == NULL)
+    {
+        wd->errcode = PHYSFS_ERR_OUT_OF_MEMORY;
+        return;
+    } /* if */
 
-    io = __PHYSFS_createMemoryIo(buf, len, del);
-    BAIL_IF_MACRO(!io, ERRPASS, 0);
-    retval = doMount(io, fname, mountPoint, appendToPath);
-    if (!retval)
+    /* same thing PHYSFS_stat() reports for a piece of a mountpoint. */
+    statbuf.filesize = -1;
+    statbuf.modtime = -1;
+    statbuf.createtime = -1;
+    statbuf.accesstime = -1;
+    statbuf.filetype = PHYSFS_FILETYPE_DIRECTORY;
+    statbuf.readonly = 1;
+
+    /* these are already virtual paths, so report them without a prefix. */
+    strcpy(mountPoint, dh->mountPoint);
+    wd->prefixlen = 0;
+    for (ptr = mountPoint + (rootlen ? rootlen + 1 : 0);
+         (end = strchr(ptr, '/')) != NULL; ptr = end + 1)
     {
-        /* docs say not to call (del) in case of failure, so cheat. */
-        MemoryIoInfo *info = (MemoryIoInfo *) io->opaque;
-        info->destruct = NULL;
-        io->destroy(io);
+        int rc;
+        *end = '\0';
+        if (ptr != mountPoint)
+            ptr[-1] = '\0';
+        rc = walkReport(wd, (ptr == mountPoint) ? "" : mountPoint, ptr, &statbuf);
+        if (ptr != mountPoint)
+            ptr[-1] = '/';
+        *end = '/';
+
+        if (rc != PHYSFS_WALK_CONTINUE)
+            break;  /* skipping anything here skips the whole archive. */
+    } /* for */
+
+    if (end == NULL)  /* made it all the way down? */
+    {
+        wd->prefixlen = slen - 2;  /* chop the trailing '/'. */
+        walkDirHandle(wd, "");
     } /* if */
 
-    return retval;
-} /* PHYSFS_mountMemory */
+    __PHYSFS_smallFree(mountPoint);
+} /* walkFromMountPoint */
 
 
-int PHYSFS_mountHandle(PHYSFS_File *file, const char *fname,
-                       const char *mountPoint, int appendToPath)
+int PHYSFS_walk(const char *_root, PHYSFS_uint32 flags,
+                PHYSFS_WalkCallback callback, void *data)
 {
-    int retval = 0;
-    PHYSFS_Io *io = NULL;
+    WalkData wd;
+    size_t len;
+    char *root;
 
-    BAIL_IF_MACRO(file == NULL, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_root, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!callback, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    io = __PHYSFS_createHandleIo(file);
-    BAIL_IF_MACRO(!io, ERRPASS, 0);
-    retval = doMount(io, fname, mountPoint, appendToPath);
-    if (!retval)
+    len = strlen(_root) + 1;
+    root = (char *) __PHYSFS_smallAlloc(len);
+    BAIL_IF_MACRO(!root, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    if (!sanitizePlatformIndependentPath(_root, root))
     {
-        /* docs say not to destruct in case of failure, so cheat. */
-        io->opaque = NULL;
-        io->destroy(io);
+        __PHYSFS_smallFree(root);
+        return 0;
     } /* if */
 
-    return retval;
-} /* PHYSFS_mountHandle */
+    memset(&wd, '\0', sizeof (wd));
+    wd.flags = flags;
+    wd.callback = callback;
+    wd.callbackData = data;
+
+    __PHYSFS_platformGrabMutex(stateLock);
 
+    for (wd.dirhandle = searchPath; wd.dirhandle != NULL;
+         wd.dirhandle = wd.dirhandle->next)
+    {
+        char *arcfname = root;
 
-int PHYSFS_mount(const char *newDir, const char *mountPoint, int appendToPath)
+        if (wd.stopped || wd.errcode || wd.failed)
+            break;
+
+        wd.prefix = wd.dirhandle->mountPoint;
+        wd.prefixlen = wd.prefix ? strlen(wd.prefix) - 1 : 0;
+
+        if (partOfMountPoint(wd.dirhandle, arcfname))
+            walkFromMountPoint(&wd, root);
+        else if (verifyPath(wd.dirhandle, &arcfname, 0))
+            walkDirHandle(&wd, arcfname);
+    } /* for */
+
+    __PHYSFS_platformReleaseMutex(stateLock);
+
+    allocator.Free(wd.path);
+    freeStringListData(&wd.pruned);
+    __PHYSFS_smallFree(root);
+
+    BAIL_IF_MACRO(wd.errcode, wd.errcode, 0);
+    return !wd.failed;
+} /* PHYSFS_walk */
+
+
+int PHYSFS_exists(const char *fname)
 {
-    BAIL_IF_MACRO(!newDir, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    return doMount(NULL, newDir, mountPoint, appendToPath);
-} /* PHYSFS_mount */
+    return (PHYSFS_getRealDir(fname) != NULL);
+} /* PHYSFS_exists */
 
 
-int PHYSFS_addToSearchPath(const char *newDir, int appendToPath)
+PHYSFS_sint64 PHYSFS_getLastModTime(const char *fname)
 {
-    return doMount(NULL, newDir, NULL, appendToPath);
-} /* PHYSFS_addToSearchPath */
+    PHYSFS_Stat statbuf;
+    BAIL_IF_MACRO(!PHYSFS_stat(fname, &statbuf), ERRPASS, -1);
+    return statbuf.modtime;
+} /* PHYSFS_getLastModTime */
 
 
-int PHYSFS_removeFromSearchPath(const char *oldDir)
+int PHYSFS_isDirectory(const char *fname)
 {
-    return PHYSFS_unmount(oldDir);
-} /* PHYSFS_removeFromSearchPath */
+    PHYSFS_Stat statbuf;
+    BAIL_IF_MACRO(!PHYSFS_stat(fname, &statbuf), ERRPASS, 0);
+    return (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY);
+} /* PHYSFS_isDirectory */
+
+
+int PHYSFS_isSymbolicLink(const char *fname)
+{
+    PHYSFS_Stat statbuf;
+    BAIL_IF_MACRO(!PHYSFS_stat(fname, &statbuf), ERRPASS, 0);
+    return (statbuf.filetype == PHYSFS_FILETYPE_SYMLINK);
+} /* PHYSFS_isSymbolicLink */
 
 
-int PHYSFS_unmount(const char *oldDir)
+static PHYSFS_File *doOpenWrite(const char *_fname, int appending)
 {
-    DirHandle *i;
-    DirHandle *prev = NULL;
-    DirHandle *next = NULL;
+    FileHandle *fh = NULL;
+    size_t len;
+    char *fname;
 
-    BAIL_IF_MACRO(oldDir == NULL, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    len = strlen(_fname) + 1;
+    fname = (char *) __PHYSFS_smallAlloc(len);
+    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
 
-    __PHYSFS_platformGrabMutex(stateLock);
-    for (i = searchPath; i != NULL; i = i->next)
+    if (sanitizePlatformIndependentPath(_fname, fname))
     {
-        if (__PHYSFS_utf8stricmp(i->dirName, oldDir) == 0)
-        {
-            next = i->next;
-            BAIL_IF_MACRO_MUTEX(!freeDirHandle(i, openReadList), ERRPASS,
-                                stateLock, 0);
-
-            if (prev == NULL)
-                searchPath = next;
-            else
-                prev->next = next;
-
-            BAIL_MACRO_MUTEX(ERRPASS, stateLock, 1);
-        } /* if */
-        prev = i;
-    } /* for */
+        PHYSFS_Io *io = NULL;
+        DirHandle *h = NULL;
+        const PHYSFS_Archiver *f;
+        __PHYSFS_MemCharge charge;
+        __PHYSFS_Stats *prevstats;
+        PHYSFS_uint64 start = 0;
 
-    BAIL_MACRO_MUTEX(PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
-} /* PHYSFS_unmount */
+        __PHYSFS_platformGrabMutex(stateLock);
 
+        if (TRACE_HOOKED())
+            start = __PHYSFS_platformGetTicks();
 
-char **PHYSFS_getSearchPath(void)
-{
-    return doEnumStringList(PHYSFS_getSearchPathCallback);
-} /* PHYSFS_getSearchPath */
+        GOTO_IF_MACRO(!writeDir, PHYSFS_ERR_NO_WRITE_DIR, doOpenWriteEnd);
 
+        h = writeDir;
+        GOTO_IF_MACRO(!verifyPath(h, &fname, 0), ERRPASS, doOpenWriteEnd);
 
-const char *PHYSFS_getMountPoint(const char *dir)
-{
-    DirHandle *i;
-    __PHYSFS_platformGrabMutex(stateLock);
-    for (i = searchPath; i != NULL; i = i->next)
-    {
-        if (__PHYSFS_utf8stricmp(i->dirName, dir) == 0)
-        {
-            const char *retval = ((i->mountPoint) ? i->mountPoint : "/");
-            __PHYSFS_platformReleaseMutex(stateLock);
-            return retval;
-        } /* if */
-    } /* for */
-    __PHYSFS_platformReleaseMutex(stateLock);
+        f = h->funcs;
+        __PHYSFS_memCharge(h->memory, PHYSFS_MEMORY_HANDLES, &charge);
+        prevstats = setCurrentStats(h->stats);
+        if (appending)
+            io = f->openAppend(h->opaque, fname);
+        else
+            io = f->openWrite(h->opaque, fname);
+        setCurrentStats(prevstats);
+        __PHYSFS_memRestore(&charge);
 
-    BAIL_MACRO(PHYSFS_ERR_NOT_MOUNTED, NULL);
-} /* PHYSFS_getMountPoint */
+        if (TRACE_HOOKED())
+            io = traceOpen(io, h, fname, start);
 
+        __PHYSFS_memCharge(h->memory, PHYSFS_MEMORY_HANDLES, &charge);
+        if (io != NULL)
+            fh = (FileHandle *) __PHYSFS_poolAlloc(&fileHandlePool);
+        __PHYSFS_memRestore(&charge);
 
-void PHYSFS_getSearchPathCallback(PHYSFS_StringCallback callback, void *data)
-{
-    DirHandle *i;
+        GOTO_IF_MACRO(!io, ERRPASS, doOpenWriteEnd);
+        __PHYSFS_statAdd(h->stats, PHYSFS_STAT_OPENS, 1);
 
-    __PHYSFS_platformGrabMutex(stateLock);
+        if (fh == NULL)
+        {
+            io->destroy(io);
+            GOTO_MACRO(ERRPASS, doOpenWriteEnd);
+        } /* if */
+        else
+        {
+            memset(fh, '\0', sizeof (FileHandle));
+            fh->io = io;
+            fh->dirHandle = h;
+            if (!registerFileHandle(fh))
+            {
+                io->destroy(io);
+                __PHYSFS_poolFree(&fileHandlePool, fh);
+                fh = NULL;
+                GOTO_MACRO(ERRPASS, doOpenWriteEnd);
+            } /* if */
+            applyBufferPolicy(fh);
+        } /* else */
 
-    for (i = searchPath; i != NULL; i = i->next)
-        callback(data, i->dirName);
+        doOpenWriteEnd:
+        __PHYSFS_platformReleaseMutex(stateLock);
+    } /* if */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
-} /* PHYSFS_getSearchPathCallback */
+    __PHYSFS_smallFree(fname);
+    return ((PHYSFS_File *) fh);
+} /* doOpenWrite */
 
 
-/* Split out to avoid stack allocation in a loop. */
-static void setSaneCfgAddPath(const char *i, const size_t l, const char *dirsep,
-                              int archivesFirst)
+PHYSFS_File *PHYSFS_openWrite(const char *filename)
 {
-    const char *d = PHYSFS_getRealDir(i);
-    const size_t allocsize = strlen(d) + strlen(dirsep) + l + 1;
-    char *str = (char *) __PHYSFS_smallAlloc(allocsize);
-    if (str != NULL)
-    {
-        sprintf(str, "%s%s%s", d, dirsep, i);
-        PHYSFS_mount(str, NULL, archivesFirst == 0);
-        __PHYSFS_smallFree(str);
-    } /* if */
-} /* setSaneCfgAddPath */
+    return doOpenWrite(filename, 0);
+} /* PHYSFS_openWrite */
 
 
-int PHYSFS_setSaneConfig(const char *organization, const char *appName,
-                         const char *archiveExt, int includeCdRoms,
-                         int archivesFirst)
+PHYSFS_File *PHYSFS_openAppend(const char *filename)
 {
-    const char *dirsep = PHYSFS_getDirSeparator();
-    const char *basedir;
-    const char *prefdir;
-
-    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    return doOpenWrite(filename, 1);
+} /* PHYSFS_openAppend */
 
-    prefdir = PHYSFS_getPrefDir(organization, appName);
-    BAIL_IF_MACRO(!prefdir, ERRPASS, 0);
 
-    basedir = PHYSFS_getBaseDir();
-    BAIL_IF_MACRO(!basedir, ERRPASS, 0);
+PHYSFS_File *PHYSFS_openRead(const char *_fname)
+{
+    FileHandle *fh = NULL;
+    char *fname;
+    size_t len;
 
-    BAIL_IF_MACRO(!PHYSFS_setWriteDir(prefdir), PHYSFS_ERR_NO_WRITE_DIR, 0);
+    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    len = strlen(_fname) + 1;
+    fname = (char *) __PHYSFS_smallAlloc(len);
+    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
 
-    /* Put write dir first in search path... */
-    PHYSFS_mount(prefdir, NULL, 0);
+    if (sanitizePlatformIndependentPath(_fname, fname))
+    {
+        DirHandle *i = NULL;
+        PHYSFS_Io *io = NULL;
+        __PHYSFS_MemCharge charge;
+        __PHYSFS_Stats *prevstats;
+        PHYSFS_uint64 start = 0;
 
-    /* Put base path on search path... */
-    PHYSFS_mount(basedir, NULL, 1);
+        __PHYSFS_platformGrabMutex(stateLock);
 
-    /* handle CD-ROMs... */
-    if (includeCdRoms)
-    {
-        char **cds = PHYSFS_getCdRomDirs();
-        char **i;
-        for (i = cds; *i != NULL; i++)
-            PHYSFS_mount(*i, NULL, 1);
-        PHYSFS_freeList(cds);
-    } /* if */
+        if (TRACE_HOOKED())
+            start = __PHYSFS_platformGetTicks();
 
-    /* Root out archives, and add them to search path... */
-    if (archiveExt != NULL)
-    {
-        char **rc = PHYSFS_enumerateFiles("/");
-        char **i;
-        size_t extlen = strlen(archiveExt);
-        char *ext;
+        GOTO_IF_MACRO(!searchPath, PHYSFS_ERR_NOT_FOUND, openReadEnd);
 
-        for (i = rc; *i != NULL; i++)
+        for (i = searchPath; i != NULL; i = i->next)
         {
-            size_t l = strlen(*i);
-            if ((l > extlen) && ((*i)[l - extlen - 1] == '.'))
+            char *arcfname = fname;
+            if (verifyPath(i, &arcfname, 0))
             {
-                ext = (*i) + (l - extlen);
-                if (__PHYSFS_utf8stricmp(ext, archiveExt) == 0)
-                    setSaneCfgAddPath(*i, l, dirsep, archivesFirst);
+                __PHYSFS_memCharge(i->memory, PHYSFS_MEMORY_HANDLES, &charge);
+                prevstats = setCurrentStats(i->stats);
+                io = i->funcs->openRead(i->opaque, arcfname);
+                setCurrentStats(prevstats);
+                __PHYSFS_memRestore(&charge);
+                if (io)
+                {
+                    __PHYSFS_statAdd(i->stats, PHYSFS_STAT_OPENS, 1);
+                    break;
+                } /* if */
+                __PHYSFS_statAdd(i->stats, PHYSFS_STAT_OPEN_MISSES, 1);
             } /* if */
         } /* for */
 
-        PHYSFS_freeList(rc);
-    } /* if */
+        if (TRACE_HOOKED())
+            io = traceOpen(io, i, fname, start);
 
-    return 1;
-} /* PHYSFS_setSaneConfig */
+        GOTO_IF_MACRO(!io, ERRPASS, openReadEnd);
 
+        __PHYSFS_memCharge(i->memory, PHYSFS_MEMORY_HANDLES, &charge);
+        fh = (FileHandle *) __PHYSFS_poolAlloc(&fileHandlePool);
+        __PHYSFS_memRestore(&charge);
+        if (fh == NULL)
+        {
+            io->destroy(io);
+            GOTO_MACRO(ERRPASS, openReadEnd);
+        } /* if */
 
-void PHYSFS_permitSymbolicLinks(int allow)
-{
-    allowSymLinks = allow;
-} /* PHYSFS_permitSymbolicLinks */
+        memset(fh, '\0', sizeof (FileHandle));
+        fh->io = io;
+        fh->forReading = 1;
+        fh->dirHandle = i;
+        if (!registerFileHandle(fh))
+        {
+            io->destroy(io);
+            __PHYSFS_poolFree(&fileHandlePool, fh);
+            fh = NULL;
+            GOTO_MACRO(ERRPASS, openReadEnd);
+        } /* if */
+        applyBufferPolicy(fh);
 
+        openReadEnd:
+        __PHYSFS_platformReleaseMutex(stateLock);
+    } /* if */
 
-int PHYSFS_symbolicLinksPermitted(void)
-{
-    return allowSymLinks;
-} /* PHYSFS_symbolicLinksPermitted */
+    __PHYSFS_smallFree(fname);
+    return ((PHYSFS_File *) fh);
+} /* PHYSFS_openRead */
 
 
 /*
- * Verify that (fname) (in platform-independent notation), in relation
- *  to (h) is secure. That means that each element of fname is checked
- *  for symlinks (if they aren't permitted). This also allows for quick
- *  rejection of files that exist outside an archive's mountpoint.
- *
- * With some exceptions (like PHYSFS_mkdir(), which builds multiple subdirs
- *  at a time), you should always pass zero for "allowMissing" for efficiency.
- *
- * (fname) must point to an output from sanitizePlatformIndependentPath(),
- *  since it will make sure that path names are in the right format for
- *  passing certain checks. It will also do checks for "insecure" pathnames
- *  like ".." which should be done once instead of once per archive. This also
- *  gives us license to treat (fname) as scratch space in this function.
- *
- * Returns non-zero if string is safe, zero if there's a security issue.
- *  PHYSFS_getLastError() will specify what was wrong. (*fname) will be
- *  updated to point past any mount point elements so it is prepared to
- *  be used with the archiver directly.
+ * Wait for the background refill, if there is one. After this, (backfill)
+ *  bytes that follow what's in (buffer) are waiting in (backbuf), and the
+ *  Io is past them. A failed refill leaves (fillerr) set and nothing in
+ *  (backbuf). Returns zero only if we couldn't wait for it; try again later.
  */
-static int verifyPath(DirHandle *h, char **_fname, int allowMissing)
+static int bufferSettle(FileHandle *fh)
 {
-    char *fname = *_fname;
-    int retval = 1;
-    char *start;
-    char *end;
+    PHYSFS_AsyncRequest *req = fh->fill;
+    PHYSFS_AsyncStatus status;
 
-    if (*fname == '\0')  /* quick rejection. */
+    if (req == NULL)
         return 1;
 
-    /* !!! FIXME: This codeblock sucks. */
-    if (h->mountPoint != NULL)  /* NULL mountpoint means "/". */
+    status = PHYSFS_waitAsync(req);
+    if ((status == PHYSFS_ASYNC_PENDING) || (status == PHYSFS_ASYNC_RUNNING))
+        return 0;  /* error is set. */
+
+    fh->fill = NULL;
+    if (status == PHYSFS_ASYNC_DONE)
+        fh->backfill = (PHYSFS_uint32) PHYSFS_getAsyncResult(req);
+    else
     {
-        size_t mntpntlen = strlen(h->mountPoint);
-        size_t len = strlen(fname);
-        assert(mntpntlen > 1); /* root mount points should be NULL. */
-        /* not under the mountpoint, so skip this archive. */
-        BAIL_IF_MACRO(len < mntpntlen-1, PHYSFS_ERR_NOT_FOUND, 0);
-        /* !!! FIXME: Case insensitive? */
-        retval = strncmp(h->mountPoint, fname, mntpntlen-1);
-        BAIL_IF_MACRO(retval != 0, PHYSFS_ERR_NOT_FOUND, 0);
-        if (len > mntpntlen-1)  /* corner case... */
-            BAIL_IF_MACRO(fname[mntpntlen-1]!='/', PHYSFS_ERR_NOT_FOUND, 0);
-        fname += mntpntlen-1;  /* move to start of actual archive path. */
-        if (*fname == '/')
-            fname++;
-        *_fname = fname;  /* skip mountpoint for later use. */
-        retval = 1;  /* may be reset, below. */
-    } /* if */
+        fh->fillerr = PHYSFS_getAsyncError(req);
+        if (fh->fillerr == PHYSFS_ERR_OK)
+            fh->fillerr = PHYSFS_ERR_OTHER_ERROR;
+    } /* else */
+
+    PHYSFS_freeAsync(req);
+    return 1;
+} /* bufferSettle */
+
+
+/* Forget anything read ahead, after the Io has been moved. */
+static void bufferDiscard(FileHandle *fh)
+{
+    fh->buffill = fh->bufpos = fh->backfill = 0;
+    fh->fillerr = PHYSFS_ERR_OK;
+    fh->bufstreak = 0;
+    if (fh->bufflags & PHYSFS_BUFFER_ADAPTIVE)
+        fh->bufsize = fh->bufbase;  /* start small again where we land. */
+} /* bufferDiscard */
+
+
+/* Make sure (*buf) can hold a full (bufsize). It's empty, so don't copy. */
+static int bufferReserve(FileHandle *fh, PHYSFS_uint8 **buf,
+                         PHYSFS_uint32 *alloc)
+{
+    PHYSFS_uint8 *newbuf;
+    PHYSFS_uint32 newalloc = 0;
+    __PHYSFS_MemCharge charge;
+
+    if (*alloc >= fh->bufsize)
+        return 1;
 
-    start = fname;
-    if (!allowSymLinks)
-    {
-        while (1)
-        {
-            PHYSFS_Stat statbuf;
-            int rc = 0;
-            end = strchr(start, '/');
+    __PHYSFS_memCharge(fh->dirHandle->memory, PHYSFS_MEMORY_HANDLES, &charge);
+    newbuf = bufferAlloc(fh->bufsize, &newalloc);
+    __PHYSFS_memRestore(&charge);
+    BAIL_IF_MACRO(!newbuf, ERRPASS, 0);
 
-            if (end != NULL) *end = '\0';
-            rc = h->funcs->stat(h->opaque, fname, &statbuf);
-            if (rc)
-                rc = (statbuf.filetype == PHYSFS_FILETYPE_SYMLINK);
-            else if (currentErrorCode() == PHYSFS_ERR_NOT_FOUND)
-                retval = 0;
+    bufferFree(*buf, *alloc);
+    *buf = newbuf;
+    *alloc = newalloc;
+    return 1;
+} /* bufferReserve */
 
-            if (end != NULL) *end = '/';
 
-            /* insecure path (has a disallowed symlink in it)? */
-            BAIL_IF_MACRO(rc, PHYSFS_ERR_SYMLINK_FORBIDDEN, 0);
+/*
+ * Called each time (buffer) is about to be refilled. An adaptive buffer
+ *  that keeps getting drained without any seeking in between is being read
+ *  straight through, so read bigger chunks.
+ */
+static void bufferRefilling(FileHandle *fh)
+{
+    PHYSFS_uint32 needed = BUFFER_ADAPTIVE_STREAK;
 
-            /* break out early if path element is missing. */
-            if (!retval)
-            {
-                /*
-                 * We need to clear it if it's the last element of the path,
-                 *  since this might be a non-existant file we're opening
-                 *  for writing...
-                 */
-                if ((end == NULL) || (allowMissing))
-                    retval = 1;
-                break;
-            } /* if */
+    if (fh->bufstreak < 0xFF)
+        fh->bufstreak++;
 
-            if (end == NULL)
-                break;
+    if (!(fh->bufflags & PHYSFS_BUFFER_ADAPTIVE))
+        return;
+    else if (fh->hint == PHYSFS_ACCESS_RANDOM)
+        return;
+    else if (fh->hint == PHYSFS_ACCESS_SEQUENTIAL)
+        needed = 1;
 
-            start = end + 1;
-        } /* while */
+    if ((fh->bufstreak > needed) && (fh->bufsize < BUFFER_ADAPTIVE_MAX))
+    {
+        fh->bufsize *= 2;
+        if (fh->bufsize > BUFFER_ADAPTIVE_MAX)
+            fh->bufsize = BUFFER_ADAPTIVE_MAX;
+        fh->bufstreak = 1;
     } /* if */
+} /* bufferRefilling */
 
-    return retval;
-} /* verifyPath */
 
+/* Have a worker read the chunk after (buffer) into (backbuf), if we can. */
+static void bufferStartFill(FileHandle *fh)
+{
+    PHYSFS_AsyncRequest *req;
+    PHYSFS_sint64 pos;
+    int threaded;
 
-static int doMkdir(const char *_dname, char *dname)
+    assert(fh->fill == NULL);
+    assert(fh->backfill == 0);
+
+    if ((!(fh->bufflags & PHYSFS_BUFFER_DOUBLE)) ||
+        (fh->hint == PHYSFS_ACCESS_RANDOM))
+        return;
+
+    __PHYSFS_platformGrabMutex(asyncLock);
+    asyncStartThreads();
+    threaded = (asyncThreadCount > 0);
+    __PHYSFS_platformReleaseMutex(asyncLock);
+
+    /* without workers, it's just a bigger read right now. Don't bother. */
+    if ((!threaded) || (!bufferReserve(fh, &fh->backbuf, &fh->backalloc)))
+        return;
+
+    /* so PHYSFS_tell() doesn't have to wait for the Io to come back. */
+    pos = fh->io->tell(fh->io);
+    if (pos < 0)
+        return;
+
+    req = asyncReadRequest(fh, 0, fh->backbuf, fh->bufsize, NULL, NULL);
+    if (req == NULL)
+        return;  /* we'll just read it when we get there. */
+
+    fh->fillpos = (PHYSFS_uint64) pos;
+    req->fill = 1;
+    req->archive = NULL;  /* not part of anyone's batch of reads. */
+    fh->fill = asyncSubmit(req);
+} /* bufferStartFill */
+
+
+int PHYSFS_close(PHYSFS_File *_handle)
 {
-    DirHandle *h;
-    char *start;
-    char *end;
-    int retval = 0;
-    int exists = 1;  /* force existance check on first path element. */
+    FileHandle *handle = (FileHandle *) _handle;
+    FileHandle **list;
+    PHYSFS_Io *io;
+    int valid;
 
-    BAIL_IF_MACRO(!sanitizePlatformIndependentPath(_dname, dname), ERRPASS, 0);
+    BAIL_IF_MACRO(!handle, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    __PHYSFS_platformGrabMutex(stateLock);
-    BAIL_IF_MACRO_MUTEX(!writeDir, PHYSFS_ERR_NO_WRITE_DIR, stateLock, 0);
-    h = writeDir;
-    BAIL_IF_MACRO_MUTEX(!verifyPath(h, &dname, 1), ERRPASS, stateLock, 0);
+    /* don't read a thing out of (handle) until we know it's really open. */
+    __PHYSFS_platformGrabMutex(openListLock);
+    valid = isOpenHandle(handle);
+    __PHYSFS_platformReleaseMutex(openListLock);
+    BAIL_IF_MACRO(!valid, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    start = dname;
-    while (1)
+    /* the caller owns this handle, so we can flush without any lock held. */
+    BAIL_IF_MACRO(!bufferSettle(handle), ERRPASS, 0);
+    BAIL_IF_MACRO(!PHYSFS_flush(_handle), ERRPASS, 0);
+
+    list = handle->forReading ? &openReadList : &openWriteList;
+    __PHYSFS_platformGrabMutex(openListLock);
+    unregisterFileHandle(list, handle);
+    io = handle->io;
+    io->destroy(io);  /* before we let go; it might use its archive. */
+    __PHYSFS_platformReleaseMutex(openListLock);
+
+    /* free any associated buffers. */
+    bufferFree(handle->buffer, handle->bufalloc);
+    bufferFree(handle->backbuf, handle->backalloc);
+
+    __PHYSFS_poolFree(&fileHandlePool, handle);
+    return 1;
+} /* PHYSFS_close */
+
+
+static PHYSFS_sint64 doBufferedRead(FileHandle *fh, void *buffer,
+                                    PHYSFS_uint64 len)
+{
+    PHYSFS_Io *io = fh->io;
+    PHYSFS_uint8 *ptr = (PHYSFS_uint8 *) buffer;
+    PHYSFS_sint64 retval = 0;
+    PHYSFS_sint64 rc = 0;
+
+    while (len > 0)
     {
-        end = strchr(start, '/');
-        if (end != NULL)
-            *end = '\0';
+        const PHYSFS_uint32 buffered = fh->buffill - fh->bufpos;
 
-        /* only check for existance if all parent dirs existed, too... */
-        if (exists)
+        if (buffered > 0)  /* take what we can from the buffer. */
         {
-            PHYSFS_Stat statbuf;
-            const int rc = h->funcs->stat(h->opaque, dname, &statbuf);
-            if ((!rc) && (currentErrorCode() == PHYSFS_ERR_NOT_FOUND))
-                exists = 0;
-            retval = ((rc) && (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY));
+            const PHYSFS_uint32 cpy = (len < buffered) ?
+                                      (PHYSFS_uint32) len : buffered;
+            memcpy(ptr, fh->buffer + fh->bufpos, (size_t) cpy);
+            fh->bufpos += cpy;
+            ptr += cpy;
+            len -= cpy;
+            retval += cpy;
+            continue;
         } /* if */
 
-        if (!exists)
-            retval = h->funcs->mkdir(h->opaque, dname);
+        /* if you got here, the buffer is drained and we still need bytes. */
+        fh->buffill = fh->bufpos = 0;
 
-        if (!retval)
-            break;
+        if (!bufferSettle(fh))
+            return ((retval == 0) ? -1 : retval);
 
-        if (end == NULL)
-            break;
+        else if (fh->fillerr != PHYSFS_ERR_OK)  /* the read-ahead failed. */
+        {
+            PHYSFS_setErrorCode(fh->fillerr);
+            fh->fillerr = PHYSFS_ERR_OK;
+            return ((retval == 0) ? -1 : retval);
+        } /* else if */
 
-        *end = '/';
-        start = end + 1;
+        else if (fh->backfill > 0)  /* the next chunk is already here. */
+        {
+            PHYSFS_uint8 *tmpbuf = fh->buffer;
+            const PHYSFS_uint32 tmpalloc = fh->bufalloc;
+            const int more = (fh->backfill == fh->bufsize);
+            fh->buffer = fh->backbuf;
+            fh->bufalloc = fh->backalloc;
+            fh->buffill = fh->backfill;
+            fh->backbuf = tmpbuf;
+            fh->backalloc = tmpalloc;
+            fh->backfill = 0;
+            bufferRefilling(fh);
+            if (more)  /* a short one means we hit the end. */
+                bufferStartFill(fh);
+            continue;
+        } /* else if */
+
+        else if (len >= fh->bufsize)  /* need more than the buffer takes. */
+        {
+            /* leave buffer empty, go right to output instead. */
+            rc = io->read(io, ptr, len);
+            if (rc < 0)
+                return ((retval == 0) ? rc : retval);
+            return retval + rc;
+        } /* else if */
+
+        /* need less than buffer can take. Fill buffer. */
+        bufferRefilling(fh);
+        if (!bufferReserve(fh, &fh->buffer, &fh->bufalloc))
+            fh->bufsize = fh->bufalloc;  /* couldn't grow; stay as we are. */
+
+        rc = io->read(io, fh->buffer, fh->bufsize);
+        if (rc < 0)
+            return ((retval == 0) ? rc : retval);
+        else if (rc == 0)
+            break;  /* EOF. */
+
+        fh->buffill = (PHYSFS_uint32) rc;
+        if (rc == fh->bufsize)
+            bufferStartFill(fh);
     } /* while */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
     return retval;
-} /* doMkdir */
+} /* doBufferedRead */
 
 
-int PHYSFS_mkdir(const char *_dname)
+PHYSFS_sint64 PHYSFS_read(PHYSFS_File *handle, void *buffer,
+                          PHYSFS_uint32 size, PHYSFS_uint32 count)
 {
-    int retval = 0;
-    char *dname;
-    size_t len;
+    const PHYSFS_uint64 len = ((PHYSFS_uint64) size) * ((PHYSFS_uint64) count);
+    const PHYSFS_sint64 retval = PHYSFS_readBytes(handle, buffer, len);
+    return ( (retval <= 0) ? retval : (retval / ((PHYSFS_sint64) size)) );
+} /* PHYSFS_read */
+
+
+PHYSFS_sint64 PHYSFS_readBytes(PHYSFS_File *handle, void *buffer,
+                               PHYSFS_uint64 len)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_sint64 retval;
+
+#ifdef PHYSFS_NO_64BIT_SUPPORT
+    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFF);
+#else
+    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFFFFFFFFFF);
+#endif
+
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL_MACRO(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+
+    BAIL_IF_MACRO(len > maxlen, PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF_MACRO(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, -1);
+    BAIL_IF_MACRO(len == 0, ERRPASS, 0);
+    if (fh->buffer)
+        retval = doBufferedRead(fh, buffer, len);
+    else
+        retval = fh->io->read(fh->io, buffer, len);
+
+    if (retval > 0)
+        __PHYSFS_statAdd(fh->dirHandle->stats, PHYSFS_STAT_BYTES_READ, retval);
 
-    BAIL_IF_MACRO(!_dname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    len = strlen(_dname) + 1;
-    dname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MACRO(!dname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
-    retval = doMkdir(_dname, dname);
-    __PHYSFS_smallFree(dname);
     return retval;
-} /* PHYSFS_mkdir */
+} /* PHYSFS_readBytes */
 
 
-static int doDelete(const char *_fname, char *fname)
+static PHYSFS_sint64 doBufferedWrite(PHYSFS_File *handle, const void *buffer,
+                                     PHYSFS_uint64 len)
 {
-    int retval;
-    DirHandle *h;
-    BAIL_IF_MACRO(!sanitizePlatformIndependentPath(_fname, fname), ERRPASS, 0);
+    FileHandle *fh = (FileHandle *) handle;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    /* whole thing fits in the buffer? */
+    if ( (((PHYSFS_uint64) fh->buffill) + len) < fh->bufsize )
+    {
+        memcpy(fh->buffer + fh->buffill, buffer, (size_t) len);
+        fh->buffill += (PHYSFS_uint32) len;
+        return (PHYSFS_sint64) len;
+    } /* if */
 
-    BAIL_IF_MACRO_MUTEX(!writeDir, PHYSFS_ERR_NO_WRITE_DIR, stateLock, 0);
-    h = writeDir;
-    BAIL_IF_MACRO_MUTEX(!verifyPath(h, &fname, 0), ERRPASS, stateLock, 0);
-    retval = h->funcs->remove(h->opaque, fname);
+    /* would overflow buffer. Flush and then write the new objects, too. */
+    BAIL_IF_MACRO(!PHYSFS_flush(handle), ERRPASS, -1);
+    return fh->io->write(fh->io, buffer, len);
+} /* doBufferedWrite */
 
-    __PHYSFS_platformReleaseMutex(stateLock);
-    return retval;
-} /* doDelete */
+
+PHYSFS_sint64 PHYSFS_write(PHYSFS_File *handle, const void *buffer,
+                           PHYSFS_uint32 size, PHYSFS_uint32 count)
+{
+    const PHYSFS_uint64 len = ((PHYSFS_uint64) size) * ((PHYSFS_uint64) count);
+    const PHYSFS_sint64 retval = PHYSFS_writeBytes(handle, buffer, len);
+    return ( (retval <= 0) ? retval : (retval / ((PHYSFS_sint64) size)) );
+} /* PHYSFS_write */
 
 
-int PHYSFS_delete(const char *_fname)
+PHYSFS_sint64 PHYSFS_writeBytes(PHYSFS_File *handle, const void *buffer,
+                                PHYSFS_uint64 len)
 {
-    int retval;
-    char *fname;
-    size_t len;
+    FileHandle *fh = (FileHandle *) handle;
 
-    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    len = strlen(_fname) + 1;
-    fname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
-    retval = doDelete(_fname, fname);
-    __PHYSFS_smallFree(fname);
-    return retval;
-} /* PHYSFS_delete */
+#ifdef PHYSFS_NO_64BIT_SUPPORT
+    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFF);
+#else
+    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFFFFFFFFFF);
+#endif
 
+    if (!__PHYSFS_ui64FitsAddressSpace(len))
+        BAIL_MACRO(PHYSFS_ERR_INVALID_ARGUMENT, -1);
 
-const char *PHYSFS_getRealDir(const char *_fname)
+    BAIL_IF_MACRO(len > maxlen, PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    BAIL_IF_MACRO(fh->forReading, PHYSFS_ERR_OPEN_FOR_READING, -1);
+    BAIL_IF_MACRO(len == 0, ERRPASS, 0);
+    if (fh->buffer)
+        return doBufferedWrite(handle, buffer, len);
+
+    return fh->io->write(fh->io, buffer, len);
+} /* PHYSFS_write */
+
+
+int PHYSFS_eof(PHYSFS_File *handle)
 {
-    const char *retval = NULL;
-    char *fname = NULL;
-    size_t len;
+    FileHandle *fh = (FileHandle *) handle;
 
-    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
-    len = strlen(_fname) + 1;
-    fname = __PHYSFS_smallAlloc(len);
-    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    if (sanitizePlatformIndependentPath(_fname, fname))
+    if (!fh->forReading)  /* never EOF on files opened for write/append. */
+        return 0;
+
+    if (fh->bufpos < fh->buffill)  /* no need to wait for a refill. */
+        return 0;
+
+    if (!bufferSettle(fh))
+        return 0;  /* beats me. */
+
+    /* can't be eof if buffer isn't empty */
+    if ((fh->bufpos == fh->buffill) && (fh->backfill == 0))
     {
-        DirHandle *i;
-        __PHYSFS_platformGrabMutex(stateLock);
-        for (i = searchPath; i != NULL; i = i->next)
-        {
-            char *arcfname = fname;
-            if (partOfMountPoint(i, arcfname))
-            {
-                retval = i->dirName;
-                break;
-            } /* if */
-            else if (verifyPath(i, &arcfname, 0))
-            {
-                PHYSFS_Stat statbuf;
-                if (i->funcs->stat(i->opaque, arcfname, &statbuf))
-                {
-                    retval = i->dirName;
-                    break;
-                } /* if */
-            } /* if */
-        } /* for */
-        __PHYSFS_platformReleaseMutex(stateLock);
+        /* check the Io. */
+        PHYSFS_Io *io = fh->io;
+        const PHYSFS_sint64 pos = io->tell(io);
+        const PHYSFS_sint64 len = io->length(io);
+        if ((pos < 0) || (len < 0))
+            return 0;  /* beats me. */
+        return (pos >= len);
     } /* if */
 
-    __PHYSFS_smallFree(fname);
-    return retval;
-} /* PHYSFS_getRealDir */
+    return 0;
+} /* PHYSFS_eof */
 
 
-static int locateInStringList(const char *str,
-                              char **list,
-                              PHYSFS_uint32 *pos)
+PHYSFS_sint64 PHYSFS_tell(PHYSFS_File *handle)
 {
-    PHYSFS_uint32 len = *pos;
-    PHYSFS_uint32 half_len;
-    PHYSFS_uint32 lo = 0;
-    PHYSFS_uint32 middle;
-    int cmp;
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_sint64 pos;
+
+    /* a refill is moving the Io, but nothing it read is in use yet. */
+    if (fh->fill != NULL)
+        return (((PHYSFS_sint64) fh->fillpos) - fh->buffill) + fh->bufpos;
+
+    pos = fh->io->tell(fh->io);
+    if (pos < 0)
+        return pos;
+    else if (!fh->forReading)
+        return pos + fh->buffill;
+    return (pos - fh->buffill - fh->backfill) + fh->bufpos;
+} /* PHYSFS_tell */
 
-    while (len > 0)
-    {
-        half_len = len >> 1;
-        middle = lo + half_len;
-        cmp = __PHYSFS_utf8stricmp(list[middle], str);
 
-        if (cmp == 0)  /* it's in the list already. */
-            return 1;
-        else if (cmp > 0)
-            len = half_len;
-        else
+int PHYSFS_seek(PHYSFS_File *handle, PHYSFS_uint64 pos)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    BAIL_IF_MACRO(!PHYSFS_flush(handle), ERRPASS, 0);
+
+    __PHYSFS_statAdd(fh->dirHandle->stats, PHYSFS_STAT_SEEKS, 1);
+
+    if (fh->buffer && fh->forReading)
+    {
+        /* avoid throwing away our precious buffer if seeking within it. */
+        PHYSFS_sint64 offset = pos - PHYSFS_tell(handle);
+        if ( /* seeking within the already-buffered range? */
+            ((offset >= 0) && (offset <= fh->buffill - fh->bufpos)) /* fwd */
+            || ((offset < 0) && (-offset <= fh->bufpos)) /* backward */ )
         {
-            lo = middle + 1;
-            len -= half_len + 1;
-        } /* else */
-    } /* while */
+            fh->bufpos += (PHYSFS_uint32) offset;
+            return 1; /* successful seek */
+        } /* if */
+    } /* if */
 
-    *pos = lo;
-    return 0;
-} /* locateInStringList */
+    /* we have to fall back to a 'raw' seek. */
+    BAIL_IF_MACRO(!bufferSettle(fh), ERRPASS, 0);
+    bufferDiscard(fh);
+    return fh->io->seek(fh->io, pos);
+} /* PHYSFS_seek */
 
 
-static void enumFilesCallback(void *data, const char *origdir, const char *str, struct PHYSFS_Stat *stat) {
-    PHYSFS_uint32 pos;
-    void *ptr;
-    char *newstr;
-    EnumStringListCallbackData *pecd = (EnumStringListCallbackData *) data;
+PHYSFS_sint64 PHYSFS_fileLength(PHYSFS_File *handle)
+{
+    PHYSFS_Io *io = ((FileHandle *) handle)->io;
+    return io->length(io);
+} /* PHYSFS_filelength */
 
-    /*
-     * See if file is in the list already, and if not, insert it in there
-     *  alphabetically...
-     */
-    pos = pecd->size;
-    if (locateInStringList(str, pecd->list, &pos))
-        return;  /* already in the list. */
 
-    ptr = allocator.Realloc(pecd->list, (pecd->size + 2) * sizeof (char *));
-    newstr = (char *) allocator.Malloc(strlen(str) + 1);
-    if (ptr != NULL)
-        pecd->list = (char **) ptr;
+int PHYSFS_setBuffer(PHYSFS_File *handle, PHYSFS_uint64 _bufsize)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_uint32 bufsize;
 
-    if ((ptr == NULL) || (newstr == NULL))
-        return;  /* better luck next time. */
+    /* !!! FIXME: actually, why use 32 bits here? */
+    /*BAIL_IF_MACRO(_bufsize > 0xFFFFFFFF, "buffer must fit in 32-bits", 0);*/
+    BAIL_IF_MACRO(_bufsize > 0xFFFFFFFF, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    bufsize = (PHYSFS_uint32) _bufsize;
 
-    strcpy(newstr, str);
+    BAIL_IF_MACRO(!PHYSFS_flush(handle), ERRPASS, 0);
+    BAIL_IF_MACRO(!bufferSettle(fh), ERRPASS, 0);
 
-    if (pos != pecd->size)
+    /*
+     * For reads, we need to move the file pointer to where it would be
+     *  if we weren't buffering, so that the next read will get the
+     *  right chunk of stuff from the file. PHYSFS_flush() handles writes.
+     */
+    if ((fh->forReading) && ((fh->buffill != fh->bufpos) || (fh->backfill)))
     {
-        memmove(&pecd->list[pos+1], &pecd->list[pos],
-                 sizeof (char *) * ((pecd->size) - pos));
+        PHYSFS_uint64 pos;
+        const PHYSFS_sint64 curpos = fh->io->tell(fh->io);
+        BAIL_IF_MACRO(curpos == -1, ERRPASS, 0);
+        pos = ((curpos - fh->buffill - fh->backfill) + fh->bufpos);
+        BAIL_IF_MACRO(!fh->io->seek(fh->io, pos), ERRPASS, 0);
     } /* if */
 
-    pecd->list[pos] = newstr;
-    pecd->size++;
-} /* enumFilesCallback */
+    /* double buffering starts over, if at all. */
+    bufferFree(fh->backbuf, fh->backalloc);
+    fh->backbuf = NULL;
+    fh->backalloc = 0;
 
+    if (bufsize == 0)  /* delete existing buffer. */
+    {
+        bufferFree(fh->buffer, fh->bufalloc);
+        fh->buffer = NULL;
+        fh->bufalloc = 0;
+    } /* if */
 
-char **PHYSFS_enumerateFiles(const char *path)
-{
-    EnumStringListCallbackData ecd;
-    memset(&ecd, '\0', sizeof (ecd));
-    ecd.list = (char **) allocator.Malloc(sizeof (char *));
-    BAIL_IF_MACRO(!ecd.list, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
-    PHYSFS_enumerateFilesCallback(path, enumFilesCallback, &ecd);
-    ecd.list[ecd.size] = NULL;
-    return ecd.list;
-} /* PHYSFS_enumerateFiles */
+    /* the contents don't matter now, so don't pay to keep them. */
+    else if ((bufsize > fh->bufalloc) || (bufsize <= fh->bufalloc / 2))
+    {
+        PHYSFS_uint8 *newbuf;
+        PHYSFS_uint32 newalloc = 0;
+        __PHYSFS_MemCharge charge;
+        __PHYSFS_memCharge(fh->dirHandle->memory, PHYSFS_MEMORY_HANDLES, &charge);
+        newbuf = bufferAlloc(bufsize, &newalloc);
+        __PHYSFS_memRestore(&charge);
+        BAIL_IF_MACRO(!newbuf, ERRPASS, 0);
+        bufferFree(fh->buffer, fh->bufalloc);
+        fh->buffer = newbuf;
+        fh->bufalloc = newalloc;
+    } /* else if */
 
+    fh->bufsize = fh->bufbase = bufsize;
+    fh->bufflags = 0;
+    bufferDiscard(fh);
+    return 1;
+} /* PHYSFS_setBuffer */
 
-/*
- * Broke out to seperate function so we can use stack allocation gratuitously.
- */
-static void enumerateFromMountPoint(DirHandle *i, const char *arcfname,
-                                    PHYSFS_EnumFilesCallback callback,
-                                    const char *_fname, void *data)
-{
-    const size_t len = strlen(arcfname);
-    char *ptr = NULL;
-    char *end = NULL;
-    const size_t slen = strlen(i->mountPoint) + 1;
-    char *mountPoint = (char *) __PHYSFS_smallAlloc(slen);
 
-    if (mountPoint == NULL)
-        return;  /* oh well. */
+int PHYSFS_setBufferMode(PHYSFS_File *handle, PHYSFS_uint64 bufsize,
+                         PHYSFS_uint32 flags)
+{
+    FileHandle *fh = (FileHandle *) handle;
+    const PHYSFS_uint32 known = PHYSFS_BUFFER_ADAPTIVE | PHYSFS_BUFFER_DOUBLE;
 
-    strcpy(mountPoint, i->mountPoint);
-    ptr = mountPoint + ((len) ? len + 1 : 0);
-    end = strchr(ptr, '/');
-    assert(end);  /* should always find a terminating '/'. */
-    *end = '\0';
-    callback(data, _fname, ptr, NULL);
-    __PHYSFS_smallFree(mountPoint);
-} /* enumerateFromMountPoint */
+    BAIL_IF_MACRO(!fh, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(flags & ~known, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
+    if (!fh->forReading)
+        flags = 0;  /* these only change how reads fill the buffer. */
+    else if ((flags != 0) && (bufsize == 0))
+        bufsize = BUFFER_ADAPTIVE_MIN;
 
-typedef struct SymlinkFilterData
-{
-    PHYSFS_EnumFilesCallback callback;
-    void *callbackData;
-    DirHandle *dirhandle;
-} SymlinkFilterData;
+    BAIL_IF_MACRO(!PHYSFS_setBuffer(handle, bufsize), ERRPASS, 0);
+    fh->bufflags = (PHYSFS_uint8) flags;
+    return 1;
+} /* PHYSFS_setBufferMode */
 
-/* !!! FIXME: broken if in a virtual mountpoint (stat call fails). */
-static void enumCallbackFilterSymLinks(void *_data, const char *origdir, const char *fname, struct PHYSFS_Stat *stat) {
-    const char *trimmedDir = (*origdir == '/') ? (origdir+1) : origdir;
-    const size_t slen = strlen(trimmedDir) + strlen(fname) + 2;
-    char *path = (char *) __PHYSFS_smallAlloc(slen);
 
-    if (path != NULL)
-    {
-        SymlinkFilterData *data = (SymlinkFilterData *) _data;
-        const DirHandle *dh = data->dirhandle;
-        PHYSFS_Stat statbuf;
+int PHYSFS_setDefaultBuffer(PHYSFS_uint64 bufsize, PHYSFS_uint32 flags)
+{
+    const PHYSFS_uint32 known = PHYSFS_BUFFER_ADAPTIVE | PHYSFS_BUFFER_DOUBLE;
 
-        sprintf(path, "%s%s%s", trimmedDir, *trimmedDir ? "/" : "", fname);
-        if (dh->funcs->stat(dh->opaque, path, &statbuf))
-        {
-            /* Pass it on to the application if it's not a symlink. */
-            if (statbuf.filetype != PHYSFS_FILETYPE_SYMLINK)
-                data->callback(data->callbackData, origdir, fname, &statbuf);
-        } /* if */
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    BAIL_IF_MACRO(bufsize > 0xFFFFFFFF, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(flags & ~known, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-        __PHYSFS_smallFree(path);
-    } /* if */
-} /* enumCallbackFilterSymLinks */
+    __PHYSFS_platformGrabMutex(stateLock);
+    defaultBufferPolicy.bufsize = (PHYSFS_uint32) bufsize;
+    defaultBufferPolicy.flags = flags;
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return 1;
+} /* PHYSFS_setDefaultBuffer */
 
 
-/* !!! FIXME: this should report error conditions. */
-void PHYSFS_enumerateFilesCallback(const char *_fname, PHYSFS_EnumFilesCallback callback, void *data) {
-    size_t len;
-    char *fname;
+int PHYSFS_setDefaultBufferForType(const char *type, PHYSFS_uint64 bufsize,
+                                   PHYSFS_uint32 flags)
+{
+    const PHYSFS_uint32 known = PHYSFS_BUFFER_ADAPTIVE | PHYSFS_BUFFER_DOUBLE;
+    BufferPolicy *policy;
 
-    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
-    BAIL_IF_MACRO(!callback, PHYSFS_ERR_INVALID_ARGUMENT, ) /*0*/;
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    BAIL_IF_MACRO(!type, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(*type == '\0', PHYSFS_ERR_INVALID_ARGUMENT, 0);  /* "DIR" */
+    BAIL_IF_MACRO(bufsize > 0xFFFFFFFF, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(flags & ~known, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    len = strlen(_fname) + 1;
-    fname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, ) /*0*/;
+    __PHYSFS_platformGrabMutex(stateLock);
 
-    if (sanitizePlatformIndependentPath(_fname, fname))
+    policy = findBufferPolicy(type);
+    if (policy == NULL)
     {
-        DirHandle *i;
-        SymlinkFilterData filterdata;
-
-        __PHYSFS_platformGrabMutex(stateLock);
-
-        if (!allowSymLinks)
+        const size_t len = (bufferPolicyCount + 1) * sizeof (BufferPolicy);
+        void *ptr = allocator.Realloc(bufferPolicies, len);
+        char *str = __PHYSFS_strdup(type);
+        if ((ptr == NULL) || (str == NULL))
         {
-            memset(&filterdata, '\0', sizeof (filterdata));
-            filterdata.callback = callback;
-            filterdata.callbackData = data;
+            allocator.Free(str);
+            if (ptr != NULL)
+                bufferPolicies = (BufferPolicy *) ptr;
+            BAIL_MACRO_MUTEX(PHYSFS_ERR_OUT_OF_MEMORY, stateLock, 0);
         } /* if */
 
-        for (i = searchPath; i != NULL; i = i->next)
-        {
-            char *arcfname = fname;
-            if (partOfMountPoint(i, arcfname)) {
-                enumerateFromMountPoint(i, arcfname, callback, _fname, data);
-            }
-            else if (verifyPath(i, &arcfname, 0))
-            {
-                if ((!allowSymLinks) && (i->funcs->info.supportsSymlinks))
-                {
-                    filterdata.dirhandle = i;
-                    i->funcs->enumerateFiles(i->opaque, arcfname, enumCallbackFilterSymLinks,_fname, &filterdata);
-                } /* if */
-                else
-                {
-                    i->funcs->enumerateFiles(i->opaque, arcfname, callback, _fname, data);
-                } /* else */
-            } /* else if */
-        } /* for */
-        __PHYSFS_platformReleaseMutex(stateLock);
+        bufferPolicies = (BufferPolicy *) ptr;
+        policy = &bufferPolicies[bufferPolicyCount++];
+        policy->type = str;
     } /* if */
 
-    __PHYSFS_smallFree(fname);
-} /* PHYSFS_enumerateFilesCallback */
-
-
-int PHYSFS_exists(const char *fname)
-{
-    return (PHYSFS_getRealDir(fname) != NULL);
-} /* PHYSFS_exists */
-
+    policy->bufsize = (PHYSFS_uint32) bufsize;
+    policy->flags = flags;
 
-PHYSFS_sint64 PHYSFS_getLastModTime(const char *fname)
-{
-    PHYSFS_Stat statbuf;
-    BAIL_IF_MACRO(!PHYSFS_stat(fname, &statbuf), ERRPASS, -1);
-    return statbuf.modtime;
-} /* PHYSFS_getLastModTime */
+    __PHYSFS_platformReleaseMutex(stateLock);
+    return 1;
+} /* PHYSFS_setDefaultBufferForType */
 
 
-int PHYSFS_isDirectory(const char *fname)
+int PHYSFS_flush(PHYSFS_File *handle)
 {
-    PHYSFS_Stat statbuf;
-    BAIL_IF_MACRO(!PHYSFS_stat(fname, &statbuf), ERRPASS, 0);
-    return (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY);
-} /* PHYSFS_isDirectory */
+    FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_Io *io;
+    PHYSFS_sint64 rc;
 
+    if ((fh->forReading) || (fh->bufpos == fh->buffill))
+        return 1;  /* open for read or buffer empty are successful no-ops. */
 
-int PHYSFS_isSymbolicLink(const char *fname)
-{
-    PHYSFS_Stat statbuf;
-    BAIL_IF_MACRO(!PHYSFS_stat(fname, &statbuf), ERRPASS, 0);
-    return (statbuf.filetype == PHYSFS_FILETYPE_SYMLINK);
-} /* PHYSFS_isSymbolicLink */
+    /* dump buffer to disk. */
+    io = fh->io;
+    rc = io->write(io, fh->buffer + fh->bufpos, fh->buffill - fh->bufpos);
+    BAIL_IF_MACRO(rc <= 0, ERRPASS, 0);
+    fh->bufpos = fh->buffill = 0;
+    return io->flush ? io->flush(io) : 1;
+} /* PHYSFS_flush */
 
 
-static PHYSFS_File *doOpenWrite(const char *_fname, int appending)
+int PHYSFS_stat(const char *_fname, PHYSFS_Stat *stat)
 {
-    FileHandle *fh = NULL;
-    size_t len;
+    int retval = 0;
     char *fname;
+    size_t len;
 
     BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!stat, PHYSFS_ERR_INVALID_ARGUMENT, 0);
     len = strlen(_fname) + 1;
     fname = (char *) __PHYSFS_smallAlloc(len);
     BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
 
+    /* set some sane defaults... */
+    stat->filesize = -1;
+    stat->modtime = -1;
+    stat->createtime = -1;
+    stat->accesstime = -1;
+    stat->filetype = PHYSFS_FILETYPE_OTHER;
+    stat->readonly = 1;  /* !!! FIXME */
+
     if (sanitizePlatformIndependentPath(_fname, fname))
     {
-        PHYSFS_Io *io = NULL;
-        DirHandle *h = NULL;
-        const PHYSFS_Archiver *f;
-
-        __PHYSFS_platformGrabMutex(stateLock);
-
-        GOTO_IF_MACRO(!writeDir, PHYSFS_ERR_NO_WRITE_DIR, doOpenWriteEnd);
-
-        h = writeDir;
-        GOTO_IF_MACRO(!verifyPath(h, &fname, 0), ERRPASS, doOpenWriteEnd);
-
-        f = h->funcs;
-        if (appending)
-            io = f->openAppend(h->opaque, fname);
-        else
-            io = f->openWrite(h->opaque, fname);
-
-        GOTO_IF_MACRO(!io, ERRPASS, doOpenWriteEnd);
-
-        fh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
-        if (fh == NULL)
+        if (*fname == '\0')
         {
-            io->destroy(io);
-            GOTO_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, doOpenWriteEnd);
+            stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+            stat->readonly = !writeDir; /* Writeable if we have a writeDir */
+            retval = 1;
         } /* if */
         else
         {
-            memset(fh, '\0', sizeof (FileHandle));
-            fh->io = io;
-            fh->dirHandle = h;
-            fh->next = openWriteList;
-            openWriteList = fh;
+            DirHandle *i;
+            int exists = 0;
+            __PHYSFS_platformGrabMutex(stateLock);
+            for (i = searchPath; ((i != NULL) && (!exists)); i = i->next)
+            {
+                char *arcfname = fname;
+                exists = partOfMountPoint(i, arcfname);
+                if (exists)
+                {
+                    stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
+                    stat->readonly = 1;  /* !!! FIXME */
+                    retval = 1;
+                } /* if */
+                else if (verifyPath(i, &arcfname, 0))
+                {
+                    /* !!! FIXME: this test is wrong and should be elsewhere. */
+                    stat->readonly = !(writeDir &&
+                                 (__PHYSFS_utf8stricmp(writeDir->dirName, i->dirName) == 0));
+                    retval = i->funcs->stat(i->opaque, arcfname, stat);
+                    if ((retval) || (currentErrorCode() != PHYSFS_ERR_NOT_FOUND))
+                        exists = 1;
+                } /* else if */
+            } /* for */
+            __PHYSFS_platformReleaseMutex(stateLock);
         } /* else */
-
-        doOpenWriteEnd:
-        __PHYSFS_platformReleaseMutex(stateLock);
     } /* if */
 
     __PHYSFS_smallFree(fname);
-    return ((PHYSFS_File *) fh);
-} /* doOpenWrite */
+    return retval;
+} /* PHYSFS_stat */
 
 
-PHYSFS_File *PHYSFS_openWrite(const char *filename)
+int __PHYSFS_readAll(PHYSFS_Io *io, void *buf, const PHYSFS_uint64 len)
 {
-    return doOpenWrite(filename, 0);
-} /* PHYSFS_openWrite */
+    return (io->read(io, buf, len) == len);
+} /* __PHYSFS_readAll */
 
 
-PHYSFS_File *PHYSFS_openAppend(const char *filename)
+void *__PHYSFS_initSmallAlloc(void *ptr, PHYSFS_uint64 len)
 {
-    return doOpenWrite(filename, 1);
-} /* PHYSFS_openAppend */
+    void *useHeap = ((ptr == NULL) ? ((void *) 1) : ((void *) 0));
+    if (useHeap)  /* too large for stack allocation or alloca() failed. */
+        ptr = allocator.Malloc(len+sizeof (void *));
 
+    if (ptr != NULL)
+    {
+        void **retval = (void **) ptr;
+        /*printf("%s alloc'd (%d) bytes at (%p).\n",
+                useHeap ? "heap" : "stack", (int) len, ptr);*/
+        *retval = useHeap;
+        return retval + 1;
+    } /* if */
 
-PHYSFS_File *PHYSFS_openRead(const char *_fname)
-{
-    FileHandle *fh = NULL;
-    char *fname;
-    size_t len;
+    return NULL;  /* allocation failed. */
+} /* __PHYSFS_initSmallAlloc */
 
-    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    len = strlen(_fname) + 1;
-    fname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
 
-    if (sanitizePlatformIndependentPath(_fname, fname))
+void __PHYSFS_smallFree(void *ptr)
+{
+    if (ptr != NULL)
     {
-        DirHandle *i = NULL;
-        PHYSFS_Io *io = NULL;
+        void **block = ((void **) ptr) - 1;
+        const int useHeap = (*block != 0);
+        if (useHeap)
+            allocator.Free(block);
+        /*printf("%s free'd (%p).\n", useHeap ? "heap" : "stack", block);*/
+    } /* if */
+} /* __PHYSFS_smallFree */
 
-        __PHYSFS_platformGrabMutex(stateLock);
 
-        GOTO_IF_MACRO(!searchPath, PHYSFS_ERR_NOT_FOUND, openReadEnd);
+int PHYSFS_setAllocator(const PHYSFS_Allocator *a)
+{
+    BAIL_IF_MACRO(initialized, PHYSFS_ERR_IS_INITIALIZED, 0);
+    externalAllocator = (a != NULL);
+    if (externalAllocator)
+        memcpy(&realAllocator, a, sizeof (PHYSFS_Allocator));
 
-        for (i = searchPath; i != NULL; i = i->next)
-        {
-            char *arcfname = fname;
-            if (verifyPath(i, &arcfname, 0))
-            {
-                io = i->funcs->openRead(i->opaque, arcfname);
-                if (io)
-                    break;
-            } /* if */
-        } /* for */
+    return 1;
+} /* PHYSFS_setAllocator */
 
-        GOTO_IF_MACRO(!io, ERRPASS, openReadEnd);
 
-        fh = (FileHandle *) allocator.Malloc(sizeof (FileHandle));
-        if (fh == NULL)
-        {
-            io->destroy(io);
-            GOTO_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, openReadEnd);
-        } /* if */
+const PHYSFS_Allocator *PHYSFS_getAllocator(void)
+{
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, NULL);
+    return &allocator;
+} /* PHYSFS_getAllocator */
 
-        memset(fh, '\0', sizeof (FileHandle));
-        fh->io = io;
-        fh->forReading = 1;
-        fh->dirHandle = i;
-        fh->next = openReadList;
-        openReadList = fh;
 
-        openReadEnd:
-        __PHYSFS_platformReleaseMutex(stateLock);
+static DirHandle *findMountedDir(const char *dir)
+{
+    DirHandle *i;
+
+    if (writeDir != NULL)
+    {
+        if (__PHYSFS_utf8stricmp(writeDir->dirName, dir) == 0)
+            return writeDir;
     } /* if */
 
-    __PHYSFS_smallFree(fname);
-    return ((PHYSFS_File *) fh);
-} /* PHYSFS_openRead */
+    for (i = searchPath; i != NULL; i = i->next)
+    {
+        if (__PHYSFS_utf8stricmp(i->dirName, dir) == 0)
+            return i;
+    } /* for */
+
+    return NULL;
+} /* findMountedDir */
 
 
-static int closeHandleInOpenList(FileHandle **list, FileHandle *handle)
+int PHYSFS_getMemoryStats(const char *archive, PHYSFS_MemoryStats *stats)
 {
-    FileHandle *prev = NULL;
-    FileHandle *i;
-    int rc = 1;
+    const __PHYSFS_MemAccount *account = &allMemory;
+    int i;
+
+    BAIL_IF_MACRO(!stats, PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    for (i = *list; i != NULL; i = i->next)
+    if (archive != NULL)
     {
-        if (i == handle)  /* handle is in this list? */
-        {
-            PHYSFS_Io *io = handle->io;
-            PHYSFS_uint8 *tmp = handle->buffer;
-            rc = PHYSFS_flush((PHYSFS_File *) handle);
-            if (!rc)
-                return -1;
-            io->destroy(io);
+        DirHandle *dh;
+        BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+        __PHYSFS_platformGrabMutex(stateLock);
+        dh = findMountedDir(archive);
+        BAIL_IF_MACRO_MUTEX(!dh, PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
+        account = dh->memory;
+    } /* if */
 
-            if (tmp != NULL)  /* free any associated buffer. */
-                allocator.Free(tmp);
+    /* the DirHandle can't go away while we hold stateLock. */
+    MEM_GRAB();
+    stats->total = MEM_LOAD(&account->total);
+    if (account != &allMemory)
+        stats->total--;  /* the DirHandle's own byte. */
+    for (i = 0; i < PHYSFS_MEMORY_CATEGORY_COUNT; i++)
+        stats->bytes[i] = MEM_LOAD(&account->bytes[i]);
+    MEM_RELEASE();
 
-            if (prev == NULL)
-                *list = handle->next;
-            else
-                prev->next = handle->next;
+    if (archive != NULL)
+        __PHYSFS_platformReleaseMutex(stateLock);
 
-            allocator.Free(handle);
-            return 1;
-        } /* if */
-        prev = i;
-    } /* for */
+    return 1;
+} /* PHYSFS_getMemoryStats */
 
-    return 0;
-} /* closeHandleInOpenList */
 
+void PHYSFS_setMemoryLimit(PHYSFS_uint64 bytes)
+{
+    MEM_STORE(&memLimit, bytes);
+
+    if (__PHYSFS_memOverLimit())
+        trimPools();
+} /* PHYSFS_setMemoryLimit */
 
-int PHYSFS_close(PHYSFS_File *_handle)
+
+int PHYSFS_getStats(const char *archive, PHYSFS_Stats *stats)
 {
-    FileHandle *handle = (FileHandle *) _handle;
-    int rc;
+    DirHandle *i;
 
-    __PHYSFS_platformGrabMutex(stateLock);
+    BAIL_IF_MACRO(!stats, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
 
-    /* -1 == close failure. 0 == not found. 1 == success. */
-    rc = closeHandleInOpenList(&openReadList, handle);
-    BAIL_IF_MACRO_MUTEX(rc == -1, ERRPASS, stateLock, 0);
-    if (!rc)
+    memset(stats, '\0', sizeof (*stats));
+
+    __PHYSFS_platformGrabMutex(stateLock);
+    if (archive != NULL)
     {
-        rc = closeHandleInOpenList(&openWriteList, handle);
-        BAIL_IF_MACRO_MUTEX(rc == -1, ERRPASS, stateLock, 0);
+        i = findMountedDir(archive);
+        BAIL_IF_MACRO_MUTEX(!i, PHYSFS_ERR_NOT_MOUNTED, stateLock, 0);
+        addStats(stats, i->stats);
     } /* if */
 
+    else
+    {
+        addStatsSnapshot(stats, &retiredStats);
+        if (writeDir != NULL)
+            addStats(stats, writeDir->stats);
+        for (i = searchPath; i != NULL; i = i->next)
+            addStats(stats, i->stats);
+    } /* else */
     __PHYSFS_platformReleaseMutex(stateLock);
-    BAIL_IF_MACRO(!rc, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
     return 1;
-} /* PHYSFS_close */
+} /* PHYSFS_getStats */
 
 
-static PHYSFS_sint64 doBufferedRead(FileHandle *fh, void *buffer,
-                                    PHYSFS_uint64 len)
+int PHYSFS_getArchiverStats(const char *ext, PHYSFS_Stats *stats)
 {
-    PHYSFS_Io *io = NULL;
-    PHYSFS_sint64 retval = 0;
-    PHYSFS_uint32 buffered = 0;
-    PHYSFS_sint64 rc = 0;
+    const PHYSFS_Archiver *arc = NULL;
+    DirHandle *i;
+    size_t idx;
 
-    if (len == 0)
-        return 0;
+    BAIL_IF_MACRO(!ext, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(*ext == '\0', PHYSFS_ERR_INVALID_ARGUMENT, 0);  /* "DIR" */
+    BAIL_IF_MACRO(!stats, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
 
-    buffered = fh->buffill - fh->bufpos;
-    if (buffered >= len)  /* totally in the buffer, just copy and return! */
-    {
-        memcpy(buffer, fh->buffer + fh->bufpos, (size_t) len);
-        fh->bufpos += (PHYSFS_uint32) len;
-        return (PHYSFS_sint64) len;
-    } /* if */
+    memset(stats, '\0', sizeof (*stats));
 
-    else if (buffered > 0) /* partially in the buffer... */
+    __PHYSFS_platformGrabMutex(stateLock);
+    if (__PHYSFS_utf8stricmp(ext, DIR_ARCHIVER_TYPE) == 0)
+        arc = &__PHYSFS_Archiver_DIR;
+    else
     {
-        memcpy(buffer, fh->buffer + fh->bufpos, (size_t) buffered);
-        buffer = ((PHYSFS_uint8 *) buffer) + buffered;
-        len -= buffered;
-        retval = buffered;
-    } /* if */
-
-    /* if you got here, the buffer is drained and we still need bytes. */
-    assert(len > 0);
+        for (idx = 0; idx < numArchivers; idx++)
+        {
+            if (__PHYSFS_utf8stricmp(archiveInfo[idx]->extension, ext) == 0)
+            {
+                arc = archivers[idx];
+                break;
+            } /* if */
+        } /* for */
+    } /* else */
 
-    fh->buffill = fh->bufpos = 0;
+    BAIL_IF_MACRO_MUTEX(!arc, PHYSFS_ERR_NOT_FOUND, stateLock, 0);
 
-    io = fh->io;
-    if (len >= fh->bufsize)  /* need more than the buffer takes. */
+    addStatsSnapshot(stats, retiredStatsFor(arc));
+    if ((writeDir != NULL) && (writeDir->funcs == arc))
+        addStats(stats, writeDir->stats);
+    for (i = searchPath; i != NULL; i = i->next)
     {
-        /* leave buffer empty, go right to output instead. */
-        rc = io->read(io, buffer, len);
-        if (rc < 0)
-            return ((retval == 0) ? rc : retval);
-        return retval + rc;
-    } /* if */
+        if (i->funcs == arc)
+            addStats(stats, i->stats);
+    } /* for */
+    __PHYSFS_platformReleaseMutex(stateLock);
 
-    /* need less than buffer can take. Fill buffer. */
-    rc = io->read(io, fh->buffer, fh->bufsize);
-    if (rc < 0)
-        return ((retval == 0) ? rc : retval);
+    return 1;
+} /* PHYSFS_getArchiverStats */
 
-    assert(fh->bufpos == 0);
-    fh->buffill = (PHYSFS_uint32) rc;
-    rc = doBufferedRead(fh, buffer, len);  /* go from the start, again. */
-    if (rc < 0)
-        return ((retval == 0) ? rc : retval);
 
-    return retval + rc;
-} /* doBufferedRead */
+void PHYSFS_setTraceCallback(PHYSFS_TraceCallback cb, void *data)
+{
+    /* waits for any callback in progress, so the old data is ours again. */
+    if (traceLock) __PHYSFS_platformGrabMutex(traceLock);
+    traceHookStorage.cb = cb;
+    traceHookStorage.data = data;
+    TRACE_PUBLISH((cb != NULL) ? &traceHookStorage : NULL);
+    if (traceLock) __PHYSFS_platformReleaseMutex(traceLock);
+} /* PHYSFS_setTraceCallback */
 
 
-PHYSFS_sint64 PHYSFS_read(PHYSFS_File *handle, void *buffer,
-                          PHYSFS_uint32 size, PHYSFS_uint32 count)
+int PHYSFS_traceToFile(const char *filename)
 {
-    const PHYSFS_uint64 len = ((PHYSFS_uint64) size) * ((PHYSFS_uint64) count);
-    const PHYSFS_sint64 retval = PHYSFS_readBytes(handle, buffer, len);
-    return ( (retval <= 0) ? retval : (retval / ((PHYSFS_sint64) size)) );
-} /* PHYSFS_read */
+    TraceFile *tf = NULL;
 
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
 
-PHYSFS_sint64 PHYSFS_readBytes(PHYSFS_File *handle, void *buffer,
-                               PHYSFS_uint64 len)
-{
-    FileHandle *fh = (FileHandle *) handle;
+    closeTraceFile();
+    if (filename == NULL)
+        return 1;
 
-#ifdef PHYSFS_NO_64BIT_SUPPORT
-    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFF);
-#else
-    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFFFFFFFFFF);
-#endif
+    tf = (TraceFile *) allocator.Malloc(sizeof (TraceFile));
+    BAIL_IF_MACRO(!tf, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    memset(tf, '\0', sizeof (TraceFile));
+    tf->empty = 1;
 
-    if (!__PHYSFS_ui64FitsAddressSpace(len))
-        BAIL_MACRO(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    tf->io = __PHYSFS_createNativeIo(filename, 'w');
+    GOTO_IF_MACRO(!tf->io, ERRPASS, traceToFile_failed);
 
-    BAIL_IF_MACRO(len > maxlen, PHYSFS_ERR_INVALID_ARGUMENT, -1);
-    BAIL_IF_MACRO(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, -1);
-    BAIL_IF_MACRO(len == 0, ERRPASS, 0);
-    if (fh->buffer)
-        return doBufferedRead(fh, buffer, len);
+    traceFileAppendStr(tf, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    traceFile = tf;
+    PHYSFS_setTraceCallback(traceFileCallback, tf);
+    return 1;
 
-    return fh->io->read(fh->io, buffer, len);
-} /* PHYSFS_readBytes */
+traceToFile_failed:
+    allocator.Free(tf);
+    return 0;
+} /* PHYSFS_traceToFile */
 
 
-static PHYSFS_sint64 doBufferedWrite(PHYSFS_File *handle, const void *buffer,
-                                     PHYSFS_uint64 len)
+PHYSFS_AsyncRequest *PHYSFS_readAsync(PHYSFS_File *handle,
+                                      PHYSFS_uint64 offset, void *buffer,
+                                      PHYSFS_uint64 len,
+                                      PHYSFS_AsyncCallback cb, void *data)
 {
     FileHandle *fh = (FileHandle *) handle;
+    PHYSFS_AsyncRequest *req;
 
-    /* whole thing fits in the buffer? */
-    if ( (((PHYSFS_uint64) fh->buffill) + len) < fh->bufsize )
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, NULL);
+    BAIL_IF_MACRO(!fh, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF_MACRO((!buffer) && (len > 0), PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF_MACRO(!__PHYSFS_ui64FitsAddressSpace(len), PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+    BAIL_IF_MACRO(!fh->forReading, PHYSFS_ERR_OPEN_FOR_WRITING, NULL);
+
+    req = asyncReadRequest(fh, offset, buffer, len, cb, data);
+    BAIL_IF_MACRO(!req, ERRPASS, NULL);
+    return asyncSubmit(req);
+} /* PHYSFS_readAsync */
+
+
+PHYSFS_AsyncRequest *PHYSFS_openReadAsync(const char *filename,
+                                          PHYSFS_AsyncCallback cb, void *data)
+{
+    PHYSFS_AsyncRequest *req;
+
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, NULL);
+    BAIL_IF_MACRO(!filename, PHYSFS_ERR_INVALID_ARGUMENT, NULL);
+
+    req = asyncAlloc(cb, data);
+    BAIL_IF_MACRO(!req, ERRPASS, NULL);
+    req->fname = __PHYSFS_strdup(filename);
+    if (req->fname == NULL)
     {
-        memcpy(fh->buffer + fh->buffill, buffer, (size_t) len);
-        fh->buffill += (PHYSFS_uint32) len;
-        return (PHYSFS_sint64) len;
+        __PHYSFS_poolFree(&asyncPool, req);
+        BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
     } /* if */
 
-    /* would overflow buffer. Flush and then write the new objects, too. */
-    BAIL_IF_MACRO(!PHYSFS_flush(handle), ERRPASS, -1);
-    return fh->io->write(fh->io, buffer, len);
-} /* doBufferedWrite */
+    return asyncSubmit(req);
+} /* PHYSFS_openReadAsync */
 
 
-PHYSFS_sint64 PHYSFS_write(PHYSFS_File *handle, const void *buffer,
-                           PHYSFS_uint32 size, PHYSFS_uint32 count)
+PHYSFS_AsyncStatus PHYSFS_pollAsync(PHYSFS_AsyncRequest *req)
 {
-    const PHYSFS_uint64 len = ((PHYSFS_uint64) size) * ((PHYSFS_uint64) count);
-    const PHYSFS_sint64 retval = PHYSFS_writeBytes(handle, buffer, len);
-    return ( (retval <= 0) ? retval : (retval / ((PHYSFS_sint64) size)) );
-} /* PHYSFS_write */
+    PHYSFS_AsyncStatus retval;
+    __PHYSFS_platformGrabMutex(asyncLock);
+    retval = req->status;
+    __PHYSFS_platformReleaseMutex(asyncLock);
+    return retval;
+} /* PHYSFS_pollAsync */
 
 
-PHYSFS_sint64 PHYSFS_writeBytes(PHYSFS_File *handle, const void *buffer,
-                                PHYSFS_uint64 len)
+PHYSFS_AsyncStatus PHYSFS_waitAsync(PHYSFS_AsyncRequest *req)
 {
-    FileHandle *fh = (FileHandle *) handle;
-
-#ifdef PHYSFS_NO_64BIT_SUPPORT
-    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFF);
-#else
-    const PHYSFS_uint64 maxlen = __PHYSFS_UI64(0x7FFFFFFFFFFFFFFF);
-#endif
+    PHYSFS_AsyncStatus retval;
 
-    if (!__PHYSFS_ui64FitsAddressSpace(len))
-        BAIL_MACRO(PHYSFS_ERR_INVALID_ARGUMENT, -1);
+    __PHYSFS_platformGrabMutex(asyncLock);
 
-    BAIL_IF_MACRO(len > maxlen, PHYSFS_ERR_INVALID_ARGUMENT, -1);
-    BAIL_IF_MACRO(fh->forReading, PHYSFS_ERR_OPEN_FOR_READING, -1);
-    BAIL_IF_MACRO(len == 0, ERRPASS, 0);
-    if (fh->buffer)
-        return doBufferedWrite(handle, buffer, len);
+    /* still in line? Don't wait for a worker; do it ourselves. */
+    if ((req->status == PHYSFS_ASYNC_PENDING) && (asyncRunnable(req)))
+    {
+        asyncStartRequest(req);
+        __PHYSFS_platformReleaseMutex(asyncLock);
+        asyncRunBatch(&req, 1, NULL);
+        __PHYSFS_platformGrabMutex(asyncLock);
+    } /* if */
 
-    return fh->io->write(fh->io, buffer, len);
-} /* PHYSFS_write */
+    while ((req->status == PHYSFS_ASYNC_PENDING) ||
+           (req->status == PHYSFS_ASYNC_RUNNING))
+    {
+        if (req->waitSem == NULL)
+        {
+            req->waitSem = __PHYSFS_platformCreateSemaphore(0);
+            BAIL_IF_MACRO_MUTEX(!req->waitSem, ERRPASS, asyncLock, req->status);
+        } /* if */
 
+        req->waiters++;
+        __PHYSFS_platformReleaseMutex(asyncLock);
+        __PHYSFS_platformWaitSemaphore(req->waitSem);
+        __PHYSFS_platformGrabMutex(asyncLock);
+    } /* while */
 
-int PHYSFS_eof(PHYSFS_File *handle)
-{
-    FileHandle *fh = (FileHandle *) handle;
+    retval = req->status;
+    __PHYSFS_platformReleaseMutex(asyncLock);
+    return retval;
+} /* PHYSFS_waitAsync */
 
-    if (!fh->forReading)  /* never EOF on files opened for write/append. */
-        return 0;
 
-    /* can't be eof if buffer isn't empty */
-    if (fh->bufpos == fh->buffill)
+int PHYSFS_cancelAsync(PHYSFS_AsyncRequest *req)
+{
+    __PHYSFS_platformGrabMutex(asyncLock);
+    if (req->status != PHYSFS_ASYNC_PENDING)
     {
-        /* check the Io. */
-        PHYSFS_Io *io = fh->io;
-        const PHYSFS_sint64 pos = io->tell(io);
-        const PHYSFS_sint64 len = io->length(io);
-        if ((pos < 0) || (len < 0))
-            return 0;  /* beats me. */
-        return (pos >= len);
+        __PHYSFS_platformReleaseMutex(asyncLock);
+        return 0;
     } /* if */
 
-    return 0;
-} /* PHYSFS_eof */
+    asyncDequeue(req);
+    req->status = PHYSFS_ASYNC_RUNNING;  /* until the callback returns. */
+    __PHYSFS_platformReleaseMutex(asyncLock);
 
+    asyncFinish(req, PHYSFS_ASYNC_CANCELLED);
+    return 1;
+} /* PHYSFS_cancelAsync */
 
-PHYSFS_sint64 PHYSFS_tell(PHYSFS_File *handle)
+
+PHYSFS_sint64 PHYSFS_getAsyncResult(PHYSFS_AsyncRequest *req)
 {
-    FileHandle *fh = (FileHandle *) handle;
-    const PHYSFS_sint64 pos = fh->io->tell(fh->io);
-    const PHYSFS_sint64 retval = fh->forReading ?
-                                 (pos - fh->buffill) + fh->bufpos :
-                                 (pos + fh->buffill);
+    PHYSFS_sint64 retval;
+    __PHYSFS_platformGrabMutex(asyncLock);
+    retval = (req->status == PHYSFS_ASYNC_DONE) ? req->result : -1;
+    __PHYSFS_platformReleaseMutex(asyncLock);
     return retval;
-} /* PHYSFS_tell */
+} /* PHYSFS_getAsyncResult */
 
 
-int PHYSFS_seek(PHYSFS_File *handle, PHYSFS_uint64 pos)
+PHYSFS_ErrorCode PHYSFS_getAsyncError(PHYSFS_AsyncRequest *req)
 {
-    FileHandle *fh = (FileHandle *) handle;
-    BAIL_IF_MACRO(!PHYSFS_flush(handle), ERRPASS, 0);
+    PHYSFS_ErrorCode retval;
+    __PHYSFS_platformGrabMutex(asyncLock);
+    retval = (req->status == PHYSFS_ASYNC_FAILED) ? req->error : PHYSFS_ERR_OK;
+    __PHYSFS_platformReleaseMutex(asyncLock);
+    return retval;
+} /* PHYSFS_getAsyncError */
 
-    if (fh->buffer && fh->forReading)
+
+PHYSFS_File *PHYSFS_getAsyncFile(PHYSFS_AsyncRequest *req)
+{
+    PHYSFS_File *retval = NULL;
+    __PHYSFS_platformGrabMutex(asyncLock);
+    if ((req->status == PHYSFS_ASYNC_DONE) && (req->fname != NULL))
     {
-        /* avoid throwing away our precious buffer if seeking within it. */
-        PHYSFS_sint64 offset = pos - PHYSFS_tell(handle);
-        if ( /* seeking within the already-buffered range? */
-            ((offset >= 0) && (offset <= fh->buffill - fh->bufpos)) /* fwd */
-            || ((offset < 0) && (-offset <= fh->bufpos)) /* backward */ )
-        {
-            fh->bufpos += (PHYSFS_uint32) offset;
-            return 1; /* successful seek */
-        } /* if */
+        retval = (PHYSFS_File *) req->fh;
+        req->fh = NULL;
     } /* if */
-
-    /* we have to fall back to a 'raw' seek. */
-    fh->buffill = fh->bufpos = 0;
-    return fh->io->seek(fh->io, pos);
-} /* PHYSFS_seek */
+    __PHYSFS_platformReleaseMutex(asyncLock);
+    return retval;
+} /* PHYSFS_getAsyncFile */
 
 
-PHYSFS_sint64 PHYSFS_fileLength(PHYSFS_File *handle)
+void PHYSFS_freeAsync(PHYSFS_AsyncRequest *req)
 {
-    PHYSFS_Io *io = ((FileHandle *) handle)->io;
-    return io->length(io);
-} /* PHYSFS_filelength */
+    PHYSFS_File *orphan;
 
+    if (req == NULL)
+        return;
 
-int PHYSFS_setBuffer(PHYSFS_File *handle, PHYSFS_uint64 _bufsize)
+    __PHYSFS_platformGrabMutex(asyncLock);
+    if (req->status == PHYSFS_ASYNC_RUNNING)
+    {
+        req->freed = 1;  /* asyncFinish() frees it. */
+        __PHYSFS_platformReleaseMutex(asyncLock);
+        return;
+    } /* if */
+
+    if (req->status == PHYSFS_ASYNC_PENDING)
+        asyncDequeue(req);
+    orphan = asyncFree(req);
+    __PHYSFS_platformReleaseMutex(asyncLock);
+
+    if (orphan != NULL)
+        PHYSFS_close(orphan);
+} /* PHYSFS_freeAsync */
+
+
+int PHYSFS_setAccessHint(PHYSFS_File *handle, PHYSFS_AccessHint hint)
 {
     FileHandle *fh = (FileHandle *) handle;
-    PHYSFS_uint32 bufsize;
+    PHYSFS_DataRange range;
 
-    /* !!! FIXME: actually, why use 32 bits here? */
-    /*BAIL_IF_MACRO(_bufsize > 0xFFFFFFFF, "buffer must fit in 32-bits", 0);*/
-    BAIL_IF_MACRO(_bufsize > 0xFFFFFFFF, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    bufsize = (PHYSFS_uint32) _bufsize;
+    BAIL_IF_MACRO(!fh, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(((int) hint < (int) PHYSFS_ACCESS_NORMAL) ||
+                  ((int) hint > (int) PHYSFS_ACCESS_DONTNEED),
+                  PHYSFS_ERR_INVALID_ARGUMENT, 0);
 
-    BAIL_IF_MACRO(!PHYSFS_flush(handle), ERRPASS, 0);
+    if (!fh->forReading)
+        return 1;  /* nothing to say about writes. */
 
-    /*
-     * For reads, we need to move the file pointer to where it would be
-     *  if we weren't buffering, so that the next read will get the
-     *  right chunk of stuff from the file. PHYSFS_flush() handles writes.
-     */
-    if ((fh->forReading) && (fh->buffill != fh->bufpos))
+    if (hint <= PHYSFS_ACCESS_RANDOM)  /* buffering reads ahead by this. */
+        fh->hint = (PHYSFS_uint8) hint;
+
+    if ((!ioDataRange(fh->io, &range)) || (range.len == 0))
+        return 1;  /* can't tell where it lives; keep it to ourselves. */
+
+    return nativeIoAdvise(range.io, range.offset, range.len, hint);
+} /* PHYSFS_setAccessHint */
+
+
+int PHYSFS_setAsyncThreads(PHYSFS_uint32 count)
+{
+    int drain = 0;
+
+    BAIL_IF_MACRO(count > ASYNC_MAX_THREADS, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+
+    if (!initialized)
     {
-        PHYSFS_uint64 pos;
-        const PHYSFS_sint64 curpos = fh->io->tell(fh->io);
-        BAIL_IF_MACRO(curpos == -1, ERRPASS, 0);
-        pos = ((curpos - fh->buffill) + fh->bufpos);
-        BAIL_IF_MACRO(!fh->io->seek(fh->io, pos), ERRPASS, 0);
+        asyncWanted = count;
+        return 1;
     } /* if */
 
-    if (bufsize == 0)  /* delete existing buffer. */
+    asyncStopThreads();
+
+    __PHYSFS_platformGrabMutex(asyncLock);
+    asyncWanted = count;
+    asyncNoThreads = 0;
+    if (asyncQueue != NULL)
     {
-        if (fh->buffer)
-        {
-            allocator.Free(fh->buffer);
-            fh->buffer = NULL;
-        } /* if */
+        asyncStartThreads();
+        drain = (asyncThreadCount == 0);
     } /* if */
+    __PHYSFS_platformReleaseMutex(asyncLock);
 
-    else
-    {
-        PHYSFS_uint8 *newbuf;
-        newbuf = (PHYSFS_uint8 *) allocator.Realloc(fh->buffer, bufsize);
-        BAIL_IF_MACRO(!newbuf, PHYSFS_ERR_OUT_OF_MEMORY, 0);
-        fh->buffer = newbuf;
-    } /* else */
+    if (drain)  /* nobody else is going to run these. */
+        asyncDrain();
 
-    fh->bufsize = bufsize;
-    fh->buffill = fh->bufpos = 0;
     return 1;
-} /* PHYSFS_setBuffer */
+} /* PHYSFS_setAsyncThreads */
 
 
-int PHYSFS_flush(PHYSFS_File *handle)
+PHYSFS_uint32 PHYSFS_loadMany(const char * const *paths, PHYSFS_uint32 count,
+                              PHYSFS_LoadCallback cb, void *data)
 {
-    FileHandle *fh = (FileHandle *) handle;
-    PHYSFS_Io *io;
-    PHYSFS_sint64 rc;
-
-    if ((fh->forReading) || (fh->bufpos == fh->buffill))
-        return 1;  /* open for read or buffer empty are successful no-ops. */
+    const PHYSFS_uint32 window = (count < LOADMANY_MAX_FILES) ? count : LOADMANY_MAX_FILES;
+    const PHYSFS_uint64 size = ((PHYSFS_uint64) window) * sizeof (LoadManyFile);
+    LoadManyState state;
+    LoadManyFile *files;
+    PHYSFS_uint32 total = 0;
+    PHYSFS_uint32 retval = 0;
+    PHYSFS_uint32 i, j;
+    int threaded;
 
-    /* dump buffer to disk. */
-    io = fh->io;
-    rc = io->write(io, fh->buffer + fh->bufpos, fh->buffill - fh->bufpos);
-    BAIL_IF_MACRO(rc <= 0, ERRPASS, 0);
-    fh->bufpos = fh->buffill = 0;
-    return io->flush ? io->flush(io) : 1;
-} /* PHYSFS_flush */
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    BAIL_IF_MACRO(!cb, PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO((!paths) && (count > 0), PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!__PHYSFS_ui64FitsAddressSpace(size), PHYSFS_ERR_OUT_OF_MEMORY, 0);
 
+    if (count == 0)
+        return 0;
 
-int PHYSFS_stat(const char *_fname, PHYSFS_Stat *stat)
-{
-    int retval = 0;
-    char *fname;
-    size_t len;
+    files = (LoadManyFile *) allocator.Malloc(size);
+    BAIL_IF_MACRO(!files, PHYSFS_ERR_OUT_OF_MEMORY, 0);
 
-    BAIL_IF_MACRO(!_fname, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    BAIL_IF_MACRO(!stat, PHYSFS_ERR_INVALID_ARGUMENT, 0);
-    len = strlen(_fname) + 1;
-    fname = (char *) __PHYSFS_smallAlloc(len);
-    BAIL_IF_MACRO(!fname, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    state.paths = paths;
+    state.callback = cb;
+    state.data = data;
 
-    /* set some sane defaults... */
-    stat->filesize = -1;
-    stat->modtime = -1;
-    stat->createtime = -1;
-    stat->accesstime = -1;
-    stat->filetype = PHYSFS_FILETYPE_OTHER;
-    stat->readonly = 1;  /* !!! FIXME */
+    __PHYSFS_platformGrabMutex(asyncLock);
+    asyncStartThreads();
+    threaded = (asyncThreadCount > 0);
+    __PHYSFS_platformReleaseMutex(asyncLock);
 
-    if (sanitizePlatformIndependentPath(_fname, fname))
+    i = 0;
+    while (i < count)
     {
-        if (*fname == '\0')
+        /* open a window's worth, so we know where those are. */
+        total = 0;
+        for (; (i < count) && (total < LOADMANY_MAX_FILES); i++)
         {
-            stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
-            stat->readonly = !writeDir; /* Writeable if we have a writeDir */
-            retval = 1;
-        } /* if */
+            LoadManyFile *file = &files[total];
+            PHYSFS_File *f = PHYSFS_openRead(paths[i]);
+            PHYSFS_sint64 len;
+            PHYSFS_DataRange range;
+
+            if (f == NULL)
+            {
+                loadManyFailed(&state, i, PHYSFS_getLastErrorCode());
+                continue;
+            } /* if */
+
+            len = PHYSFS_fileLength(f);
+            if ((len < 0) || (!__PHYSFS_ui64FitsAddressSpace((PHYSFS_uint64) len)))
+            {
+                if (len >= 0)
+                    PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+                loadManyFailed(&state, i, PHYSFS_getLastErrorCode());
+                PHYSFS_close(f);
+                continue;
+            } /* if */
+
+            memset(file, '\0', sizeof (*file));
+            file->state = &state;
+            file->index = i;
+            file->fh = (FileHandle *) f;
+            file->len = (PHYSFS_uint64) len;
+            if (ioDataRange(file->fh->io, &range))
+                file->physpos = range.offset;
+            total++;
+        } /* for */
+
+        __PHYSFS_sort(files, total, loadManyCmp, loadManySwap);
+
+        /* every file in the window is closed by the time these return. */
+        if (threaded)
+            loadManyQueued(files, total);
         else
+            loadManyHere(files, total);
+
+        for (j = 0; j < total; j++)
         {
-            DirHandle *i;
-            int exists = 0;
-            __PHYSFS_platformGrabMutex(stateLock);
-            for (i = searchPath; ((i != NULL) && (!exists)); i = i->next)
-            {
-                char *arcfname = fname;
-                exists = partOfMountPoint(i, arcfname);
-                if (exists)
-                {
-                    stat->filetype = PHYSFS_FILETYPE_DIRECTORY;
-                    stat->readonly = 1;  /* !!! FIXME */
-                    retval = 1;
-                } /* if */
-                else if (verifyPath(i, &arcfname, 0))
-                {
-                    /* !!! FIXME: this test is wrong and should be elsewhere. */
-                    stat->readonly = !(writeDir &&
-                                 (__PHYSFS_utf8stricmp(writeDir->dirName, i->dirName) == 0));
-                    retval = i->funcs->stat(i->opaque, arcfname, stat);
-                    if ((retval) || (currentErrorCode() != PHYSFS_ERR_NOT_FOUND))
-                        exists = 1;
-                } /* else if */
-            } /* for */
-            __PHYSFS_platformReleaseMutex(stateLock);
-        } /* else */
-    } /* if */
+            if (files[j].loaded)
+                retval++;
+        } /* for */
+    } /* while */
 
-    __PHYSFS_smallFree(fname);
+    allocator.Free(files);
     return retval;
-} /* PHYSFS_stat */
+} /* PHYSFS_loadMany */
 
 
-int __PHYSFS_readAll(PHYSFS_Io *io, void *buf, const PHYSFS_uint64 len)
+/*
+ * Find where the first archive in the search path with (path) in it keeps
+ *  its bytes, without opening it as a PHYSFS_File: no open list, buffering
+ *  or tracing. ZIP and the unpacked formats look it up in their index.
+ *  Anything else gets opened by its archiver, and since that Io won't
+ *  outlive this call, its range is advised right here and (range->len)
+ *  comes back zero. (owner) is the archive's place in the search path.
+ *  Returns zero if (path) isn't anywhere, with (err) set.
+ *  MAKE SURE you hold stateLock before calling this!
+ */
+static int prefetchLocate(const char *path, PHYSFS_DataRange *range,
+                          PHYSFS_uint32 *owner, PHYSFS_ErrorCode *err)
 {
-    return (io->read(io, buf, len) == len);
-} /* __PHYSFS_readAll */
+    const size_t len = strlen(path) + 1;
+    char *fname = (char *) __PHYSFS_smallAlloc(len);
+    PHYSFS_Io *io = NULL;
+    DirHandle *h;
+    int rc = -1;
 
+    if (fname == NULL)
+    {
+        *err = PHYSFS_ERR_OUT_OF_MEMORY;
+        return 0;
+    } /* if */
 
-void *__PHYSFS_initSmallAlloc(void *ptr, PHYSFS_uint64 len)
-{
-    void *useHeap = ((ptr == NULL) ? ((void *) 1) : ((void *) 0));
-    if (useHeap)  /* too large for stack allocation or alloca() failed. */
-        ptr = allocator.Malloc(len+sizeof (void *));
+    *err = PHYSFS_ERR_NOT_FOUND;
+    *owner = 0;
+    if (!sanitizePlatformIndependentPath(path, fname))
+        h = NULL;
+    else
+    {
+        for (h = searchPath; h != NULL; h = h->next, (*owner)++)
+        {
+            char *arcfname = fname;
+            if (!verifyPath(h, &arcfname, 0))
+                continue;
 
-    if (ptr != NULL)
+            rc = 0;
+            if (h->funcs->locate != NULL)
+                rc = h->funcs->locate(h->opaque, arcfname, range);
+
+            if (rc == 0)  /* no index to ask, so open it after all. */
+            {
+                __PHYSFS_MemCharge charge;
+                __PHYSFS_Stats *prevstats;
+                __PHYSFS_memCharge(h->memory, PHYSFS_MEMORY_HANDLES, &charge);
+                prevstats = setCurrentStats(h->stats);
+                io = h->funcs->openRead(h->opaque, arcfname);
+                setCurrentStats(prevstats);
+                __PHYSFS_memRestore(&charge);
+                rc = (io != NULL) ? 1 : -1;
+            } /* if */
+
+            if (rc > 0)
+                break;
+        } /* for */
+    } /* else */
+
+    if (h == NULL)
     {
-        void **retval = (void **) ptr;
-        /*printf("%s alloc'd (%d) bytes at (%p).\n",
-                useHeap ? "heap" : "stack", (int) len, ptr);*/
-        *retval = useHeap;
-        return retval + 1;
+        const PHYSFS_ErrorCode lasterr = PHYSFS_getLastErrorCode();
+        if (lasterr != PHYSFS_ERR_OK)
+            *err = lasterr;
     } /* if */
 
-    return NULL;  /* allocation failed. */
-} /* __PHYSFS_initSmallAlloc */
+    else if (io != NULL)
+    {
+        *err = PHYSFS_ERR_OK;
+        if ( (ioDataRange(io, range)) && (range->len > 0) &&
+             (range->io != NULL) && (range->io->read == nativeIo_read) &&
+             (!nativeIoAdvise(range->io, range->offset, range->len,
+                              PHYSFS_ACCESS_WILLNEED)) )
+            *err = PHYSFS_getLastErrorCode();
+        range->len = 0;  /* done with it. */
+        io->destroy(io);
+    } /* else if */
 
+    else
+    {
+        *err = PHYSFS_ERR_OK;
+    } /* else */
 
-void __PHYSFS_smallFree(void *ptr)
+    __PHYSFS_smallFree(fname);
+    return (h != NULL);
+} /* prefetchLocate */
+
+
+PHYSFS_uint32 PHYSFS_prefetchMany(const char * const *paths,
+                                  PHYSFS_uint32 count)
 {
-    if (ptr != NULL)
+    const PHYSFS_uint64 size = ((PHYSFS_uint64) count) * sizeof (PrefetchSpan);
+    PrefetchSpan *spans;
+    PHYSFS_uint32 total = 0;
+    PHYSFS_uint32 retval = 0;
+    PHYSFS_ErrorCode err = PHYSFS_ERR_OK;
+    PHYSFS_uint32 i;
+
+    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, 0);
+    BAIL_IF_MACRO((!paths) && (count > 0), PHYSFS_ERR_INVALID_ARGUMENT, 0);
+    BAIL_IF_MACRO(!__PHYSFS_ui64FitsAddressSpace(size), PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    if (count == 0)
+        return 0;
+
+    spans = (PrefetchSpan *) allocator.Malloc((size_t) size);
+    BAIL_IF_MACRO(!spans, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+
+    /* archives can't go away while we hold this, so neither can their Ios. */
+    __PHYSFS_platformGrabMutex(stateLock);
+
+    for (i = 0; i < count; i++)
     {
-        void **block = ((void **) ptr) - 1;
-        const int useHeap = (*block != 0);
-        if (useHeap)
-            allocator.Free(block);
-        /*printf("%s free'd (%p).\n", useHeap ? "heap" : "stack", block);*/
-    } /* if */
-} /* __PHYSFS_smallFree */
+        PHYSFS_DataRange range;
+        PHYSFS_ErrorCode thiserr = PHYSFS_ERR_INVALID_ARGUMENT;
+        PHYSFS_uint32 owner;
 
+        if ((paths[i] != NULL) && (prefetchLocate(paths[i], &range, &owner, &thiserr)))
+        {
+            retval++;
+            if ( (range.len > 0) && (range.io != NULL) &&
+                 (range.io->read == nativeIo_read) )
+            {
+                spans[total].owner = owner;
+                spans[total].io = range.io;
+                spans[total].start = range.offset;
+                spans[total].end = range.offset + range.len;
+                total++;
+            } /* if */
+        } /* if */
 
-int PHYSFS_setAllocator(const PHYSFS_Allocator *a)
-{
-    BAIL_IF_MACRO(initialized, PHYSFS_ERR_IS_INITIALIZED, 0);
-    externalAllocator = (a != NULL);
-    if (externalAllocator)
-        memcpy(&allocator, a, sizeof (PHYSFS_Allocator));
+        if (thiserr != PHYSFS_ERR_OK)
+            err = thiserr;
+    } /* for */
 
-    return 1;
-} /* PHYSFS_setAllocator */
+    __PHYSFS_sort(spans, total, prefetchCmp, prefetchSwap);
+    if (!prefetchSpans(spans, total))
+        err = PHYSFS_getLastErrorCode();
 
+    __PHYSFS_platformReleaseMutex(stateLock);
 
-const PHYSFS_Allocator *PHYSFS_getAllocator(void)
+    allocator.Free(spans);
+
+    if (err != PHYSFS_ERR_OK)
+        PHYSFS_setErrorCode(err);
+
+    return retval;
+} /* PHYSFS_prefetchMany */
+
+
+int PHYSFS_prefetch(const char *fname)
 {
-    BAIL_IF_MACRO(!initialized, PHYSFS_ERR_NOT_INITIALIZED, NULL);
-    return &allocator;
-} /* PHYSFS_getAllocator */
+    return (PHYSFS_prefetchMany(&fname, 1) == 1);
+} /* PHYSFS_prefetch */
 
 
 static void *mallocAllocatorMalloc(PHYSFS_uint64 s)
@@ -2974,13 +7317,13 @@ static void mallocAllocatorFree(void *ptr)
 static void setDefaultAllocator(void)
 {
     assert(!externalAllocator);
-    if (!__PHYSFS_platformSetDefaultAllocator(&allocator))
+    if (!__PHYSFS_platformSetDefaultAllocator(&realAllocator))
     {
-        allocator.Init = NULL;
-        allocator.Deinit = NULL;
-        allocator.Malloc = mallocAllocatorMalloc;
-        allocator.Realloc = mallocAllocatorRealloc;
-        allocator.Free = mallocAllocatorFree;
+        realAllocator.Init = NULL;
+        realAllocator.Deinit = NULL;
+        realAllocator.Malloc = mallocAllocatorMalloc;
+        realAllocator.Realloc = mallocAllocatorRealloc;
+        realAllocator.Free = mallocAllocatorFree;
     } /* if */
 } /* setDefaultAllocator */
 
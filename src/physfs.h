@@ -594,6 +594,10 @@ PHYSFS_DECL const PHYSFS_ArchiveInfo **PHYSFS_supportedArchiveTypes(void);
  * Certain PhysicsFS functions return lists of information that are
  *  dynamically allocated. Use this function to free those resources.
  *
+ * Each list, and all the strings it points to, lives in one allocation, so
+ *  free the whole thing here: don't free individual elements, and don't
+ *  hand this function a list you built yourself.
+ *
  * It is safe to pass a NULL here, but doing so will cause a crash in versions
  *  before PhysicsFS 2.1.0.
  *
@@ -702,6 +706,13 @@ PHYSFS_DECL const char *PHYSFS_getDirSeparator(void);
  *  aren't permitted through this function, PHYSFS_stat() ignores them, and
  *  would treat the query as if the path didn't exist at all.
  *
+ * To keep this check cheap, PhysicsFS remembers which directories it has
+ *  already found to be free of symlinks, and only looks at the rest of a
+ *  path. It forgets all of this when PhysicsFS deletes something, or when
+ *  you call this function. If something outside of PhysicsFS might swap a
+ *  directory for a symlink while you're running, call this function again
+ *  with the same value to make PhysicsFS check everything from scratch.
+ *
  * Symbolic link permission can be enabled or disabled at any time after
  *  you've called PHYSFS_init(), and is disabled by default.
  *
@@ -1448,7 +1459,8 @@ PHYSFS_DECL PHYSFS_sint64 PHYSFS_fileLength(PHYSFS_File *handle);
  *  on the same file. Setting the buffer size to zero will free an existing
  *  buffer.
  *
- * PhysicsFS file handles are unbuffered by default.
+ * PhysicsFS file handles are unbuffered by default, unless
+ *  PHYSFS_setDefaultBuffer() says otherwise.
  *
  * Please check the return value of this function! Failures can include
  *  not being able to seek backwards in a read-only file when removing the
@@ -1459,6 +1471,7 @@ PHYSFS_DECL PHYSFS_sint64 PHYSFS_fileLength(PHYSFS_File *handle);
  *   \param bufsize size, in bytes, of buffer to allocate.
  *  \return nonzero if successful, zero on error.
  *
+ * \sa PHYSFS_setBufferMode
  * \sa PHYSFS_flush
  * \sa PHYSFS_read
  * \sa PHYSFS_write
@@ -2256,6 +2269,8 @@ PHYSFS_DECL const char *PHYSFS_getMountPoint(const char *dir);
 typedef void (*PHYSFS_StringCallback)(void *data, const char *str);
 
 
+struct PHYSFS_Stat;  /* defined below; the callback only passes a pointer. */
+
 /**
  * \typedef PHYSFS_EnumFilesCallback
  * \brief Function signature for callbacks that enumerate files.
@@ -2284,6 +2299,18 @@ typedef void (*PHYSFS_StringCallback)(void *data, const char *str);
  *                 fired, and it will not contain the full path. You can
  *                 recreate the fullpath with $origdir/$fname ... The file
  *                 can be a subdirectory, a file, a symlink, etc.
+ *    \param stat What PHYSFS_stat() would report for this file, filled in
+ *                from the metadata the archiver already had on hand while
+ *                enumerating, so you don't have to stat each file again.
+ *                The filetype is always right, but files in native
+ *                directories only get the rest (size, times, readonly) if
+ *                you asked with PHYSFS_enumerateFilesCallbackWithStats(),
+ *                since that costs a stat() per file; otherwise those are -1
+ *                (and readonly is zero). This can be NULL if the archiver
+ *                couldn't get it (some third-party archivers never provide
+ *                it), in which case you'll have to call PHYSFS_stat()
+ *                yourself. Like (fname), this is only valid for the
+ *                duration of the callback.
  *
  * \sa PHYSFS_enumerateFilesCallback
  */
@@ -2375,7 +2402,8 @@ PHYSFS_DECL void PHYSFS_getSearchPathCallback(PHYSFS_StringCallback c, void *d);
  *
  * \code
  *
- * static void printDir(void *data, const char *origdir, const char *fname)
+ * static void printDir(void *data, const char *origdir, const char *fname,
+ *                      PHYSFS_Stat *stat)
  * {
  *     printf(" * We've got [%s] in [%s].\n", fname, origdir);
  * }
@@ -2408,6 +2436,27 @@ PHYSFS_DECL void PHYSFS_enumerateFilesCallback(const char *dir,
                                                PHYSFS_EnumFilesCallback c,
                                                void *d);
 
+/**
+ * \fn void PHYSFS_enumerateFilesCallbackWithStats(const char *dir, PHYSFS_EnumFilesCallback c, void *d)
+ * \brief Like PHYSFS_enumerateFilesCallback(), with a complete PHYSFS_Stat.
+ *
+ * PHYSFS_enumerateFilesCallback() only promises each file's type for files
+ *  in native directories, because the OS lists those for free; sizes and
+ *  times cost a stat() per file. This fills in everything, so use it if
+ *  you're going to look at more than the filetype. For archives, both
+ *  versions report the same thing.
+ *
+ *    \param dir Directory, in platform-independent notation, to enumerate.
+ *    \param c Callback function to notify about search path elements.
+ *    \param d Application-defined data passed to callback. Can be NULL.
+ *
+ * \sa PHYSFS_EnumFilesCallback
+ * \sa PHYSFS_enumerateFilesCallback
+ */
+PHYSFS_DECL void PHYSFS_enumerateFilesCallbackWithStats(const char *dir,
+                                                        PHYSFS_EnumFilesCallback c,
+                                                        void *d);
+
 /**
  * \fn void PHYSFS_utf8FromUcs4(const PHYSFS_uint32 *src, char *dst, PHYSFS_uint64 len)
  * \brief Convert a UCS-4 string to a UTF-8 string.
@@ -2664,6 +2713,542 @@ typedef struct PHYSFS_Stat
 PHYSFS_DECL int PHYSFS_stat(const char *fname, PHYSFS_Stat *stat);
 
 
+/**
+ * \enum PHYSFS_WalkResult
+ * \brief What a PHYSFS_WalkCallback wants PHYSFS_walk() to do next.
+ *
+ * \sa PHYSFS_WalkCallback
+ * \sa PHYSFS_walk
+ */
+typedef enum PHYSFS_WalkResult
+{
+    PHYSFS_WALK_CONTINUE,  /**< Keep going; descend if this is a directory. */
+    PHYSFS_WALK_SKIP_SUBTREE, /**< Don't descend into this directory. */
+    PHYSFS_WALK_STOP  /**< Abandon the whole walk immediately. */
+} PHYSFS_WalkResult;
+
+/**
+ * \enum PHYSFS_WalkFlags
+ * \brief Flags that modify the behaviour of PHYSFS_walk().
+ *
+ * Combine these with bitwise OR, or pass zero for the defaults.
+ *
+ * \sa PHYSFS_walk
+ */
+typedef enum PHYSFS_WalkFlags
+{
+    PHYSFS_WALK_FILES_ONLY = (1 << 0) /**< Descend into directories, but
+                                           don't report them. */
+} PHYSFS_WalkFlags;
+
+/**
+ * \typedef PHYSFS_WalkCallback
+ * \brief Function signature for callbacks that walk a directory tree.
+ *
+ * This is just like PHYSFS_EnumFilesCallback, except that it can steer the
+ *  walk with its return value, and (dir) is always the full path of the
+ *  directory containing (fname), not whatever the application originally
+ *  asked for.
+ *
+ *    \param data User-defined data pointer, passed through from
+ *                PHYSFS_walk().
+ *    \param dir The directory containing this file, in platform-independent
+ *               notation, with no leading or trailing '/'. The root of the
+ *               tree is "".
+ *    \param fname The filename that is being reported, without its path.
+ *    \param stat What PHYSFS_stat() would report for this file. Never NULL.
+ *   \return A PHYSFS_WalkResult value. PHYSFS_WALK_SKIP_SUBTREE is only
+ *           meaningful for directories; for anything else it's the same as
+ *           PHYSFS_WALK_CONTINUE.
+ *
+ * \sa PHYSFS_walk
+ */
+typedef int (*PHYSFS_WalkCallback)(void *data, const char *dir,
+                                   const char *fname,
+                                   const PHYSFS_Stat *stat);
+
+/**
+ * \fn int PHYSFS_walk(const char *root, PHYSFS_uint32 flags, PHYSFS_WalkCallback c, void *d)
+ * \brief Recursively report every file under a directory of the search path.
+ *
+ * This walks the entire tree below (root), in every element of the search
+ *  path, in a single call. It is much faster than calling
+ *  PHYSFS_enumerateFilesCallback() on each directory yourself, as the
+ *  search path is only locked and checked once, and archives that know how
+ *  to iterate their own directory tree do so directly.
+ *
+ * Every file, directory and (if permitted) symlink is reported to (c), a
+ *  directory always before anything inside it. Like
+ *  PHYSFS_enumerateFilesCallback(), nothing is sorted, and as each element
+ *  of the search path is walked separately, you may see the same file more
+ *  than once. Symlinks are reported, but never followed.
+ *
+ * Return PHYSFS_WALK_SKIP_SUBTREE from (c) for a directory to not descend
+ *  into it. That directory won't be reported or entered again from later
+ *  elements of the search path, either. Return PHYSFS_WALK_STOP to end the
+ *  walk.
+ *
+ * The search path is locked for the duration of the walk. You may call
+ *  into PhysicsFS from (c) on the same thread, but don't change the search
+ *  path from inside the callback.
+ *
+ *    \param root Directory, in platform-independent notation, to walk. Use
+ *                "/" or "" to walk the entire tree.
+ *    \param flags Zero or more PHYSFS_WalkFlags values, OR'd together.
+ *    \param c Callback function to notify about each file.
+ *    \param d Application-defined data passed to callback. Can be NULL.
+ *   \return non-zero if the walk finished or (c) stopped it, zero on error.
+ *           Specifics of the error can be gleaned from
+ *           PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_WalkCallback
+ * \sa PHYSFS_enumerateFilesCallback
+ */
+PHYSFS_DECL int PHYSFS_walk(const char *root, PHYSFS_uint32 flags,
+                            PHYSFS_WalkCallback c, void *d);
+
+
+/**
+ * \fn void PHYSFS_enumerateFilesPatternCallback(const char *dir, const char *pattern, PHYSFS_EnumFilesCallback c, void *d)
+ * \brief Get the files in a directory whose names match a wildcard pattern.
+ *
+ * This works just like PHYSFS_enumerateFilesCallback(), but only reports
+ *  names that match (pattern). In the pattern, '*' matches any run of
+ *  characters (including none), '?' matches exactly one character, and
+ *  anything else matches itself, case-insensitively. Case is compared one
+ *  Unicode codepoint at a time, the way archive lookups do it, so the two
+ *  "st" ligatures (U+FB05 and U+FB06) match each other, but not "st", and
+ *  '?' never matches half of a ligature. There's no way to escape a
+ *  wildcard character. The pattern only applies to names in (dir) itself;
+ *  since those never contain a '/', a pattern with one in it matches
+ *  nothing.
+ *
+ * This is much faster than filtering PHYSFS_enumerateFilesCallback()
+ *  yourself, since archives with sorted indexes only look at names that
+ *  start with the pattern's literal prefix (the "tex" in "tex*.dds"), and
+ *  everything else is matched before a callback is made. You'll get the
+ *  most out of this by putting the literal part of a pattern first.
+ *
+ *    \param dir Directory, in platform-independent notation, to enumerate.
+ *    \param pattern Wildcard pattern to match filenames against.
+ *    \param c Callback function to notify about search path elements.
+ *    \param d Application-defined data passed to callback. Can be NULL.
+ *
+ * \sa PHYSFS_enumerateFilesPattern
+ * \sa PHYSFS_enumerateFilesCallback
+ */
+PHYSFS_DECL void PHYSFS_enumerateFilesPatternCallback(const char *dir,
+                                                      const char *pattern,
+                                                      PHYSFS_EnumFilesCallback c,
+                                                      void *d);
+
+/**
+ * \fn char **PHYSFS_enumerateFilesPattern(const char *dir, const char *pattern)
+ * \brief Get a sorted list of the files in a directory that match a pattern.
+ *
+ * This is PHYSFS_enumerateFiles(), limited to names that match (pattern).
+ *  See PHYSFS_enumerateFilesPatternCallback() for the pattern syntax.
+ *
+ * \code
+ * char **i, **dds = PHYSFS_enumerateFilesPattern("textures", "*.dds");
+ * for (i = dds; *i != NULL; i++)
+ *     printf("texture: [%s]\n", *i);
+ * PHYSFS_freeList(dds);
+ * \endcode
+ *
+ *    \param dir Directory, in platform-independent notation, to enumerate.
+ *    \param pattern Wildcard pattern to match filenames against.
+ *   \return Null-terminated array of null-terminated strings, or NULL on
+ *           error. Free it with PHYSFS_freeList().
+ *
+ * \sa PHYSFS_enumerateFilesPatternCallback
+ * \sa PHYSFS_enumerateFiles
+ */
+PHYSFS_DECL char **PHYSFS_enumerateFilesPattern(const char *dir,
+                                                const char *pattern);
+
+
+/**
+ * \enum PHYSFS_MountFlags
+ * \brief Flags that modify the behaviour of PHYSFS_mountWithFlags().
+ *
+ * Combine these with bitwise OR, or pass zero for the defaults.
+ *
+ * \sa PHYSFS_mountWithFlags
+ */
+typedef enum PHYSFS_MountFlags
+{
+    PHYSFS_MOUNT_IGNORE_CASE = (1 << 0) /**< Look up names in a directory
+                                             case-insensitively. */
+} PHYSFS_MountFlags;
+
+/**
+ * \fn int PHYSFS_mountWithFlags(const char *newDir, const char *mountPoint, int appendToPath, PHYSFS_uint32 flags)
+ * \brief Add an archive or directory to the search path, with options.
+ *
+ * This is PHYSFS_mount(), plus (flags).
+ *
+ * PHYSFS_MOUNT_IGNORE_CASE makes a directory on a case-sensitive filesystem
+ *  behave like an archive does: "Textures/Wall.PNG" will find
+ *  "textures/wall.png". This is meant for content that was authored on a
+ *  case-insensitive system. PhysicsFS tries the name exactly as given
+ *  first, and only falls back to searching if that isn't there, so paths
+ *  that are already correct cost nothing extra. When a path has to be
+ *  searched for, each directory along the way is read once and remembered
+ *  until its modification time changes. If more than one file matches,
+ *  which one you get is undefined. Archives are always case-insensitive,
+ *  so this flag does nothing for them, and it doesn't apply to the write
+ *  directory.
+ *
+ * If (newDir) is already in the search path, this succeeds without
+ *  changing anything, including its flags.
+ *
+ *   \param newDir directory or archive to add to the path, in
+ *                   platform-dependent notation.
+ *   \param mountPoint Location in the interpolated tree that this archive
+ *                     will be "mounted", in platform-independent notation.
+ *                     NULL or "" is equivalent to "/".
+ *   \param appendToPath nonzero to append to search path, zero to prepend.
+ *   \param flags Zero or more PHYSFS_MountFlags values, OR'd together.
+ *  \return nonzero if added to path, zero on failure (bogus archive, dir
+ *                   missing, etc). Specifics of the error can be
+ *                   gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_mount
+ */
+PHYSFS_DECL int PHYSFS_mountWithFlags(const char *newDir,
+                                      const char *mountPoint,
+                                      int appendToPath,
+                                      PHYSFS_uint32 flags);
+
+
+/**
+ * \enum PHYSFS_MemoryCategory
+ * \brief What PhysicsFS is holding memory for.
+ *
+ * \sa PHYSFS_MemoryStats
+ * \sa PHYSFS_getMemoryStats
+ */
+typedef enum PHYSFS_MemoryCategory
+{
+    PHYSFS_MEMORY_OTHER,    /**< Search path, strings, lists, etc. */
+    PHYSFS_MEMORY_INDEX,    /**< Tables an archive builds when mounted. */
+    PHYSFS_MEMORY_CACHE,    /**< Decompressed data and idle objects kept
+                                 for reuse. Can be dropped at any time. */
+    PHYSFS_MEMORY_HANDLES,  /**< Open files and their buffers. */
+    PHYSFS_MEMORY_CATEGORY_COUNT  /**< Not a category; array size. */
+} PHYSFS_MemoryCategory;
+
+/**
+ * \struct PHYSFS_MemoryStats
+ * \brief Bytes held by PhysicsFS, filled in by PHYSFS_getMemoryStats().
+ *
+ * These count what PhysicsFS asked its allocator for, not what the
+ *  allocator itself spends keeping track of it.
+ *
+ * \sa PHYSFS_getMemoryStats
+ */
+typedef struct PHYSFS_MemoryStats
+{
+    PHYSFS_uint64 total;  /**< Sum of everything in (bytes). */
+    PHYSFS_uint64 bytes[PHYSFS_MEMORY_CATEGORY_COUNT];  /**< Indexed by
+                                                   PHYSFS_MemoryCategory. */
+} PHYSFS_MemoryStats;
+
+/**
+ * \fn int PHYSFS_getMemoryStats(const char *archive, PHYSFS_MemoryStats *stats)
+ * \brief Find out how much memory PhysicsFS is using.
+ *
+ * With (archive) set to NULL, this reports everything PhysicsFS holds. With
+ *  (archive) set to something in the search path or the write dir, in the
+ *  same notation you passed to PHYSFS_mount() or PHYSFS_setWriteDir(), it
+ *  reports just the memory charged to that archive: its index, its caches,
+ *  and the files open in it.
+ *
+ * Memory is charged to an archive when it's allocated on that archive's
+ *  behalf. Some of it can't be pinned on any one archive (the search path
+ *  itself, lists you haven't freed, idle objects kept around for the next
+ *  open), so the per-archive figures don't add up to the total. On
+ *  platforms without thread-local storage, nothing is charged to individual
+ *  archives at all; they all report zero, and the total is still right.
+ *
+ * The totals include memory PhysicsFS allocated for your application, like
+ *  lists from PHYSFS_enumerateFiles() that you haven't freed yet, and
+ *  anything you allocated through PHYSFS_getAllocator().
+ *
+ *   \param archive NULL for everything, or an archive or directory that
+ *                  is mounted or is the write dir.
+ *   \param stats Filled in with the results.
+ *  \return nonzero on success, zero if (archive) isn't mounted. Specifics
+ *          of the error can be gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_setMemoryLimit
+ */
+PHYSFS_DECL int PHYSFS_getMemoryStats(const char *archive,
+                                      PHYSFS_MemoryStats *stats);
+
+/**
+ * \fn void PHYSFS_setMemoryLimit(PHYSFS_uint64 bytes)
+ * \brief Ask PhysicsFS to give back its caches past a certain size.
+ *
+ * Once PhysicsFS holds more than (bytes) in total, as reported by
+ *  PHYSFS_getMemoryStats(), it stops keeping idle objects around for reuse
+ *  and frees the ones it has. Archivers that cache decompressed data drop
+ *  their caches before building new ones, and read from the archive
+ *  instead of copying small files into memory.
+ *
+ * This is a soft limit. It only ever drops things PhysicsFS can get back
+ *  later at the cost of some speed. It never makes an allocation fail, so
+ *  the total can still go past (bytes) if that's what the archives and
+ *  open files need.
+ *
+ * The limit can be set at any time, even before PHYSFS_init(), and lasts
+ *  until you change it.
+ *
+ *   \param bytes The soft limit, or zero for no limit. The default is zero.
+ *
+ * \sa PHYSFS_getMemoryStats
+ */
+PHYSFS_DECL void PHYSFS_setMemoryLimit(PHYSFS_uint64 bytes);
+
+
+/**
+ * \enum PHYSFS_StatCounter
+ * \brief The counters in a PHYSFS_Stats.
+ *
+ * Times are in nanoseconds. Archivers only fill in the counters that make
+ *  sense for them; a directory never decompresses anything, for example.
+ *
+ * \sa PHYSFS_Stats
+ * \sa PHYSFS_getStats
+ */
+typedef enum PHYSFS_StatCounter
+{
+    PHYSFS_STAT_OPENS,          /**< Files opened for reading or writing. */
+    PHYSFS_STAT_OPEN_MISSES,    /**< Searched for a file to open and it
+                                     wasn't there. */
+    PHYSFS_STAT_BYTES_READ,     /**< Bytes read by the application. */
+    PHYSFS_STAT_BYTES_PHYSICAL, /**< Bytes read from the physical
+                                     filesystem. */
+    PHYSFS_STAT_BYTES_DECOMPRESSED, /**< Bytes decompressed. */
+    PHYSFS_STAT_BYTES_DECRYPTED,    /**< Bytes decrypted. */
+    PHYSFS_STAT_SEEKS,          /**< Seeks requested by the application. */
+    PHYSFS_STAT_SEEKS_REDECODE, /**< Seeks that had to decompress the file
+                                     again from the start. */
+    PHYSFS_STAT_LOOKUPS,        /**< Paths looked up in an archive's index. */
+    PHYSFS_STAT_LOOKUP_PROBES,  /**< Index entries looked at to find them. */
+    PHYSFS_STAT_CACHE_HITS,     /**< Found in a cache: verified paths,
+                                     decompressed blocks. */
+    PHYSFS_STAT_CACHE_MISSES,   /**< Had to do the work after all. */
+    PHYSFS_STAT_NS_DECOMPRESS,  /**< Time spent decompressing. */
+    PHYSFS_STAT_NS_DECRYPT,     /**< Time spent decrypting. */
+    PHYSFS_STAT_NS_SYSCALL,     /**< Time spent reading, writing and
+                                     seeking in the physical filesystem. */
+    PHYSFS_STAT_COUNT           /**< Not a counter; array size. */
+} PHYSFS_StatCounter;
+
+/**
+ * \struct PHYSFS_Stats
+ * \brief A snapshot of i/o counters, filled in by PHYSFS_getStats().
+ *
+ * \sa PHYSFS_getStats
+ * \sa PHYSFS_getArchiverStats
+ */
+typedef struct PHYSFS_Stats
+{
+    PHYSFS_uint64 counters[PHYSFS_STAT_COUNT];  /**< Indexed by
+                                                     PHYSFS_StatCounter. */
+} PHYSFS_Stats;
+
+/**
+ * \fn int PHYSFS_getStats(const char *archive, PHYSFS_Stats *stats)
+ * \brief Find out what PhysicsFS has been doing.
+ *
+ * PhysicsFS keeps a set of counters for everything in the search path and
+ *  the write dir: files opened, bytes read by you and bytes read from the
+ *  disk to get them, time spent decompressing and decrypting, and so on.
+ *  Comparing them tells you whether a slow load is waiting on the disk, on
+ *  decompression, or on finding files in the first place.
+ *
+ * With (archive) set to NULL, this reports the sum of everything since
+ *  PHYSFS_init(), including archives that have since been unmounted. With
+ *  (archive) set to something in the search path or the write dir, in the
+ *  same notation you passed to PHYSFS_mount() or PHYSFS_setWriteDir(), it
+ *  reports just that archive, since it was mounted.
+ *
+ * The counters only go up; take two snapshots and subtract to measure
+ *  something in particular. They're cheap enough to leave on all the time,
+ *  and safe to update from any number of threads, but a snapshot taken
+ *  while other threads are reading might be a few counts behind. The
+ *  PHYSFS_STAT_NS_* times are the exception: they cost two clock reads per
+ *  read, seek or decode, so they stay at zero unless you turn them on with
+ *  PHYSFS_setStatsTiming().
+ *
+ * Physical bytes and syscall time are only counted for archives that live
+ *  in the physical filesystem, and not for archives mounted with
+ *  PHYSFS_mountIo() or PHYSFS_mountMemory(). On platforms without
+ *  thread-local storage, they aren't charged to individual archives at all.
+ *
+ *   \param archive NULL for everything, or an archive or directory that
+ *                  is mounted or is the write dir.
+ *   \param stats Filled in with the counters.
+ *  \return nonzero on success, zero if (archive) isn't mounted. Specifics
+ *          of the error can be gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_getArchiverStats
+ * \sa PHYSFS_setStatsTiming
+ */
+PHYSFS_DECL int PHYSFS_getStats(const char *archive, PHYSFS_Stats *stats);
+
+/**
+ * \fn int PHYSFS_getArchiverStats(const char *ext, PHYSFS_Stats *stats)
+ * \brief Find out what one kind of archive has been doing.
+ *
+ * This is PHYSFS_getStats() for every archive of one type, mounted now or
+ *  unmounted since the archiver was registered. Use the extension from
+ *  the archiver's PHYSFS_ArchiveInfo ("ZIP", "7Z", ...), or "DIR" for plain
+ *  directories, the same names PHYSFS_setDefaultBufferForType() takes.
+ *  Case doesn't matter. "" is an error.
+ *
+ *   \param ext The archiver's file extension, without the '.'.
+ *   \param stats Filled in with the counters.
+ *  \return nonzero on success, zero if no archiver handles (ext).
+ *          Specifics of the error can be gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_getStats
+ * \sa PHYSFS_supportedArchiveTypes
+ */
+PHYSFS_DECL int PHYSFS_getArchiverStats(const char *ext, PHYSFS_Stats *stats);
+
+/**
+ * \fn void PHYSFS_setStatsTiming(int enable)
+ * \brief Turn the time counters in PHYSFS_Stats on or off.
+ *
+ * PHYSFS_STAT_NS_DECOMPRESS, PHYSFS_STAT_NS_DECRYPT and
+ *  PHYSFS_STAT_NS_SYSCALL need the clock read before and after every
+ *  operation they measure, which costs more than the rest of the counters
+ *  put together on small reads. So they're off until you ask for them, and
+ *  only count time spent while they're on. Everything else is always
+ *  counted.
+ *
+ * This can be called at any time, even before PHYSFS_init(), and lasts
+ *  until you change it.
+ *
+ *   \param enable nonzero to collect times, zero to stop. The default is
+ *                 zero.
+ *
+ * \sa PHYSFS_getStats
+ */
+PHYSFS_DECL void PHYSFS_setStatsTiming(int enable);
+
+
+/**
+ * \enum PHYSFS_TraceEventType
+ * \brief What a PHYSFS_TraceEvent is reporting.
+ *
+ * \sa PHYSFS_TraceEvent
+ * \sa PHYSFS_setTraceCallback
+ */
+typedef enum PHYSFS_TraceEventType
+{
+    PHYSFS_TRACE_MOUNT,    /**< An archive was mounted, or failed to be. */
+    PHYSFS_TRACE_UNMOUNT,  /**< An archive was unmounted. */
+    PHYSFS_TRACE_OPEN,     /**< A file was opened, or failed to be. */
+    PHYSFS_TRACE_READ,     /**< An archive read from a file. */
+    PHYSFS_TRACE_WRITE,    /**< An archive wrote to a file. */
+    PHYSFS_TRACE_SEEK,     /**< An archive seeked in a file. */
+    PHYSFS_TRACE_CLOSE     /**< A file was closed. */
+} PHYSFS_TraceEventType;
+
+/**
+ * \struct PHYSFS_TraceEvent
+ * \brief One operation, as reported to a PHYSFS_TraceCallback.
+ *
+ * Reads, writes and seeks are the ones PhysicsFS asks of the archive, under
+ *  any buffer set with PHYSFS_setBuffer(), so a lot of small reads from
+ *  the application can show up as a few big ones here.
+ *
+ * The strings are only good until the callback returns.
+ *
+ * \sa PHYSFS_setTraceCallback
+ */
+typedef struct PHYSFS_TraceEvent
+{
+    PHYSFS_TraceEventType type;  /**< What happened. */
+    PHYSFS_uint64 id;  /**< Tells open files apart; the same from OPEN to
+                            CLOSE, never reused. Zero for mounts. */
+    const char *path;  /**< The file, in platform-independent notation.
+                            For mounts, the mount point. */
+    const char *archive;  /**< The archive or directory (path) was found
+                               in, as it was passed to PHYSFS_mount().
+                               NULL if an open failed. */
+    PHYSFS_uint64 offset;  /**< Position in the file before a read or
+                                write, or where a seek went. */
+    PHYSFS_uint64 requested;  /**< Bytes asked for by a read or write. */
+    PHYSFS_sint64 result;  /**< Bytes read or written, -1 on error. For
+                                everything else, nonzero on success. */
+    PHYSFS_uint64 start;  /**< When it started, in nanoseconds. */
+    PHYSFS_uint64 end;  /**< When it finished, in nanoseconds. */
+} PHYSFS_TraceEvent;
+
+/**
+ * \typedef PHYSFS_TraceCallback
+ * \brief Function signature for callbacks that see every file operation.
+ *
+ * This is called on whatever thread did the work, sometimes with PhysicsFS's
+ *  locks held, so it must be quick and must not call back into PhysicsFS.
+ *  Calls are serialized: only one thread is ever inside (cb) at a time.
+ *
+ *    \param data The pointer you passed to PHYSFS_setTraceCallback().
+ *    \param event What just happened.
+ *
+ * \sa PHYSFS_setTraceCallback
+ */
+typedef void (*PHYSFS_TraceCallback)(void *data, const PHYSFS_TraceEvent *event);
+
+/**
+ * \fn void PHYSFS_setTraceCallback(PHYSFS_TraceCallback cb, void *data)
+ * \brief Watch every mount, open, read, seek and close as it happens.
+ *
+ * Once set, (cb) hears about mounts and unmounts, and about everything done
+ *  to files opened after this call: opens (including ones that found
+ *  nothing), reads, writes, seeks and closes, each with timestamps from a
+ *  monotonic clock. Files that were already open aren't traced.
+ *
+ * Tracing costs nothing when it's off, and setting (cb) to NULL turns it
+ *  off. It's safe to change while other threads are using PhysicsFS: this
+ *  waits for a call to the old callback in progress, so once it returns,
+ *  the old callback won't run again and its (data) can be freed.
+ *
+ *   \param cb The function to call, or NULL to stop tracing.
+ *   \param data An opaque pointer passed to (cb).
+ *
+ * \sa PHYSFS_TraceCallback
+ * \sa PHYSFS_traceToFile
+ */
+PHYSFS_DECL void PHYSFS_setTraceCallback(PHYSFS_TraceCallback cb, void *data);
+
+/**
+ * \fn int PHYSFS_traceToFile(const char *filename)
+ * \brief Trace everything into a file chrome://tracing can load.
+ *
+ * This sets a trace callback (see PHYSFS_setTraceCallback()) that writes
+ *  each event to (filename) in the Chrome trace-event JSON format. Load it
+ *  in chrome://tracing or Perfetto to see what every thread was waiting on.
+ *  Call it again with NULL to finish the file and stop tracing; this also
+ *  happens in PHYSFS_deinit(). Starting a new file finishes the old one.
+ *
+ * Don't call this while other threads are using PhysicsFS.
+ *
+ *   \param filename A file in platform-dependent notation, or NULL to stop.
+ *  \return nonzero on success, zero if the file couldn't be created.
+ *          Specifics of the error can be gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_setTraceCallback
+ */
+PHYSFS_DECL int PHYSFS_traceToFile(const char *filename);
+
+
 #ifndef SWIG  /* not available from scripting languages. */
 
 /**
@@ -3319,6 +3904,30 @@ PHYSFS_DECL void PHYSFS_setErrorCode(PHYSFS_ErrorCode code);
 PHYSFS_DECL const char *PHYSFS_getPrefDir(const char *org, const char *app);
 
 
+/**
+ * \struct PHYSFS_DataRange
+ * \brief Where a file's bytes sit in an archive.
+ *
+ * This is how a file is stored (compressed, encrypted, whatever): (len)
+ *  bytes at (offset) in (io). A PHYSFS_Archiver fills one in from its
+ *  locate() method, so PhysicsFS can ask the OS to start reading a file
+ *  in the background without opening it first.
+ *
+ * \sa PHYSFS_Archiver
+ * \sa PHYSFS_prefetchMany
+ */
+typedef struct PHYSFS_DataRange
+{
+    /**
+     * The Io the bytes are read through: usually the one your archive was
+     *  opened with. NULL if there isn't one, like a file kept in memory.
+     */
+    PHYSFS_Io *io;
+    PHYSFS_uint64 offset;  /**< Where the bytes start in (io). */
+    PHYSFS_uint64 len;  /**< How many bytes there are. */
+    int raw;  /**< Non-zero if those bytes are the file's contents as-is. */
+} PHYSFS_DataRange;
+
 /**
  * \struct PHYSFS_Archiver
  * \brief Abstract interface to provide support for user-defined archives.
@@ -3368,6 +3977,7 @@ PHYSFS_DECL const char *PHYSFS_getPrefDir(const char *org, const char *app);
  * \sa PHYSFS_deregisterArchiver
  * \sa PHYSFS_supportedArchiveTypes
  */
+
 typedef struct PHYSFS_Archiver
 {
 
@@ -3376,7 +3986,11 @@ typedef struct PHYSFS_Archiver
     /**
      * \brief Binary compatibility information.
      *
-     * This must be set to zero at this time. Future versions of this
+     * This should be set to 5. Set it to 4 if you don't provide
+     *  openArchiveWithFlags, to 3 if you don't provide
+     *  enumerateFilesWithStats either, to 2 if you don't provide locate,
+     *  to 1 if you don't provide enumerateFilesPrefix either, or to zero if
+     *  you don't provide walk either. Future versions of this
      *  struct will increment this field, so we know what a given
      *  implementation supports. We'll presumably keep supporting older
      *  versions as we offer new features, though.
@@ -3414,6 +4028,9 @@ typedef struct PHYSFS_Archiver
      * List all files in (dirname). Each file is passed to (cb),
      *  where a copy is made if appropriate, so you should dispose of
      *  it properly upon return from the callback.
+     * Pass each file's metadata to (cb) too, filled in as your stat()
+     *  method would, if you have it handy. Pass NULL if getting it would
+     *  be expensive; callers that need it will call stat() themselves.
      * If you have a failure, report as much as you can.
      *  (dirname) is in platform-independent notation.
      */
@@ -3495,6 +4112,76 @@ typedef struct PHYSFS_Archiver
      *  there are still files open from this archive.
      */
     void (*closeArchive)(void *opaque);
+
+    /**
+     * Recursively report everything under (dirname) to (cb), passing
+     *  (callbackdata) through. This field is only read if (version) is
+     *  at least 1, and may be NULL; PhysicsFS will walk the tree with
+     *  enumerateFiles() and stat() instead.
+     * Report a directory before anything inside it, and don't descend
+     *  into it if (cb) returns PHYSFS_WALK_SKIP_SUBTREE. Stop and return
+     *  zero as soon as (cb) returns PHYSFS_WALK_STOP.
+     * The (dir) you pass to (cb) is the containing directory in
+     *  platform-independent notation relative to the root of your
+     *  archive, "" for the root. (stat) must never be NULL.
+     * Return non-zero if you reached the end of the tree.
+     */
+    int (*walk)(void *opaque, const char *dirname, PHYSFS_WalkCallback cb,
+                void *callbackdata);
+
+    /**
+     * List the files in (dirname) whose names start with (prefix),
+     *  case-insensitively, just like enumerateFiles() does. This lets
+     *  archives with a sorted index jump straight to the matching range
+     *  for PHYSFS_enumerateFilesPattern(). This field is only read if
+     *  (version) is at least 2, and may be NULL; PhysicsFS will use
+     *  enumerateFiles() and filter the results instead.
+     * It's okay to report names that don't start with (prefix); everything
+     *  you report is matched against the full pattern before it goes
+     *  further. Just don't leave out any that do.
+     */
+    void (*enumerateFilesPrefix)(void *opaque, const char *dirname,
+                                 const char *prefix,
+                                 PHYSFS_EnumFilesCallback cb,
+                                 const char *origdir, void *callbackdata);
+
+    /**
+     * Fill in (range) with where file (name)'s bytes are, from your index,
+     *  without opening it; PHYSFS_prefetchMany() uses this to get the OS
+     *  reading ahead. The range may start a little before the data, if
+     *  that's all you know for sure yet. This field is only read if
+     *  (version) is at least 3, and may be NULL; PhysicsFS will open the
+     *  file and ask its Io instead.
+     * Return 1 if you filled in (range), -1 and call PHYSFS_setErrorCode()
+     *  if (name) isn't a file you have, or 0 if you can't tell without
+     *  opening it.
+     */
+    int (*locate)(void *opaque, const char *name, PHYSFS_DataRange *range);
+
+    /**
+     * List all files in (dirname), just like enumerateFiles(), but if
+     *  (withStats) is zero, (cb) only looks at each PHYSFS_Stat's filetype,
+     *  so you can skip the rest if it's expensive to get. If (withStats) is
+     *  non-zero, fill in everything, as your stat() method would.
+     *  This field is only read if (version) is at least 4, and may be NULL;
+     *  PhysicsFS will call enumerateFiles() instead.
+     */
+    void (*enumerateFilesWithStats)(void *opaque, const char *dirname,
+                                    PHYSFS_EnumFilesCallback cb,
+                                    int withStats, const char *origdir,
+                                    void *callbackdata);
+
+    /**
+     * Open an archive, just like openArchive(), but with the
+     *  PHYSFS_MountFlags that PHYSFS_mountWithFlags() was given in (flags),
+     *  or zero. Ignore any flags that don't mean anything to your
+     *  archives; PHYSFS_MOUNT_IGNORE_CASE, for example, only matters if
+     *  you'd otherwise look names up case-sensitively. This field is only
+     *  read if (version) is at least 5, and may be NULL; PhysicsFS will
+     *  call openArchive() instead.
+     */
+    void *(*openArchiveWithFlags)(PHYSFS_Io *io, const char *name,
+                                  int forWrite, PHYSFS_uint32 flags);
 } PHYSFS_Archiver;
 
 /**
@@ -3505,7 +4192,9 @@ typedef struct PHYSFS_Archiver
  *
  * You may not have two archivers that handle the same extension. If you are
  *  going to have a clash, you can deregister the other archiver (including
- *  built-in ones) with PHYSFS_deregisterArchiver().
+ *  built-in ones) with PHYSFS_deregisterArchiver(). "DIR" is taken, too:
+ *  that's what PHYSFS_getArchiverStats() and
+ *  PHYSFS_setDefaultBufferForType() call plain directories.
  *
  * The data in (archiver) is copied; you may free this pointer when this
  *  function returns.
@@ -3535,6 +4224,496 @@ PHYSFS_DECL int PHYSFS_registerArchiver(const PHYSFS_Archiver *archiver);
 PHYSFS_DECL int PHYSFS_deregisterArchiver(const char *ext);
 
 
+/**
+ * \struct PHYSFS_AsyncRequest
+ * \brief A read or open that's running on PhysicsFS's worker threads.
+ *
+ * You get one of these from PHYSFS_readAsync() or PHYSFS_openReadAsync(),
+ *  and give it back with PHYSFS_freeAsync() when you're done with it. The
+ *  contents are private.
+ *
+ * \sa PHYSFS_readAsync
+ * \sa PHYSFS_openReadAsync
+ * \sa PHYSFS_freeAsync
+ */
+typedef struct PHYSFS_AsyncRequest PHYSFS_AsyncRequest;
+
+/**
+ * \enum PHYSFS_AsyncStatus
+ * \brief Where a PHYSFS_AsyncRequest is in its life.
+ *
+ * \sa PHYSFS_pollAsync
+ * \sa PHYSFS_waitAsync
+ */
+typedef enum PHYSFS_AsyncStatus
+{
+    PHYSFS_ASYNC_PENDING,   /**< Queued; no thread has picked it up yet. */
+    PHYSFS_ASYNC_RUNNING,   /**< A thread is working on it, or its
+                                 callback hasn't returned yet. */
+    PHYSFS_ASYNC_DONE,      /**< Finished; see PHYSFS_getAsyncResult(). */
+    PHYSFS_ASYNC_FAILED,    /**< Finished; see PHYSFS_getAsyncError(). */
+    PHYSFS_ASYNC_CANCELLED  /**< PHYSFS_cancelAsync() got to it first. */
+} PHYSFS_AsyncStatus;
+
+/**
+ * \typedef PHYSFS_AsyncCallback
+ * \brief Function signature for hearing that a request is finished.
+ *
+ * This is called exactly once per request that has one, as soon as it's
+ *  DONE, FAILED or CANCELLED, usually on a PhysicsFS worker thread. Keep it
+ *  short; the worker isn't serving other requests while it runs. You can
+ *  call PhysicsFS from here, including PHYSFS_freeAsync() on (req), which
+ *  is the easiest way to fire and forget.
+ *
+ * Until the callback returns, other threads see (req) as still running, so
+ *  they don't free it out from under you.
+ *
+ *    \param data The pointer you passed when making the request.
+ *    \param req The request that finished.
+ *    \param status How it finished.
+ *
+ * \sa PHYSFS_readAsync
+ * \sa PHYSFS_openReadAsync
+ */
+typedef void (*PHYSFS_AsyncCallback)(void *data, PHYSFS_AsyncRequest *req,
+                                     PHYSFS_AsyncStatus status);
+
+/**
+ * \fn PHYSFS_AsyncRequest *PHYSFS_readAsync(PHYSFS_File *handle, PHYSFS_uint64 offset, void *buffer, PHYSFS_uint64 len, PHYSFS_AsyncCallback cb, void *data)
+ * \brief Read from a file without waiting for it.
+ *
+ * This queues a read of (len) bytes at (offset) in (handle), and returns
+ *  right away. A worker thread does the read, including any decompression
+ *  and decryption, and then calls (cb), if it isn't NULL. You can also
+ *  check on it with PHYSFS_pollAsync() or block with PHYSFS_waitAsync().
+ *
+ * Queued requests are picked up a batch at a time, one archive per batch,
+ *  and each batch is read in the order its data is laid out in the
+ *  archive, so a pile of small reads turns into something close to one
+ *  pass over the disk. Reads that follow on from each other in the same
+ *  file are served as one stream, without seeking in between. This means
+ *  requests don't necessarily finish in the order you made them.
+ *
+ * Requests on one file never run at the same time, but while any are
+ *  outstanding, (handle) belongs to the workers: don't read, seek or close
+ *  it until they're all finished, and expect its position to be anywhere
+ *  afterwards. (buffer) must stay valid until the request finishes, too.
+ *  Open the file more than once if you need to keep using it yourself.
+ *
+ *   \param handle A file opened for reading.
+ *   \param offset Where in the file to start reading.
+ *   \param buffer Where to put the bytes.
+ *   \param len How many bytes to read. Fewer are read at the end of file.
+ *   \param cb Called when the read is finished. Can be NULL.
+ *   \param data An opaque pointer passed to (cb).
+ *  \return A request to give to PHYSFS_freeAsync() eventually, or NULL if
+ *          it couldn't be queued. Specifics of the error can be gleaned
+ *          from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_setAsyncThreads
+ * \sa PHYSFS_getAsyncResult
+ */
+PHYSFS_DECL PHYSFS_AsyncRequest *PHYSFS_readAsync(PHYSFS_File *handle,
+                                                  PHYSFS_uint64 offset,
+                                                  void *buffer,
+                                                  PHYSFS_uint64 len,
+                                                  PHYSFS_AsyncCallback cb,
+                                                  void *data);
+
+/**
+ * \fn PHYSFS_AsyncRequest *PHYSFS_openReadAsync(const char *filename, PHYSFS_AsyncCallback cb, void *data)
+ * \brief Open a file for reading without waiting for it.
+ *
+ * This is PHYSFS_openRead() on a worker thread, which is worth it for
+ *  archives that do real work on open, like deriving keys for encrypted
+ *  ZIP entries. When it's finished, PHYSFS_getAsyncFile() has the file.
+ *
+ *   \param filename File to open, in platform-independent notation.
+ *   \param cb Called when the open is finished. Can be NULL.
+ *   \param data An opaque pointer passed to (cb).
+ *  \return A request to give to PHYSFS_freeAsync() eventually, or NULL if
+ *          it couldn't be queued. Specifics of the error can be gleaned
+ *          from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_getAsyncFile
+ */
+PHYSFS_DECL PHYSFS_AsyncRequest *PHYSFS_openReadAsync(const char *filename,
+                                                      PHYSFS_AsyncCallback cb,
+                                                      void *data);
+
+/**
+ * \fn PHYSFS_AsyncStatus PHYSFS_pollAsync(PHYSFS_AsyncRequest *req)
+ * \brief See how a request is doing, without waiting.
+ *
+ *   \param req The request to check.
+ *  \return Its status right now.
+ *
+ * \sa PHYSFS_waitAsync
+ */
+PHYSFS_DECL PHYSFS_AsyncStatus PHYSFS_pollAsync(PHYSFS_AsyncRequest *req);
+
+/**
+ * \fn PHYSFS_AsyncStatus PHYSFS_waitAsync(PHYSFS_AsyncRequest *req)
+ * \brief Wait for a request to finish.
+ *
+ * If no worker has picked (req) up yet, and nothing else is using its file,
+ *  the calling thread just does the work itself instead of waiting in line.
+ *  Either way, this returns after (req)'s callback has returned.
+ *
+ * Don't call this from the callback of a request that's reading the same
+ *  file as (req); it'll wait forever.
+ *
+ *   \param req The request to wait for.
+ *  \return How it finished: PHYSFS_ASYNC_DONE, PHYSFS_ASYNC_FAILED or
+ *           PHYSFS_ASYNC_CANCELLED.
+ *
+ * \sa PHYSFS_pollAsync
+ */
+PHYSFS_DECL PHYSFS_AsyncStatus PHYSFS_waitAsync(PHYSFS_AsyncRequest *req);
+
+/**
+ * \fn int PHYSFS_cancelAsync(PHYSFS_AsyncRequest *req)
+ * \brief Stop a request before it starts.
+ *
+ * Only requests that are still PHYSFS_ASYNC_PENDING can be cancelled. If
+ *  this works, the request's callback is called from here, with
+ *  PHYSFS_ASYNC_CANCELLED. You still have to free (req).
+ *
+ *   \param req The request to cancel.
+ *  \return nonzero if it was cancelled, zero if it had already started.
+ *
+ * \sa PHYSFS_freeAsync
+ */
+PHYSFS_DECL int PHYSFS_cancelAsync(PHYSFS_AsyncRequest *req);
+
+/**
+ * \fn PHYSFS_sint64 PHYSFS_getAsyncResult(PHYSFS_AsyncRequest *req)
+ * \brief What a finished request did.
+ *
+ *   \param req A finished request.
+ *  \return For reads, the number of bytes read, which is less than you
+ *           asked for at the end of the file. For opens, nonzero if the
+ *           file was opened. -1 if it failed, was cancelled, or isn't
+ *           finished.
+ *
+ * \sa PHYSFS_getAsyncError
+ */
+PHYSFS_DECL PHYSFS_sint64 PHYSFS_getAsyncResult(PHYSFS_AsyncRequest *req);
+
+/**
+ * \fn PHYSFS_ErrorCode PHYSFS_getAsyncError(PHYSFS_AsyncRequest *req)
+ * \brief Why a request failed.
+ *
+ * Errors on worker threads can't go to PHYSFS_getLastErrorCode(), so they
+ *  go here instead.
+ *
+ *   \param req A finished request.
+ *  \return PHYSFS_ERR_OK unless (req) is PHYSFS_ASYNC_FAILED.
+ */
+PHYSFS_DECL PHYSFS_ErrorCode PHYSFS_getAsyncError(PHYSFS_AsyncRequest *req);
+
+/**
+ * \fn PHYSFS_File *PHYSFS_getAsyncFile(PHYSFS_AsyncRequest *req)
+ * \brief Take the file a PHYSFS_openReadAsync() request opened.
+ *
+ * The file is yours after this, to close with PHYSFS_close(). If you free
+ *  the request without taking it, the file is closed for you.
+ *
+ *   \param req A finished open request.
+ *  \return The file, or NULL if (req) didn't open one or it was already
+ *           taken.
+ */
+PHYSFS_DECL PHYSFS_File *PHYSFS_getAsyncFile(PHYSFS_AsyncRequest *req);
+
+/**
+ * \fn void PHYSFS_freeAsync(PHYSFS_AsyncRequest *req)
+ * \brief Let go of a request.
+ *
+ * Every request has to be freed, whether it finished or not. A pending
+ *  request is dropped without running (and without its callback). One
+ *  that's already running is left to finish, and freed after its callback
+ *  returns; its buffer must stay valid until then. Don't use (req) after
+ *  this.
+ *
+ * PHYSFS_deinit() frees every request that's still around, after waiting
+ *  for the ones that are running.
+ *
+ *   \param req The request to free. NULL is ignored.
+ */
+PHYSFS_DECL void PHYSFS_freeAsync(PHYSFS_AsyncRequest *req);
+
+/**
+ * \fn int PHYSFS_setAsyncThreads(PHYSFS_uint32 count)
+ * \brief Choose how many worker threads do asynchronous requests.
+ *
+ * The default is 4. The threads aren't started until the first request,
+ *  and they sleep when there's nothing to do. Changing the count waits for
+ *  the current workers to finish what they're doing; queued requests carry
+ *  over to the new ones.
+ *
+ * With zero threads, or on platforms without them, requests run on the
+ *  calling thread before PHYSFS_readAsync() or PHYSFS_openReadAsync()
+ *  returns, callback and all.
+ *
+ *   \param count Number of worker threads, 64 at most.
+ *  \return nonzero on success, zero if (count) is too big. Specifics of
+ *          the error can be gleaned from PHYSFS_getLastError().
+ */
+PHYSFS_DECL int PHYSFS_setAsyncThreads(PHYSFS_uint32 count);
+
+/**
+ * \typedef PHYSFS_LoadCallback
+ * \brief Function signature for receiving files from PHYSFS_loadMany().
+ *
+ * This is called exactly once for each path given to PHYSFS_loadMany(),
+ *  whether it loaded or not. It's usually called on a PhysicsFS worker
+ *  thread, and several can be running at once, in no particular order, so
+ *  anything it touches needs its own locking.
+ *
+ * (buffer) belongs to PhysicsFS, and is freed when the callback returns;
+ *  copy what you want to keep.
+ *
+ *    \param data The pointer you passed to PHYSFS_loadMany().
+ *    \param index Where this file is in the list you passed.
+ *    \param fname The path, as it was in that list.
+ *    \param buffer The file's contents, or NULL if it failed.
+ *    \param len Bytes in (buffer), or -1 if it failed.
+ *    \param err Why it failed, or PHYSFS_ERR_OK.
+ *
+ * \sa PHYSFS_loadMany
+ */
+typedef void (*PHYSFS_LoadCallback)(void *data, PHYSFS_uint32 index,
+                                    const char *fname, const void *buffer,
+                                    PHYSFS_sint64 len, PHYSFS_ErrorCode err);
+
+/**
+ * \fn PHYSFS_uint32 PHYSFS_loadMany(const char * const *paths, PHYSFS_uint32 count, PHYSFS_LoadCallback cb, void *data)
+ * \brief Read a whole list of files as fast as possible.
+ *
+ * This is for loading a level's worth of small files at once. Rather than
+ *  reading them in the order you list them, PhysicsFS opens a few hundred
+ *  at a time, then reads each archive's files in the order they're stored, on
+ *  the worker threads (see PHYSFS_setAsyncThreads()). Files that sit next
+ *  to each other are read from the archive in one large read and handed out
+ *  from memory, and compressed files are decompressed in parallel. A pile of
+ *  scattered small reads becomes something close to one sequential pass
+ *  over each archive.
+ *
+ * Only so much is read ahead of the callbacks, so this doesn't need memory
+ *  for every file in the list at once.
+ *
+ * This returns when every file has been handed to (cb), or failed.
+ *
+ *   \param paths Files to load, in platform-independent notation.
+ *   \param count Number of paths in (paths).
+ *   \param cb Gets each file's contents. Must not be NULL.
+ *   \param data Passed to (cb) untouched.
+ *  \return The number of files that loaded. The callback gets the reason
+ *           for each that didn't.
+ *
+ * \sa PHYSFS_LoadCallback
+ * \sa PHYSFS_readAsync
+ */
+PHYSFS_DECL PHYSFS_uint32 PHYSFS_loadMany(const char * const *paths,
+                                          PHYSFS_uint32 count,
+                                          PHYSFS_LoadCallback cb, void *data);
+
+/**
+ * \enum PHYSFS_AccessHint
+ * \brief How a file is going to be read, for PHYSFS_setAccessHint().
+ *
+ * \sa PHYSFS_setAccessHint
+ * \sa PHYSFS_prefetch
+ */
+typedef enum PHYSFS_AccessHint
+{
+    PHYSFS_ACCESS_NORMAL,      /**< No idea; the default. */
+    PHYSFS_ACCESS_SEQUENTIAL,  /**< Start to finish. Read ahead more. */
+    PHYSFS_ACCESS_RANDOM,      /**< Jumping around. Don't read ahead. */
+    PHYSFS_ACCESS_WILLNEED,    /**< All of it, soon. Start reading now. */
+    PHYSFS_ACCESS_DONTNEED     /**< Done with it. Drop it from the cache. */
+} PHYSFS_AccessHint;
+
+/**
+ * \fn int PHYSFS_setAccessHint(PHYSFS_File *handle, PHYSFS_AccessHint hint)
+ * \brief Tell the OS how you're going to read an open file.
+ *
+ * This passes (hint) along for the bytes the file occupies on disk, which
+ *  for a file in an archive is its compressed data inside the archive, not
+ *  the whole archive. Where that's posix_fadvise(), SEQUENTIAL and RANDOM
+ *  change how far the OS reads ahead for this handle, WILLNEED starts
+ *  reading it into memory in the background, and DONTNEED lets the OS forget
+ *  it.
+ *
+ * It's only ever a hint. Files that aren't on disk (an archive in memory,
+ *  or inside another archive) and platforms that can't take hints succeed
+ *  without doing anything.
+ *
+ *   \param handle An open file.
+ *   \param hint How you'll use it.
+ *  \return nonzero on success, zero on error. Specifics of the error can be
+ *          gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_prefetch
+ */
+PHYSFS_DECL int PHYSFS_setAccessHint(PHYSFS_File *handle,
+                                     PHYSFS_AccessHint hint);
+
+/**
+ * \fn int PHYSFS_prefetch(const char *fname)
+ * \brief Start reading a file into memory before you need it.
+ *
+ * This finds (fname) in the search path and asks the OS to start reading
+ *  its bytes in the background, then returns without waiting. A later
+ *  PHYSFS_openRead() and read of it should find the data already in the
+ *  OS's cache. Compressed files are prefetched as they're stored; they're
+ *  still decompressed when you read them.
+ *
+ * Like PHYSFS_setAccessHint(), this is only a hint.
+ *
+ *   \param fname File to prefetch, in platform-independent notation.
+ *  \return nonzero if the file was found, zero otherwise. Specifics of the
+ *          error can be gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_prefetchMany
+ */
+PHYSFS_DECL int PHYSFS_prefetch(const char *fname);
+
+/**
+ * \fn PHYSFS_uint32 PHYSFS_prefetchMany(const char * const *paths, PHYSFS_uint32 count)
+ * \brief Start reading a list of files into memory before you need them.
+ *
+ * This is PHYSFS_prefetch() for a whole list, like the files for the next
+ *  level, but files that are near each other in an archive are asked for
+ *  together, as one range.
+ *
+ *   \param paths Files to prefetch, in platform-independent notation.
+ *   \param count Number of paths in (paths).
+ *  \return The number of files that were found. If that's not all of them,
+ *           PHYSFS_getLastError() has the last reason one wasn't.
+ *
+ * \sa PHYSFS_prefetch
+ * \sa PHYSFS_loadMany
+ */
+PHYSFS_DECL PHYSFS_uint32 PHYSFS_prefetchMany(const char * const *paths,
+                                              PHYSFS_uint32 count);
+
+/**
+ * \enum PHYSFS_BufferFlags
+ * \brief How a read buffer gets filled, for PHYSFS_setBufferMode().
+ *
+ * These are bits; OR them together.
+ *
+ * \sa PHYSFS_setBufferMode
+ */
+typedef enum PHYSFS_BufferFlags
+{
+    PHYSFS_BUFFER_ADAPTIVE = (1 << 0),  /**< Grow while reading straight through. */
+    PHYSFS_BUFFER_DOUBLE = (1 << 1)     /**< Read the next chunk in the background. */
+} PHYSFS_BufferFlags;
+
+/**
+ * \fn int PHYSFS_setBufferMode(PHYSFS_File *handle, PHYSFS_uint64 bufsize, PHYSFS_uint32 flags)
+ * \brief Set up a buffer that reads ahead on its own.
+ *
+ * This is PHYSFS_setBuffer(), plus some control over how the buffer is
+ *  refilled for files opened for reading. It's meant for code that does
+ *  lots of tiny reads, like a parser calling PHYSFS_readULE32() over and
+ *  over, so it gets bulk throughput without anyone tuning a buffer size.
+ *
+ * With PHYSFS_BUFFER_ADAPTIVE, the buffer starts at (bufsize) bytes and
+ *  doubles, up to a megabyte, as long as you keep draining it without
+ *  seeking. A seek that leaves the buffer shrinks it back to (bufsize), so
+ *  jumping around a file doesn't read a lot that you throw away. Calling
+ *  PHYSFS_setAccessHint() with PHYSFS_ACCESS_SEQUENTIAL makes it grow
+ *  sooner, and PHYSFS_ACCESS_RANDOM stops it growing.
+ *
+ * With PHYSFS_BUFFER_DOUBLE, every time the buffer is refilled, one of the
+ *  asynchronous i/o threads (see PHYSFS_setAsyncThreads()) starts reading
+ *  the next chunk into a second buffer, decompressing it if need be, while
+ *  you read out of the first. If there aren't any threads, this does
+ *  nothing. This uses twice the memory.
+ *
+ * A (bufsize) of zero with any flags set picks a small starting size. For
+ *  files opened for writing, (flags) are ignored. Zero for both removes the
+ *  buffer, like PHYSFS_setBuffer(handle, 0). Calling PHYSFS_setBuffer()
+ *  later turns these flags off.
+ *
+ *   \param handle handle returned from PHYSFS_open*().
+ *   \param bufsize size, in bytes, of buffer to start with.
+ *   \param flags Zero or more PHYSFS_BufferFlags, ORed together.
+ *  \return nonzero if successful, zero on error. Specifics of the error can
+ *          be gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_setBuffer
+ * \sa PHYSFS_setAccessHint
+ */
+PHYSFS_DECL int PHYSFS_setBufferMode(PHYSFS_File *handle,
+                                     PHYSFS_uint64 bufsize,
+                                     PHYSFS_uint32 flags);
+
+/**
+ * \fn int PHYSFS_setDefaultBuffer(PHYSFS_uint64 bufsize, PHYSFS_uint32 flags)
+ * \brief Buffer every file opened from now on.
+ *
+ * Files come out of PHYSFS_openRead(), PHYSFS_openWrite() and
+ *  PHYSFS_openAppend() unbuffered unless you say otherwise. This says
+ *  otherwise for all of them at once: each new file gets
+ *  PHYSFS_setBufferMode(file, bufsize, flags) before you see it. That's
+ *  handy when it's a library doing the opening, and it reads four bytes at
+ *  a time.
+ *
+ * Files already open keep what they have. PHYSFS_setDefaultBufferForType()
+ *  overrides this for some kinds of archive. If a buffer can't be set up,
+ *  the file opens anyhow, unbuffered. Zero for both turns this off, which is
+ *  how things start out after PHYSFS_init().
+ *
+ *   \param bufsize size, in bytes, of buffer each file starts with.
+ *   \param flags Zero or more PHYSFS_BufferFlags, ORed together.
+ *  \return nonzero if successful, zero on error. Specifics of the error can
+ *          be gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_setDefaultBufferForType
+ * \sa PHYSFS_setBufferMode
+ */
+PHYSFS_DECL int PHYSFS_setDefaultBuffer(PHYSFS_uint64 bufsize,
+                                        PHYSFS_uint32 flags);
+
+/**
+ * \fn int PHYSFS_setDefaultBufferForType(const char *type, PHYSFS_uint64 bufsize, PHYSFS_uint32 flags)
+ * \brief Buffer files opened from one kind of archive differently.
+ *
+ * This is PHYSFS_setDefaultBuffer(), but only for files that come out of
+ *  archives of (type), which is the extension an archiver reports in its
+ *  PHYSFS_ArchiveInfo, like "ZIP". There are two special ones: "DIR" for
+ *  real directories (and so every file opened for writing), and "MEMORY"
+ *  for anything mounted with PHYSFS_mountMemory(), which wins over the
+ *  archive's own type. Case doesn't matter. "" is an error; use "DIR", as
+ *  PHYSFS_getArchiverStats() does.
+ *
+ * For example, files in memory gain nothing from a buffer, but files on
+ *  disk read through a 64 kilobyte one make far fewer system calls:
+ *
+ * \code
+ * PHYSFS_setDefaultBufferForType("MEMORY", 0, 0);
+ * PHYSFS_setDefaultBufferForType("DIR", 64 * 1024, 0);
+ * \endcode
+ *
+ * Calling this again for the same (type) replaces what it had.
+ *
+ *   \param type Kind of archive this applies to.
+ *   \param bufsize size, in bytes, of buffer each file starts with.
+ *   \param flags Zero or more PHYSFS_BufferFlags, ORed together.
+ *  \return nonzero if successful, zero on error. Specifics of the error can
+ *          be gleaned from PHYSFS_getLastError().
+ *
+ * \sa PHYSFS_setDefaultBuffer
+ */
+PHYSFS_DECL int PHYSFS_setDefaultBufferForType(const char *type,
+                                               PHYSFS_uint64 bufsize,
+                                               PHYSFS_uint32 flags);
+
+
 /* Everything above this line is part of the PhysicsFS 2.1 API. */
 
 #ifdef __cplusplus
@@ -19,6 +19,7 @@
 /* The holy trinity. */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "physfs_platforms.h"
@@ -53,10 +54,33 @@ extern "C" {
 #   define inline __inline
 #endif
 
+/*
+ * Storage class for per-thread variables, if the compiler has one. Code
+ *  that uses this needs a fallback for when it isn't defined. Define
+ *  PHYSFS_NO_THREAD_LOCAL to force that fallback.
+ */
+#if (defined PHYSFS_NO_THREAD_LOCAL) || (defined PHYSFS_PLATFORM_BEOS)
+    /* leave it undefined. */
+#elif (defined PHYSFS_NO_THREAD_SUPPORT)
+#   define __PHYSFS_THREAD_LOCAL  /* only one thread, so a plain static. */
+#elif (defined __STDC_VERSION__) && (__STDC_VERSION__ >= 201112L)
+#   define __PHYSFS_THREAD_LOCAL _Thread_local
+#elif (defined _MSC_VER)
+#   define __PHYSFS_THREAD_LOCAL __declspec(thread)
+#elif (defined __GNUC__) || (defined __clang__)
+#   define __PHYSFS_THREAD_LOCAL __thread
+#endif
+
 #if PHYSFS_PLATFORM_LINUX && !defined(_FILE_OFFSET_BITS)
 #define _FILE_OFFSET_BITS 64
 #endif
 
+/* openat() and friends; see __PHYSFS_platformOpenDirHandle(). */
+#if (defined PHYSFS_PLATFORM_POSIX) && (!defined PHYSFS_PLATFORM_BEOS) && \
+    (!defined PHYSFS_NO_DIRHANDLES)
+#define PHYSFS_HAVE_DIRHANDLES 1
+#endif
+
 /*
  * Interface for small allocations. If you need a little scratch space for
  *  a throwaway buffer or string, use this. It will make small allocations
@@ -125,7 +149,7 @@ void __PHYSFS_smallFree(void *ptr);
 #define CURRENT_PHYSFS_IO_API_VERSION 0
 
 /* The latest supported PHYSFS_Archiver::version value. */
-#define CURRENT_PHYSFS_ARCHIVER_API_VERSION 0
+#define CURRENT_PHYSFS_ARCHIVER_API_VERSION 5
 
 /* This byteorder stuff was lifted from SDL. https://www.libsdl.org/ */
 #define PHYSFS_LIL_ENDIAN  1234
@@ -254,9 +278,45 @@ char *__PHYSFS_strdup(const char *str);
 
 /*
  * Give a hash value for a C string (uses djb's xor hashing algorithm).
+ *  The hash is case-insensitive, consistent with __PHYSFS_utf8stricmp():
+ *  strings that compare equal there will hash to the same value here.
+ *  (len) is in bytes; hashing stops early at a null char.
  */
 PHYSFS_uint32 __PHYSFS_hashString(const char *str, size_t len);
 
+/*
+ * A filename wildcard pattern, compiled once so it can be matched against
+ *  lots of names. '*' matches any run of characters, '?' matches exactly
+ *  one, and everything else matches case-insensitively, exactly the way
+ *  __PHYSFS_utf8stricmp() would compare it: a codepoint at a time, so a
+ *  "character" is one codepoint, and one that case-folds to several
+ *  (U+FB05 to "st") doesn't match those several separately.
+ *  (prefix) is the literal text before the first wildcard; every name that
+ *  matches starts with it, so sorted indexes can jump straight there.
+ */
+typedef struct __PHYSFS_Pattern
+{
+    const char *prefix;  /* points into our own copy; null-terminated. */
+    size_t prefixlen;  /* in bytes. */
+    PHYSFS_uint32 prefixchars;  /* in codepoints, for __PHYSFS_utf8strnicmp(). */
+    int literal;  /* non-zero if there are no wildcards at all. */
+    PHYSFS_uint32 count;  /* elements in (folded). */
+    PHYSFS_uint32 (*folded)[3];  /* case-folded pattern, or a wildcard marker. */
+} __PHYSFS_Pattern;
+
+/*
+ * Compile (pattern) for __PHYSFS_matchPattern(). Returns NULL and sets the
+ *  error state if we're out of memory. Free it with __PHYSFS_freePattern().
+ */
+__PHYSFS_Pattern *__PHYSFS_compilePattern(const char *pattern);
+
+/*
+ * Returns non-zero if all of (str) matches (pattern).
+ */
+int __PHYSFS_matchPattern(const __PHYSFS_Pattern *pattern, const char *str);
+
+void __PHYSFS_freePattern(__PHYSFS_Pattern *pattern);
+
 
 /*
  * The current allocator. Not valid before PHYSFS_init is called!
@@ -266,6 +326,86 @@ extern PHYSFS_Allocator __PHYSFS_AllocatorHooks;
 /* convenience macro to make this less cumbersome internally... */
 #define allocator __PHYSFS_AllocatorHooks
 
+/*
+ * A pool of same-sized objects, for things that get allocated and freed on
+ *  every file open and close. Freed objects are kept on a list and handed
+ *  out again, up to (maxfree) of them; past that, they really go back to
+ *  the allocator. Everything still sitting in a pool is freed during
+ *  PHYSFS_deinit(). Pools are meant to be static, set up with
+ *  __PHYSFS_POOL_INIT(). They're safe to use from any thread.
+ */
+typedef struct __PHYSFS_Pool
+{
+    size_t size;
+    PHYSFS_uint32 maxfree;
+    PHYSFS_uint32 freecount;
+    void *freelist;
+    int registered;  /* non-zero if it's in the list deinit drains. */
+    struct __PHYSFS_Pool *next;
+} __PHYSFS_Pool;
+
+#define __PHYSFS_POOL_INIT(objsize, maxfree) { objsize, maxfree, 0, NULL, 0, NULL }
+
+void *__PHYSFS_poolAlloc(__PHYSFS_Pool *pool);
+void __PHYSFS_poolFree(__PHYSFS_Pool *pool, void *ptr);
+
+/* For PHYSFS_Io structs, which every kind of open creates at least one of. */
+extern __PHYSFS_Pool __PHYSFS_ioPool;
+
+/*
+ * Memory accounting. Everything (allocator) hands out is charged to an
+ *  account and a PHYSFS_MemoryCategory; each DirHandle has its own account,
+ *  and PHYSFS_getMemoryStats() reports on them. What gets charged where is
+ *  a per-thread setting: call __PHYSFS_memCharge() before allocating on an
+ *  archive's behalf and __PHYSFS_memRestore() after. The core does this
+ *  around openArchive and the open* methods, so archivers only need it for
+ *  memory they allocate at other times, like caches filled during a read.
+ *  Without thread-local storage, charges are ignored and everything lands
+ *  in PhysicsFS's own account.
+ */
+typedef struct __PHYSFS_MemAccount __PHYSFS_MemAccount;
+
+typedef struct __PHYSFS_MemCharge
+{
+    __PHYSFS_MemAccount *account;  /* NULL for PhysicsFS as a whole. */
+    PHYSFS_MemoryCategory category;
+} __PHYSFS_MemCharge;
+
+void __PHYSFS_memCharge(__PHYSFS_MemAccount *account,
+                        const PHYSFS_MemoryCategory category,
+                        __PHYSFS_MemCharge *prev);
+void __PHYSFS_memRestore(const __PHYSFS_MemCharge *prev);
+
+/* The account being charged right now; call it from openArchive. */
+__PHYSFS_MemAccount *__PHYSFS_memCurrentAccount(void);
+
+/* Non-zero if we're past PHYSFS_setMemoryLimit(); drop caches if you can. */
+int __PHYSFS_memOverLimit(void);
+
+/*
+ * I/O statistics, for PHYSFS_getStats(). Each DirHandle has a set of
+ *  counters, which __PHYSFS_statAdd() bumps from any thread without a lock;
+ *  (stats) can be NULL, which counts nothing. Archivers should hold on to
+ *  __PHYSFS_statsCurrent() from openArchive for their own counters. Native
+ *  Ios pick it up when they're created, and count physical bytes and
+ *  syscall time themselves, as does the core for opens, reads and seeks.
+ */
+typedef struct __PHYSFS_Stats __PHYSFS_Stats;
+void __PHYSFS_statAdd(__PHYSFS_Stats *stats, const PHYSFS_StatCounter which,
+                      const PHYSFS_uint64 n);
+__PHYSFS_Stats *__PHYSFS_statsCurrent(void);
+
+/*
+ * For the PHYSFS_STAT_NS_* counters: __PHYSFS_statTimeStart() before the
+ *  work, __PHYSFS_statAddTime() after. Unless PHYSFS_setStatsTiming() turned
+ *  timing on, the first returns zero without reading the clock, and the
+ *  second does nothing with a zero (start).
+ */
+PHYSFS_uint64 __PHYSFS_statTimeStart(void);
+void __PHYSFS_statAddTime(__PHYSFS_Stats *stats,
+                          const PHYSFS_StatCounter which,
+                          const PHYSFS_uint64 start);
+
 /*
  * Create a PHYSFS_Io for a file in the physical filesystem.
  *  This path is in platform-dependent notation. (mode) must be 'r', 'w', or
@@ -273,6 +413,16 @@ extern PHYSFS_Allocator __PHYSFS_AllocatorHooks;
  */
 PHYSFS_Io *__PHYSFS_createNativeIo(const char *path, const int mode);
 
+#if PHYSFS_HAVE_DIRHANDLES
+/*
+ * Same as __PHYSFS_createNativeIo(), but (path) is relative to (dirhandle),
+ *  from __PHYSFS_platformOpenDirHandle(). The Io uses (dirhandle) again if
+ *  it's duplicated, so it has to outlive the Io.
+ */
+PHYSFS_Io *__PHYSFS_createNativeIoAt(void *dirhandle, const char *path,
+                                     const int mode);
+#endif
+
 /*
  * Create a PHYSFS_Io for a buffer of memory (READ-ONLY). If you already
  *  have one of these, just use its duplicate() method, and it'll increment
@@ -309,6 +459,20 @@ PHYSFS_Io *UNPK_openAppend(void *opaque, const char *name);
 int UNPK_remove(void *opaque, const char *name);
 int UNPK_mkdir(void *opaque, const char *name);
 int UNPK_stat(void *opaque, const char *fn, PHYSFS_Stat *st);
+int UNPK_walk(void *opaque, const char *dname, PHYSFS_WalkCallback cb,
+              void *callbackdata);
+void UNPK_enumerateFilesPrefix(void *opaque, const char *dname,
+                               const char *prefix, PHYSFS_EnumFilesCallback cb,
+                               const char *origdir, void *callbackdata);
+int UNPK_dataRange(PHYSFS_Io *io, PHYSFS_DataRange *range);
+int UNPK_locate(void *opaque, const char *name, PHYSFS_DataRange *range);
+
+/*
+ * If (io) is a file opened by this archiver, fill in (range) and return
+ *  non-zero. Return zero for anyone else's Io.
+ */
+int __PHYSFS_ZIP_dataRange(PHYSFS_Io *io, PHYSFS_DataRange *range);
+int __PHYSFS_ISO9660_dataRange(PHYSFS_Io *io, PHYSFS_DataRange *range);
 
 
 /*--------------------------------------------------------------------------*/
@@ -545,6 +709,12 @@ char *__PHYSFS_platformCalcPrefDir(const char *org, const char *app);
  */
 void *__PHYSFS_platformGetThreadID(void);
 
+/*
+ * Return a count of nanoseconds from some arbitrary starting point that
+ *  never goes backwards. Only differences between two calls mean anything.
+ */
+PHYSFS_uint64 __PHYSFS_platformGetTicks(void);
+
 
 /*
  * Enumerate a directory of files. This follows the rules for the
@@ -553,10 +723,13 @@ void *__PHYSFS_platformGetThreadID(void);
  *  platform-DEPENDENT notation by the caller. The PHYSFS_Archiver version
  *  uses platform-independent notation. Note that ".", "..", and other
  *  meta-entries should always be ignored.
+ *
+ * If (withStats) is zero, the callback's PHYSFS_Stat only needs a correct
+ *  filetype; don't go out of your way to fill in the rest.
  */
 void __PHYSFS_platformEnumerateFiles(const char *dirname,
                                      PHYSFS_EnumFilesCallback callback,
-                                     const char *origdir,
+                                     int withStats, const char *origdir,
                                      void *callbackdata);
 
 /*
@@ -581,6 +754,51 @@ int __PHYSFS_platformMkDir(const char *path);
 int __PHYSFS_platformDelete(const char *path);
 
 
+/*
+ * Platforms that can resolve paths relative to an open directory define
+ *  PHYSFS_HAVE_DIRHANDLES and implement the functions below. The DIR
+ *  archiver opens its root once at mount time and does everything else
+ *  relative to that, so the kernel doesn't walk the whole base path on
+ *  every call, and a mount stays on the same directory even if something
+ *  renames one of its parents. Everywhere else, it builds full paths.
+ *  (PHYSFS_HAVE_DIRHANDLES is decided near the top of this file.)
+ */
+#if PHYSFS_HAVE_DIRHANDLES
+/*
+ * Open directory (dirname), in platform-dependent notation, as a base for
+ *  the *At() functions. Return NULL and set the error code on failure.
+ */
+void *__PHYSFS_platformOpenDirHandle(const char *dirname);
+
+/*
+ * Close a handle from __PHYSFS_platformOpenDirHandle().
+ */
+void __PHYSFS_platformCloseDirHandle(void *dirhandle);
+
+/*
+ * These are __PHYSFS_platformOpenRead(), etc, except that (filename) is
+ *  relative to (dirhandle). For all the *At() functions, a relative path
+ *  of "" means (dirhandle) itself. The returned handle is used with the
+ *  usual __PHYSFS_platformRead(), __PHYSFS_platformClose(), etc.
+ */
+void *__PHYSFS_platformOpenReadAt(void *dirhandle, const char *filename);
+void *__PHYSFS_platformOpenWriteAt(void *dirhandle, const char *filename);
+void *__PHYSFS_platformOpenAppendAt(void *dirhandle, const char *filename);
+
+/*
+ * These follow the rules of __PHYSFS_platformStat(), etc, but take a path
+ *  relative to (dirhandle).
+ */
+int __PHYSFS_platformStatAt(void *dirhandle, const char *fn, PHYSFS_Stat *st);
+void __PHYSFS_platformEnumerateFilesAt(void *dirhandle, const char *dirname,
+                                       PHYSFS_EnumFilesCallback callback,
+                                       int withStats, const char *origdir,
+                                       void *callbackdata);
+int __PHYSFS_platformMkDirAt(void *dirhandle, const char *path);
+int __PHYSFS_platformDeleteAt(void *dirhandle, const char *path);
+#endif
+
+
 /*
  * Create a platform-specific mutex. This can be whatever datatype your
  *  platform uses for mutexes, but it is cast to a (void *) for abstractness.
@@ -627,6 +845,95 @@ int __PHYSFS_platformGrabMutex(void *mutex);
  */
 void __PHYSFS_platformReleaseMutex(void *mutex);
 
+/*
+ * Create a counting semaphore with an initial count of (count). This is what
+ *  PhysicsFS's worker threads sleep on while they wait for work.
+ *
+ * Return (NULL) if you couldn't create one. Systems without threads can
+ *  return any arbitrary non-NULL value; nothing will wait on it.
+ */
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count);
+
+/*
+ * Destroy a semaphore from __PHYSFS_platformCreateSemaphore(). Nothing is
+ *  waiting on it when this is called.
+ */
+void __PHYSFS_platformDestroySemaphore(void *sem);
+
+/*
+ * Block until (sem)'s count is above zero, then decrement it. Return zero
+ *  only on a major system error, not a timeout; there isn't one.
+ */
+int __PHYSFS_platformWaitSemaphore(void *sem);
+
+/*
+ * Increment (sem)'s count, waking up one thread waiting on it, if any.
+ */
+void __PHYSFS_platformPostSemaphore(void *sem);
+
+/*
+ * Start a new thread running (fn)(data), and return a handle for
+ *  __PHYSFS_platformJoinThread(). The thread needs no more than a modest
+ *  stack; it decompresses, but doesn't recurse.
+ *
+ * Return (NULL) if you can't, or if the platform has no threads; callers
+ *  fall back to doing the work themselves.
+ */
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data);
+
+/*
+ * Wait for a thread from __PHYSFS_platformCreateThread() to return from its
+ *  function, and free anything associated with it.
+ */
+void __PHYSFS_platformJoinThread(void *thread);
+
+/*
+ * One read for __PHYSFS_platformReadBatch(): (len) bytes at (offset) in
+ *  (handle), from __PHYSFS_platformOpenRead(), into (buffer). (result) gets
+ *  the number of bytes read, or -1 if it failed.
+ */
+typedef struct __PHYSFS_PlatformRead
+{
+    void *handle;
+    PHYSFS_uint64 offset;
+    void *buffer;
+    PHYSFS_uint64 len;
+    PHYSFS_sint64 result;
+} __PHYSFS_PlatformRead;
+
+/*
+ * Create a queue for __PHYSFS_platformReadBatch() that keeps up to (depth)
+ *  reads in flight at once. Each async worker makes its own, so it's only
+ *  ever used by one thread at a time.
+ *
+ * Return (NULL) if the platform can't do better than one read after another;
+ *  this isn't an error, and callers read the usual way instead.
+ */
+void *__PHYSFS_platformCreateReadQueue(PHYSFS_uint32 depth);
+
+/*
+ * Do all (count) of (reads) through (queue), in any order, and return when
+ *  they're all finished. The handles' file positions aren't used and don't
+ *  change. Return zero if the queue itself failed; then the (result) fields
+ *  are meaningless and the caller reads the usual way.
+ */
+int __PHYSFS_platformReadBatch(void *queue, __PHYSFS_PlatformRead *reads,
+                               PHYSFS_uint32 count);
+
+/*
+ * Destroy a queue from __PHYSFS_platformCreateReadQueue().
+ */
+void __PHYSFS_platformDestroyReadQueue(void *queue);
+
+/*
+ * Pass (hint) to the OS for (len) bytes at (offset) in (opaque), a handle
+ *  from __PHYSFS_platformOpenRead(). It's only a hint: if the platform can't
+ *  take it, do nothing and return non-zero. Return zero only if the OS said
+ *  the request itself was bad, like a closed handle.
+ */
+int __PHYSFS_platformAdvise(void *opaque, PHYSFS_uint64 offset,
+                            PHYSFS_uint64 len, PHYSFS_AccessHint hint);
+
 /*
  * Called at the start of PHYSFS_init() to prepare the allocator, if the user
  *  hasn't selected their own allocator via PHYSFS_setAllocator().
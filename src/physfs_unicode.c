@@ -444,6 +444,27 @@ static void locate_case_fold_mapping(const PHYSFS_uint32 from,
 } /* locate_case_fold_mapping */
 
 
+/*
+ * Every case-insensitive comparison goes through here, a codepoint at a
+ *  time: one that folds to several (U+FB05, an "st" ligature, folds to "st")
+ *  equals another that folds to the same several (U+FB06), but never the
+ *  separate codepoints ("st"). __PHYSFS_matchPattern() relies on that.
+ */
+static void fold_codepoint(const PHYSFS_uint32 cp, PHYSFS_uint32 *folded)
+{
+    if (cp < 0x80)  /* low ASCII fast path; only A-Z fold here. */
+    {
+        folded[0] = ((cp >= 'A') && (cp <= 'Z')) ? (cp + 32) : cp;
+        folded[1] = 0;
+        folded[2] = 0;
+    } /* if */
+    else
+    {
+        locate_case_fold_mapping(cp, folded);
+    } /* else */
+} /* fold_codepoint */
+
+
 static int utf8codepointcmp(const PHYSFS_uint32 cp1, const PHYSFS_uint32 cp2)
 {
     PHYSFS_uint32 folded1[3], folded2[3];
@@ -451,8 +472,8 @@ static int utf8codepointcmp(const PHYSFS_uint32 cp1, const PHYSFS_uint32 cp2)
     if (cp1 == cp2)
         return 0;  /* obviously matches. */
 
-    locate_case_fold_mapping(cp1, folded1);
-    locate_case_fold_mapping(cp2, folded2);
+    fold_codepoint(cp1, folded1);
+    fold_codepoint(cp2, folded2);
 
     if (folded1[0] < folded2[0])
         return -1;
@@ -506,6 +527,169 @@ int __PHYSFS_utf8strnicmp(const char *str1, const char *str2, PHYSFS_uint32 n)
 } /* __PHYSFS_utf8strnicmp */
 
 
+/*
+ * This hashes the case-folded codepoints, so two strings that
+ *  __PHYSFS_utf8stricmp() considers equal always land in the same bucket.
+ */
+PHYSFS_uint32 __PHYSFS_hashString(const char *str, size_t len)
+{
+    const char *end = str + len;
+    PHYSFS_uint32 hash = 5381;
+
+    while (str < end)
+    {
+        const PHYSFS_uint8 ch = (PHYSFS_uint8) *str;
+        if (ch < 0x80)  /* low ASCII fast path; only A-Z fold here. */
+        {
+            if (ch == 0)
+                break;
+            str++;
+            hash = ((hash << 5) + hash) ^ (((ch >= 'A') && (ch <= 'Z')) ? (ch+32) : ch);
+        } /* if */
+        else
+        {
+            PHYSFS_uint32 folded[3];
+            const PHYSFS_uint32 cp = utf8codepoint(&str);
+            if (cp == 0)
+                break;
+            locate_case_fold_mapping(cp, folded);
+            hash = ((hash << 5) + hash) ^ folded[0];
+            if (folded[1])
+            {
+                hash = ((hash << 5) + hash) ^ folded[1];
+                if (folded[2])
+                    hash = ((hash << 5) + hash) ^ folded[2];
+            } /* if */
+        } /* else */
+    } /* while */
+
+    return hash;
+} /* __PHYSFS_hashString */
+
+
+/* markers in __PHYSFS_Pattern::folded; neither is a valid codepoint. */
+#define PATTERN_ANY_RUN 0xFFFFFFFE  /* '*' */
+#define PATTERN_ANY_CHAR 0xFFFFFFFD  /* '?' */
+
+__PHYSFS_Pattern *__PHYSFS_compilePattern(const char *pattern)
+{
+    const size_t len = strlen(pattern);
+    const char *ptr = pattern;
+    __PHYSFS_Pattern *retval;
+    PHYSFS_uint32 count = 0;
+    char *prefix;
+
+    /* one block: the struct, the folded codepoints, then the prefix. */
+    retval = (__PHYSFS_Pattern *) allocator.Malloc(sizeof (__PHYSFS_Pattern)
+                                + (len * sizeof (retval->folded[0])) + len + 1);
+    BAIL_IF_MACRO(!retval, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+
+    retval->folded = (PHYSFS_uint32 (*)[3]) (retval + 1);
+    prefix = (char *) (retval->folded + len);
+    retval->prefix = prefix;
+    retval->prefixlen = 0;
+    retval->prefixchars = 0;
+    retval->literal = 1;
+
+    while (*ptr)
+    {
+        const char *start = ptr;
+        const PHYSFS_uint32 cp = utf8codepoint(&ptr);
+        PHYSFS_uint32 *folded = retval->folded[count];
+
+        if (cp == '*')
+        {
+            retval->literal = 0;
+            if ((count > 0) && (retval->folded[count-1][0] == PATTERN_ANY_RUN))
+                continue;  /* "**" is the same as "*". */
+            folded[0] = PATTERN_ANY_RUN;
+        } /* if */
+        else if (cp == '?')
+        {
+            retval->literal = 0;
+            folded[0] = PATTERN_ANY_CHAR;
+        } /* else if */
+        else
+        {
+            fold_codepoint(cp, folded);
+            if (retval->literal)
+            {
+                memcpy(prefix + retval->prefixlen, start, ptr - start);
+                retval->prefixlen += (size_t) (ptr - start);
+                retval->prefixchars++;
+            } /* if */
+        } /* else */
+
+        count++;
+    } /* while */
+
+    prefix[retval->prefixlen] = '\0';
+    retval->count = count;
+    return retval;
+} /* __PHYSFS_compilePattern */
+
+
+int __PHYSFS_matchPattern(const __PHYSFS_Pattern *pattern, const char *str)
+{
+    const PHYSFS_uint32 (*pat)[3] = (const PHYSFS_uint32 (*)[3]) pattern->folded;
+    const PHYSFS_uint32 (*end)[3] = pat + pattern->count;
+    const PHYSFS_uint32 (*star)[3] = NULL;  /* just past the last '*'. */
+    const char *starstr = NULL;  /* where that '*' stopped eating. */
+
+    /* classic glob: on mismatch, let the last '*' eat one more char. */
+    while (*str)
+    {
+        const char *next = str;
+        const PHYSFS_uint32 cp = utf8codepoint(&next);
+
+        if ((pat < end) && ((*pat)[0] == PATTERN_ANY_RUN))
+        {
+            star = ++pat;
+            starstr = str;
+            continue;
+        } /* if */
+
+        else if (pat < end)
+        {
+            PHYSFS_uint32 folded[3];
+            if ((*pat)[0] == PATTERN_ANY_CHAR)
+            {
+                pat++;
+                str = next;
+                continue;
+            } /* if */
+
+            fold_codepoint(cp, folded);  /* just like utf8codepointcmp(). */
+            if ( (folded[0] == (*pat)[0]) && (folded[1] == (*pat)[1]) &&
+                 (folded[2] == (*pat)[2]) )
+            {
+                pat++;
+                str = next;
+                continue;
+            } /* if */
+        } /* else if */
+
+        if (star == NULL)
+            return 0;  /* mismatch, and no '*' to fall back on. */
+
+        pat = star;
+        utf8codepoint(&starstr);
+        str = starstr;
+    } /* while */
+
+    while ((pat < end) && ((*pat)[0] == PATTERN_ANY_RUN))
+        pat++;
+
+    return (pat == end);
+} /* __PHYSFS_matchPattern */
+
+
+void __PHYSFS_freePattern(__PHYSFS_Pattern *pattern)
+{
+    allocator.Free(pattern);
+} /* __PHYSFS_freePattern */
+
+
 int __PHYSFS_stricmpASCII(const char *str1, const char *str2)
 {
     while (1)
@@ -228,6 +228,74 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
 } /* __PHYSFS_platformReleaseMutex */
 
 
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count)
+{
+    sem_id sem = create_sem((int32) count, "PhysicsFS semaphore");
+    BAIL_IF_MACRO(sem < B_NO_ERROR, PHYSFS_ERR_OS_ERROR, NULL);
+    return (void *) ((size_t) sem + 1);  /* sem_id 0 is valid. */
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    delete_sem((sem_id) (((size_t) sem) - 1));
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+int __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    return (acquire_sem((sem_id) (((size_t) sem) - 1)) == B_NO_ERROR);
+} /* __PHYSFS_platformWaitSemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+    release_sem((sem_id) (((size_t) sem) - 1));
+} /* __PHYSFS_platformPostSemaphore */
+
+
+typedef struct
+{
+    thread_id thread;
+    void (*fn)(void *);
+    void *data;
+} BeThread;
+
+
+static int32 beThreadEntry(void *arg)
+{
+    BeThread *t = (BeThread *) arg;
+    t->fn(t->data);
+    return 0;
+} /* beThreadEntry */
+
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    BeThread *t = (BeThread *) allocator.Malloc(sizeof (BeThread));
+    BAIL_IF_MACRO(!t, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    t->fn = fn;
+    t->data = data;
+    t->thread = spawn_thread(beThreadEntry, "PhysicsFS worker",
+                             B_NORMAL_PRIORITY, t);
+    if ((t->thread < B_NO_ERROR) || (resume_thread(t->thread) != B_NO_ERROR))
+    {
+        allocator.Free(t);
+        BAIL_MACRO(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+    return (void *) t;
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformJoinThread(void *thread)
+{
+    BeThread *t = (BeThread *) thread;
+    status_t rc;
+    wait_for_thread(t->thread, &rc);
+    allocator.Free(t);
+} /* __PHYSFS_platformJoinThread */
+
+
 int __PHYSFS_platformSetDefaultAllocator(PHYSFS_Allocator *a)
 {
     return 0;  /* just use malloc() and friends. */
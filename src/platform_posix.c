@@ -24,10 +24,40 @@
 
 #if ((!defined PHYSFS_NO_THREAD_SUPPORT) && (!defined PHYSFS_PLATFORM_BEOS))
 #include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
 #endif
 
 #include "physfs_internal.h"
 
+#ifdef O_CLOEXEC
+#define PHYSFS_O_CLOEXEC O_CLOEXEC
+#else
+#define PHYSFS_O_CLOEXEC 0
+#endif
+
+/* Linux can list directories in bulk; see enumerateFd(). */
+#if (defined PHYSFS_PLATFORM_LINUX) && (!defined PHYSFS_NO_GETDENTS)
+#include <sys/syscall.h>
+#ifdef SYS_getdents64
+#define PHYSFS_HAVE_GETDENTS 1
+#ifndef PHYSFS_GETDENTS_BUFSIZE
+#define PHYSFS_GETDENTS_BUFSIZE (256 * 1024)
+#endif
+#endif
+#endif
+
+/* Linux can have a batch of reads in flight at once; see IoUring. */
+#if (defined PHYSFS_PLATFORM_LINUX) && (!defined PHYSFS_NO_IO_URING) && (defined PHYSFS_HAVE_LINUX_IO_URING_H)
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#if (defined __NR_io_uring_setup) && (defined __NR_io_uring_enter)
+#define PHYSFS_HAVE_IO_URING 1
+#endif
+#endif
+
 
 static PHYSFS_ErrorCode errcodeFromErrnoError(const int err)
 {
@@ -121,35 +151,232 @@ char *__PHYSFS_platformCalcUserDir(void)
 } /* __PHYSFS_platformCalcUserDir */
 
 
-void __PHYSFS_platformEnumerateFiles(const char *dirname,
-                                     PHYSFS_EnumFilesCallback callback,
-                                     const char *origdir,
-                                     void *callbackdata)
+static void statFromStatbuf(const struct stat *statbuf, PHYSFS_Stat *st)
 {
-    DIR *dir;
-    struct dirent *ent;
-    char *buf = NULL;
+    if (S_ISREG(statbuf->st_mode))
+    {
+        st->filetype = PHYSFS_FILETYPE_REGULAR;
+        st->filesize = statbuf->st_size;
+    } /* if */
 
-    errno = 0;
-    dir = opendir(dirname);
-    if (dir == NULL)
+    else if(S_ISDIR(statbuf->st_mode))
     {
-        allocator.Free(buf);
-        return;
+        st->filetype = PHYSFS_FILETYPE_DIRECTORY;
+        st->filesize = 0;
+    } /* else if */
+
+    else if(S_ISLNK(statbuf->st_mode))
+    {
+        st->filetype = PHYSFS_FILETYPE_SYMLINK;
+        st->filesize = 0;
+    } /* else if */
+
+    else
+    {
+        st->filetype = PHYSFS_FILETYPE_OTHER;
+        st->filesize = statbuf->st_size;
+    } /* else */
+
+    st->modtime = statbuf->st_mtime;
+    st->createtime = statbuf->st_ctime;
+    st->accesstime = statbuf->st_atime;
+} /* statFromStatbuf */
+
+
+/*
+ * Stat a directory entry relative to the open directory (dirfd), so the
+ *  kernel doesn't have to walk the whole path again for every file. That
+ *  costs a couple of syscalls per entry, so unless the caller wants the
+ *  full stat (withStats), or the listing didn't say what the entry is, we
+ *  just report the file type (dtype) the listing gave us for free.
+ *  Returns zero if we know nothing about the entry.
+ */
+static int statDirEntry(const int dirfd, const char *name, const int dtype,
+                        const int withStats, PHYSFS_Stat *st)
+{
+#ifdef AT_SYMLINK_NOFOLLOW
+    struct stat statbuf;
+#ifdef DT_UNKNOWN
+    if ((!withStats) && (dtype != DT_UNKNOWN))
+        ;  /* skip it; the dtype is enough. */
+    else
+#endif
+    if ((dirfd != -1) && (fstatat(dirfd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0))
+    {
+        statFromStatbuf(&statbuf, st);
+        /* !!! FIXME: maybe we should just report full permissions? */
+        st->readonly = (faccessat(dirfd, name, W_OK, 0) != 0);
+        return 1;
     } /* if */
+#endif
 
-    while ((ent = readdir(dir)) != NULL)
+#ifdef DT_UNKNOWN
+    if (dtype != DT_UNKNOWN)
     {
-        if (strcmp(ent->d_name, ".") == 0)
-            continue;
-        else if (strcmp(ent->d_name, "..") == 0)
-            continue;
+        switch (dtype)
+        {
+            case DT_REG: st->filetype = PHYSFS_FILETYPE_REGULAR; break;
+            case DT_DIR: st->filetype = PHYSFS_FILETYPE_DIRECTORY; break;
+            case DT_LNK: st->filetype = PHYSFS_FILETYPE_SYMLINK; break;
+            default: st->filetype = PHYSFS_FILETYPE_OTHER; break;
+        } /* switch */
+        st->filesize = -1;
+        st->modtime = st->createtime = st->accesstime = -1;
+        st->readonly = 0;  /* unknown; we'll find out if a write fails. */
+        return 1;
+    } /* if */
+#endif
 
-        callback(callbackdata, origdir, ent->d_name);
+    return 0;
+} /* statDirEntry */
+
+
+static inline int isDotOrDotDot(const char *name)
+{
+    return ( (name[0] == '.') &&
+             ((name[1] == '\0') || ((name[1] == '.') && (name[2] == '\0'))) );
+} /* isDotOrDotDot */
+
+
+static void reportDirEntry(const int dirfd, const char *name, const int dtype,
+                           PHYSFS_EnumFilesCallback callback, int withStats,
+                           const char *origdir, void *callbackdata)
+{
+    PHYSFS_Stat statbuf;
+    if (statDirEntry(dirfd, name, dtype, withStats, &statbuf))
+        callback(callbackdata, origdir, name, &statbuf);
+    else
+        callback(callbackdata, origdir, name, NULL);
+} /* reportDirEntry */
+
+
+/* report everything in (dir) to (callback), and close it. */
+static void enumerateDir(DIR *dir, PHYSFS_EnumFilesCallback callback,
+                         int withStats, const char *origdir,
+                         void *callbackdata)
+{
+#ifdef AT_SYMLINK_NOFOLLOW
+    const int fd = dirfd(dir);
+#else
+    const int fd = -1;
+#endif
+    struct dirent *ent;
+
+    while ((ent = readdir(dir)) != NULL)
+    {
+#ifdef DT_UNKNOWN
+        const int dtype = ent->d_type;
+#else
+        const int dtype = 0;
+#endif
+        if (!isDotOrDotDot(ent->d_name))
+        {
+            reportDirEntry(fd, ent->d_name, dtype, callback, withStats,
+                           origdir, callbackdata);
+        } /* if */
     } /* while */
 
-    allocator.Free(buf);
     closedir(dir);
+} /* enumerateDir */
+
+
+#if PHYSFS_HAVE_GETDENTS
+/*
+ * On Linux, we skip readdir() and pull entries straight from the kernel
+ *  with getdents64(), into a buffer much bigger than the one libc uses, so
+ *  huge directories take a fraction of the syscalls. The batching stops
+ *  there: PHYSFS_EnumFilesCallback takes one name at a time, so that's how
+ *  the entries in each buffer-full are reported. This is the kernel's
+ *  record layout; glibc only started exposing it in 2.30.
+ */
+typedef struct
+{
+    PHYSFS_uint64 d_ino;
+    PHYSFS_sint64 d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+} LinuxDirent64;
+
+/* report everything in directory (fd) to (callback), and close it. */
+static void enumerateFd(const int fd, PHYSFS_EnumFilesCallback callback,
+                        int withStats, const char *origdir,
+                        void *callbackdata)
+{
+    const size_t bufsize = PHYSFS_GETDENTS_BUFSIZE;
+    char *buf = (char *) allocator.Malloc(bufsize);
+    int nosys = 0;
+    long rc = -1;
+
+    if (buf != NULL)
+    {
+        while ((rc = syscall(SYS_getdents64, fd, buf, bufsize)) > 0)
+        {
+            long pos = 0;
+            while (pos < rc)
+            {
+                const LinuxDirent64 *ent = (const LinuxDirent64 *) (buf + pos);
+                pos += ent->d_reclen;
+                if (!isDotOrDotDot(ent->d_name))
+                {
+                    reportDirEntry(fd, ent->d_name, ent->d_type, callback,
+                                   withStats, origdir, callbackdata);
+                } /* if */
+            } /* while */
+        } /* while */
+
+        nosys = ((rc < 0) && (errno == ENOSYS));  /* before Free() stomps it. */
+        allocator.Free(buf);
+    } /* if */
+
+    /* no memory, or a kernel/sandbox without getdents64: use readdir(). */
+    if ((buf == NULL) || (nosys))
+    {
+        DIR *dir = fdopendir(fd);  /* (dir) owns (fd) from here on. */
+        if (dir != NULL)
+        {
+            enumerateDir(dir, callback, withStats, origdir, callbackdata);
+            return;
+        } /* if */
+    } /* if */
+
+    close(fd);
+} /* enumerateFd */
+
+#elif PHYSFS_HAVE_DIRHANDLES
+
+static void enumerateFd(const int fd, PHYSFS_EnumFilesCallback callback,
+                        int withStats, const char *origdir,
+                        void *callbackdata)
+{
+    DIR *dir = fdopendir(fd);  /* (dir) owns (fd) from here on. */
+    if (dir == NULL)
+        close(fd);
+    else
+        enumerateDir(dir, callback, withStats, origdir, callbackdata);
+} /* enumerateFd */
+
+#endif
+
+
+void __PHYSFS_platformEnumerateFiles(const char *dirname,
+                                     PHYSFS_EnumFilesCallback callback,
+                                     int withStats, const char *origdir,
+                                     void *callbackdata)
+{
+#if PHYSFS_HAVE_GETDENTS
+    int fd;
+    errno = 0;
+    fd = open(dirname, O_RDONLY | O_DIRECTORY | PHYSFS_O_CLOEXEC);
+    if (fd >= 0)
+        enumerateFd(fd, callback, withStats, origdir, callbackdata);
+#else
+    DIR *dir;
+    errno = 0;
+    dir = opendir(dirname);
+    if (dir != NULL)
+        enumerateDir(dir, callback, withStats, origdir, callbackdata);
+#endif
 } /* __PHYSFS_platformEnumerateFiles */
 
 
@@ -161,18 +388,13 @@ int __PHYSFS_platformMkDir(const char *path)
 } /* __PHYSFS_platformMkDir */
 
 
-static void *doOpen(const char *filename, int mode)
+/* every open file's fd lives in one of these. */
+static __PHYSFS_Pool fdPool = __PHYSFS_POOL_INIT(sizeof (int), 64);
+
+/* wrap a freshly-opened (fd) up as a platform file handle. */
+static void *handleFromFd(const int fd, const int appending)
 {
-    const int appending = (mode & O_APPEND);
-    int fd;
     int *retval;
-    errno = 0;
-
-    /* O_APPEND doesn't actually behave as we'd like. */
-    mode &= ~O_APPEND;
-
-    fd = open(filename, mode, S_IRUSR | S_IWUSR);
-    BAIL_IF_MACRO(fd < 0, errcodeFromErrno(), NULL);
 
     if (appending)
     {
@@ -184,15 +406,30 @@ static void *doOpen(const char *filename, int mode)
         } /* if */
     } /* if */
 
-    retval = (int *) allocator.Malloc(sizeof (int));
+    retval = (int *) __PHYSFS_poolAlloc(&fdPool);
     if (!retval)
     {
         close(fd);
-        BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+        BAIL_MACRO(ERRPASS, NULL);
     } /* if */
 
     *retval = fd;
     return ((void *) retval);
+} /* handleFromFd */
+
+
+static void *doOpen(const char *filename, int mode)
+{
+    const int appending = (mode & O_APPEND);
+    int fd;
+    errno = 0;
+
+    /* O_APPEND doesn't actually behave as we'd like. */
+    mode &= ~O_APPEND;
+
+    fd = open(filename, mode, S_IRUSR | S_IWUSR);
+    BAIL_IF_MACRO(fd < 0, errcodeFromErrno(), NULL);
+    return handleFromFd(fd, appending);
 } /* doOpen */
 
 
@@ -276,6 +513,49 @@ PHYSFS_sint64 __PHYSFS_platformFileLength(void *opaque)
 } /* __PHYSFS_platformFileLength */
 
 
+int __PHYSFS_platformAdvise(void *opaque, PHYSFS_uint64 offset,
+                            PHYSFS_uint64 len, PHYSFS_AccessHint hint)
+{
+    const int fd = *((int *) opaque);
+
+#if (defined POSIX_FADV_NORMAL)
+    int advice = POSIX_FADV_NORMAL;
+    int rc;
+
+    switch (hint)
+    {
+        case PHYSFS_ACCESS_NORMAL: advice = POSIX_FADV_NORMAL; break;
+        case PHYSFS_ACCESS_SEQUENTIAL: advice = POSIX_FADV_SEQUENTIAL; break;
+        case PHYSFS_ACCESS_RANDOM: advice = POSIX_FADV_RANDOM; break;
+        case PHYSFS_ACCESS_WILLNEED: advice = POSIX_FADV_WILLNEED; break;
+        case PHYSFS_ACCESS_DONTNEED: advice = POSIX_FADV_DONTNEED; break;
+    } /* switch */
+
+    /* it returns the error instead of setting errno. */
+    rc = posix_fadvise(fd, (off_t) offset, (off_t) len, advice);
+    BAIL_IF_MACRO(rc == EBADF, errcodeFromErrnoError(rc), 0);
+    return 1;  /* anything else means it can't take the hint here. */
+
+#elif (defined F_RDADVISE)  /* Mac OS X has its own way. */
+    if (hint == PHYSFS_ACCESS_WILLNEED)
+    {
+        struct radvisory ra;
+        ra.ra_offset = (off_t) offset;
+        ra.ra_count = (len > 0x7FFFFFFF) ? 0x7FFFFFFF : (int) len;
+        (void) fcntl(fd, F_RDADVISE, &ra);
+    } /* if */
+    else if (hint != PHYSFS_ACCESS_DONTNEED)
+    {
+        (void) fcntl(fd, F_RDAHEAD, (hint == PHYSFS_ACCESS_RANDOM) ? 0 : 1);
+    } /* else if */
+    return 1;
+
+#else
+    return 1;  /* nothing to tell. */
+#endif
+} /* __PHYSFS_platformAdvise */
+
+
 int __PHYSFS_platformFlush(void *opaque)
 {
     const int fd = *((int *) opaque);
@@ -289,10 +569,248 @@ void __PHYSFS_platformClose(void *opaque)
 {
     const int fd = *((int *) opaque);
     (void) close(fd);  /* we don't check this. You should have used flush! */
-    allocator.Free(opaque);
+    __PHYSFS_poolFree(&fdPool, opaque);
 } /* __PHYSFS_platformClose */
 
 
+#if PHYSFS_HAVE_IO_URING
+
+/*
+ * All we need from io_uring is to hand the kernel a batch of preads and
+ *  wait for them, so this talks to it directly instead of needing liburing.
+ *  Each queue belongs to one thread, and every batch is submitted and waited
+ *  on with the same io_uring_enter() call, so there's no polling and nothing
+ *  to lock.
+ */
+typedef struct
+{
+    int fd;
+    PHYSFS_uint32 entries;  /* size of the submission ring. */
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    struct io_uring_sqe *sqes;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+    struct iovec *iov;  /* one for each submission slot. */
+    void *sqRing;
+    size_t sqRingSize;
+    void *cqRing;  /* same mapping as (sqRing), if the kernel allows. */
+    size_t cqRingSize;
+    size_t sqesSize;
+    int broken;  /* the kernel refused a batch; stop trying. */
+} IoUring;
+
+/* the kernel won't do more than this in one read anyhow. */
+#define IO_URING_MAX_READ 0x7FFFF000
+
+static void destroyIoUring(IoUring *ring)
+{
+    if (ring->sqes != NULL)
+        munmap(ring->sqes, ring->sqesSize);
+    if ((ring->cqRing != NULL) && (ring->cqRing != ring->sqRing))
+        munmap(ring->cqRing, ring->cqRingSize);
+    if (ring->sqRing != NULL)
+        munmap(ring->sqRing, ring->sqRingSize);
+    if (ring->fd >= 0)
+        close(ring->fd);
+    allocator.Free(ring->iov);
+    allocator.Free(ring);
+} /* destroyIoUring */
+
+
+static void *mapIoUring(IoUring *ring, const size_t len, const off_t which)
+{
+    void *retval = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, which);
+    return (retval == MAP_FAILED) ? NULL : retval;
+} /* mapIoUring */
+
+
+void *__PHYSFS_platformCreateReadQueue(PHYSFS_uint32 depth)
+{
+    struct io_uring_params params;
+    IoUring *ring;
+    char *sq;
+    char *cq;
+    int single = 0;
+
+    ring = (IoUring *) allocator.Malloc(sizeof (IoUring));
+    BAIL_IF_MACRO(!ring, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    memset(ring, '\0', sizeof (IoUring));
+    memset(&params, '\0', sizeof (params));
+
+    /* ENOSYS, or EPERM from a sandbox: not an error, just no queue. */
+    ring->fd = (int) syscall(__NR_io_uring_setup, depth, &params);
+    if (ring->fd < 0)
+    {
+        allocator.Free(ring);
+        return NULL;
+    } /* if */
+
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + (params.sq_entries * sizeof (unsigned));
+    ring->cqRingSize = params.cq_off.cqes + (params.cq_entries * sizeof (struct io_uring_cqe));
+    ring->sqesSize = params.sq_entries * sizeof (struct io_uring_sqe);
+
+    #ifdef IORING_FEAT_SINGLE_MMAP
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        single = 1;
+        if (ring->cqRingSize > ring->sqRingSize)
+            ring->sqRingSize = ring->cqRingSize;
+        ring->cqRingSize = ring->sqRingSize;
+    } /* if */
+    #endif
+
+    ring->sqRing = mapIoUring(ring, ring->sqRingSize, IORING_OFF_SQ_RING);
+    if (ring->sqRing != NULL)
+    {
+        if (single)
+            ring->cqRing = ring->sqRing;
+        else
+            ring->cqRing = mapIoUring(ring, ring->cqRingSize, IORING_OFF_CQ_RING);
+    } /* if */
+
+    if (ring->cqRing != NULL)
+        ring->sqes = (struct io_uring_sqe *) mapIoUring(ring, ring->sqesSize, IORING_OFF_SQES);
+    if (ring->sqes != NULL)
+        ring->iov = (struct iovec *) allocator.Malloc(ring->entries * sizeof (struct iovec));
+
+    if (ring->iov == NULL)
+    {
+        destroyIoUring(ring);
+        return NULL;
+    } /* if */
+
+    sq = (char *) ring->sqRing;
+    cq = (char *) ring->cqRing;
+    ring->sqTail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sqMask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sqArray = (unsigned *) (sq + params.sq_off.array);
+    ring->cqHead = (unsigned *) (cq + params.cq_off.head);
+    ring->cqTail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cqMask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+    return ring;
+} /* __PHYSFS_platformCreateReadQueue */
+
+
+/* Submit (count) reads, no more than (ring->entries), and wait for them. */
+static int ioUringBatch(IoUring *ring, __PHYSFS_PlatformRead *reads,
+                        const PHYSFS_uint32 count)
+{
+    const unsigned sqMask = *ring->sqMask;
+    const unsigned cqMask = *ring->cqMask;
+    unsigned tail = *ring->sqTail;  /* nobody else writes this. */
+    PHYSFS_uint32 wanted = count;
+    PHYSFS_uint32 submitted = 0;
+    PHYSFS_uint32 reaped = 0;
+    PHYSFS_uint32 i;
+
+    for (i = 0; i < count; i++)
+    {
+        __PHYSFS_PlatformRead *r = &reads[i];
+        const unsigned slot = tail & sqMask;
+        struct io_uring_sqe *sqe = &ring->sqes[slot];
+        struct iovec *iov = &ring->iov[slot];
+
+        iov->iov_base = r->buffer;
+        iov->iov_len = (size_t) ((r->len > IO_URING_MAX_READ) ? IO_URING_MAX_READ : r->len);
+        memset(sqe, '\0', sizeof (*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = *((int *) r->handle);
+        sqe->off = r->offset;
+        sqe->addr = (PHYSFS_uint64) (size_t) iov;
+        sqe->len = 1;
+        sqe->user_data = i;
+        ring->sqArray[slot] = slot;
+        r->result = -1;
+        tail++;
+    } /* for */
+
+    __atomic_store_n(ring->sqTail, tail, __ATOMIC_RELEASE);
+
+    while (reaped < wanted)
+    {
+        unsigned head = *ring->cqHead;
+        const long rc = syscall(__NR_io_uring_enter, ring->fd,
+                                wanted - submitted, wanted - reaped,
+                                IORING_ENTER_GETEVENTS, NULL, 0);
+        if (rc < 0)
+        {
+            if ((errno == EINTR) || (errno == EAGAIN) || (errno == EBUSY))
+                continue;
+
+            /* don't return while the kernel might still fill buffers. */
+            ring->broken = 1;
+            wanted = submitted;
+            continue;
+        } /* if */
+
+        submitted += (PHYSFS_uint32) rc;
+        while (head != __atomic_load_n(ring->cqTail, __ATOMIC_ACQUIRE))
+        {
+            const struct io_uring_cqe *cqe = &ring->cqes[head & cqMask];
+            __PHYSFS_PlatformRead *r = &reads[cqe->user_data];
+            r->result = (cqe->res < 0) ? -1 : (PHYSFS_sint64) cqe->res;
+            head++;
+            reaped++;
+        } /* while */
+        __atomic_store_n(ring->cqHead, head, __ATOMIC_RELEASE);
+    } /* while */
+
+    return !ring->broken;
+} /* ioUringBatch */
+
+
+int __PHYSFS_platformReadBatch(void *queue, __PHYSFS_PlatformRead *reads,
+                               PHYSFS_uint32 count)
+{
+    IoUring *ring = (IoUring *) queue;
+
+    while ((count > 0) && (!ring->broken))
+    {
+        const PHYSFS_uint32 n = (count < ring->entries) ? count : ring->entries;
+        if (!ioUringBatch(ring, reads, n))
+            break;
+        reads += n;
+        count -= n;
+    } /* while */
+
+    return !ring->broken;
+} /* __PHYSFS_platformReadBatch */
+
+
+void __PHYSFS_platformDestroyReadQueue(void *queue)
+{
+    destroyIoUring((IoUring *) queue);
+} /* __PHYSFS_platformDestroyReadQueue */
+
+#else
+
+void *__PHYSFS_platformCreateReadQueue(PHYSFS_uint32 depth)
+{
+    return NULL;  /* just read() on each worker thread. */
+} /* __PHYSFS_platformCreateReadQueue */
+
+
+int __PHYSFS_platformReadBatch(void *queue, __PHYSFS_PlatformRead *reads,
+                               PHYSFS_uint32 count)
+{
+    BAIL_MACRO(PHYSFS_ERR_UNSUPPORTED, 0);  /* never created one. */
+} /* __PHYSFS_platformReadBatch */
+
+
+void __PHYSFS_platformDestroyReadQueue(void *queue)
+{
+} /* __PHYSFS_platformDestroyReadQueue */
+
+#endif  /* PHYSFS_HAVE_IO_URING */
+
+
 int __PHYSFS_platformDelete(const char *path)
 {
     BAIL_IF_MACRO(remove(path) == -1, errcodeFromErrno(), 0);
@@ -305,39 +823,172 @@ int __PHYSFS_platformStat(const char *filename, PHYSFS_Stat *st)
     struct stat statbuf;
 
     BAIL_IF_MACRO(lstat(filename, &statbuf) == -1, errcodeFromErrno(), 0);
+    statFromStatbuf(&statbuf, st);
 
-    if (S_ISREG(statbuf.st_mode))
+    /* !!! FIXME: maybe we should just report full permissions? */
+    st->readonly = access(filename, W_OK);
+    return 1;
+} /* __PHYSFS_platformStat */
+
+
+#if PHYSFS_HAVE_DIRHANDLES
+
+/* the *At() functions take "" for the directory itself. */
+static inline const char *atPath(const char *path)
+{
+    return (*path == '\0') ? "." : path;
+} /* atPath */
+
+
+void *__PHYSFS_platformOpenDirHandle(const char *dirname)
+{
+    int flags = O_RDONLY | O_DIRECTORY | PHYSFS_O_CLOEXEC;
+    int fd;
+    int *retval;
+
+#ifdef O_PATH
+    flags |= O_PATH;  /* we only ever resolve names from this. */
+#endif
+
+    errno = 0;
+    fd = open(dirname, flags);
+    BAIL_IF_MACRO(fd < 0, errcodeFromErrno(), NULL);
+
+    retval = (int *) allocator.Malloc(sizeof (int));
+    if (!retval)
     {
-        st->filetype = PHYSFS_FILETYPE_REGULAR;
-        st->filesize = statbuf.st_size;
+        close(fd);
+        BAIL_MACRO(PHYSFS_ERR_OUT_OF_MEMORY, NULL);
     } /* if */
 
-    else if(S_ISDIR(statbuf.st_mode))
-    {
-        st->filetype = PHYSFS_FILETYPE_DIRECTORY;
-        st->filesize = 0;
-    } /* else if */
+    *retval = fd;
+    return ((void *) retval);
+} /* __PHYSFS_platformOpenDirHandle */
 
-    else if(S_ISLNK(statbuf.st_mode))
-    {
-        st->filetype = PHYSFS_FILETYPE_SYMLINK;
-        st->filesize = 0;
-    } /* else if */
 
-    else
-    {
-        st->filetype = PHYSFS_FILETYPE_OTHER;
-        st->filesize = statbuf.st_size;
-    } /* else */
+void __PHYSFS_platformCloseDirHandle(void *dirhandle)
+{
+    (void) close(*((int *) dirhandle));
+    allocator.Free(dirhandle);
+} /* __PHYSFS_platformCloseDirHandle */
+
+
+static void *doOpenAt(void *dirhandle, const char *filename, int mode)
+{
+    const int dirfd = *((int *) dirhandle);
+    const int appending = (mode & O_APPEND);
+    int fd;
+    errno = 0;
+
+    /* O_APPEND doesn't actually behave as we'd like. */
+    mode &= ~O_APPEND;
+
+    fd = openat(dirfd, atPath(filename), mode | PHYSFS_O_CLOEXEC,
+                S_IRUSR | S_IWUSR);
+    BAIL_IF_MACRO(fd < 0, errcodeFromErrno(), NULL);
+    return handleFromFd(fd, appending);
+} /* doOpenAt */
+
+
+void *__PHYSFS_platformOpenReadAt(void *dirhandle, const char *filename)
+{
+    return doOpenAt(dirhandle, filename, O_RDONLY);
+} /* __PHYSFS_platformOpenReadAt */
 
-    st->modtime = statbuf.st_mtime;
-    st->createtime = statbuf.st_ctime;
-    st->accesstime = statbuf.st_atime;
+
+void *__PHYSFS_platformOpenWriteAt(void *dirhandle, const char *filename)
+{
+    return doOpenAt(dirhandle, filename, O_WRONLY | O_CREAT | O_TRUNC);
+} /* __PHYSFS_platformOpenWriteAt */
+
+
+void *__PHYSFS_platformOpenAppendAt(void *dirhandle, const char *filename)
+{
+    return doOpenAt(dirhandle, filename, O_WRONLY | O_CREAT | O_APPEND);
+} /* __PHYSFS_platformOpenAppendAt */
+
+
+int __PHYSFS_platformStatAt(void *dirhandle, const char *fn, PHYSFS_Stat *st)
+{
+    const int dirfd = *((int *) dirhandle);
+    const char *path = atPath(fn);
+    struct stat statbuf;
+
+    if (fstatat(dirfd, path, &statbuf, AT_SYMLINK_NOFOLLOW) == -1)
+        BAIL_MACRO(errcodeFromErrno(), 0);
+    statFromStatbuf(&statbuf, st);
 
     /* !!! FIXME: maybe we should just report full permissions? */
-    st->readonly = access(filename, W_OK);
+    st->readonly = (faccessat(dirfd, path, W_OK, 0) != 0);
     return 1;
-} /* __PHYSFS_platformStat */
+} /* __PHYSFS_platformStatAt */
+
+
+void __PHYSFS_platformEnumerateFilesAt(void *dirhandle, const char *dirname,
+                                       PHYSFS_EnumFilesCallback callback,
+                                       int withStats, const char *origdir,
+                                       void *callbackdata)
+{
+    const int dirfd = *((int *) dirhandle);
+    const int flags = O_RDONLY | O_DIRECTORY | PHYSFS_O_CLOEXEC;
+    int fd;
+
+    errno = 0;
+    fd = openat(dirfd, atPath(dirname), flags);
+    if (fd >= 0)
+        enumerateFd(fd, callback, withStats, origdir, callbackdata);
+} /* __PHYSFS_platformEnumerateFilesAt */
+
+
+int __PHYSFS_platformMkDirAt(void *dirhandle, const char *path)
+{
+    const int dirfd = *((int *) dirhandle);
+    const int rc = mkdirat(dirfd, atPath(path), S_IRWXU);
+    BAIL_IF_MACRO(rc == -1, errcodeFromErrno(), 0);
+    return 1;
+} /* __PHYSFS_platformMkDirAt */
+
+
+int __PHYSFS_platformDeleteAt(void *dirhandle, const char *path)
+{
+    const int dirfd = *((int *) dirhandle);
+    int err;
+
+    path = atPath(path);
+
+    /* this is what remove() does: try it as a file, then as a directory. */
+    if (unlinkat(dirfd, path, 0) == 0)
+        return 1;
+
+    err = errno;
+    if ((err == EISDIR) || (err == EPERM))  /* EPERM: some BSDs, Mac OS X. */
+    {
+        if (unlinkat(dirfd, path, AT_REMOVEDIR) == 0)
+            return 1;
+        else if (errno != ENOTDIR)
+            err = errno;
+    } /* if */
+
+    BAIL_MACRO(errcodeFromErrnoError(err), 0);
+} /* __PHYSFS_platformDeleteAt */
+
+#endif  /* PHYSFS_HAVE_DIRHANDLES */
+
+
+PHYSFS_uint64 __PHYSFS_platformGetTicks(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+        return (((PHYSFS_uint64) ts.tv_sec) * 1000000000) + ts.tv_nsec;
+#endif
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (((PHYSFS_uint64) tv.tv_sec) * 1000000000) +
+                (((PHYSFS_uint64) tv.tv_usec) * 1000);
+    }
+} /* __PHYSFS_platformGetTicks */
 
 
 #ifndef PHYSFS_PLATFORM_BEOS  /* BeOS has its own code in platform_beos.cpp */
@@ -348,6 +999,16 @@ void *__PHYSFS_platformCreateMutex(void) { return ((void *) 0x0001); }
 void __PHYSFS_platformDestroyMutex(void *mutex) {}
 int __PHYSFS_platformGrabMutex(void *mutex) { return 1; }
 void __PHYSFS_platformReleaseMutex(void *mutex) {}
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count) { return ((void *) 0x0001); }
+void __PHYSFS_platformDestroySemaphore(void *sem) {}
+int __PHYSFS_platformWaitSemaphore(void *sem) { return 1; }
+void __PHYSFS_platformPostSemaphore(void *sem) {}
+void __PHYSFS_platformJoinThread(void *thread) {}
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    BAIL_MACRO(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformCreateThread */
 
 #else
 
@@ -427,6 +1088,117 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
     } /* if */
 } /* __PHYSFS_platformReleaseMutex */
 
+
+/* Not sem_t: Mac OS X doesn't implement unnamed POSIX semaphores. */
+typedef struct
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    PHYSFS_uint32 count;
+} PthreadSemaphore;
+
+
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count)
+{
+    PthreadSemaphore *s;
+    s = (PthreadSemaphore *) allocator.Malloc(sizeof (PthreadSemaphore));
+    BAIL_IF_MACRO(!s, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    if (pthread_mutex_init(&s->mutex, NULL) != 0)
+    {
+        allocator.Free(s);
+        BAIL_MACRO(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+
+    if (pthread_cond_init(&s->cond, NULL) != 0)
+    {
+        pthread_mutex_destroy(&s->mutex);
+        allocator.Free(s);
+        BAIL_MACRO(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+
+    s->count = count;
+    return ((void *) s);
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    pthread_cond_destroy(&s->cond);
+    pthread_mutex_destroy(&s->mutex);
+    allocator.Free(s);
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+int __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    if (pthread_mutex_lock(&s->mutex) != 0)
+        return 0;
+
+    while (s->count == 0)
+    {
+        if (pthread_cond_wait(&s->cond, &s->mutex) != 0)
+        {
+            pthread_mutex_unlock(&s->mutex);
+            return 0;
+        } /* if */
+    } /* while */
+
+    s->count--;
+    pthread_mutex_unlock(&s->mutex);
+    return 1;
+} /* __PHYSFS_platformWaitSemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+    PthreadSemaphore *s = (PthreadSemaphore *) sem;
+    pthread_mutex_lock(&s->mutex);
+    s->count++;
+    pthread_cond_signal(&s->cond);
+    pthread_mutex_unlock(&s->mutex);
+} /* __PHYSFS_platformPostSemaphore */
+
+
+typedef struct
+{
+    pthread_t thread;
+    void (*fn)(void *);
+    void *data;
+} PthreadThread;
+
+
+static void *pthreadEntry(void *arg)
+{
+    PthreadThread *t = (PthreadThread *) arg;
+    t->fn(t->data);
+    return NULL;
+} /* pthreadEntry */
+
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    PthreadThread *t = (PthreadThread *) allocator.Malloc(sizeof (PthreadThread));
+    BAIL_IF_MACRO(!t, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    t->fn = fn;
+    t->data = data;
+    if (pthread_create(&t->thread, NULL, pthreadEntry, t) != 0)
+    {
+        allocator.Free(t);
+        BAIL_MACRO(PHYSFS_ERR_OS_ERROR, NULL);
+    } /* if */
+    return ((void *) t);
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformJoinThread(void *thread)
+{
+    PthreadThread *t = (PthreadThread *) thread;
+    pthread_join(t->thread, NULL);
+    allocator.Free(t);
+} /* __PHYSFS_platformJoinThread */
+
 #endif /* !PHYSFS_NO_THREAD_SUPPORT */
 #endif /* !PHYSFS_PLATFORM_BEOS */
 
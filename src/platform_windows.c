@@ -507,9 +507,26 @@ void *__PHYSFS_platformGetThreadID(void)
     return ( (void *) ((size_t) GetCurrentThreadId()) );
 } /* __PHYSFS_platformGetThreadID */
 
+
+PHYSFS_uint64 __PHYSFS_platformGetTicks(void)
+{
+    LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    PHYSFS_uint64 hz, ticks;
+    QueryPerformanceFrequency(&freq);  /* can't fail on XP and later. */
+    QueryPerformanceCounter(&now);
+    hz = (PHYSFS_uint64) freq.QuadPart;
+    ticks = (PHYSFS_uint64) now.QuadPart;
+    /* split it up so (ticks * 1000000000) can't overflow. */
+    return ((ticks / hz) * 1000000000) + (((ticks % hz) * 1000000000) / hz);
+} /* __PHYSFS_platformGetTicks */
+
+static void statFromAttributeData(const WIN32_FILE_ATTRIBUTE_DATA *winstat,
+                                  PHYSFS_Stat *st);
+
 void __PHYSFS_platformEnumerateFiles(const char *dirname,
                                      PHYSFS_EnumFilesCallback callback,
-                                     const char *origdir,
+                                     int withStats, const char *origdir,
                                      void *callbackdata)
 {
     HANDLE dir = INVALID_HANDLE_VALUE;
@@ -547,31 +564,34 @@ void __PHYSFS_platformEnumerateFiles(const char *dirname,
     if (dir == INVALID_HANDLE_VALUE)
         return;
 
-    int dirnameLen = strlen(dirname);
-    char *filePath = (char *)__PHYSFS_smallAlloc(dirnameLen + MAX_PATH + 2);
-    filePath[0] = 0;
-    strcat(filePath, dirname);
-    strcat(filePath, "\\");
+    (void) withStats;  /* the full stat costs us nothing here. */
+
     do
     {
         const WCHAR *fn = entw.cFileName;
+        WIN32_FILE_ATTRIBUTE_DATA winstat;
+        PHYSFS_Stat stat;
+        char *utf8;
 
         if ((fn[0] == '.') && (fn[1] == '\0')) continue;
         if ((fn[0] == '.') && (fn[1] == '.') && (fn[2] == '\0')) continue;
 
-        char *utf8 = unicodeToUtf8Heap(fn);
+        utf8 = unicodeToUtf8Heap(fn);
         if (utf8 == NULL) continue;
 
-        filePath[dirnameLen+1] = 0;
-        strcat(filePath, utf8);
-        PHYSFS_Stat stat = { -1, 0 };
-        if ((entw.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0) stat.filetype = PHYSFS_FILETYPE_REGULAR;
-        else stat.filetype = PHYSFS_FILETYPE_DIRECTORY;
+        /* FindNextFile already gave us everything stat would. */
+        winstat.dwFileAttributes = entw.dwFileAttributes;
+        winstat.ftCreationTime = entw.ftCreationTime;
+        winstat.ftLastAccessTime = entw.ftLastAccessTime;
+        winstat.ftLastWriteTime = entw.ftLastWriteTime;
+        winstat.nFileSizeHigh = entw.nFileSizeHigh;
+        winstat.nFileSizeLow = entw.nFileSizeLow;
+        statFromAttributeData(&winstat, &stat);
+
         callback(callbackdata, origdir, utf8, &stat);
         allocator.Free(utf8);
     } while (FindNextFileW(dir, &entw) != 0);
 
-    __PHYSFS_smallFree(filePath);
     FindClose(dir);
 } /* __PHYSFS_platformEnumerateFiles */
 
@@ -791,6 +811,14 @@ PHYSFS_sint64 __PHYSFS_platformFileLength(void *opaque)
 } /* __PHYSFS_platformFileLength */
 
 
+int __PHYSFS_platformAdvise(void *opaque, PHYSFS_uint64 offset,
+                            PHYSFS_uint64 len, PHYSFS_AccessHint hint)
+{
+    /* !!! FIXME: FILE_FLAG_SEQUENTIAL_SCAN/RANDOM_ACCESS are open-time only. */
+    return 1;
+} /* __PHYSFS_platformAdvise */
+
+
 int __PHYSFS_platformFlush(void *opaque)
 {
     WinApiFile *fh = ((WinApiFile *) opaque);
@@ -860,6 +888,93 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
 } /* __PHYSFS_platformReleaseMutex */
 
 
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count)
+{
+    HANDLE sem = CreateSemaphoreW(NULL, (LONG) count, 0x7FFFFFFF, NULL);
+    BAIL_IF_MACRO(sem == NULL, errcodeFromWinApi(), NULL);
+    return (void *) sem;
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+    CloseHandle((HANDLE) sem);
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+int __PHYSFS_platformWaitSemaphore(void *sem)
+{
+    return (WaitForSingleObject((HANDLE) sem, INFINITE) == WAIT_OBJECT_0);
+} /* __PHYSFS_platformWaitSemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+    ReleaseSemaphore((HANDLE) sem, 1, NULL);
+} /* __PHYSFS_platformPostSemaphore */
+
+
+typedef struct
+{
+    HANDLE thread;
+    void (*fn)(void *);
+    void *data;
+} WinApiThread;
+
+
+static DWORD WINAPI winApiThreadEntry(LPVOID arg)
+{
+    WinApiThread *t = (WinApiThread *) arg;
+    t->fn(t->data);
+    return 0;
+} /* winApiThreadEntry */
+
+
+void *__PHYSFS_platformCreateThread(void (*fn)(void *), void *data)
+{
+    WinApiThread *t = (WinApiThread *) allocator.Malloc(sizeof (WinApiThread));
+    BAIL_IF_MACRO(!t, PHYSFS_ERR_OUT_OF_MEMORY, NULL);
+    t->fn = fn;
+    t->data = data;
+    t->thread = CreateThread(NULL, 0, winApiThreadEntry, t, 0, NULL);
+    if (t->thread == NULL)
+    {
+        const PHYSFS_ErrorCode err = errcodeFromWinApi();
+        allocator.Free(t);
+        BAIL_MACRO(err, NULL);
+    } /* if */
+    return (void *) t;
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformJoinThread(void *thread)
+{
+    WinApiThread *t = (WinApiThread *) thread;
+    WaitForSingleObject(t->thread, INFINITE);
+    CloseHandle(t->thread);
+    allocator.Free(t);
+} /* __PHYSFS_platformJoinThread */
+
+
+/* !!! FIXME: overlapped reads, but our handles aren't FILE_FLAG_OVERLAPPED. */
+void *__PHYSFS_platformCreateReadQueue(PHYSFS_uint32 depth)
+{
+    return NULL;  /* just ReadFile() on each worker thread. */
+} /* __PHYSFS_platformCreateReadQueue */
+
+
+int __PHYSFS_platformReadBatch(void *queue, __PHYSFS_PlatformRead *reads,
+                               PHYSFS_uint32 count)
+{
+    BAIL_MACRO(PHYSFS_ERR_UNSUPPORTED, 0);  /* never created one. */
+} /* __PHYSFS_platformReadBatch */
+
+
+void __PHYSFS_platformDestroyReadQueue(void *queue)
+{
+} /* __PHYSFS_platformDestroyReadQueue */
+
+
 static PHYSFS_sint64 FileTimeToPhysfsTime(const FILETIME *ft)
 {
 #ifndef _XBOX_ONE
@@ -898,31 +1013,20 @@ static PHYSFS_sint64 FileTimeToPhysfsTime(const FILETIME *ft)
 } /* FileTimeToPhysfsTime */
 
 
-int __PHYSFS_platformStat(const char *filename, PHYSFS_Stat *st)
+static void statFromAttributeData(const WIN32_FILE_ATTRIBUTE_DATA *winstat,
+                                  PHYSFS_Stat *st)
 {
-    WIN32_FILE_ATTRIBUTE_DATA winstat;
-    WCHAR *wstr = NULL;
-    DWORD err = 0;
-    BOOL rc = 0;
+    st->modtime = FileTimeToPhysfsTime(&winstat->ftLastWriteTime);
+    st->accesstime = FileTimeToPhysfsTime(&winstat->ftLastAccessTime);
+    st->createtime = FileTimeToPhysfsTime(&winstat->ftCreationTime);
 
-    UTF8_TO_UNICODE_STACK_MACRO(wstr, filename);
-    BAIL_IF_MACRO(!wstr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
-    rc = GetFileAttributesExW(wstr, GetFileExInfoStandard, &winstat);
-    err = (!rc) ? GetLastError() : 0;
-    __PHYSFS_smallFree(wstr);
-    BAIL_IF_MACRO(!rc, errcodeFromWinApiError(err), 0);
-
-    st->modtime = FileTimeToPhysfsTime(&winstat.ftLastWriteTime);
-    st->accesstime = FileTimeToPhysfsTime(&winstat.ftLastAccessTime);
-    st->createtime = FileTimeToPhysfsTime(&winstat.ftCreationTime);
-
-    if(winstat.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+    if(winstat->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
     {
         st->filetype = PHYSFS_FILETYPE_DIRECTORY;
         st->filesize = 0;
     } /* if */
 
-    else if(winstat.dwFileAttributes & (FILE_ATTRIBUTE_OFFLINE | FILE_ATTRIBUTE_DEVICE))
+    else if(winstat->dwFileAttributes & (FILE_ATTRIBUTE_OFFLINE | FILE_ATTRIBUTE_DEVICE))
     {
         /* !!! FIXME: what are reparse points? */
         st->filetype = PHYSFS_FILETYPE_OTHER;
@@ -935,11 +1039,28 @@ int __PHYSFS_platformStat(const char *filename, PHYSFS_Stat *st)
     else
     {
         st->filetype = PHYSFS_FILETYPE_REGULAR;
-        st->filesize = (((PHYSFS_uint64) winstat.nFileSizeHigh) << 32) | winstat.nFileSizeLow;
+        st->filesize = (((PHYSFS_uint64) winstat->nFileSizeHigh) << 32) | winstat->nFileSizeLow;
     } /* else */
 
-    st->readonly = ((winstat.dwFileAttributes & FILE_ATTRIBUTE_READONLY) != 0);
+    st->readonly = ((winstat->dwFileAttributes & FILE_ATTRIBUTE_READONLY) != 0);
+} /* statFromAttributeData */
+
+
+int __PHYSFS_platformStat(const char *filename, PHYSFS_Stat *st)
+{
+    WIN32_FILE_ATTRIBUTE_DATA winstat;
+    WCHAR *wstr = NULL;
+    DWORD err = 0;
+    BOOL rc = 0;
+
+    UTF8_TO_UNICODE_STACK_MACRO(wstr, filename);
+    BAIL_IF_MACRO(!wstr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+    rc = GetFileAttributesExW(wstr, GetFileExInfoStandard, &winstat);
+    err = (!rc) ? GetLastError() : 0;
+    __PHYSFS_smallFree(wstr);
+    BAIL_IF_MACRO(!rc, errcodeFromWinApiError(err), 0);
 
+    statFromAttributeData(&winstat, st);
     return 1;
 } /* __PHYSFS_platformStat */
 
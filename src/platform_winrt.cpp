@@ -237,6 +237,18 @@ void *__PHYSFS_platformGetThreadID(void)
 } /* __PHYSFS_platformGetThreadID */
 
 
+PHYSFS_uint64 __PHYSFS_platformGetTicks(void)
+{
+	LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	const PHYSFS_uint64 hz = (PHYSFS_uint64)freq.QuadPart;
+	const PHYSFS_uint64 ticks = (PHYSFS_uint64)now.QuadPart;
+	return ((ticks / hz) * 1000000000) + (((ticks % hz) * 1000000000) / hz);
+} /* __PHYSFS_platformGetTicks */
+
+
 static int isSymlinkAttrs(const DWORD attr, const DWORD tag)
 {
 	return ((attr & FILE_ATTRIBUTE_REPARSE_POINT) &&
@@ -244,9 +256,12 @@ static int isSymlinkAttrs(const DWORD attr, const DWORD tag)
 } /* isSymlinkAttrs */
 
 
+static void statFromAttributeData(const WIN32_FILE_ATTRIBUTE_DATA *winstat,
+	PHYSFS_Stat *st);
+
 void __PHYSFS_platformEnumerateFiles(const char *dirname,
 	PHYSFS_EnumFilesCallback callback,
-	const char *origdir,
+	int withStats, const char *origdir,
 	void *callbackdata)
 {
 
@@ -286,6 +301,8 @@ void __PHYSFS_platformEnumerateFiles(const char *dirname,
 	if (dir == INVALID_HANDLE_VALUE)
 		return;
 
+	(void) withStats;  /* the full stat costs us nothing here. */
+
 	do
 	{
 		const DWORD attr = entw.dwFileAttributes;
@@ -301,7 +318,18 @@ void __PHYSFS_platformEnumerateFiles(const char *dirname,
 		utf8 = unicodeToUtf8Heap(fn);
 		if (utf8 != NULL)
 		{
-			callback(callbackdata, origdir, utf8);
+			/* FindNextFile already gave us everything stat would. */
+			WIN32_FILE_ATTRIBUTE_DATA winstat;
+			PHYSFS_Stat stat;
+			winstat.dwFileAttributes = attr;
+			winstat.ftCreationTime = entw.ftCreationTime;
+			winstat.ftLastAccessTime = entw.ftLastAccessTime;
+			winstat.ftLastWriteTime = entw.ftLastWriteTime;
+			winstat.nFileSizeHigh = entw.nFileSizeHigh;
+			winstat.nFileSizeLow = entw.nFileSizeLow;
+			statFromAttributeData(&winstat, &stat);
+
+			callback(callbackdata, origdir, utf8, &stat);
 			allocator.Free(utf8);
 		} /* if */
 	} while (FindNextFileW(dir, &entw) != 0);
@@ -509,6 +537,13 @@ PHYSFS_sint64 __PHYSFS_platformFileLength(void *opaque)
 } /* __PHYSFS_platformFileLength */
 
 
+int __PHYSFS_platformAdvise(void *opaque, PHYSFS_uint64 offset,
+	PHYSFS_uint64 len, PHYSFS_AccessHint hint)
+{
+	return 1;
+} /* __PHYSFS_platformAdvise */
+
+
 int __PHYSFS_platformFlush(void *opaque)
 {
 	WinApiFile *fh = ((WinApiFile *)opaque);
@@ -586,6 +621,62 @@ void __PHYSFS_platformReleaseMutex(void *mutex)
 } /* __PHYSFS_platformReleaseMutex */
 
 
+void *__PHYSFS_platformCreateSemaphore(PHYSFS_uint32 count)
+{
+	HANDLE sem = CreateSemaphoreExW(NULL, (LONG)count, 0x7FFFFFFF, NULL, 0, SEMAPHORE_ALL_ACCESS);
+	BAIL_IF_MACRO(sem == NULL, errcodeFromWinApi(), NULL);
+	return (void *)sem;
+} /* __PHYSFS_platformCreateSemaphore */
+
+
+void __PHYSFS_platformDestroySemaphore(void *sem)
+{
+	CloseHandle((HANDLE)sem);
+} /* __PHYSFS_platformDestroySemaphore */
+
+
+int __PHYSFS_platformWaitSemaphore(void *sem)
+{
+	return (WaitForSingleObjectEx((HANDLE)sem, INFINITE, FALSE) == WAIT_OBJECT_0);
+} /* __PHYSFS_platformWaitSemaphore */
+
+
+void __PHYSFS_platformPostSemaphore(void *sem)
+{
+	ReleaseSemaphore((HANDLE)sem, 1, NULL);
+} /* __PHYSFS_platformPostSemaphore */
+
+
+/* No CreateThread() here; async requests run on the caller's thread. */
+void *__PHYSFS_platformCreateThread(void(*fn)(void *), void *data)
+{
+	BAIL_MACRO(PHYSFS_ERR_UNSUPPORTED, NULL);
+} /* __PHYSFS_platformCreateThread */
+
+
+void __PHYSFS_platformJoinThread(void *thread)
+{
+} /* __PHYSFS_platformJoinThread */
+
+
+void *__PHYSFS_platformCreateReadQueue(PHYSFS_uint32 depth)
+{
+	return NULL;
+} /* __PHYSFS_platformCreateReadQueue */
+
+
+int __PHYSFS_platformReadBatch(void *queue, __PHYSFS_PlatformRead *reads,
+	PHYSFS_uint32 count)
+{
+	BAIL_MACRO(PHYSFS_ERR_UNSUPPORTED, 0);
+} /* __PHYSFS_platformReadBatch */
+
+
+void __PHYSFS_platformDestroyReadQueue(void *queue)
+{
+} /* __PHYSFS_platformDestroyReadQueue */
+
+
 static PHYSFS_sint64 FileTimeToPhysfsTime(const FILETIME *ft)
 {
 	SYSTEMTIME st_utc;
@@ -620,31 +711,20 @@ static PHYSFS_sint64 FileTimeToPhysfsTime(const FILETIME *ft)
 } /* FileTimeToPhysfsTime */
 
 
-int __PHYSFS_platformStat(const char *filename, PHYSFS_Stat *st)
+static void statFromAttributeData(const WIN32_FILE_ATTRIBUTE_DATA *winstat,
+	PHYSFS_Stat *st)
 {
-	WIN32_FILE_ATTRIBUTE_DATA winstat;
-	WCHAR *wstr = NULL;
-	DWORD err = 0;
-	BOOL rc = 0;
-
-	UTF8_TO_UNICODE_STACK_MACRO(wstr, filename);
-	BAIL_IF_MACRO(!wstr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
-	rc = GetFileAttributesExW(wstr, GetFileExInfoStandard, &winstat);
-	err = (!rc) ? GetLastError() : 0;
-	__PHYSFS_smallFree(wstr);
-	BAIL_IF_MACRO(!rc, errcodeFromWinApiError(err), 0);
+	st->modtime = FileTimeToPhysfsTime(&winstat->ftLastWriteTime);
+	st->accesstime = FileTimeToPhysfsTime(&winstat->ftLastAccessTime);
+	st->createtime = FileTimeToPhysfsTime(&winstat->ftCreationTime);
 
-	st->modtime = FileTimeToPhysfsTime(&winstat.ftLastWriteTime);
-	st->accesstime = FileTimeToPhysfsTime(&winstat.ftLastAccessTime);
-	st->createtime = FileTimeToPhysfsTime(&winstat.ftCreationTime);
-
-	if (winstat.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+	if (winstat->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
 	{
 		st->filetype = PHYSFS_FILETYPE_DIRECTORY;
 		st->filesize = 0;
 	} /* if */
 
-	else if (winstat.dwFileAttributes & (FILE_ATTRIBUTE_OFFLINE | FILE_ATTRIBUTE_DEVICE))
+	else if (winstat->dwFileAttributes & (FILE_ATTRIBUTE_OFFLINE | FILE_ATTRIBUTE_DEVICE))
 	{
 		/* !!! FIXME: what are reparse points? */
 		st->filetype = PHYSFS_FILETYPE_OTHER;
@@ -657,11 +737,28 @@ int __PHYSFS_platformStat(const char *filename, PHYSFS_Stat *st)
 	else
 	{
 		st->filetype = PHYSFS_FILETYPE_REGULAR;
-		st->filesize = (((PHYSFS_uint64)winstat.nFileSizeHigh) << 32) | winstat.nFileSizeLow;
+		st->filesize = (((PHYSFS_uint64)winstat->nFileSizeHigh) << 32) | winstat->nFileSizeLow;
 	} /* else */
 
-	st->readonly = ((winstat.dwFileAttributes & FILE_ATTRIBUTE_READONLY) != 0);
+	st->readonly = ((winstat->dwFileAttributes & FILE_ATTRIBUTE_READONLY) != 0);
+} /* statFromAttributeData */
+
+
+int __PHYSFS_platformStat(const char *filename, PHYSFS_Stat *st)
+{
+	WIN32_FILE_ATTRIBUTE_DATA winstat;
+	WCHAR *wstr = NULL;
+	DWORD err = 0;
+	BOOL rc = 0;
+
+	UTF8_TO_UNICODE_STACK_MACRO(wstr, filename);
+	BAIL_IF_MACRO(!wstr, PHYSFS_ERR_OUT_OF_MEMORY, 0);
+	rc = GetFileAttributesExW(wstr, GetFileExInfoStandard, &winstat);
+	err = (!rc) ? GetLastError() : 0;
+	__PHYSFS_smallFree(wstr);
+	BAIL_IF_MACRO(!rc, errcodeFromWinApiError(err), 0);
 
+	statFromAttributeData(&winstat, st);
 	return 1;
 } /* __PHYSFS_platformStat */
 
@@ -0,0 +1,1610 @@
+/**
+ * Synthetic archive fixtures for PhysicsFS benchmarks.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fixture.h"
+
+#if FIXTURE_HAVE_AES
+#include "fileenc.h"
+
+/* This has to match ZIP_AES_DEFAULT_PASSWORD in archiver_zip.c! */
+#define FIXTURE_AES_PASSWORD "8!*MJw=g4e)ah#0BxlcUjl7p*W6jSV!l4qg!31gutTjh.cwJflgfWcd8LhdjaIY0*UYda3Yj@BY9WA"
+#define FIXTURE_AES_MODE 3  /* 256 bits; the archiver won't take 128. */
+#endif
+
+#define FIXTURE_BLOCKSIZE 4096
+#define FIXTURE_IOSIZE (64 * 1024)
+#define ISO_SECTOR 2048
+
+static const char *format_names[] = { "dir", "zip", "grp", "wad", "iso", "7z" };
+
+void fixture_defaults(FixtureParams *p, FixtureFormat format)
+{
+    memset(p, '\0', sizeof (*p));
+    p->format = format;
+    p->method = FIXTURE_STORED;
+    p->seed = 1;
+    p->entries = 100;
+    p->filesize = 1024;
+} /* fixture_defaults */
+
+
+const char *fixture_format_name(FixtureFormat format)
+{
+    return format_names[format];
+} /* fixture_format_name */
+
+
+int fixture_parse_format(const char *name, FixtureFormat *format)
+{
+    size_t i;
+    for (i = 0; i < sizeof (format_names) / sizeof (format_names[0]); i++)
+    {
+        if (strcmp(name, format_names[i]) == 0)
+        {
+            *format = (FixtureFormat) i;
+            return 1;
+        } /* if */
+    } /* for */
+    return 0;
+} /* fixture_parse_format */
+
+
+PHYSFS_uint32 fixture_count(const FixtureParams *p)
+{
+    return p->entries + ((p->bigsize > 0) ? 1 : 0);
+} /* fixture_count */
+
+
+PHYSFS_uint64 fixture_size(const FixtureParams *p, PHYSFS_uint32 idx)
+{
+    return (idx < p->entries) ? p->filesize : p->bigsize;
+} /* fixture_size */
+
+
+FixtureMethod fixture_method(const FixtureParams *p, PHYSFS_uint32 idx)
+{
+    if (p->format != FIXTURE_ZIP)
+        return FIXTURE_STORED;
+    else if (p->method != FIXTURE_MIXED)
+        return p->method;
+#if FIXTURE_HAVE_AES
+    return (FixtureMethod) (idx % 3);
+#else
+    return (FixtureMethod) (idx % 2);
+#endif
+} /* fixture_method */
+
+
+static int fixture_flat(const FixtureParams *p)
+{
+    return ( (p->format == FIXTURE_GRP) || (p->format == FIXTURE_WAD) ||
+             (p->width == 0) || (p->depth == 0) );
+} /* fixture_flat */
+
+
+/* Leaf directories, which is where the small files go, round-robin. */
+static PHYSFS_uint32 fixture_leaves(const FixtureParams *p)
+{
+    PHYSFS_uint32 retval = 1;
+    PHYSFS_uint32 i;
+    if (!fixture_flat(p))
+    {
+        for (i = 0; i < p->depth; i++)
+            retval *= p->width;
+    } /* if */
+    return retval;
+} /* fixture_leaves */
+
+
+/*
+ * Path of directory (k) at (level), with a trailing '/', or "" for the
+ *  root. The first (level) base-(width) digits of (k), lowest first, pick
+ *  the subdirectory at each level, so file (idx) is in leaf (idx % leaves).
+ */
+static void fixture_dirpath(const FixtureParams *p, PHYSFS_uint32 level,
+                            PHYSFS_uint32 k, char *buf, size_t buflen)
+{
+    const char *fmt = (p->format == FIXTURE_ISO) ? "D%02u/" : "d%02u/";
+    PHYSFS_uint32 i;
+    size_t len = 0;
+
+    *buf = '\0';
+    for (i = 0; (i < level) && ((len + 16) < buflen); i++)
+    {
+        sprintf(buf + len, fmt, (unsigned int) (k % p->width));
+        len += strlen(buf + len);
+        k /= p->width;
+    } /* for */
+} /* fixture_dirpath */
+
+
+/* Just the last part of file (idx)'s name. */
+static void fixture_basename(const FixtureParams *p, PHYSFS_uint32 idx,
+                             char *buf)
+{
+    const int big = (idx >= p->entries);
+    switch (p->format)
+    {
+        case FIXTURE_WAD:  /* 8 chars, max. */
+            if (big)
+                strcpy(buf, "BIGDATA");
+            else
+                sprintf(buf, "F%07u", (unsigned int) idx);
+            break;
+
+        case FIXTURE_GRP:  /* 12 chars, max. */
+        case FIXTURE_ISO:
+            if (big)
+                strcpy(buf, "BIG.DAT");
+            else
+                sprintf(buf, "F%07u.DAT", (unsigned int) idx);
+            break;
+
+        default:
+            if (big)
+                strcpy(buf, "big.dat");
+            else
+                sprintf(buf, "f%07u.dat", (unsigned int) idx);
+            break;
+    } /* switch */
+} /* fixture_basename */
+
+
+void fixture_name(const FixtureParams *p, PHYSFS_uint32 idx,
+                  char *buf, size_t buflen)
+{
+    char tmp[32];
+    size_t len;
+
+    *buf = '\0';
+    if ((!fixture_flat(p)) && (idx < p->entries))
+        fixture_dirpath(p, p->depth, idx % fixture_leaves(p), buf, buflen);
+
+    len = strlen(buf);
+    fixture_basename(p, idx, tmp);
+    if ((len + strlen(tmp)) < buflen)
+        strcpy(buf + len, tmp);
+} /* fixture_name */
+
+
+/*
+ * Each 4k block of each file comes from its own xorshift stream, so any
+ *  range can be regenerated without the bytes before it. The output is
+ *  words from a short list, so it compresses about as well as text.
+ */
+static void fixture_block(const FixtureParams *p, PHYSFS_uint32 idx,
+                          PHYSFS_uint64 block, PHYSFS_uint8 *buf)
+{
+    static const char *words[32] = {
+        "the", "of", "and", "to", "in", "is", "that", "for", "it", "as",
+        "was", "with", "be", "by", "on", "not", "he", "this", "are", "or",
+        "his", "from", "at", "which", "but", "have", "an", "had", "they",
+        "you", "were", "archive"
+    };
+    PHYSFS_uint32 x = p->seed * 2654435761u;
+    size_t i = 0;
+
+    x ^= (idx + 1) * 2246822519u;
+    x ^= ((PHYSFS_uint32) block + 1) * 3266489917u;
+    x ^= (PHYSFS_uint32) (block >> 32);
+    if (x == 0)
+        x = 1;
+
+    while (i < FIXTURE_BLOCKSIZE)
+    {
+        const char *word;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        word = words[(x >> 8) & 31];
+        while ((*word) && (i < FIXTURE_BLOCKSIZE))
+            buf[i++] = (PHYSFS_uint8) *(word++);
+        if (i < FIXTURE_BLOCKSIZE)
+            buf[i++] = ((x >> 16) & 15) ? ' ' : '\n';
+    } /* while */
+} /* fixture_block */
+
+
+void fixture_data(const FixtureParams *p, PHYSFS_uint32 idx,
+                  PHYSFS_uint64 offset, void *_buf, size_t len)
+{
+    PHYSFS_uint8 block[FIXTURE_BLOCKSIZE];
+    PHYSFS_uint8 *buf = (PHYSFS_uint8 *) _buf;
+
+    while (len > 0)
+    {
+        const size_t pos = (size_t) (offset % FIXTURE_BLOCKSIZE);
+        size_t cpy = FIXTURE_BLOCKSIZE - pos;
+        if (cpy > len)
+            cpy = len;
+        fixture_block(p, idx, offset / FIXTURE_BLOCKSIZE, block);
+        memcpy(buf, block + pos, cpy);
+        buf += cpy;
+        offset += cpy;
+        len -= cpy;
+    } /* while */
+} /* fixture_data */
+
+
+static PHYSFS_uint32 crc32_table[256];
+
+static PHYSFS_uint32 fixture_crc32(PHYSFS_uint32 crc, const PHYSFS_uint8 *buf,
+                                   size_t len)
+{
+    if (crc32_table[1] == 0)
+    {
+        PHYSFS_uint32 i, j;
+        for (i = 0; i < 256; i++)
+        {
+            PHYSFS_uint32 c = i;
+            for (j = 0; j < 8; j++)
+                c = (c & 1) ? (0xEDB88320 ^ (c >> 1)) : (c >> 1);
+            crc32_table[i] = c;
+        } /* for */
+    } /* if */
+
+    crc ^= 0xFFFFFFFF;
+    while (len--)
+        crc = crc32_table[(crc ^ *(buf++)) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFF;
+} /* fixture_crc32 */
+
+
+static int fixture_writeAll(PHYSFS_File *f, const void *buf, size_t len)
+{
+    return (PHYSFS_writeBytes(f, buf, len) == (PHYSFS_sint64) len);
+} /* fixture_writeAll */
+
+
+/* Write file (idx)'s contents to (f), and (if (crc) isn't NULL) CRC them. */
+static int fixture_copy(const FixtureParams *p, PHYSFS_uint32 idx,
+                        PHYSFS_File *f, PHYSFS_uint32 *crc)
+{
+    static PHYSFS_uint8 buf[FIXTURE_IOSIZE];
+    const PHYSFS_uint64 size = fixture_size(p, idx);
+    PHYSFS_uint64 pos = 0;
+
+    while (pos < size)
+    {
+        size_t len = FIXTURE_IOSIZE;
+        if ((PHYSFS_uint64) len > (size - pos))
+            len = (size_t) (size - pos);
+        fixture_data(p, idx, pos, buf, len);
+        if (crc != NULL)
+            *crc = fixture_crc32(*crc, buf, len);
+        if ((f != NULL) && (!fixture_writeAll(f, buf, len)))
+            return 0;
+        pos += len;
+    } /* while */
+
+    return 1;
+} /* fixture_copy */
+
+
+static PHYSFS_File *fixture_open(const char *fname)
+{
+    PHYSFS_File *f = PHYSFS_openWrite(fname);
+    if (f != NULL)
+        PHYSFS_setBuffer(f, FIXTURE_IOSIZE);
+    return f;
+} /* fixture_open */
+
+
+static int fixture_unsupported(void)
+{
+    PHYSFS_setErrorCode(PHYSFS_ERR_UNSUPPORTED);
+    return 0;
+} /* fixture_unsupported */
+
+
+static void *fixture_malloc(size_t len)
+{
+    void *retval = malloc(len ? len : 1);
+    if (retval == NULL)
+        PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+    return retval;
+} /* fixture_malloc */
+
+
+static void put16le(PHYSFS_uint8 *buf, PHYSFS_uint16 val)
+{
+    buf[0] = (PHYSFS_uint8) (val & 0xFF);
+    buf[1] = (PHYSFS_uint8) (val >> 8);
+} /* put16le */
+
+static void put32le(PHYSFS_uint8 *buf, PHYSFS_uint32 val)
+{
+    put16le(buf, (PHYSFS_uint16) (val & 0xFFFF));
+    put16le(buf + 2, (PHYSFS_uint16) (val >> 16));
+} /* put32le */
+
+static void put64le(PHYSFS_uint8 *buf, PHYSFS_uint64 val)
+{
+    put32le(buf, (PHYSFS_uint32) (val & 0xFFFFFFFF));
+    put32le(buf + 4, (PHYSFS_uint32) (val >> 32));
+} /* put64le */
+
+static void put16be(PHYSFS_uint8 *buf, PHYSFS_uint16 val)
+{
+    buf[0] = (PHYSFS_uint8) (val >> 8);
+    buf[1] = (PHYSFS_uint8) (val & 0xFF);
+} /* put16be */
+
+static void put32be(PHYSFS_uint8 *buf, PHYSFS_uint32 val)
+{
+    put16be(buf, (PHYSFS_uint16) (val >> 16));
+    put16be(buf + 2, (PHYSFS_uint16) (val & 0xFFFF));
+} /* put32be */
+
+
+/* A plain directory tree... */
+
+static int fixture_write_dir(const FixtureParams *p, const char *fname)
+{
+    const PHYSFS_uint32 count = fixture_count(p);
+    const PHYSFS_uint32 leaves = fixture_leaves(p);
+    char name[256];
+    char *path;
+    PHYSFS_uint32 i;
+
+    if (!PHYSFS_mkdir(fname))
+        return 0;
+
+    path = (char *) fixture_malloc(strlen(fname) + sizeof (name) + 1);
+    if (path == NULL)
+        return 0;
+
+    for (i = 0; i < count; i++)
+    {
+        PHYSFS_File *f;
+        int ok;
+
+        if ((i < leaves) && (!fixture_flat(p)))  /* first file in its dir. */
+        {
+            fixture_dirpath(p, p->depth, i, name, sizeof (name));
+            sprintf(path, "%s/%s", fname, name);
+            if (!PHYSFS_mkdir(path))
+                break;
+        } /* if */
+
+        fixture_name(p, i, name, sizeof (name));
+        sprintf(path, "%s/%s", fname, name);
+        f = fixture_open(path);
+        if (f == NULL)
+            break;
+        ok = fixture_copy(p, i, f, NULL);
+        ok = PHYSFS_close(f) && ok;
+        if (!ok)
+            break;
+    } /* for */
+
+    free(path);
+    return (i == count);
+} /* fixture_write_dir */
+
+
+/*
+ * A deflate encoder. It's not a good one: fixed Huffman codes, and matches
+ *  from a single-entry hash table, in independent 64k blocks. But it's
+ *  small, it's deterministic, and inflating its output is real work.
+ */
+
+#define DEFLATE_HASHBITS 15
+#define DEFLATE_WINDOW 32768
+
+typedef struct DeflateState
+{
+    PHYSFS_File *f;
+    PHYSFS_uint32 bitbuf;
+    int bitcount;
+    PHYSFS_uint8 out[FIXTURE_IOSIZE];
+    size_t outlen;
+    PHYSFS_uint64 total;  /* compressed bytes so far. */
+    int ok;
+    PHYSFS_uint32 head[1 << DEFLATE_HASHBITS];  /* position + 1, or 0. */
+} DeflateState;
+
+static const PHYSFS_uint16 deflate_lenbase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const PHYSFS_uint8 deflate_lenextra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const PHYSFS_uint16 deflate_distbase[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const PHYSFS_uint8 deflate_distextra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void deflate_byte(DeflateState *s, PHYSFS_uint8 val)
+{
+    if (s->outlen == sizeof (s->out))
+    {
+        if (!fixture_writeAll(s->f, s->out, s->outlen))
+            s->ok = 0;
+        s->outlen = 0;
+    } /* if */
+    s->out[s->outlen++] = val;
+    s->total++;
+} /* deflate_byte */
+
+/* deflate packs bits starting at the low end of each byte. */
+static void deflate_bits(DeflateState *s, PHYSFS_uint32 val, int count)
+{
+    s->bitbuf |= val << s->bitcount;
+    s->bitcount += count;
+    while (s->bitcount >= 8)
+    {
+        deflate_byte(s, (PHYSFS_uint8) (s->bitbuf & 0xFF));
+        s->bitbuf >>= 8;
+        s->bitcount -= 8;
+    } /* while */
+} /* deflate_bits */
+
+/* ...but Huffman codes go in starting from their high bit. */
+static void deflate_code(DeflateState *s, PHYSFS_uint32 code, int len)
+{
+    PHYSFS_uint32 rev = 0;
+    int i;
+    for (i = 0; i < len; i++)
+        rev |= ((code >> i) & 1) << (len - 1 - i);
+    deflate_bits(s, rev, len);
+} /* deflate_code */
+
+static void deflate_symbol(DeflateState *s, int sym)
+{
+    if (sym < 144)
+        deflate_code(s, 0x30 + sym, 8);
+    else if (sym < 256)
+        deflate_code(s, 0x190 + (sym - 144), 9);
+    else if (sym < 280)
+        deflate_code(s, sym - 256, 7);
+    else
+        deflate_code(s, 0xC0 + (sym - 280), 8);
+} /* deflate_symbol */
+
+static void deflate_match(DeflateState *s, int len, int dist)
+{
+    int i;
+
+    for (i = 28; deflate_lenbase[i] > len; i--) { /* spin. */ }
+    deflate_symbol(s, 257 + i);
+    deflate_bits(s, len - deflate_lenbase[i], deflate_lenextra[i]);
+
+    for (i = 29; deflate_distbase[i] > dist; i--) { /* spin. */ }
+    deflate_code(s, i, 5);
+    deflate_bits(s, dist - deflate_distbase[i], deflate_distextra[i]);
+} /* deflate_match */
+
+static PHYSFS_uint32 deflate_hash(const PHYSFS_uint8 *ptr)
+{
+    const PHYSFS_uint32 val = ptr[0] | (ptr[1] << 8) | (ptr[2] << 16);
+    return (val * 2654435761u) >> (32 - DEFLATE_HASHBITS);
+} /* deflate_hash */
+
+static void deflate_block(DeflateState *s, const PHYSFS_uint8 *buf,
+                          size_t len, int final)
+{
+    size_t i = 0;
+
+    memset(s->head, '\0', sizeof (s->head));
+    deflate_bits(s, final ? 1 : 0, 1);
+    deflate_bits(s, 1, 2);  /* fixed Huffman codes. */
+
+    while (i < len)
+    {
+        size_t matchlen = 0;
+        size_t dist = 0;
+
+        if ((i + 3) <= len)
+        {
+            const PHYSFS_uint32 h = deflate_hash(buf + i);
+            const PHYSFS_uint32 cand = s->head[h];
+            s->head[h] = (PHYSFS_uint32) (i + 1);
+            if ((cand > 0) && ((i - (cand - 1)) <= DEFLATE_WINDOW))
+            {
+                const PHYSFS_uint8 *a = buf + (cand - 1);
+                const PHYSFS_uint8 *b = buf + i;
+                size_t max = len - i;
+                if (max > 258)
+                    max = 258;
+                while ((matchlen < max) && (a[matchlen] == b[matchlen]))
+                    matchlen++;
+                dist = i - (cand - 1);
+            } /* if */
+        } /* if */
+
+        if (matchlen >= 3)
+        {
+            size_t j;
+            deflate_match(s, (int) matchlen, (int) dist);
+            for (j = 1; j < matchlen; j++)
+            {
+                if ((i + j + 3) <= len)
+                    s->head[deflate_hash(buf + i + j)] = (PHYSFS_uint32) (i + j + 1);
+            } /* for */
+            i += matchlen;
+        } /* if */
+        else
+        {
+            deflate_symbol(s, buf[i]);
+            i++;
+        } /* else */
+    } /* while */
+
+    deflate_symbol(s, 256);  /* end of block. */
+} /* deflate_block */
+
+/* Deflate file (idx) to (f); returns the compressed size, or -1. */
+static PHYSFS_sint64 fixture_deflate(const FixtureParams *p, PHYSFS_uint32 idx,
+                                     PHYSFS_File *f)
+{
+    static PHYSFS_uint8 buf[FIXTURE_IOSIZE];
+    const PHYSFS_uint64 size = fixture_size(p, idx);
+    DeflateState *s = (DeflateState *) fixture_malloc(sizeof (DeflateState));
+    PHYSFS_uint64 pos = 0;
+    PHYSFS_sint64 retval = -1;
+
+    if (s == NULL)
+        return -1;
+
+    memset(s, '\0', offsetof(DeflateState, head));
+    s->f = f;
+    s->ok = 1;
+
+    do  /* an empty file still needs one (empty) final block. */
+    {
+        size_t len = FIXTURE_IOSIZE;
+        if ((PHYSFS_uint64) len > (size - pos))
+            len = (size_t) (size - pos);
+        fixture_data(p, idx, pos, buf, len);
+        pos += len;
+        deflate_block(s, buf, len, pos == size);
+    } while (pos < size);
+
+    if (s->bitcount > 0)
+        deflate_bits(s, 0, 8 - s->bitcount);
+    if ((s->outlen > 0) && (!fixture_writeAll(f, s->out, s->outlen)))
+        s->ok = 0;
+
+    if (s->ok)
+        retval = (PHYSFS_sint64) s->total;
+    free(s);
+    return retval;
+} /* fixture_deflate */
+
+
+#if FIXTURE_HAVE_AES
+/* WinZip AE-2: salt, password verifier, ciphertext, then a MAC. */
+static PHYSFS_sint64 fixture_encrypt(const FixtureParams *p, PHYSFS_uint32 idx,
+                                     PHYSFS_File *f)
+{
+    static PHYSFS_uint8 buf[FIXTURE_IOSIZE];
+    const PHYSFS_uint64 size = fixture_size(p, idx);
+    const char *pwd = FIXTURE_AES_PASSWORD;
+    unsigned char salt[16];
+    unsigned char pwdver[PWD_VER_LENGTH];
+    unsigned char mac[10];
+    PHYSFS_uint32 x = (p->seed * 2654435761u) ^ ((idx + 1) * 2246822519u);
+    PHYSFS_uint64 pos = 0;
+    fcrypt_ctx ctx;
+    int i;
+
+    for (i = 0; i < (int) SALT_LENGTH(FIXTURE_AES_MODE); i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        salt[i] = (unsigned char) (x >> 24);
+    } /* for */
+
+    fcrypt_init(FIXTURE_AES_MODE, (const unsigned char *) pwd,
+                (unsigned int) strlen(pwd), salt, pwdver, &ctx);
+    if ( (!fixture_writeAll(f, salt, SALT_LENGTH(FIXTURE_AES_MODE))) ||
+         (!fixture_writeAll(f, pwdver, PWD_VER_LENGTH)) )
+        return -1;
+
+    while (pos < size)
+    {
+        size_t len = FIXTURE_IOSIZE;
+        if ((PHYSFS_uint64) len > (size - pos))
+            len = (size_t) (size - pos);
+        fixture_data(p, idx, pos, buf, len);
+        fcrypt_encrypt(buf, (unsigned int) len, &ctx);
+        if (!fixture_writeAll(f, buf, len))
+            return -1;
+        pos += len;
+    } /* while */
+
+    fcrypt_end(mac, &ctx);
+    if (!fixture_writeAll(f, mac, MAC_LENGTH(FIXTURE_AES_MODE)))
+        return -1;
+
+    return (PHYSFS_sint64) (size + SALT_LENGTH(FIXTURE_AES_MODE) +
+                            PWD_VER_LENGTH + MAC_LENGTH(FIXTURE_AES_MODE));
+} /* fixture_encrypt */
+#endif
+
+
+/* ZIP... */
+
+typedef struct ZipRecord
+{
+    PHYSFS_uint64 offset;
+    PHYSFS_uint64 csize;
+    PHYSFS_uint32 crc;
+    PHYSFS_uint16 method;
+    PHYSFS_uint16 flags;
+    PHYSFS_uint16 version;
+} ZipRecord;
+
+#define ZIP_DOSTIME 0x00210000  /* 1980-01-01 00:00 */
+
+/* The WinZip AES extra field: AE-2, "AE", 256 bits, stored. */
+static void zip_aes_extra(PHYSFS_uint8 *buf)
+{
+    put16le(buf, 0x9901);
+    put16le(buf + 2, 7);
+    put16le(buf + 4, 2);
+    put16le(buf + 6, 0x4541);
+    buf[8] = 3;
+    put16le(buf + 9, 0);
+} /* zip_aes_extra */
+
+/* Fill in a local header's sizes; the Zip64 extra field is right after it. */
+static void zip_local_sizes(PHYSFS_uint8 *hdr, int big, PHYSFS_uint64 csize,
+                            PHYSFS_uint64 size)
+{
+    if (big)
+    {
+        put64le(hdr + 42, csize);
+        put32le(hdr + 18, 0xFFFFFFFF);
+        put32le(hdr + 22, 0xFFFFFFFF);
+    } /* if */
+    else
+    {
+        put32le(hdr + 18, (PHYSFS_uint32) csize);
+        put32le(hdr + 22, (PHYSFS_uint32) size);
+    } /* else */
+} /* zip_local_sizes */
+
+static int zip_write_entry(const FixtureParams *p, PHYSFS_uint32 idx,
+                           PHYSFS_File *f, ZipRecord *rec, int zip64)
+{
+    const FixtureMethod method = fixture_method(p, idx);
+    const PHYSFS_uint64 size = fixture_size(p, idx);
+    const int big = (size >= 0xFFFF0000);  /* leave room for overhead. */
+    PHYSFS_uint8 hdr[30 + 20 + 11];
+    char name[256];
+    PHYSFS_uint16 extralen = 0;
+    PHYSFS_sint64 csize;
+    PHYSFS_sint64 pos;
+
+    if ((big) && (!zip64))
+        return fixture_unsupported();
+
+    fixture_name(p, idx, name, sizeof (name));
+    rec->offset = (PHYSFS_uint64) PHYSFS_tell(f);
+    rec->crc = 0;
+    rec->flags = 0;
+    rec->version = zip64 ? 45 : 20;
+
+    if (method == FIXTURE_STORED)
+        rec->method = 0;
+    else if (method == FIXTURE_DEFLATED)
+        rec->method = 8;
+    else
+    {
+#if FIXTURE_HAVE_AES
+        rec->method = 99;
+        rec->flags = 1;  /* "encrypted" */
+        rec->version = 51;
+#else
+        return fixture_unsupported();
+#endif
+    } /* else */
+
+    if (method != FIXTURE_ENCRYPTED)  /* AE-2 leaves the CRC out. */
+        fixture_copy(p, idx, NULL, &rec->crc);
+
+    /* sizes go in later, once we know them. */
+    put32le(hdr, 0x04034b50);
+    put16le(hdr + 4, rec->version);
+    put16le(hdr + 6, rec->flags);
+    put16le(hdr + 8, rec->method);
+    put32le(hdr + 10, ZIP_DOSTIME);
+    put32le(hdr + 14, rec->crc);
+    put32le(hdr + 18, 0);
+    put32le(hdr + 22, 0);
+    put16le(hdr + 26, (PHYSFS_uint16) strlen(name));
+    if (big)
+    {
+        put16le(hdr + 30 + extralen, 0x0001);
+        put16le(hdr + 32 + extralen, 16);
+        put64le(hdr + 34 + extralen, size);
+        put64le(hdr + 42 + extralen, 0);
+        extralen += 20;
+    } /* if */
+    if (rec->method == 99)
+    {
+        zip_aes_extra(hdr + 30 + extralen);
+        extralen += 11;
+    } /* if */
+    put16le(hdr + 28, extralen);
+
+    /*
+     * Stored sizes are known now, so we don't have to come back for them;
+     *  seeking back empties the write buffer, and with a million tiny
+     *  entries, that's most of the time it takes to write the archive.
+     */
+    if (rec->method == 0)
+        zip_local_sizes(hdr, big, size, size);
+
+    if ( (!fixture_writeAll(f, hdr, 30)) ||
+         (!fixture_writeAll(f, name, strlen(name))) ||
+         (!fixture_writeAll(f, hdr + 30, extralen)) )
+        return 0;
+
+    if (rec->method == 0)
+        csize = fixture_copy(p, idx, f, NULL) ? (PHYSFS_sint64) size : -1;
+    else if (rec->method == 8)
+        csize = fixture_deflate(p, idx, f);
+#if FIXTURE_HAVE_AES
+    else
+        csize = fixture_encrypt(p, idx, f);
+#endif
+
+    if (csize < 0)
+        return 0;
+    rec->csize = (PHYSFS_uint64) csize;
+    if (rec->method == 0)
+        return 1;
+
+    /* go back and fill in the sizes. */
+    pos = PHYSFS_tell(f);
+    zip_local_sizes(hdr, big, rec->csize, size);
+
+    return ( (PHYSFS_seek(f, rec->offset)) &&
+             (fixture_writeAll(f, hdr, 30)) &&
+             (PHYSFS_seek(f, rec->offset + 30 + strlen(name))) &&
+             (fixture_writeAll(f, hdr + 30, extralen)) &&
+             (PHYSFS_seek(f, pos)) );
+} /* zip_write_entry */
+
+static int zip_write_central(const FixtureParams *p, PHYSFS_uint32 idx,
+                             PHYSFS_File *f, const ZipRecord *rec, int zip64)
+{
+    PHYSFS_uint8 hdr[46 + 28 + 11];
+    const PHYSFS_uint64 size = fixture_size(p, idx);
+    PHYSFS_uint16 extralen = 0;
+    char name[256];
+
+    fixture_name(p, idx, name, sizeof (name));
+    put32le(hdr, 0x02014b50);
+    put16le(hdr + 4, rec->version);  /* made by */
+    put16le(hdr + 6, rec->version);  /* needed */
+    put16le(hdr + 8, rec->flags);
+    put16le(hdr + 10, rec->method);
+    put32le(hdr + 12, ZIP_DOSTIME);
+    put32le(hdr + 16, rec->crc);
+    put32le(hdr + 20, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) rec->csize);
+    put32le(hdr + 24, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) size);
+    put16le(hdr + 28, (PHYSFS_uint16) strlen(name));
+    put16le(hdr + 32, 0);  /* comment */
+    put16le(hdr + 34, 0);  /* disk */
+    put16le(hdr + 36, 0);  /* internal attributes */
+    put32le(hdr + 38, 0);  /* external attributes */
+    put32le(hdr + 42, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) rec->offset);
+
+    if (zip64)
+    {
+        put16le(hdr + 46, 0x0001);
+        put16le(hdr + 48, 24);
+        put64le(hdr + 50, size);
+        put64le(hdr + 58, rec->csize);
+        put64le(hdr + 66, rec->offset);
+        extralen += 28;
+    } /* if */
+    if (rec->method == 99)
+    {
+        zip_aes_extra(hdr + 46 + extralen);
+        extralen += 11;
+    } /* if */
+    put16le(hdr + 30, extralen);
+
+    return ( (fixture_writeAll(f, hdr, 46)) &&
+             (fixture_writeAll(f, name, strlen(name))) &&
+             (fixture_writeAll(f, hdr + 46, extralen)) );
+} /* zip_write_central */
+
+static int fixture_write_zip(const FixtureParams *p, const char *fname)
+{
+    const PHYSFS_uint32 count = fixture_count(p);
+    const int zip64 = ((p->zip64) || (count > 0xFFFF) || (p->bigsize >= 0xFFFF0000));
+    ZipRecord *recs = NULL;
+    PHYSFS_File *f = NULL;
+    PHYSFS_uint8 end[56 + 20 + 22];
+    PHYSFS_uint64 cdir, cdirlen;
+    PHYSFS_uint8 *ptr = end;
+    PHYSFS_uint32 i;
+    int ok = 0;
+
+    recs = (ZipRecord *) fixture_malloc(sizeof (ZipRecord) * count);
+    if (recs == NULL)
+        return 0;
+
+    f = fixture_open(fname);
+    if (f == NULL)
+        goto zip_done;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!zip_write_entry(p, i, f, &recs[i], zip64))
+            goto zip_done;
+    } /* for */
+
+    cdir = (PHYSFS_uint64) PHYSFS_tell(f);
+    for (i = 0; i < count; i++)
+    {
+        if (!zip_write_central(p, i, f, &recs[i], zip64))
+            goto zip_done;
+    } /* for */
+    cdirlen = (PHYSFS_uint64) PHYSFS_tell(f) - cdir;
+
+    if (zip64)
+    {
+        put32le(ptr, 0x06064b50);  /* zip64 end of central directory */
+        put64le(ptr + 4, 44);
+        put16le(ptr + 12, 45);
+        put16le(ptr + 14, 45);
+        put32le(ptr + 16, 0);
+        put32le(ptr + 20, 0);
+        put64le(ptr + 24, count);
+        put64le(ptr + 32, count);
+        put64le(ptr + 40, cdirlen);
+        put64le(ptr + 48, cdir);
+        ptr += 56;
+
+        put32le(ptr, 0x07064b50);  /* ...and its locator. */
+        put32le(ptr + 4, 0);
+        put64le(ptr + 8, cdir + cdirlen);
+        put32le(ptr + 16, 1);
+        ptr += 20;
+    } /* if */
+
+    put32le(ptr, 0x06054b50);
+    put16le(ptr + 4, 0);  /* this disk */
+    put16le(ptr + 6, 0);  /* central dir's disk */
+    put16le(ptr + 8, zip64 ? 0xFFFF : (PHYSFS_uint16) count);
+    put16le(ptr + 10, zip64 ? 0xFFFF : (PHYSFS_uint16) count);
+    put32le(ptr + 12, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) cdirlen);
+    put32le(ptr + 16, zip64 ? 0xFFFFFFFF : (PHYSFS_uint32) cdir);
+    put16le(ptr + 20, 0);  /* comment */
+    ptr += 22;
+
+    ok = fixture_writeAll(f, end, (size_t) (ptr - end));
+
+zip_done:
+    if ((f != NULL) && (!PHYSFS_close(f)))
+        ok = 0;
+    free(recs);
+    return ok;
+} /* fixture_write_zip */
+
+
+/* GRP and WAD: a table of names and sizes, then the data. */
+
+static int fixture_write_grp(const FixtureParams *p, const char *fname)
+{
+    const PHYSFS_uint32 count = fixture_count(p);
+    PHYSFS_uint8 entry[16];
+    PHYSFS_File *f;
+    PHYSFS_uint32 i;
+    int ok;
+
+    if (p->bigsize >= 0xFFFFFFFF)
+        return fixture_unsupported();
+
+    f = fixture_open(fname);
+    if (f == NULL)
+        return 0;
+
+    put32le(entry, count);
+    ok = ( (fixture_writeAll(f, "KenSilverman", 12)) &&
+           (fixture_writeAll(f, entry, 4)) );
+
+    for (i = 0; (ok) && (i < count); i++)
+    {
+        memset(entry, '\0', sizeof (entry));
+        fixture_basename(p, i, (char *) entry);
+        put32le(entry + 12, (PHYSFS_uint32) fixture_size(p, i));
+        ok = fixture_writeAll(f, entry, 16);
+    } /* for */
+
+    for (i = 0; (ok) && (i < count); i++)
+        ok = fixture_copy(p, i, f, NULL);
+
+    return PHYSFS_close(f) && ok;
+} /* fixture_write_grp */
+
+
+static int fixture_write_wad(const FixtureParams *p, const char *fname)
+{
+    const PHYSFS_uint32 count = fixture_count(p);
+    PHYSFS_uint64 pos = 12;
+    PHYSFS_uint8 entry[16];
+    PHYSFS_File *f;
+    PHYSFS_uint32 i;
+    int ok;
+
+    for (i = 0; i < count; i++)
+        pos += fixture_size(p, i);
+    if ((pos >= 0xFFFFFFFF) || (p->entries > 9999999))
+        return fixture_unsupported();
+
+    f = fixture_open(fname);
+    if (f == NULL)
+        return 0;
+
+    /* the lumps, then the directory after them. */
+    memcpy(entry, "PWAD", 4);
+    put32le(entry + 4, count);
+    put32le(entry + 8, (PHYSFS_uint32) pos);
+    ok = fixture_writeAll(f, entry, 12);
+
+    for (i = 0; (ok) && (i < count); i++)
+        ok = fixture_copy(p, i, f, NULL);
+
+    for (pos = 12, i = 0; (ok) && (i < count); i++)
+    {
+        char name[16];
+        fixture_basename(p, i, name);
+        put32le(entry, (PHYSFS_uint32) pos);
+        put32le(entry + 4, (PHYSFS_uint32) fixture_size(p, i));
+        memset(entry + 8, '\0', 8);
+        memcpy(entry + 8, name, strlen(name));  /* not null-terminated. */
+        ok = fixture_writeAll(f, entry, 16);
+        pos += fixture_size(p, i);
+    } /* for */
+
+    return PHYSFS_close(f) && ok;
+} /* fixture_write_wad */
+
+
+/*
+ * ISO9660: system area, primary volume descriptor, terminator, both path
+ *  tables, every directory in breadth-first order, then the files.
+ */
+
+typedef struct IsoDir
+{
+    PHYSFS_uint32 level;
+    PHYSFS_uint32 k;  /* see fixture_dirpath(). */
+    PHYSFS_uint32 parent;  /* index into the IsoDir array. */
+    PHYSFS_uint32 lba;
+    PHYSFS_uint32 size;  /* bytes, a multiple of ISO_SECTOR. */
+} IsoDir;
+
+typedef struct IsoWriter
+{
+    const FixtureParams *p;
+    PHYSFS_File *f;
+    IsoDir *dirs;
+    PHYSFS_uint32 numdirs;
+    PHYSFS_uint32 *filelba;
+    PHYSFS_uint8 sector[ISO_SECTOR];
+    PHYSFS_uint32 pos;  /* bytes used in this dir extent, so far. */
+    int writing;  /* zero while we're just measuring. */
+    int ok;
+} IsoWriter;
+
+static PHYSFS_uint32 iso_sectors(PHYSFS_uint64 len)
+{
+    return (PHYSFS_uint32) ((len + ISO_SECTOR - 1) / ISO_SECTOR);
+} /* iso_sectors */
+
+static void iso_both16(PHYSFS_uint8 *buf, PHYSFS_uint16 val)
+{
+    put16le(buf, val);
+    put16be(buf + 2, val);
+} /* iso_both16 */
+
+static void iso_both32(PHYSFS_uint8 *buf, PHYSFS_uint32 val)
+{
+    put32le(buf, val);
+    put32be(buf + 4, val);
+} /* iso_both32 */
+
+/* Build a directory record in (buf); returns its length. */
+static PHYSFS_uint32 iso_record(PHYSFS_uint8 *buf, const char *name,
+                                PHYSFS_uint32 namelen, PHYSFS_uint32 lba,
+                                PHYSFS_uint32 size, int isdir)
+{
+    const PHYSFS_uint32 len = 33 + namelen + ((namelen % 2) ? 0 : 1);
+    memset(buf, '\0', len);
+    buf[0] = (PHYSFS_uint8) len;
+    iso_both32(buf + 2, lba);
+    iso_both32(buf + 10, size);
+    buf[18] = 80;  /* 1980-01-01 00:00:00 GMT */
+    buf[19] = 1;
+    buf[20] = 1;
+    buf[25] = isdir ? 2 : 0;
+    iso_both16(buf + 28, 1);
+    buf[32] = (PHYSFS_uint8) namelen;
+    memcpy(buf + 33, name, namelen);
+    return len;
+} /* iso_record */
+
+static void iso_flush_sector(IsoWriter *iw)
+{
+    if ((iw->writing) && (iw->ok))
+        iw->ok = fixture_writeAll(iw->f, iw->sector, ISO_SECTOR);
+    memset(iw->sector, '\0', ISO_SECTOR);
+} /* iso_flush_sector */
+
+/* Records can't straddle sectors; pad with zeros to the next one. */
+static void iso_add_record(IsoWriter *iw, const char *name,
+                           PHYSFS_uint32 namelen, PHYSFS_uint32 lba,
+                           PHYSFS_uint32 size, int isdir)
+{
+    PHYSFS_uint8 rec[256];
+    const PHYSFS_uint32 len = iso_record(rec, name, namelen, lba, size, isdir);
+    PHYSFS_uint32 offset = iw->pos % ISO_SECTOR;
+
+    if ((offset + len) > ISO_SECTOR)
+    {
+        iso_flush_sector(iw);
+        iw->pos += ISO_SECTOR - offset;
+        offset = 0;
+    } /* if */
+
+    memcpy(iw->sector + offset, rec, len);
+    iw->pos += len;
+    if ((iw->pos % ISO_SECTOR) == 0)
+        iso_flush_sector(iw);
+} /* iso_add_record */
+
+static PHYSFS_uint32 iso_power(PHYSFS_uint32 width, PHYSFS_uint32 level)
+{
+    PHYSFS_uint32 retval = 1;
+    while (level--)
+        retval *= width;
+    return retval;
+} /* iso_power */
+
+/* The last part of (dir)'s path: its digit at its own level. */
+static void iso_dirname(const FixtureParams *p, const IsoDir *dir, char *buf)
+{
+    const PHYSFS_uint32 digit = (dir->k / iso_power(p->width, dir->level - 1)) % p->width;
+    sprintf(buf, "D%02u", (unsigned int) digit);
+} /* iso_dirname */
+
+/* Emit directory (d)'s records; (iw->writing) says if they go to disk. */
+static void iso_walk_dir(IsoWriter *iw, PHYSFS_uint32 d)
+{
+    const FixtureParams *p = iw->p;
+    const IsoDir *dir = &iw->dirs[d];
+    const IsoDir *parent = &iw->dirs[dir->parent];
+    const PHYSFS_uint32 leaves = fixture_leaves(p);
+    char name[32];
+    PHYSFS_uint32 i;
+
+    iw->pos = 0;
+    memset(iw->sector, '\0', ISO_SECTOR);
+    iso_add_record(iw, "\0", 1, dir->lba, dir->size, 1);
+    iso_add_record(iw, "\1", 1, parent->lba, parent->size, 1);
+
+    if ((dir->level == 0) && (p->bigsize > 0))  /* "BIG.DAT" sorts first. */
+    {
+        strcpy(name, "BIG.DAT;1");
+        iso_add_record(iw, name, (PHYSFS_uint32) strlen(name),
+                       iw->filelba[p->entries], (PHYSFS_uint32) p->bigsize, 0);
+    } /* if */
+
+    if ((fixture_flat(p)) || (dir->level == p->depth))  /* files. */
+    {
+        for (i = dir->k; i < p->entries; i += leaves)
+        {
+            fixture_basename(p, i, name);
+            strcat(name, ";1");
+            iso_add_record(iw, name, (PHYSFS_uint32) strlen(name),
+                           iw->filelba[i], p->filesize, 0);
+        } /* for */
+    } /* if */
+    else  /* subdirectories; they're in order right after their parent's. */
+    {
+        for (i = d + 1; i < iw->numdirs; i++)
+        {
+            const IsoDir *child = &iw->dirs[i];
+            if (child->parent != d)
+                continue;
+            iso_dirname(p, child, name);
+            iso_add_record(iw, name, 3, child->lba, child->size, 1);
+        } /* for */
+    } /* else */
+
+    if ((iw->pos % ISO_SECTOR) != 0)
+    {
+        iso_flush_sector(iw);
+        iw->pos += ISO_SECTOR - (iw->pos % ISO_SECTOR);
+    } /* if */
+} /* iso_walk_dir */
+
+static int fixture_write_iso(const FixtureParams *p, const char *fname)
+{
+    const PHYSFS_uint32 count = fixture_count(p);
+    PHYSFS_uint32 numdirs = 1;
+    PHYSFS_uint32 levelsize = 1;
+    PHYSFS_uint32 ptsize = 10;  /* the root's path table record. */
+    PHYSFS_uint32 ptsectors;
+    PHYSFS_uint32 lba;
+    PHYSFS_uint8 *pt = NULL;
+    IsoWriter *iw;
+    PHYSFS_uint32 i, j;
+    int ok = 0;
+
+    if ((p->bigsize >= 0xFFFFFFFF) || (p->entries > 9999999))
+        return fixture_unsupported();
+
+    iw = (IsoWriter *) fixture_malloc(sizeof (IsoWriter));
+    if (iw == NULL)
+        return 0;
+    memset(iw, '\0', sizeof (*iw));
+    iw->p = p;
+    iw->ok = 1;
+
+    if (!fixture_flat(p))
+    {
+        for (i = 0; i < p->depth; i++)
+        {
+            levelsize *= p->width;
+            numdirs += levelsize;
+            ptsize += levelsize * 12;  /* 8 + "Dnn" + 1 pad. */
+        } /* for */
+    } /* if */
+
+    iw->numdirs = numdirs;
+    iw->dirs = (IsoDir *) fixture_malloc(sizeof (IsoDir) * numdirs);
+    iw->filelba = (PHYSFS_uint32 *) fixture_malloc(sizeof (PHYSFS_uint32) * (count + 1));
+    ptsectors = iso_sectors(ptsize);
+    pt = (PHYSFS_uint8 *) fixture_malloc(ptsectors * ISO_SECTOR);
+    if ((iw->dirs == NULL) || (iw->filelba == NULL) || (pt == NULL))
+        goto iso_done;
+
+    /*
+     * Breadth-first: each directory's children follow in digit order, the
+     *  way path tables want them. Child (digit) of (k) at (level) is
+     *  k + digit * width^level.
+     */
+    memset(iw->dirs, '\0', sizeof (IsoDir) * numdirs);
+    for (i = 0, j = 1; j < numdirs; i++)
+    {
+        const IsoDir *parent = &iw->dirs[i];
+        const PHYSFS_uint32 scale = iso_power(p->width, parent->level);
+        PHYSFS_uint32 digit;
+        for (digit = 0; digit < p->width; digit++, j++)
+        {
+            iw->dirs[j].level = parent->level + 1;
+            iw->dirs[j].k = parent->k + (digit * scale);
+            iw->dirs[j].parent = i;
+        } /* for */
+    } /* for */
+
+    /* Measure every directory, so we know where everything goes. */
+    for (i = 0; i < count; i++)
+        iw->filelba[i] = 0;
+    for (i = 0; i < numdirs; i++)
+    {
+        iso_walk_dir(iw, i);
+        iw->dirs[i].size = iw->pos;
+    } /* for */
+
+    lba = 18 + (ptsectors * 2);
+    for (i = 0; i < numdirs; i++)
+    {
+        iw->dirs[i].lba = lba;
+        lba += iw->dirs[i].size / ISO_SECTOR;
+    } /* for */
+    for (i = 0; i < count; i++)
+    {
+        iw->filelba[i] = lba;
+        lba += iso_sectors(fixture_size(p, i));
+    } /* for */
+
+    iw->f = fixture_open(fname);
+    if (iw->f == NULL)
+        goto iso_done;
+
+    /* system area. */
+    memset(iw->sector, '\0', ISO_SECTOR);
+    for (i = 0; (iw->ok) && (i < 16); i++)
+        iw->ok = fixture_writeAll(iw->f, iw->sector, ISO_SECTOR);
+
+    /* primary volume descriptor. */
+    memset(iw->sector, ' ', ISO_SECTOR);
+    memset(iw->sector, '\0', 8);
+    iw->sector[0] = 1;
+    memcpy(iw->sector + 1, "CD001", 5);
+    iw->sector[6] = 1;
+    memcpy(iw->sector + 40, "PHYSFS_FIXTURE", 14);
+    memset(iw->sector + 72, '\0', 8);
+    iso_both32(iw->sector + 80, lba);
+    memset(iw->sector + 88, '\0', 32);
+    iso_both16(iw->sector + 120, 1);
+    iso_both16(iw->sector + 124, 1);
+    iso_both16(iw->sector + 128, ISO_SECTOR);
+    iso_both32(iw->sector + 132, ptsize);
+    put32le(iw->sector + 140, 18);
+    put32le(iw->sector + 144, 0);
+    put32be(iw->sector + 148, 18 + ptsectors);
+    put32be(iw->sector + 152, 0);
+    iso_record(iw->sector + 156, "\0", 1, iw->dirs[0].lba, iw->dirs[0].size, 1);
+    for (i = 0; i < 4; i++)  /* timestamps: all zeros, "not specified". */
+    {
+        memset(iw->sector + 813 + (i * 17), '0', 16);
+        iw->sector[813 + (i * 17) + 16] = 0;
+    } /* for */
+    iw->sector[881] = 1;
+    memset(iw->sector + 882, '\0', ISO_SECTOR - 882);
+    if (iw->ok)
+        iw->ok = fixture_writeAll(iw->f, iw->sector, ISO_SECTOR);
+
+    /* volume descriptor set terminator. */
+    memset(iw->sector, '\0', ISO_SECTOR);
+    iw->sector[0] = 255;
+    memcpy(iw->sector + 1, "CD001", 5);
+    iw->sector[6] = 1;
+    if (iw->ok)
+        iw->ok = fixture_writeAll(iw->f, iw->sector, ISO_SECTOR);
+
+    /* path tables: little endian, then big. */
+    for (j = 0; j < 2; j++)
+    {
+        PHYSFS_uint8 *ptr = pt;
+        memset(pt, '\0', ptsectors * ISO_SECTOR);
+        for (i = 0; i < numdirs; i++)
+        {
+            const IsoDir *dir = &iw->dirs[i];
+            const PHYSFS_uint32 namelen = (i == 0) ? 1 : 3;
+            ptr[0] = (PHYSFS_uint8) namelen;
+            if (j == 0)
+            {
+                put32le(ptr + 2, dir->lba);
+                put16le(ptr + 6, (PHYSFS_uint16) (dir->parent + 1));
+            } /* if */
+            else
+            {
+                put32be(ptr + 2, dir->lba);
+                put16be(ptr + 6, (PHYSFS_uint16) (dir->parent + 1));
+            } /* else */
+            if (i > 0)
+            {
+                char tmp[8];
+                iso_dirname(p, dir, tmp);
+                memcpy(ptr + 8, tmp, 3);
+            } /* if */
+            ptr += 8 + namelen + (namelen % 2);
+        } /* for */
+
+        if (iw->ok)
+            iw->ok = fixture_writeAll(iw->f, pt, ptsectors * ISO_SECTOR);
+    } /* for */
+
+    iw->writing = 1;
+    for (i = 0; (iw->ok) && (i < numdirs); i++)
+        iso_walk_dir(iw, i);
+
+    for (i = 0; (iw->ok) && (i < count); i++)
+    {
+        const PHYSFS_uint64 size = fixture_size(p, i);
+        iw->ok = fixture_copy(p, i, iw->f, NULL);
+        if ((iw->ok) && ((size % ISO_SECTOR) != 0))
+        {
+            memset(iw->sector, '\0', ISO_SECTOR);
+            iw->ok = fixture_writeAll(iw->f, iw->sector,
+                                      ISO_SECTOR - (size_t) (size % ISO_SECTOR));
+        } /* if */
+    } /* for */
+
+    ok = iw->ok;
+
+iso_done:
+    if ((iw->f != NULL) && (!PHYSFS_close(iw->f)))
+        ok = 0;
+    free(pt);
+    free(iw->filelba);
+    free(iw->dirs);
+    free(iw);
+    return ok;
+} /* fixture_write_iso */
+
+
+/*
+ * 7zip. There's no LZMA encoder in the tree, so every folder uses the
+ *  "copy" coder, but the layout is otherwise what 7-Zip writes: the packed
+ *  streams, then the header, with (solid) files sharing each folder.
+ */
+
+typedef struct ByteBuffer
+{
+    PHYSFS_uint8 *data;
+    size_t len;
+    size_t alloc;
+    int ok;
+} ByteBuffer;
+
+static void bb_byte(ByteBuffer *bb, PHYSFS_uint8 val)
+{
+    if (bb->len == bb->alloc)
+    {
+        const size_t newalloc = bb->alloc ? bb->alloc * 2 : 4096;
+        void *ptr = realloc(bb->data, newalloc);
+        if (ptr == NULL)
+        {
+            bb->ok = 0;
+            return;
+        } /* if */
+        bb->data = (PHYSFS_uint8 *) ptr;
+        bb->alloc = newalloc;
+    } /* if */
+    bb->data[bb->len++] = val;
+} /* bb_byte */
+
+static void bb_u32(ByteBuffer *bb, PHYSFS_uint32 val)
+{
+    int i;
+    for (i = 0; i < 4; i++, val >>= 8)
+        bb_byte(bb, (PHYSFS_uint8) (val & 0xFF));
+} /* bb_u32 */
+
+/* 7z's variable-length numbers: leading 1 bits count the extra bytes. */
+static void bb_number(ByteBuffer *bb, PHYSFS_uint64 val)
+{
+    PHYSFS_uint8 first = 0;
+    PHYSFS_uint8 mask = 0x80;
+    int i;
+
+    for (i = 0; i < 8; i++)
+    {
+        if (val < (((PHYSFS_uint64) 1) << (7 * (i + 1))))
+        {
+            first |= (PHYSFS_uint8) (val >> (8 * i));
+            break;
+        } /* if */
+        first |= mask;
+        mask >>= 1;
+    } /* for */
+
+    bb_byte(bb, first);
+    for (; i > 0; i--, val >>= 8)
+        bb_byte(bb, (PHYSFS_uint8) (val & 0xFF));
+} /* bb_number */
+
+static int fixture_write_7z(const FixtureParams *p, const char *fname)
+{
+    const PHYSFS_uint32 count = fixture_count(p);
+    const PHYSFS_uint32 perfolder = ((p->solid == 0) || (p->solid > count)) ? count : p->solid;
+    const PHYSFS_uint32 folders = (count + perfolder - 1) / perfolder;
+    PHYSFS_uint32 numdirs = 0;
+    PHYSFS_uint32 levelsize = 1;
+    PHYSFS_uint32 *crcs = NULL;
+    ByteBuffer hdr;
+    ByteBuffer names;
+    PHYSFS_uint8 start[32];
+    PHYSFS_uint64 packed = 0;
+    PHYSFS_File *f = NULL;
+    char name[256];
+    PHYSFS_uint32 i, j;
+    int ok = 0;
+
+    memset(&hdr, '\0', sizeof (hdr));
+    memset(&names, '\0', sizeof (names));
+    hdr.ok = names.ok = 1;
+
+    for (i = 0; i < count; i++)
+    {
+        if (fixture_size(p, i) == 0)  /* would need "empty file" records. */
+            return fixture_unsupported();
+    } /* for */
+
+    crcs = (PHYSFS_uint32 *) fixture_malloc(sizeof (PHYSFS_uint32) * (count + 1));
+    if (crcs == NULL)
+        return 0;
+
+    f = fixture_open(fname);
+    if (f == NULL)
+        goto sevenz_done;
+
+    /* start header goes in last, once we know where everything is. */
+    memset(start, '\0', sizeof (start));
+    if (!fixture_writeAll(f, start, sizeof (start)))
+        goto sevenz_done;
+
+    for (i = 0; i < count; i++)
+    {
+        crcs[i] = 0;
+        fixture_copy(p, i, NULL, &crcs[i]);
+        if (!fixture_copy(p, i, f, NULL))
+            goto sevenz_done;
+        packed += fixture_size(p, i);
+    } /* for */
+
+    /* directories first, then files, each name as UTF-16LE. */
+    bb_byte(&names, 0);  /* not external. */
+    if (!fixture_flat(p))
+    {
+        for (i = 1; i <= p->depth; i++)
+        {
+            levelsize *= p->width;
+            for (j = 0; j < levelsize; j++, numdirs++)
+            {
+                char *ptr = name;
+                fixture_dirpath(p, i, j, name, sizeof (name));
+                name[strlen(name) - 1] = '\0';  /* no trailing '/'. */
+                while (*ptr)
+                {
+                    bb_byte(&names, (PHYSFS_uint8) *(ptr++));
+                    bb_byte(&names, 0);
+                } /* while */
+                bb_byte(&names, 0);
+                bb_byte(&names, 0);
+            } /* for */
+        } /* for */
+    } /* if */
+
+    for (i = 0; i < count; i++)
+    {
+        char *ptr = name;
+        fixture_name(p, i, name, sizeof (name));
+        while (*ptr)
+        {
+            bb_byte(&names, (PHYSFS_uint8) *(ptr++));
+            bb_byte(&names, 0);
+        } /* while */
+        bb_byte(&names, 0);
+        bb_byte(&names, 0);
+    } /* for */
+
+    bb_byte(&hdr, 0x01);  /* header */
+    bb_byte(&hdr, 0x04);  /* main streams info */
+
+    bb_byte(&hdr, 0x06);  /* pack info */
+    bb_number(&hdr, 0);
+    bb_number(&hdr, folders);
+    bb_byte(&hdr, 0x09);  /* sizes */
+    for (i = 0; i < folders; i++)
+    {
+        PHYSFS_uint64 size = 0;
+        for (j = i * perfolder; (j < count) && (j < (i + 1) * perfolder); j++)
+            size += fixture_size(p, j);
+        bb_number(&hdr, size);
+    } /* for */
+    bb_byte(&hdr, 0x00);
+
+    bb_byte(&hdr, 0x07);  /* unpack info */
+    bb_byte(&hdr, 0x0B);  /* folders */
+    bb_number(&hdr, folders);
+    bb_byte(&hdr, 0);  /* not external. */
+    for (i = 0; i < folders; i++)
+    {
+        bb_number(&hdr, 1);  /* one coder... */
+        bb_byte(&hdr, 0x01);  /* ...with a 1-byte id, one in, one out... */
+        bb_byte(&hdr, 0x00);  /* ...and that id is "copy". */
+    } /* for */
+    bb_byte(&hdr, 0x0C);  /* unpacked sizes */
+    for (i = 0; i < folders; i++)
+    {
+        PHYSFS_uint64 size = 0;
+        for (j = i * perfolder; (j < count) && (j < (i + 1) * perfolder); j++)
+            size += fixture_size(p, j);
+        bb_number(&hdr, size);
+    } /* for */
+    bb_byte(&hdr, 0x00);
+
+    bb_byte(&hdr, 0x08);  /* substreams info */
+    bb_byte(&hdr, 0x0D);  /* files per folder */
+    for (i = 0; i < folders; i++)
+    {
+        const PHYSFS_uint32 end = ((i + 1) * perfolder < count) ? (i + 1) * perfolder : count;
+        bb_number(&hdr, end - (i * perfolder));
+    } /* for */
+    bb_byte(&hdr, 0x09);  /* sizes, except the last in each folder. */
+    for (i = 0; i < count; i++)
+    {
+        if (((i + 1) % perfolder != 0) && (i + 1 != count))
+            bb_number(&hdr, fixture_size(p, i));
+    } /* for */
+    bb_byte(&hdr, 0x0A);  /* CRCs */
+    bb_byte(&hdr, 1);  /* all defined. */
+    for (i = 0; i < count; i++)
+        bb_u32(&hdr, crcs[i]);
+    bb_byte(&hdr, 0x00);
+
+    bb_byte(&hdr, 0x00);  /* end of main streams info. */
+
+    bb_byte(&hdr, 0x05);  /* files info */
+    bb_number(&hdr, numdirs + count);
+    if (numdirs > 0)
+    {
+        const PHYSFS_uint32 bytes = (numdirs + count + 7) / 8;
+        bb_byte(&hdr, 0x0E);  /* empty streams: the directories. */
+        bb_number(&hdr, bytes);
+        for (i = 0; i < bytes; i++)
+        {
+            PHYSFS_uint8 val = 0;
+            for (j = 0; j < 8; j++)
+            {
+                if (((i * 8) + j) < numdirs)
+                    val |= 0x80 >> j;
+            } /* for */
+            bb_byte(&hdr, val);
+        } /* for */
+    } /* if */
+    bb_byte(&hdr, 0x11);  /* names */
+    bb_number(&hdr, names.len);
+    for (i = 0; i < names.len; i++)
+        bb_byte(&hdr, names.data[i]);
+    bb_byte(&hdr, 0x00);  /* end of files info. */
+
+    bb_byte(&hdr, 0x00);  /* end of header. */
+
+    if ((!hdr.ok) || (!names.ok))
+    {
+        PHYSFS_setErrorCode(PHYSFS_ERR_OUT_OF_MEMORY);
+        goto sevenz_done;
+    } /* if */
+
+    if (!fixture_writeAll(f, hdr.data, hdr.len))
+        goto sevenz_done;
+
+    memcpy(start, "7z\xBC\xAF\x27\x1C", 6);
+    start[6] = 0;
+    start[7] = 2;
+    put64le(start + 12, packed);
+    put64le(start + 20, hdr.len);
+    put32le(start + 28, fixture_crc32(0, hdr.data, hdr.len));
+    put32le(start + 8, fixture_crc32(0, start + 12, 20));
+    ok = ( (PHYSFS_seek(f, 0)) && (fixture_writeAll(f, start, sizeof (start))) );
+
+sevenz_done:
+    if ((f != NULL) && (!PHYSFS_close(f)))
+        ok = 0;
+    free(names.data);
+    free(hdr.data);
+    free(crcs);
+    return ok;
+} /* fixture_write_7z */
+
+
+int fixture_write(const FixtureParams *p, const char *fname)
+{
+    switch (p->format)
+    {
+        case FIXTURE_DIR: return fixture_write_dir(p, fname);
+        case FIXTURE_ZIP: return fixture_write_zip(p, fname);
+        case FIXTURE_GRP: return fixture_write_grp(p, fname);
+        case FIXTURE_WAD: return fixture_write_wad(p, fname);
+        case FIXTURE_ISO: return fixture_write_iso(p, fname);
+        case FIXTURE_7Z: return fixture_write_7z(p, fname);
+    } /* switch */
+
+    PHYSFS_setErrorCode(PHYSFS_ERR_INVALID_ARGUMENT);
+    return 0;
+} /* fixture_write */
+
+/* end of fixture.c ... */
+
@@ -0,0 +1,82 @@
+/**
+ * Synthetic archive fixtures for PhysicsFS benchmarks.
+ *
+ * Everything here is generated from a seed, so the same parameters always
+ *  produce byte-for-byte the same archive, on any machine, without needing
+ *  any external tools. Fixtures are written through PhysicsFS itself, into
+ *  whatever PHYSFS_setWriteDir() is pointing at.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+#ifndef _INCLUDE_PHYSFS_FIXTURE_H_
+#define _INCLUDE_PHYSFS_FIXTURE_H_
+
+#include "physfs.h"
+
+typedef enum FixtureFormat
+{
+    FIXTURE_DIR,  /* a real directory tree. */
+    FIXTURE_ZIP,
+    FIXTURE_GRP,  /* Build engine groupfile; always flat, 8.3 names. */
+    FIXTURE_WAD,  /* Doom WAD; always flat, 8 character names. */
+    FIXTURE_ISO,  /* ISO9660, level 1: 8.3 names, upper case. */
+    FIXTURE_7Z    /* 7zip, with the "copy" coder; see (solid). */
+} FixtureFormat;
+
+typedef enum FixtureMethod  /* only ZIP has a choice. */
+{
+    FIXTURE_STORED,
+    FIXTURE_DEFLATED,
+    FIXTURE_ENCRYPTED,  /* WinZip AES-256, stored. Needs FIXTURE_HAVE_AES. */
+    FIXTURE_MIXED  /* each of the above in turn, or the first two. */
+} FixtureMethod;
+
+typedef struct FixtureParams
+{
+    FixtureFormat format;
+    FixtureMethod method;
+    PHYSFS_uint32 seed;
+    PHYSFS_uint32 entries;  /* number of small files. */
+    PHYSFS_uint32 filesize;  /* bytes in each small file. */
+    PHYSFS_uint32 width;  /* subdirectories per directory. */
+    PHYSFS_uint32 depth;  /* levels of subdirectories; 0 for a flat tree. */
+    PHYSFS_uint64 bigsize;  /* bytes in one extra large file; 0 for none. */
+    PHYSFS_uint32 solid;  /* 7z: files per solid block; 0 for just one. */
+    int zip64;  /* ZIP: write Zip64 records even when they aren't needed. */
+} FixtureParams;
+
+/* Fill in (p) with something small and flat. */
+void fixture_defaults(FixtureParams *p, FixtureFormat format);
+
+/* "zip", "grp", etc, to and from FixtureFormat. "dir" is FIXTURE_DIR. */
+const char *fixture_format_name(FixtureFormat format);
+int fixture_parse_format(const char *name, FixtureFormat *format);
+
+/* Files in the fixture: the small ones, then the large one, if any. */
+PHYSFS_uint32 fixture_count(const FixtureParams *p);
+
+/* Size of file (idx). */
+PHYSFS_uint64 fixture_size(const FixtureParams *p, PHYSFS_uint32 idx);
+
+/* How a ZIP stores file (idx). */
+FixtureMethod fixture_method(const FixtureParams *p, PHYSFS_uint32 idx);
+
+/* Platform-independent path of file (idx), relative to the fixture root. */
+void fixture_name(const FixtureParams *p, PHYSFS_uint32 idx,
+                  char *buf, size_t buflen);
+
+/* Contents of file (idx), starting at (offset); usable to verify reads. */
+void fixture_data(const FixtureParams *p, PHYSFS_uint32 idx,
+                  PHYSFS_uint64 offset, void *buf, size_t len);
+
+/*
+ * Write the fixture as (fname), relative to the write dir. Returns zero on
+ *  failure, with the details in PHYSFS_getLastError().
+ */
+int fixture_write(const FixtureParams *p, const char *fname);
+
+#endif  /* include-once blocker. */
+
+/* end of fixture.h ... */
+
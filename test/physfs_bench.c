@@ -0,0 +1,1528 @@
+/**
+ * Benchmarks for PhysicsFS.
+ *
+ * This generates its own fixtures (see fixture.h), so it runs the same way
+ *  everywhere, offline, and prints one CSV line per result to stdout so runs
+ *  can be compared by machine. Progress and errors go to stderr.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN 1
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#include <sys/time.h>
+#include <dirent.h>
+#endif
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "physfs.h"
+#include "fixture.h"
+
+#define BENCH_READSIZE (64 * 1024)
+#define BENCH_MAXTHREADS 64
+#define BENCH_MAXFILES 4096
+#define BENCH_MAXNS (2 * 1000000000ull)  /* stop slow loops after this. */
+#define BENCH_CHECKSIZE (4 * 1024)  /* bytes check_file() compares. */
+
+typedef struct BenchArchive
+{
+    char label[64];
+    char *native;  /* platform-dependent path, to PHYSFS_mount(). */
+    FixtureParams params;
+    int generated;
+} BenchArchive;
+
+typedef struct BenchFiles
+{
+    char **names;
+    PHYSFS_uint32 count;
+    PHYSFS_uint32 capacity;
+    PHYSFS_uint32 total;  /* everything seen, even past BENCH_MAXFILES. */
+    char *largest;
+    PHYSFS_sint64 largestsize;
+} BenchFiles;
+
+static const char *workdir = "physfs_bench.tmp";
+static PHYSFS_uint32 scale = 1;
+static int maxthreads = 8;
+static PHYSFS_uint32 seed = 1;
+static int keepfixtures = 0;
+static PHYSFS_uint32 maxlistentries = 1000000;
+static int failures = 0;
+
+/*
+ * Everything PhysicsFS allocates goes through here, so bench_open_close()
+ *  can count it. It only counts while (countallocs) is set, and that's only
+ *  set while a single thread is using PhysicsFS, so a plain counter is fine.
+ */
+static int countallocs = 0;
+static PHYSFS_uint64 allocs = 0;
+
+static void *count_malloc(PHYSFS_uint64 len)
+{
+    if (countallocs)
+        allocs++;
+    return malloc((size_t) len);
+} /* count_malloc */
+
+static void *count_realloc(void *ptr, PHYSFS_uint64 len)
+{
+    if (countallocs)
+        allocs++;
+    return realloc(ptr, (size_t) len);
+} /* count_realloc */
+
+static void count_free(void *ptr)
+{
+    free(ptr);
+} /* count_free */
+
+static const PHYSFS_Allocator countingAllocator =
+{
+    NULL, NULL, count_malloc, count_realloc, count_free
+};
+
+
+static PHYSFS_uint64 now_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER counter;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (PHYSFS_uint64) ((double) counter.QuadPart * 1e9 / (double) freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((PHYSFS_uint64) ts.tv_sec * 1000000000) + ts.tv_nsec;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((PHYSFS_uint64) tv.tv_sec * 1000000000) + (tv.tv_usec * 1000);
+#endif
+} /* now_ns */
+
+
+static PHYSFS_uint32 next_random(PHYSFS_uint32 *state)
+{
+    PHYSFS_uint32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+} /* next_random */
+
+
+static PHYSFS_uint64 random_below(PHYSFS_uint32 *state, PHYSFS_uint64 max)
+{
+    const PHYSFS_uint64 hi = next_random(state);
+    const PHYSFS_uint64 r = (hi << 32) | next_random(state);
+    return (max > 0) ? (r % max) : 0;
+} /* random_below */
+
+
+static void report(const char *bench, const char *archive, const char *param,
+                   double value, const char *unit)
+{
+    printf("%s,%s,%s,%.3f,%s\n", bench, archive, param, value, unit);
+    fflush(stdout);
+} /* report */
+
+
+static void fail(const char *what, const char *archive)
+{
+    fprintf(stderr, "physfs_bench: %s failed on %s: %s\n", what, archive,
+            PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+    failures++;
+} /* fail */
+
+
+static char *native_path(const char *fname)
+{
+    const char *sep = PHYSFS_getDirSeparator();
+    char *retval = (char *) malloc(strlen(workdir) + strlen(sep) + strlen(fname) + 1);
+    if (retval != NULL)
+        sprintf(retval, "%s%s%s", workdir, sep, fname);
+    return retval;
+} /* native_path */
+
+
+static void collect_files(BenchFiles *files, const char *dir);
+
+static void collect_callback(void *data, const char *origdir,
+                             const char *fname, PHYSFS_Stat *stat)
+{
+    BenchFiles *files = (BenchFiles *) data;
+    PHYSFS_Stat statbuf;
+    char *path = (char *) malloc(strlen(origdir) + strlen(fname) + 2);
+
+    if (path == NULL)
+        return;
+    else if (*origdir)
+        sprintf(path, "%s/%s", origdir, fname);
+    else
+        strcpy(path, fname);
+
+    if (stat != NULL)
+        memcpy(&statbuf, stat, sizeof (statbuf));
+    else if (!PHYSFS_stat(path, &statbuf))
+    {
+        free(path);
+        return;
+    } /* else if */
+
+    if (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY)
+    {
+        collect_files(files, path);
+        free(path);
+        return;
+    } /* if */
+
+    files->total++;
+    if (statbuf.filesize > files->largestsize)
+    {
+        free(files->largest);
+        files->largest = (char *) malloc(strlen(path) + 1);
+        if (files->largest != NULL)
+            strcpy(files->largest, path);
+        files->largestsize = statbuf.filesize;
+    } /* if */
+
+    if (files->count < BENCH_MAXFILES)
+    {
+        if (files->count == files->capacity)
+        {
+            const PHYSFS_uint32 newcap = files->capacity ? files->capacity * 2 : 64;
+            void *ptr = realloc(files->names, newcap * sizeof (char *));
+            if (ptr == NULL)
+            {
+                free(path);
+                return;
+            } /* if */
+            files->names = (char **) ptr;
+            files->capacity = newcap;
+        } /* if */
+        files->names[files->count++] = path;
+        path = NULL;
+    } /* if */
+    free(path);
+} /* collect_callback */
+
+
+static void collect_files(BenchFiles *files, const char *dir)
+{
+    /* we want sizes, so ask for the whole stat. */
+    PHYSFS_enumerateFilesCallbackWithStats(dir, collect_callback, files);
+} /* collect_files */
+
+
+static void free_files(BenchFiles *files)
+{
+    PHYSFS_uint32 i;
+    for (i = 0; i < files->count; i++)
+        free(files->names[i]);
+    free(files->names);
+    free(files->largest);
+    memset(files, '\0', sizeof (*files));
+} /* free_files */
+
+
+static void bench_mount(const BenchArchive *arc, const char *param)
+{
+    const int reps = 5;
+    PHYSFS_uint64 best = 0;
+    int i;
+
+    for (i = 0; i < reps; i++)
+    {
+        const PHYSFS_uint64 start = now_ns();
+        PHYSFS_uint64 elapsed;
+        if (!PHYSFS_mount(arc->native, "/", 0))
+        {
+            fail("mount", arc->label);
+            return;
+        } /* if */
+        elapsed = now_ns() - start;
+        PHYSFS_unmount(arc->native);
+        if ((i == 0) || (elapsed < best))
+            best = elapsed;
+    } /* for */
+
+    report("mount", arc->label, param, best / 1000.0, "us");
+} /* bench_mount */
+
+
+static void bench_enumerate(const BenchArchive *arc, BenchFiles *files)
+{
+    const PHYSFS_uint64 start = now_ns();
+    char param[32];
+    double secs;
+
+    collect_files(files, "");
+    secs = (now_ns() - start) / 1e9;
+    sprintf(param, "entries=%u", (unsigned int) files->total);
+    report("enumerate", arc->label, param, files->total / secs, "entries/s");
+} /* bench_enumerate */
+
+
+static void bench_open_close(const BenchArchive *arc, const BenchFiles *files)
+{
+    const int ops = 2000;
+    PHYSFS_uint32 state = seed;
+    PHYSFS_uint64 start;
+    int i;
+
+    allocs = 0;
+    countallocs = 1;
+    start = now_ns();
+    for (i = 0; i < ops; i++)
+    {
+        const char *fname = files->names[random_below(&state, files->count)];
+        PHYSFS_File *f = PHYSFS_openRead(fname);
+        if (f == NULL)
+        {
+            countallocs = 0;
+            fail("open", arc->label);
+            return;
+        } /* if */
+        PHYSFS_close(f);
+    } /* for */
+    countallocs = 0;
+
+    report("open_close", arc->label, "random",
+           (now_ns() - start) / (1000.0 * ops), "us/op");
+    report("open_close_allocs", arc->label, "random",
+           ((double) allocs) / ops, "allocs/op");
+} /* bench_open_close */
+
+
+/* Check a read of the generated big file against what we generated. */
+static void verify_read(const BenchArchive *arc, PHYSFS_uint64 offset,
+                        const void *buf, size_t len)
+{
+    static PHYSFS_uint8 expected[BENCH_READSIZE];
+    if ((!arc->generated) || (arc->params.bigsize == 0))
+        return;
+
+    fixture_data(&arc->params, arc->params.entries, offset, expected, len);
+    if (memcmp(buf, expected, len) != 0)
+    {
+        fprintf(stderr, "physfs_bench: bad data at offset %lu in %s\n",
+                (unsigned long) offset, arc->label);
+        failures++;
+    } /* if */
+} /* verify_read */
+
+
+static void bench_seq_read(const BenchArchive *arc, const BenchFiles *files)
+{
+    static PHYSFS_uint8 buf[BENCH_READSIZE];
+    const int passes = 3;
+    PHYSFS_uint64 total = 0;
+    PHYSFS_uint64 start;
+    int i;
+
+    start = now_ns();
+    for (i = 0; i < passes; i++)
+    {
+        PHYSFS_File *f = PHYSFS_openRead(files->largest);
+        PHYSFS_sint64 br;
+        if (f == NULL)
+        {
+            fail("open", arc->label);
+            return;
+        } /* if */
+
+        while ((br = PHYSFS_readBytes(f, buf, sizeof (buf))) > 0)
+        {
+            if (i == 0)
+                verify_read(arc, total, buf, (size_t) br);
+            total += br;
+        } /* while */
+
+        if (br < 0)
+            fail("read", arc->label);
+        PHYSFS_close(f);
+    } /* for */
+
+    report("seq_read", arc->label, "64k",
+           total / ((now_ns() - start) / 1e9) / (1024.0 * 1024.0), "MiB/s");
+} /* bench_seq_read */
+
+
+/* A parser's reads: four bytes at a time, under each buffering mode. */
+static void bench_small_reads(const BenchArchive *arc, const BenchFiles *files)
+{
+    static const struct { const char *param; PHYSFS_uint64 bufsize;
+                          PHYSFS_uint32 flags; } modes[] = {
+        { "unbuffered", 0, 0 },
+        { "4k", 4096, 0 },
+        { "adaptive", 0, PHYSFS_BUFFER_ADAPTIVE },
+        { "adaptive_double", 0, PHYSFS_BUFFER_ADAPTIVE | PHYSFS_BUFFER_DOUBLE }
+    };
+    const PHYSFS_uint64 limit = 4 * 1024 * 1024;
+    PHYSFS_uint32 expected = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof (modes) / sizeof (modes[0]); i++)
+    {
+        PHYSFS_File *f = PHYSFS_openRead(files->largest);
+        PHYSFS_uint32 sum = 0;
+        PHYSFS_uint64 total = 0;
+        PHYSFS_uint64 start;
+        PHYSFS_uint32 val;
+
+        if (f == NULL)
+        {
+            fail("open", arc->label);
+            return;
+        } /* if */
+
+        if (!PHYSFS_setBufferMode(f, modes[i].bufsize, modes[i].flags))
+        {
+            fail("setBufferMode", arc->label);
+            PHYSFS_close(f);
+            return;
+        } /* if */
+
+        start = now_ns();
+        while ((total < limit) && (PHYSFS_readULE32(f, &val)))
+        {
+            sum = (sum * 31) + val;
+            total += sizeof (val);
+        } /* while */
+
+        report("small_reads", arc->label, modes[i].param,
+               total / ((now_ns() - start) / 1e9) / (1024.0 * 1024.0),
+               "MiB/s");
+        PHYSFS_close(f);
+
+        if (i == 0)
+            expected = sum;
+        else if (sum != expected)
+        {
+            fprintf(stderr, "physfs_bench: %s reads differ in %s\n",
+                    modes[i].param, arc->label);
+            failures++;
+        } /* else if */
+    } /* for */
+} /* bench_small_reads */
+
+
+static void bench_random_read(const BenchArchive *arc, const BenchFiles *files)
+{
+    static PHYSFS_uint8 buf[4096];
+    const int ops = 2000;
+    const PHYSFS_uint64 max = (files->largestsize > (PHYSFS_sint64) sizeof (buf)) ?
+                              files->largestsize - sizeof (buf) : 0;
+    PHYSFS_uint32 state = seed;
+    PHYSFS_File *f = PHYSFS_openRead(files->largest);
+    PHYSFS_uint64 start;
+    int i;
+
+    if (f == NULL)
+    {
+        fail("open", arc->label);
+        return;
+    } /* if */
+
+    start = now_ns();
+    for (i = 0; (i < ops) && ((now_ns() - start) < BENCH_MAXNS); i++)
+    {
+        const PHYSFS_uint64 offset = random_below(&state, max + 1);
+        if ( (!PHYSFS_seek(f, offset)) ||
+             (PHYSFS_readBytes(f, buf, sizeof (buf)) < 0) )
+        {
+            fail("random read", arc->label);
+            break;
+        } /* if */
+    } /* for */
+
+    report("random_read", arc->label, "4k",
+           (now_ns() - start) / (1000.0 * i), "us/op");
+    PHYSFS_close(f);
+} /* bench_random_read */
+
+
+static void bench_backward_seek(const BenchArchive *arc, const BenchFiles *files)
+{
+    const int ops = 50;
+    const PHYSFS_uint64 begin = now_ns();
+    PHYSFS_uint64 total = 0;
+    PHYSFS_File *f = PHYSFS_openRead(files->largest);
+    char ch;
+    int i;
+
+    if (f == NULL)
+    {
+        fail("open", arc->label);
+        return;
+    } /* if */
+
+    for (i = 0; (i < ops) && ((now_ns() - begin) < BENCH_MAXNS); i++)
+    {
+        PHYSFS_uint64 start;
+        if ( (!PHYSFS_seek(f, files->largestsize - 1)) ||
+             (PHYSFS_readBytes(f, &ch, 1) != 1) )
+        {
+            fail("seek", arc->label);
+            break;
+        } /* if */
+
+        start = now_ns();
+        if ( (!PHYSFS_seek(f, 0)) || (PHYSFS_readBytes(f, &ch, 1) != 1) )
+        {
+            fail("seek", arc->label);
+            break;
+        } /* if */
+        total += now_ns() - start;
+    } /* for */
+
+    report("backward_seek", arc->label, "end_to_start",
+           total / (1000.0 * i), "us/op");
+    PHYSFS_close(f);
+} /* bench_backward_seek */
+
+
+typedef struct ThreadWork
+{
+    const BenchFiles *files;
+    PHYSFS_uint32 state;
+    int ops;
+    int errors;
+} ThreadWork;
+
+static void thread_work(ThreadWork *work)
+{
+    static const int BUFSIZE = 16 * 1024;
+    char *buf = (char *) malloc(BUFSIZE);
+    int i;
+
+    for (i = 0; (buf != NULL) && (i < work->ops); i++)
+    {
+        const PHYSFS_uint32 idx = (PHYSFS_uint32) random_below(&work->state, work->files->count);
+        PHYSFS_File *f = PHYSFS_openRead(work->files->names[idx]);
+        PHYSFS_sint64 br;
+        if (f == NULL)
+        {
+            work->errors++;
+            continue;
+        } /* if */
+
+        while ((br = PHYSFS_readBytes(f, buf, BUFSIZE)) > 0) { /* spin. */ }
+        if (br < 0)
+            work->errors++;
+        PHYSFS_close(f);
+    } /* for */
+
+    free(buf);
+} /* thread_work */
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID data)
+{
+    thread_work((ThreadWork *) data);
+    return 0;
+} /* thread_entry */
+#else
+static void *thread_entry(void *data)
+{
+    thread_work((ThreadWork *) data);
+    return NULL;
+} /* thread_entry */
+#endif
+
+
+static void bench_threads(const BenchArchive *arc, const BenchFiles *files)
+{
+    const int ops = 1000;
+    ThreadWork work[BENCH_MAXTHREADS];
+    int threads;
+
+    for (threads = 1; threads <= maxthreads; threads *= 2)
+    {
+        PHYSFS_uint64 start;
+        char param[32];
+        int errors = 0;
+        int i;
+#ifdef _WIN32
+        HANDLE handles[BENCH_MAXTHREADS];
+#else
+        pthread_t handles[BENCH_MAXTHREADS];
+#endif
+
+        start = now_ns();
+        for (i = 0; i < threads; i++)
+        {
+            work[i].files = files;
+            work[i].state = seed + i;
+            work[i].ops = ops / threads;  /* same total work each time. */
+            work[i].errors = 0;
+#ifdef _WIN32
+            handles[i] = CreateThread(NULL, 0, thread_entry, &work[i], 0, NULL);
+#else
+            if (pthread_create(&handles[i], NULL, thread_entry, &work[i]) != 0)
+                break;
+#endif
+        } /* for */
+
+        while (i-- > 0)
+        {
+#ifdef _WIN32
+            WaitForSingleObject(handles[i], INFINITE);
+            CloseHandle(handles[i]);
+#else
+            pthread_join(handles[i], NULL);
+#endif
+            errors += work[i].errors;
+        } /* while */
+
+        if (errors)
+        {
+            fprintf(stderr, "physfs_bench: %d errors with %d threads on %s\n",
+                    errors, threads, arc->label);
+            failures++;
+        } /* if */
+
+        sprintf(param, "threads=%d", threads);
+        report("open_read_close", arc->label, param,
+               (threads * (ops / threads)) / ((now_ns() - start) / 1e9),
+               "files/s");
+    } /* for */
+} /* bench_threads */
+
+
+static void bench_async(const BenchArchive *arc, const BenchFiles *files)
+{
+    enum { OPS = 256 };
+    PHYSFS_File *f[OPS];
+    PHYSFS_AsyncRequest *req[OPS];
+    PHYSFS_sint64 len[OPS];
+    char *buf = (char *) malloc(OPS * BENCH_READSIZE);
+    int workers;
+
+    for (workers = 0; (buf != NULL) && (workers <= maxthreads);
+         workers = workers ? workers * 2 : 1)
+    {
+        PHYSFS_uint32 state = seed;
+        PHYSFS_uint64 start;
+        char param[32];
+        int errors = 0;
+        int i;
+
+        PHYSFS_setAsyncThreads((PHYSFS_uint32) workers);
+        start = now_ns();
+        for (i = 0; i < OPS; i++)
+        {
+            const PHYSFS_uint32 idx = (PHYSFS_uint32) random_below(&state, files->count);
+            req[i] = NULL;
+            f[i] = PHYSFS_openRead(files->names[idx]);
+            if (f[i] == NULL)
+                continue;
+            len[i] = PHYSFS_fileLength(f[i]);
+            if (len[i] > BENCH_READSIZE)
+                len[i] = BENCH_READSIZE;
+            req[i] = PHYSFS_readAsync(f[i], 0, buf + (i * BENCH_READSIZE),
+                                      (PHYSFS_uint64) len[i], NULL, NULL);
+        } /* for */
+
+        for (i = 0; i < OPS; i++)
+        {
+            if ( (req[i] == NULL) ||
+                 (PHYSFS_waitAsync(req[i]) != PHYSFS_ASYNC_DONE) ||
+                 (PHYSFS_getAsyncResult(req[i]) != len[i]) )
+                errors++;
+            PHYSFS_freeAsync(req[i]);
+            if (f[i] != NULL)
+                PHYSFS_close(f[i]);
+        } /* for */
+
+        if (errors)
+        {
+            fprintf(stderr, "physfs_bench: %d async errors with %d workers on %s\n",
+                    errors, workers, arc->label);
+            failures++;
+        } /* if */
+
+        sprintf(param, "workers=%d", workers);
+        report("async_load", arc->label, param,
+               OPS / ((now_ns() - start) / 1e9), "files/s");
+    } /* for */
+
+    PHYSFS_setAsyncThreads(4);
+    free(buf);
+} /* bench_async */
+
+
+/* each call has its own index, so no locking; callbacks can overlap. */
+static void load_many_callback(void *data, PHYSFS_uint32 index,
+                               const char *fname, const void *buffer,
+                               PHYSFS_sint64 len, PHYSFS_ErrorCode err)
+{
+    ((PHYSFS_sint64 *) data)[index] = len;
+} /* load_many_callback */
+
+
+static void bench_load_many(const BenchArchive *arc, const BenchFiles *files)
+{
+    const PHYSFS_uint32 count = files->count;
+    const char **list = (const char **) malloc(count * sizeof (char *));
+    PHYSFS_sint64 *lens = (PHYSFS_sint64 *) malloc(count * sizeof (PHYSFS_sint64));
+    PHYSFS_uint32 state = seed;
+    PHYSFS_uint64 start;
+    char *buf = NULL;
+    PHYSFS_sint64 bufsize = 0;
+    int workers;
+    PHYSFS_uint32 i;
+
+    if ((list == NULL) || (lens == NULL))
+    {
+        free(list);
+        free(lens);
+        return;
+    } /* if */
+
+    /* every file once, in the kind of order a game asks for them. */
+    for (i = 0; i < count; i++)
+        list[i] = files->names[i];
+    for (i = count - 1; i > 0; i--)
+    {
+        const PHYSFS_uint32 j = (PHYSFS_uint32) random_below(&state, i + 1);
+        const char *tmp = list[i];
+        list[i] = list[j];
+        list[j] = tmp;
+    } /* for */
+
+    start = now_ns();
+    for (i = 0; i < count; i++)
+    {
+        PHYSFS_File *f = PHYSFS_openRead(list[i]);
+        const PHYSFS_sint64 len = f ? PHYSFS_fileLength(f) : -1;
+        if ((len >= 0) && (len >= bufsize))
+        {
+            free(buf);
+            bufsize = len + 1;
+            buf = (char *) malloc((size_t) bufsize);
+        } /* if */
+        if ((buf == NULL) || (len < 0) || (PHYSFS_readBytes(f, buf, len) != len))
+            fail("load_each", list[i]);
+        if (f != NULL)
+            PHYSFS_close(f);
+    } /* for */
+    report("load_each", arc->label, "sync", count / ((now_ns() - start) / 1e9),
+           "files/s");
+    free(buf);
+
+    for (workers = 0; workers <= maxthreads; workers = workers ? workers * 2 : 1)
+    {
+        char param[32];
+        PHYSFS_uint32 loaded;
+
+        PHYSFS_setAsyncThreads((PHYSFS_uint32) workers);
+        start = now_ns();
+        loaded = PHYSFS_loadMany(list, count, load_many_callback, lens);
+        sprintf(param, "workers=%d", workers);
+        report("load_many", arc->label, param,
+               count / ((now_ns() - start) / 1e9), "files/s");
+
+        if (loaded != count)
+        {
+            fprintf(stderr, "physfs_bench: loaded %u of %u with %d workers on %s\n",
+                    (unsigned int) loaded, (unsigned int) count, workers,
+                    arc->label);
+            failures++;
+        } /* if */
+    } /* for */
+
+    PHYSFS_setAsyncThreads(4);
+    free(lens);
+    free(list);
+} /* bench_load_many */
+
+
+/*
+ * Read the start and end of generated file (idx) and check them against
+ *  what we generated, then seek to its end and back. A second handle reads
+ *  the start again in the middle of that, since it mustn't share a
+ *  position with the first. Returns zero, after saying why, if anything's
+ *  wrong.
+ */
+static int check_file(const BenchArchive *arc, PHYSFS_uint32 idx)
+{
+    PHYSFS_uint8 buf[BENCH_CHECKSIZE];
+    PHYSFS_uint8 expected[BENCH_CHECKSIZE];
+    const PHYSFS_uint64 size = fixture_size(&arc->params, idx);
+    const size_t len = (size < BENCH_CHECKSIZE) ? (size_t) size : BENCH_CHECKSIZE;
+    const char *what = NULL;
+    char name[256];
+    PHYSFS_File *f;
+    PHYSFS_File *g;
+
+    fixture_name(&arc->params, idx, name, sizeof (name));
+    f = PHYSFS_openRead(name);
+    g = PHYSFS_openRead(name);
+    if ((f == NULL) || (g == NULL))
+        what = "open";
+    else if (PHYSFS_fileLength(f) != (PHYSFS_sint64) size)
+        what = "length";
+    else if (PHYSFS_readBytes(f, buf, len) != (PHYSFS_sint64) len)
+        what = "read at start";
+    else
+    {
+        fixture_data(&arc->params, idx, 0, expected, len);
+        if (memcmp(buf, expected, len) != 0)
+            what = "data at start";
+        else if (PHYSFS_readBytes(g, buf, len) != (PHYSFS_sint64) len)
+            what = "read at start, second handle";
+        else if (memcmp(buf, expected, len) != 0)
+            what = "data at start, second handle";
+        else if (!PHYSFS_seek(f, size - len))
+            what = "seek to end";
+        else if (PHYSFS_readBytes(f, buf, len) != (PHYSFS_sint64) len)
+            what = "read at end";
+        else
+        {
+            fixture_data(&arc->params, idx, size - len, expected, len);
+            if (memcmp(buf, expected, len) != 0)
+                what = "data at end";
+            else if ( (!PHYSFS_seek(f, size)) ||
+                      (PHYSFS_tell(f) != (PHYSFS_sint64) size) ||
+                      (PHYSFS_readBytes(f, buf, 1) != 0) )
+                what = "seek to eof";
+            else if (!PHYSFS_seek(f, 0))
+                what = "seek back to start";
+        } /* else */
+    } /* else */
+
+    if (f != NULL)
+        PHYSFS_close(f);
+    if (g != NULL)
+        PHYSFS_close(g);
+
+    if (what != NULL)
+    {
+        fprintf(stderr, "physfs_bench: check failed on %s in %s: %s\n",
+                name, arc->label, what);
+        return 0;
+    } /* if */
+
+    return 1;
+} /* check_file */
+
+
+/*
+ * Check (count) files, starting at (first), with the file before each one
+ *  open and part-read, so archivers that share state between neighbours
+ *  (like 7z's folder cache) have it live. Returns how many failed.
+ */
+static int check_range(const BenchArchive *arc, PHYSFS_uint32 first,
+                       PHYSFS_uint32 count)
+{
+    PHYSFS_uint32 i;
+    int errors = 0;
+
+    for (i = 0; i < count; i++)
+    {
+        const PHYSFS_uint32 idx = first + i;
+        PHYSFS_File *prev = NULL;
+        char name[256];
+        char ch;
+
+        if (idx > 0)
+        {
+            fixture_name(&arc->params, idx - 1, name, sizeof (name));
+            prev = PHYSFS_openRead(name);
+            if (prev != NULL)
+                PHYSFS_readBytes(prev, &ch, 1);
+        } /* if */
+
+        if (!check_file(arc, idx))
+            errors++;
+
+        if (prev != NULL)
+            PHYSFS_close(prev);
+    } /* for */
+
+    return errors;
+} /* check_range */
+
+
+typedef struct CheckWork
+{
+    const BenchArchive *arc;
+    PHYSFS_uint32 first;
+    PHYSFS_uint32 count;
+    int errors;
+} CheckWork;
+
+#ifdef _WIN32
+static DWORD WINAPI check_entry(LPVOID data)
+{
+    CheckWork *work = (CheckWork *) data;
+    work->errors = check_range(work->arc, work->first, work->count);
+    return 0;
+} /* check_entry */
+#else
+static void *check_entry(void *data)
+{
+    CheckWork *work = (CheckWork *) data;
+    work->errors = check_range(work->arc, work->first, work->count);
+    return NULL;
+} /* check_entry */
+#endif
+
+
+/*
+ * Make sure a generated archive reads back as generated before timing it,
+ *  first from one thread, then again with the files split between several
+ *  threads at once.
+ */
+static void check_files(const BenchArchive *arc)
+{
+    PHYSFS_uint32 count = fixture_count(&arc->params);
+    const int threads = (maxthreads > 1) ? maxthreads : 2;
+    CheckWork work[BENCH_MAXTHREADS];
+#ifdef _WIN32
+    HANDLE handles[BENCH_MAXTHREADS];
+#else
+    pthread_t handles[BENCH_MAXTHREADS];
+#endif
+    int errors;
+    int i;
+
+    if (!arc->generated)
+        return;
+
+    if (count > BENCH_MAXFILES)
+        count = BENCH_MAXFILES;
+
+    errors = check_range(arc, 0, count);
+    if (errors)
+    {
+        fprintf(stderr, "physfs_bench: %d files failed checks in %s\n",
+                errors, arc->label);
+        failures++;
+        return;  /* no sense piling threads on top of that. */
+    } /* if */
+
+    for (i = 0; i < threads; i++)
+    {
+        const PHYSFS_uint32 end = (PHYSFS_uint32) ((count * (i + 1)) / threads);
+        work[i].arc = arc;
+        work[i].first = (PHYSFS_uint32) ((count * i) / threads);
+        work[i].count = end - work[i].first;
+        work[i].errors = 0;
+#ifdef _WIN32
+        handles[i] = CreateThread(NULL, 0, check_entry, &work[i], 0, NULL);
+#else
+        if (pthread_create(&handles[i], NULL, check_entry, &work[i]) != 0)
+            break;
+#endif
+    } /* for */
+
+    while (i-- > 0)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(handles[i], INFINITE);
+        CloseHandle(handles[i]);
+#else
+        pthread_join(handles[i], NULL);
+#endif
+        errors += work[i].errors;
+    } /* while */
+
+    if (errors)
+    {
+        fprintf(stderr, "physfs_bench: %d files failed checks with %d threads"
+                " in %s\n", errors, threads, arc->label);
+        failures++;
+    } /* if */
+} /* check_files */
+
+
+static void bench_archive(const BenchArchive *arc)
+{
+    BenchFiles files;
+
+    fprintf(stderr, "physfs_bench: running %s...\n", arc->label);
+    bench_mount(arc, "full");
+
+    memset(&files, '\0', sizeof (files));
+    if (!PHYSFS_mount(arc->native, "/", 0))
+    {
+        fail("mount", arc->label);
+        return;
+    } /* if */
+
+    bench_enumerate(arc, &files);
+    check_files(arc);
+    if (files.count == 0)
+        fprintf(stderr, "physfs_bench: no files in %s\n", arc->label);
+    else
+    {
+        bench_open_close(arc, &files);
+        bench_seq_read(arc, &files);
+        bench_small_reads(arc, &files);
+        bench_random_read(arc, &files);
+        bench_backward_seek(arc, &files);
+        bench_threads(arc, &files);
+        bench_async(arc, &files);
+        bench_load_many(arc, &files);
+    } /* else */
+
+    PHYSFS_unmount(arc->native);
+    free_files(&files);
+} /* bench_archive */
+
+
+static void remove_tree(const char *dir)
+{
+    char **rc = PHYSFS_enumerateFiles(dir);
+    char **i;
+
+    if (rc == NULL)
+        return;
+
+    for (i = rc; *i != NULL; i++)
+    {
+        char *path = (char *) malloc(strlen(dir) + strlen(*i) + 2);
+        PHYSFS_Stat statbuf;
+        if (path == NULL)
+            continue;
+        sprintf(path, "%s/%s", dir, *i);
+        if ( (PHYSFS_stat(path, &statbuf)) &&
+             (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY) )
+            remove_tree(path);
+        PHYSFS_delete(path);
+        free(path);
+    } /* for */
+
+    PHYSFS_freeList(rc);
+} /* remove_tree */
+
+
+/* Throw away a generated fixture as soon as we're done with it. */
+static void remove_fixture(const char *fname)
+{
+    PHYSFS_Stat statbuf;
+    if (!PHYSFS_mount(workdir, "/", 0))
+        return;
+    if ((PHYSFS_stat(fname, &statbuf)) &&
+        (statbuf.filetype == PHYSFS_FILETYPE_DIRECTORY))
+        remove_tree(fname);
+    PHYSFS_delete(fname);
+    PHYSFS_unmount(workdir);
+} /* remove_fixture */
+
+
+static int generate(BenchArchive *arc, const FixtureParams *params,
+                    const char *fname)
+{
+    const PHYSFS_uint64 start = now_ns();
+
+    fprintf(stderr, "physfs_bench: generating %s...\n", fname);
+    memcpy(&arc->params, params, sizeof (*params));
+    arc->generated = 1;
+    strncpy(arc->label, fname, sizeof (arc->label) - 1);
+    arc->native = native_path(fname);
+
+    if ((arc->native == NULL) || (!fixture_write(params, fname)))
+    {
+        fail("generate", fname);
+        return 0;
+    } /* if */
+
+    fprintf(stderr, "physfs_bench: ...took %.3f seconds.\n",
+            (now_ns() - start) / 1e9);
+    return 1;
+} /* generate */
+
+
+static const char *method_suffix(FixtureMethod method)
+{
+    switch (method)
+    {
+        case FIXTURE_DEFLATED: return "_deflate";
+        case FIXTURE_ENCRYPTED: return "_aes";
+        case FIXTURE_MIXED: return "_mixed";
+        default: break;
+    } /* switch */
+    return "";
+} /* method_suffix */
+
+
+/* GRP and WAD fixtures come out flat, whatever width and depth say. */
+static void bench_mount_scaling(FixtureFormat format, FixtureMethod method,
+                                const char *ext)
+{
+    PHYSFS_uint32 entries;
+
+    for (entries = 100; entries <= 10000; entries *= 10)
+    {
+        BenchArchive arc;
+        FixtureParams params;
+        char fname[64];
+        char param[32];
+
+        memset(&arc, '\0', sizeof (arc));
+        fixture_defaults(&params, format);
+        params.method = method;
+        params.seed = seed;
+        params.entries = entries * scale;
+        params.filesize = 64;
+        params.width = 16;
+        params.depth = 2;
+
+        sprintf(fname, "mount_%u%s%s", (unsigned int) params.entries,
+                method_suffix(method), ext);
+        sprintf(param, "entries=%u", (unsigned int) params.entries);
+        if (generate(&arc, &params, fname))
+            bench_mount(&arc, param);
+        free(arc.native);
+    } /* for */
+} /* bench_mount_scaling */
+
+
+static void count_callback(void *data, const char *origdir,
+                           const char *fname, PHYSFS_Stat *stat)
+{
+    (*((PHYSFS_uint32 *) data))++;
+} /* count_callback */
+
+
+/* Names in (native), without "." and "..", the way libc lists them. */
+static PHYSFS_uint32 list_readdir(const char *native)
+{
+    PHYSFS_uint32 retval = 0;
+#ifndef _WIN32
+    DIR *dir = opendir(native);
+    struct dirent *ent;
+    if (dir == NULL)
+        return 0;
+    while ((ent = readdir(dir)) != NULL)
+    {
+        if ((strcmp(ent->d_name, ".") != 0) && (strcmp(ent->d_name, "..") != 0))
+            retval++;
+    } /* while */
+    closedir(dir);
+#endif
+    return retval;
+} /* list_readdir */
+
+
+#if (defined __linux__) && (defined SYS_getdents64)
+#define BENCH_HAVE_GETDENTS 1
+#define BENCH_GETDENTS_BUFSIZE (256 * 1024)  /* what PhysicsFS uses. */
+
+/* The same, straight from the kernel; see enumerateFd() in platform_posix.c. */
+static PHYSFS_uint32 list_getdents(const char *native)
+{
+    static char buf[BENCH_GETDENTS_BUFSIZE];
+    PHYSFS_uint32 retval = 0;
+    const int fd = open(native, O_RDONLY | O_DIRECTORY);
+    long rc;
+
+    if (fd < 0)
+        return 0;
+
+    while ((rc = syscall(SYS_getdents64, fd, buf, sizeof (buf))) > 0)
+    {
+        long pos = 0;
+        while (pos < rc)
+        {
+            /* d_ino, d_off, d_reclen, d_type, d_name. */
+            const unsigned short reclen = *((unsigned short *) (buf + pos + 16));
+            const char *name = buf + pos + 19;
+            if ((strcmp(name, ".") != 0) && (strcmp(name, "..") != 0))
+                retval++;
+            pos += reclen;
+        } /* while */
+    } /* while */
+
+    close(fd);
+    return retval;
+} /* list_getdents */
+#endif
+
+
+/*
+ * What PhysicsFS itself lists native directories with. physfs_bench_readdir
+ *  is this program linked against a copy of the library built with
+ *  PHYSFS_NO_GETDENTS, so comparing the two runs' "physfs" lines shows what
+ *  getdents64() buys PHYSFS_enumerateFiles() on a DIR mount.
+ */
+#if BENCH_NO_GETDENTS
+#define BENCH_PHYSFS_LISTER "readdir"
+#elif BENCH_HAVE_GETDENTS
+#define BENCH_PHYSFS_LISTER "getdents64"
+#else
+#define BENCH_PHYSFS_LISTER "native"
+#endif
+
+/*
+ * Just listing one big flat directory: libc's readdir(), then getdents64()
+ *  with PhysicsFS's buffer size on Linux, then PhysicsFS itself, which is
+ *  one of those plus the trip through the archiver and the callback, and
+ *  then PHYSFS_enumerateFiles(), which also sorts the names into a list.
+ *  Best of a few runs each, since the first one warms the dentry cache.
+ */
+static void bench_list_dir(const BenchArchive *arc, const char *param)
+{
+    const int reps = 5;
+    PHYSFS_uint64 best[4] = { 0, 0, 0, 0 };
+    PHYSFS_uint32 counts[4] = { 0, 0, 0, 0 };
+    char name[64];
+    int i;
+
+    if (!PHYSFS_mount(arc->native, "/", 0))
+    {
+        fail("mount", arc->label);
+        return;
+    } /* if */
+
+    for (i = 0; i < reps; i++)
+    {
+        PHYSFS_uint64 elapsed[4];
+        PHYSFS_uint64 start = now_ns();
+        char **list;
+        counts[0] = list_readdir(arc->native);
+        elapsed[0] = now_ns() - start;
+#if BENCH_HAVE_GETDENTS
+        start = now_ns();
+        counts[1] = list_getdents(arc->native);
+        elapsed[1] = now_ns() - start;
+#else
+        elapsed[1] = 0;
+#endif
+        start = now_ns();
+        counts[2] = 0;
+        PHYSFS_enumerateFilesCallback("", count_callback, &counts[2]);
+        elapsed[2] = now_ns() - start;
+
+        start = now_ns();
+        list = PHYSFS_enumerateFiles("");
+        elapsed[3] = now_ns() - start;
+        for (counts[3] = 0; (list != NULL) && (list[counts[3]] != NULL); counts[3]++) {}
+        PHYSFS_freeList(list);
+
+        if ((i == 0) || (elapsed[0] < best[0])) best[0] = elapsed[0];
+        if ((i == 0) || (elapsed[1] < best[1])) best[1] = elapsed[1];
+        if ((i == 0) || (elapsed[2] < best[2])) best[2] = elapsed[2];
+        if ((i == 0) || (elapsed[3] < best[3])) best[3] = elapsed[3];
+    } /* for */
+
+    PHYSFS_unmount(arc->native);
+
+#ifndef _WIN32
+    sprintf(name, "%s,readdir", param);
+    report("list_dir", arc->label, name, counts[0] / (best[0] / 1e9), "entries/s");
+#endif
+#if BENCH_HAVE_GETDENTS
+    sprintf(name, "%s,getdents64", param);
+    report("list_dir", arc->label, name, counts[1] / (best[1] / 1e9), "entries/s");
+#endif
+    sprintf(name, "%s,physfs_callback_" BENCH_PHYSFS_LISTER, param);
+    report("list_dir", arc->label, name, counts[2] / (best[2] / 1e9), "entries/s");
+    sprintf(name, "%s,physfs_list_" BENCH_PHYSFS_LISTER, param);
+    report("list_dir", arc->label, name, counts[3] / (best[3] / 1e9), "entries/s");
+} /* bench_list_dir */
+
+
+/*
+ * PHYSFS_enumerateFiles(), which has to merge what every mount says and
+ *  sort it, over (zip) alone and then with (dir) on top, which has the
+ *  same names, so every one of them is a duplicate.
+ */
+static void bench_enumerate_list(const BenchArchive *zip,
+                                 const BenchArchive *dir, const char *param)
+{
+    const int reps = 5;
+    char name[64];
+    int mounts;
+
+    for (mounts = 1; mounts <= 2; mounts++)
+    {
+        const BenchArchive *arc = (mounts == 1) ? zip : dir;
+        PHYSFS_uint64 best = 0;
+        PHYSFS_uint32 count = 0;
+        int i;
+
+        if (!PHYSFS_mount(arc->native, "/", 1))
+        {
+            fail("mount", arc->label);
+            break;
+        } /* if */
+
+        for (i = 0; i < reps; i++)
+        {
+            const PHYSFS_uint64 start = now_ns();
+            char **list = PHYSFS_enumerateFiles("");
+            PHYSFS_uint64 elapsed;
+            char **ptr;
+
+            if (list == NULL)
+            {
+                fail("enumerate", zip->label);
+                break;
+            } /* if */
+
+            for (ptr = list, count = 0; *ptr != NULL; ptr++)
+                count++;
+            PHYSFS_freeList(list);
+            elapsed = now_ns() - start;
+            if ((i == 0) || (elapsed < best))
+                best = elapsed;
+        } /* for */
+
+        if (count != zip->params.entries)
+        {
+            fprintf(stderr, "physfs_bench: enumerate on %s: %u entries, wanted %u\n",
+                    zip->label, (unsigned int) count,
+                    (unsigned int) zip->params.entries);
+            failures++;
+        } /* if */
+        else if (best > 0)
+        {
+            sprintf(name, "%s,mounts=%d", param, mounts);
+            report("enumerate_list", zip->label, name, count / (best / 1e9), "entries/s");
+        } /* else if */
+    } /* for */
+
+    PHYSFS_unmount(dir->native);
+    PHYSFS_unmount(zip->native);
+} /* bench_enumerate_list */
+
+
+/* Flat directories and ZIPs from a thousand entries up to (maxlistentries). */
+static void bench_list_scaling(void)
+{
+    PHYSFS_uint32 entries;
+
+    for (entries = 1000; entries <= maxlistentries; entries *= 10)
+    {
+        BenchArchive dir;
+        BenchArchive zip;
+        FixtureParams params;
+        char dirname[64];
+        char zipname[64];
+        char param[32];
+
+        memset(&dir, '\0', sizeof (dir));
+        memset(&zip, '\0', sizeof (zip));
+        fixture_defaults(&params, FIXTURE_DIR);
+        params.seed = seed;
+        params.entries = entries;
+        params.filesize = 0;  /* it's the names we're after. */
+
+        sprintf(dirname, "list_%u", (unsigned int) entries);
+        sprintf(zipname, "list_%u.zip", (unsigned int) entries);
+        sprintf(param, "entries=%u", (unsigned int) entries);
+        if (generate(&dir, &params, dirname))
+        {
+            bench_list_dir(&dir, param);
+            params.format = FIXTURE_ZIP;
+            if (generate(&zip, &params, zipname))
+                bench_enumerate_list(&zip, &dir, param);
+        } /* if */
+
+        if (!keepfixtures)
+        {
+            remove_fixture(dirname);
+            remove_fixture(zipname);
+        } /* if */
+        free(dir.native);
+        free(zip.native);
+
+        if (entries > (maxlistentries / 10))
+            break;  /* don't wrap around. */
+    } /* for */
+} /* bench_list_scaling */
+
+
+static void bench_fixture(FixtureFormat format, FixtureMethod method,
+                          const char *ext)
+{
+    BenchArchive arc;
+    FixtureParams params;
+    char fname[64];
+
+    memset(&arc, '\0', sizeof (arc));
+    fixture_defaults(&params, format);
+    params.method = method;
+    params.seed = seed;
+    params.entries = 1000;
+    params.filesize = 4096;
+    params.bigsize = 16 * 1024 * 1024 * (PHYSFS_uint64) scale;
+    params.width = 8;
+    params.depth = 2;
+    params.solid = 64;  /* 7z: make seeks pay for what's ahead of them. */
+
+    sprintf(fname, "bench%s%s", method_suffix(method), ext);
+    if (generate(&arc, &params, fname))
+        bench_archive(&arc);
+    free(arc.native);
+} /* bench_fixture */
+
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "USAGE: %s [options] [archive ...]\n"
+        "  -d <dir>   put generated fixtures in <dir> (default: ./%s)\n"
+        "  -s <n>     scale entry counts and file sizes by <n> (default: 1)\n"
+        "  -t <n>     go up to <n> threads (default: 8)\n"
+        "  -r <n>     random seed (default: 1)\n"
+        "  -k         keep the fixtures afterwards\n"
+        "  -e <n>     list and enumerate up to <n> entries (default: 1000000)\n"
+        "  -n         don't generate fixtures, just run the given archives\n"
+        "\n"
+        "Output is CSV: benchmark,archive,parameter,value,unit\n",
+        argv0, workdir);
+} /* usage */
+
+
+int main(int argc, char **argv)
+{
+    int generatefixtures = 1;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (*arg != '-')
+            break;
+        else if ((strcmp(arg, "-k") == 0))
+            keepfixtures = 1;
+        else if ((strcmp(arg, "-n") == 0))
+            generatefixtures = 0;
+        else if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        } /* else if */
+        else if (strcmp(arg, "-d") == 0)
+            workdir = argv[++i];
+        else if (strcmp(arg, "-s") == 0)
+            scale = (PHYSFS_uint32) atoi(argv[++i]);
+        else if (strcmp(arg, "-t") == 0)
+            maxthreads = atoi(argv[++i]);
+        else if (strcmp(arg, "-r") == 0)
+            seed = (PHYSFS_uint32) strtoul(argv[++i], NULL, 10);
+        else if (strcmp(arg, "-e") == 0)
+            maxlistentries = (PHYSFS_uint32) strtoul(argv[++i], NULL, 10);
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        } /* else */
+    } /* for */
+
+    if (scale < 1)
+        scale = 1;
+    if (seed == 0)
+        seed = 1;
+    if (maxthreads < 1)
+        maxthreads = 1;
+    else if (maxthreads > BENCH_MAXTHREADS)
+        maxthreads = BENCH_MAXTHREADS;
+
+    if (!PHYSFS_setAllocator(&countingAllocator))
+    {
+        fprintf(stderr, "PHYSFS_setAllocator(): %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init(): %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    printf("benchmark,archive,parameter,value,unit\n");
+
+    for (; i < argc; i++)
+    {
+        BenchArchive arc;
+        memset(&arc, '\0', sizeof (arc));
+        strncpy(arc.label, argv[i], sizeof (arc.label) - 1);
+        arc.native = argv[i];
+        bench_archive(&arc);
+    } /* for */
+
+    if (generatefixtures)
+    {
+        /*
+         * make the work dir if it isn't there, then write everything into it.
+         *  Check with a mount, since setting a missing write dir makes a file.
+         */
+        int created = 0;
+        if (PHYSFS_mount(workdir, NULL, 0))
+        {
+            PHYSFS_unmount(workdir);
+            PHYSFS_setWriteDir(workdir);
+        } /* if */
+        else
+        {
+            created = ( (PHYSFS_setWriteDir(".")) &&
+                        (PHYSFS_mkdir(workdir)) &&
+                        (PHYSFS_setWriteDir(workdir)) );
+        } /* else */
+
+        if (!PHYSFS_getWriteDir())
+        {
+            fail("create", workdir);
+            PHYSFS_deinit();
+            return 1;
+        } /* if */
+
+        bench_mount_scaling(FIXTURE_ZIP, FIXTURE_STORED, ".zip");
+        bench_mount_scaling(FIXTURE_GRP, FIXTURE_STORED, ".grp");
+        bench_mount_scaling(FIXTURE_WAD, FIXTURE_STORED, ".wad");
+        bench_mount_scaling(FIXTURE_ISO, FIXTURE_STORED, ".iso");
+        bench_mount_scaling(FIXTURE_7Z, FIXTURE_STORED, ".7z");
+        bench_mount_scaling(FIXTURE_DIR, FIXTURE_STORED, "");
+        bench_list_scaling();
+        bench_fixture(FIXTURE_ZIP, FIXTURE_STORED, ".zip");
+        bench_fixture(FIXTURE_ZIP, FIXTURE_DEFLATED, ".zip");
+#if FIXTURE_HAVE_AES
+        bench_fixture(FIXTURE_ZIP, FIXTURE_ENCRYPTED, ".zip");
+#endif
+        bench_fixture(FIXTURE_ZIP, FIXTURE_MIXED, ".zip");
+        bench_fixture(FIXTURE_GRP, FIXTURE_STORED, ".grp");
+        bench_fixture(FIXTURE_WAD, FIXTURE_STORED, ".wad");
+        bench_fixture(FIXTURE_ISO, FIXTURE_STORED, ".iso");
+        bench_fixture(FIXTURE_7Z, FIXTURE_STORED, ".7z");
+        bench_fixture(FIXTURE_DIR, FIXTURE_STORED, "");
+
+        if ((!keepfixtures) && (PHYSFS_mount(workdir, "/", 0)))
+        {
+            remove_tree("");
+            PHYSFS_unmount(workdir);
+            if ((created) && (PHYSFS_setWriteDir(".")))
+                PHYSFS_delete(workdir);
+        } /* if */
+    } /* if */
+
+    PHYSFS_deinit();
+    return (failures > 0) ? 1 : 0;
+} /* main */
+
+/* end of physfs_bench.c ... */
+
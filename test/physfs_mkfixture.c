@@ -0,0 +1,156 @@
+/**
+ * Write a synthetic archive fixture (see fixture.h) to disk.
+ *
+ * This is what the benchmarks use internally, exposed so the same archives
+ *  can be made on demand for other tests, or for other tools to chew on.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "physfs.h"
+#include "fixture.h"
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+        "USAGE: %s [options] <format> <output>\n"
+        "  <format> is one of: dir zip grp wad iso 7z\n"
+        "  -s <n>     random seed (default: 1)\n"
+        "  -n <n>     number of small files (default: 100)\n"
+        "  -z <n>     bytes in each small file (default: 1024)\n"
+        "  -w <n>     subdirectories per directory (default: 0)\n"
+        "  -d <n>     levels of subdirectories (default: 0)\n"
+        "  -b <n>     bytes in one extra large file (default: none)\n"
+        "  -m <m>     zip: stored, deflate, aes or mixed (default: stored)\n"
+        "  -S <n>     7z: files per solid block (default: all of them)\n"
+        "  -6         zip: write Zip64 records even if they aren't needed\n",
+        argv0);
+} /* usage */
+
+
+static int parse_method(const char *str, FixtureMethod *method)
+{
+    if (strcmp(str, "stored") == 0)
+        *method = FIXTURE_STORED;
+    else if (strcmp(str, "deflate") == 0)
+        *method = FIXTURE_DEFLATED;
+    else if (strcmp(str, "aes") == 0)
+        *method = FIXTURE_ENCRYPTED;
+    else if (strcmp(str, "mixed") == 0)
+        *method = FIXTURE_MIXED;
+    else
+        return 0;
+    return 1;
+} /* parse_method */
+
+
+int main(int argc, char **argv)
+{
+    FixtureParams params;
+    FixtureFormat format;
+    FixtureMethod method = FIXTURE_STORED;
+    FixtureParams opts;
+    const char *base;
+    char *dir;
+    int retval = 1;
+    int i;
+
+    fixture_defaults(&opts, FIXTURE_DIR);
+    for (i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (*arg != '-')
+            break;
+        else if (strcmp(arg, "-6") == 0)
+            opts.zip64 = 1;
+        else if (i + 1 >= argc)
+        {
+            usage(argv[0]);
+            return 1;
+        } /* else if */
+        else if (strcmp(arg, "-s") == 0)
+            opts.seed = (PHYSFS_uint32) strtoul(argv[++i], NULL, 10);
+        else if (strcmp(arg, "-n") == 0)
+            opts.entries = (PHYSFS_uint32) strtoul(argv[++i], NULL, 10);
+        else if (strcmp(arg, "-z") == 0)
+            opts.filesize = (PHYSFS_uint32) strtoul(argv[++i], NULL, 10);
+        else if (strcmp(arg, "-w") == 0)
+            opts.width = (PHYSFS_uint32) strtoul(argv[++i], NULL, 10);
+        else if (strcmp(arg, "-d") == 0)
+            opts.depth = (PHYSFS_uint32) strtoul(argv[++i], NULL, 10);
+        else if (strcmp(arg, "-b") == 0)
+            opts.bigsize = (PHYSFS_uint64) strtod(argv[++i], NULL);
+        else if (strcmp(arg, "-S") == 0)
+            opts.solid = (PHYSFS_uint32) strtoul(argv[++i], NULL, 10);
+        else if ((strcmp(arg, "-m") != 0) || (!parse_method(argv[++i], &method)))
+        {
+            usage(argv[0]);
+            return 1;
+        } /* else if */
+    } /* for */
+
+    if ((argc - i) != 2)
+    {
+        usage(argv[0]);
+        return 1;
+    } /* if */
+
+    if (!fixture_parse_format(argv[i], &format))
+    {
+        fprintf(stderr, "%s: unknown format '%s'\n", argv[0], argv[i]);
+        return 1;
+    } /* if */
+
+    memcpy(&params, &opts, sizeof (params));
+    params.format = format;
+    params.method = method;
+    if (params.seed == 0)
+        params.seed = 1;
+
+    if (!PHYSFS_init(argv[0]))
+    {
+        fprintf(stderr, "PHYSFS_init(): %s\n",
+                PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        return 1;
+    } /* if */
+
+    /* write dir is the output's parent; the fixture gets its last part. */
+    dir = (char *) malloc(strlen(argv[i + 1]) + 2);
+    if (dir != NULL)
+    {
+        const char *sep = PHYSFS_getDirSeparator();
+        char *ptr;
+        strcpy(dir, argv[i + 1]);
+        ptr = strrchr(dir, *sep);
+        if (ptr == NULL)
+        {
+            base = argv[i + 1];
+            strcpy(dir, ".");
+        } /* if */
+        else
+        {
+            base = argv[i + 1] + ((ptr - dir) + 1);
+            ptr[(ptr == dir) ? 1 : 0] = '\0';  /* keep a lone root. */
+        } /* else */
+
+        if (!PHYSFS_setWriteDir(dir))
+            fprintf(stderr, "%s: can't write to '%s': %s\n", argv[0], dir,
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        else if (!fixture_write(&params, base))
+            fprintf(stderr, "%s: can't write '%s': %s\n", argv[0], argv[i + 1],
+                    PHYSFS_getErrorByCode(PHYSFS_getLastErrorCode()));
+        else
+            retval = 0;
+        free(dir);
+    } /* if */
+
+    PHYSFS_deinit();
+    return retval;
+} /* main */
+
+/* end of physfs_mkfixture.c ... */
+